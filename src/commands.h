@@ -8,6 +8,7 @@
 
 #define RS_CREATE_CMD RS_CMD_PREFIX ".CREATE"
 #define RS_ADD_CMD RS_CMD_PREFIX ".ADD"
+#define RS_MADD_CMD RS_CMD_PREFIX ".MADD"
 #define RS_SETPAYLOAD_CMD RS_CMD_PREFIX ".SETPAYLOAD"
 #define RS_ADDHASH_CMD RS_CMD_PREFIX ".ADDHASH"
 #define RS_INFO_CMD RS_CMD_PREFIX ".INFO"
@@ -1,8 +1,17 @@
 #include "concurrent_ctx.h"
 #include "dep/thpool/thpool.h"
+#include <pthread.h>
+#include <unistd.h>
 
 threadpool ConcurrentSearchThreadPool = NULL;
 
+static threadpool shardThreadPool = NULL;
+static int numShardThreads = 0;
+static pthread_once_t shardPoolOnce = PTHREAD_ONCE_INIT;
+
+static threadpool indexingThreadPool = NULL;
+static pthread_once_t indexingPoolOnce = PTHREAD_ONCE_INIT;
+
 /** Start the concurrent search thread pool. Should be called when initializing the module */
 void ConcurrentSearch_ThreadPoolStart() {
   if (ConcurrentSearchThreadPool == NULL) {
@@ -15,8 +24,86 @@ void ConcurrentSearch_ThreadPoolRun(void (*func)(void *), void *arg) {
   thpool_add_work(ConcurrentSearchThreadPool, func, arg);
 }
 
+static void startShardPool() {
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  numShardThreads = ncpu < 1 ? 1 : (ncpu > CONCURRENT_MAX_SHARDS ? CONCURRENT_MAX_SHARDS : ncpu);
+  if (numShardThreads > 1) {
+    shardThreadPool = thpool_init(numShardThreads);
+  }
+}
+
+int ConcurrentSearch_NumShardThreads() {
+  pthread_once(&shardPoolOnce, startShardPool);
+  return numShardThreads;
+}
+
+static void startIndexingPool() {
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  indexingThreadPool = thpool_init(
+      ncpu < 1 ? 1 : (ncpu > CONCURRENT_MAX_INDEXING_THREADS ? CONCURRENT_MAX_INDEXING_THREADS : ncpu));
+}
+
+void ConcurrentIndexing_ThreadPoolRun(void (*func)(void *), void *arg) {
+  pthread_once(&indexingPoolOnce, startIndexingPool);
+  thpool_add_work(indexingThreadPool, func, arg);
+}
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int pending;
+} shardGroup;
+
+typedef struct {
+  void (*func)(void *);
+  void *arg;
+  shardGroup *group;
+} shardJob;
+
+static void runShardJob(void *p) {
+  shardJob *job = p;
+  job->func(job->arg);
+
+  shardGroup *g = job->group;
+  pthread_mutex_lock(&g->lock);
+  if (--g->pending == 0) {
+    pthread_cond_signal(&g->cond);
+  }
+  pthread_mutex_unlock(&g->lock);
+}
+
+void ConcurrentSearch_RunShards(void (*func)(void *), void **args, int n) {
+  if (ConcurrentSearch_NumShardThreads() == 1 || n == 1) {
+    for (int i = 0; i < n; i++) {
+      func(args[i]);
+    }
+    return;
+  }
+
+  shardGroup g = {.pending = n - 1};
+  pthread_mutex_init(&g.lock, NULL);
+  pthread_cond_init(&g.cond, NULL);
+  shardJob jobs[n];
+  for (int i = 1; i < n; i++) {
+    jobs[i] = (shardJob){.func = func, .arg = args[i], .group = &g};
+    thpool_add_work(shardThreadPool, runShardJob, &jobs[i]);
+  }
+
+  // the calling thread runs the first shard itself
+  func(args[0]);
+
+  pthread_mutex_lock(&g.lock);
+  while (g.pending) {
+    pthread_cond_wait(&g.cond, &g.lock);
+  }
+  pthread_mutex_unlock(&g.lock);
+  pthread_mutex_destroy(&g.lock);
+  pthread_cond_destroy(&g.cond);
+}
+
 /** Check the elapsed timer, and release the lock if enough time has passed */
 inline void ConcurrentSearch_CheckTimer(ConcurrentSearchCtx *ctx) {
+  if (ctx->unlocked) return;
   static struct timespec now;
   clock_gettime(CLOCK_MONOTONIC_RAW, &now);
 
@@ -47,5 +134,20 @@ void ConcurrentSearchCtx_Init(RedisModuleCtx *rctx, ConcurrentSearchCtx *ctx) {
   }
   ctx->ctx = rctx;
   ctx->ticker = 0;
+  ctx->unlocked = 0;
   clock_gettime(CLOCK_MONOTONIC_RAW, &ctx->lastTime);
 }
+
+void ConcurrentSearchCtx_Unlock(ConcurrentSearchCtx *ctx) {
+  if (!ctx->ctx || ctx->unlocked) return;
+  RedisModule_ThreadSafeContextUnlock(ctx->ctx);
+  ctx->unlocked = 1;
+}
+
+void ConcurrentSearchCtx_Lock(ConcurrentSearchCtx *ctx) {
+  if (!ctx->unlocked) return;
+  RedisModule_ThreadSafeContextLock(ctx->ctx);
+  ctx->unlocked = 0;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ctx->lastTime);
+  ctx->ticker = 0;
+}
@@ -30,6 +30,8 @@ typedef struct {
   long long ticker;
   struct timespec lastTime;
   RedisModuleCtx *ctx;
+  // set while the query runs without the lock, see ConcurrentSearchCtx_Unlock
+  int unlocked;
 } ConcurrentSearchCtx;
 
 /** The maximal size of the concurrent query thread pool. Since only one thread is operational at a
@@ -37,6 +39,14 @@ typedef struct {
  * By default the pool starts with just one thread, and scales up as needed  */
 #define CONCURRENT_SEARCH_POOL_SIZE 100
 
+/** The maximal number of threads running the shards of heavy queries in parallel. The shard pool has
+ * a thread per CPU core, up to this limit */
+#define CONCURRENT_MAX_SHARDS 32
+
+/** The maximal number of threads tokenizing documents added with FT.ADD ASYNC. The indexing pool has a
+ * thread per CPU core, up to this limit */
+#define CONCURRENT_MAX_INDEXING_THREADS 32
+
 /** The number of execution "ticks" per elapsed time check. This is intended to reduce the number of
  * calls to clock_gettime() */
 #define CONCURRENT_TICK_CHECK 50
@@ -50,12 +60,32 @@ void ConcurrentSearch_ThreadPoolStart();
 /* Run a function on the concurrent thread pool */
 void ConcurrentSearch_ThreadPoolRun(void (*func)(void *), void *arg);
 
+/* The number of threads in the shard pool, i.e. the number of shards worth splitting a query into */
+int ConcurrentSearch_NumShardThreads();
+
+/* Run func on each of the n args in parallel on the shard thread pool, and wait for all of them to
+ * finish. The shard pool is separate from the query pool, and the functions must never take the
+ * global lock, so a query waiting for its shards never waits for other queries */
+void ConcurrentSearch_RunShards(void (*func)(void *), void **args, int n);
+
+/* Run a function on the indexing thread pool. Documents are tokenized there without the global
+ * lock, and then merged into the index with it */
+void ConcurrentIndexing_ThreadPoolRun(void (*func)(void *), void *arg);
+
 /** Check the elapsed timer, and release the lock if enough time has passed */
 void ConcurrentSearch_CheckTimer(ConcurrentSearchCtx *ctx);
 
 /** Initialize and reset a concurrent search ctx */
 void ConcurrentSearchCtx_Init(RedisModuleCtx *rctx, ConcurrentSearchCtx *ctx);
 
+/** Release the global lock until ConcurrentSearchCtx_Lock is called, for queries that only read
+ * snapshots of the index. The ticks leave the lock alone meanwhile. Does nothing if the context
+ * has no thread safe context, i.e. it does not run on a query thread */
+void ConcurrentSearchCtx_Unlock(ConcurrentSearchCtx *ctx);
+
+/** Take back the global lock released by ConcurrentSearchCtx_Unlock */
+void ConcurrentSearchCtx_Lock(ConcurrentSearchCtx *ctx);
+
 /** This macro is called by concurrent executors (currently the query only).
  * It checks if enough time has passed and releases the global lock if that is the case.
  */
@@ -7,15 +7,146 @@
 #include "dep/triemap/triemap.h"
 #include "sortable.h"
 #include "rmalloc.h"
+#include "epoch.h"
 
 /* Creates a new DocTable with a given capacity */
 DocTable NewDocTable(size_t cap) {
   return (DocTable){.size = 1,
                     .cap = cap,
                     .maxDocId = 0,
-                    .memsize = 0,
+                    .payloadsSize = 0,
+                    .sortVectorsSize = 0,
+                    .generation = 0,
                     .docs = rm_calloc(cap, sizeof(RSDocumentMetadata)),
-                    .dim = NewDocIdMap()};
+                    .keys = (DocKeys){0},
+                    .dim = (DocIdMap){0}};
+}
+
+/* Copy a key to the key chunks of the table */
+static char *docKeys_store(DocKeys *k, const char *key, size_t len) {
+  if (!k->numChunks || k->offset + len + 1 > k->chunkSize) {
+    k->chunkSize = MAX(DOCTABLE_KEYS_CHUNK_SIZE, len + 1);
+    k->chunks = rm_realloc(k->chunks, (k->numChunks + 1) * sizeof(char *));
+    k->chunks[k->numChunks++] = rm_malloc(k->chunkSize);
+    k->offset = 0;
+    k->memsize += k->chunkSize;
+  }
+  char *ret = k->chunks[k->numChunks - 1] + k->offset;
+  memcpy(ret, key, len);
+  ret[len] = '\0';
+  k->offset += len + 1;
+  return ret;
+}
+
+static void docKeys_free(DocKeys *k) {
+  for (size_t i = 0; i < k->numChunks; i++) {
+    rm_free(k->chunks[i]);
+  }
+  rm_free(k->chunks);
+}
+
+// the key of deleted documents whose key was dropped
+static char deletedKey[] = "";
+
+/* Copy the keys of the live documents to new chunks, dropping the keys of deleted documents.
+ * Queries may be reading keys without the lock, so the old chunks are retired */
+static void docKeys_compact(DocTable *t) {
+  DocKeys old = t->keys;
+  t->keys = (DocKeys){0};
+  for (t_docId i = 1; i <= t->maxDocId; i++) {
+    RSDocumentMetadata *md = &t->docs[i];
+    if (md->flags & Document_Deleted) {
+      md->key = deletedKey;
+    } else {
+      md->key = docKeys_store(&t->keys, md->key, strlen(md->key));
+    }
+  }
+  for (size_t i = 0; i < old.numChunks; i++) {
+    Epoch_RetireMem(old.chunks[i]);
+  }
+  rm_free(old.chunks);
+}
+
+/* Marks the slot of a deleted id in the id map, so that lookups keep probing past it */
+#define DOCIDMAP_DELETED ((t_docId)-1)
+
+/* Find the slot of a key in the id map, or the empty slot it would be put in */
+static size_t docIdMap_find(DocTable *t, const char *key, size_t len, int *found) {
+  DocIdMap *m = &t->dim;
+  size_t mask = m->cap - 1;
+  size_t i = fnv_32a_buf((void *)key, len, 0) & mask;
+  // the first deleted slot on the way, which a new key can take
+  size_t deleted = m->cap;
+  *found = 0;
+  while (m->slots[i]) {
+    t_docId id = m->slots[i];
+    if (id == DOCIDMAP_DELETED) {
+      if (deleted == m->cap) deleted = i;
+    } else if (!strcmp(t->docs[id].key, key)) {
+      *found = 1;
+      return i;
+    }
+    i = (i + 1) & mask;
+  }
+  return deleted < m->cap ? deleted : i;
+}
+
+static void docIdMap_put(DocTable *t, const char *key, t_docId docId);
+
+/* Grow the id map, or just drop its deleted slots, so that at most 3/4 of the slots are taken */
+static void docIdMap_rehash(DocTable *t) {
+  DocIdMap *m = &t->dim;
+  DocIdMap old = *m;
+  size_t cap = m->cap ? m->cap : 16;
+  while ((m->size + 1) * 2 > cap) cap *= 2;
+
+  *m = (DocIdMap){.slots = rm_calloc(cap, sizeof(t_docId)), .cap = cap};
+  for (size_t i = 0; i < old.cap; i++) {
+    if (old.slots[i] && old.slots[i] != DOCIDMAP_DELETED) {
+      docIdMap_put(t, t->docs[old.slots[i]].key, old.slots[i]);
+    }
+  }
+  rm_free(old.slots);
+}
+
+/* Put the id of a key that is not in the map */
+static void docIdMap_put(DocTable *t, const char *key, t_docId docId) {
+  DocIdMap *m = &t->dim;
+  if ((m->used + 1) * 4 > m->cap * 3) {
+    docIdMap_rehash(t);
+  }
+  int found;
+  size_t i = docIdMap_find(t, key, strlen(key), &found);
+  if (!m->slots[i]) m->used++;
+  m->slots[i] = docId;
+  m->size++;
+}
+
+static t_docId docIdMap_get(DocTable *t, const char *key) {
+  if (!t->dim.size) return 0;
+  int found;
+  size_t i = docIdMap_find(t, key, strlen(key), &found);
+  return found ? t->dim.slots[i] : 0;
+}
+
+static int docIdMap_delete(DocTable *t, const char *key) {
+  if (!t->dim.size) return 0;
+  int found;
+  size_t i = docIdMap_find(t, key, strlen(key), &found);
+  if (!found) return 0;
+  t->dim.slots[i] = DOCIDMAP_DELETED;
+  t->dim.size--;
+  return 1;
+}
+
+static size_t sortingVector_memUsage(RSSortingVector *v) {
+  size_t ret = sizeof(RSSortingVector) + v->len * sizeof(RSSortableValue);
+  for (int i = 0; i < v->len; i++) {
+    if (v->values[i].type == RS_SORTABLE_STR) {
+      ret += strlen(v->values[i].str) + 1;
+    }
+  }
+  return ret;
 }
 
 /* Get the metadata for a doc Id from the DocTable.
@@ -29,7 +160,7 @@ inline RSDocumentMetadata *DocTable_Get(DocTable *t, t_docId docId) {
 
 /** Get the docId of a key if it exists in the table, or 0 if it doesnt */
 t_docId DocTable_GetId(DocTable *dt, const char *key) {
-  return DocIdMap_Get(&dt->dim, key);
+  return docIdMap_get(dt, key);
 }
 
 /* Set the payload for a document. Returns 1 if we set the payload, 0 if we couldn't find the
@@ -47,9 +178,10 @@ int DocTable_SetPayload(DocTable *t, t_docId docId, const char *data, size_t len
     if (dmd->payload->data) {
       rm_free(dmd->payload->data);
     }
-    t->memsize -= dmd->payload->len;
+    t->payloadsSize -= dmd->payload->len;
   } else {
     dmd->payload = rm_malloc(sizeof(RSPayload));
+    t->payloadsSize += sizeof(RSPayload);
   }
   /* Copy it... */
   dmd->payload->data = rm_calloc(1, len + 1);
@@ -57,7 +189,8 @@ int DocTable_SetPayload(DocTable *t, t_docId docId, const char *data, size_t len
   memcpy(dmd->payload->data, data, len);
 
   dmd->flags |= Document_HasPayload;
-  t->memsize += len;
+  t->payloadsSize += len;
+  ++t->generation;
   return 1;
 }
 
@@ -69,18 +202,24 @@ int DocTable_SetSortingVector(DocTable *t, t_docId docId, RSSortingVector *v) {
     return 0;
   }
 
+  if (dmd->sortVector) {
+    t->sortVectorsSize -= sortingVector_memUsage(dmd->sortVector);
+    SortingVector_Free(dmd->sortVector);
+    dmd->sortVector = NULL;
+  }
+
   /* Null vector means remove the current vector if it exists */
   if (!v) {
-    if (dmd->sortVector) {
-      SortingVector_Free(dmd->sortVector);
-    }
     dmd->flags &= ~Document_HasSortVector;
+    ++t->generation;
     return 1;
   }
 
   /* Set th new vector and the flags accordingly */
   dmd->sortVector = v;
+  t->sortVectorsSize += sortingVector_memUsage(v);
   dmd->flags |= Document_HasSortVector;
+  ++t->generation;
 
   return 1;
 }
@@ -92,7 +231,9 @@ int DocTable_SetSortingVector(DocTable *t, t_docId docId, RSSortingVector *v) {
 t_docId DocTable_Put(DocTable *t, const char *key, double score, u_char flags, const char *payload,
                      size_t payloadSize) {
 
-  t_docId xid = DocIdMap_Get(&t->dim, key);
+  // deleted documents are only put when the table is rebuilt from its AOF. They only take an id
+  int deleted = flags & Document_Deleted;
+  t_docId xid = deleted ? 0 : docIdMap_get(t, key);
   // if the document is already in the index, return 0
   if (xid) {
     return 0;
@@ -101,8 +242,17 @@ t_docId DocTable_Put(DocTable *t, const char *key, double score, u_char flags, c
   // if needed - grow the table
   if (t->maxDocId + 1 >= t->cap) {
 
-    t->cap += 1 + (t->cap ? MIN(t->cap / 2, 1024 * 1024) : 1);
-    t->docs = rm_realloc(t->docs, t->cap * sizeof(RSDocumentMetadata));
+    size_t cap = t->cap + 1 + (t->cap ? MIN(t->cap / 2, 1024 * 1024) : 1);
+    if (Epoch_InUse(Epoch_Current())) {
+      // queries may be reading the table without the lock, so they keep the old copy
+      RSDocumentMetadata *docs = rm_malloc(cap * sizeof(RSDocumentMetadata));
+      memcpy(docs, t->docs, t->cap * sizeof(RSDocumentMetadata));
+      Epoch_RetireMem(t->docs);
+      t->docs = docs;
+    } else {
+      t->docs = rm_realloc(t->docs, cap * sizeof(RSDocumentMetadata));
+    }
+    t->cap = cap;
   }
 
   /* Copy the payload since it's probably an input string not retained */
@@ -114,14 +264,20 @@ t_docId DocTable_Put(DocTable *t, const char *key, double score, u_char flags, c
     memcpy(dpl->data, payload, payloadSize);
     dpl->len = payloadSize;
     flags |= Document_HasPayload;
-    t->memsize += payloadSize + sizeof(RSPayload);
+    t->payloadsSize += payloadSize + sizeof(RSPayload);
   }
 
-  t->docs[docId] = (RSDocumentMetadata){
-      .key = rm_strdup(key), .score = score, .flags = flags, .payload = dpl, .maxFreq = 1};
+  t->docs[docId] =
+      (RSDocumentMetadata){.key = deleted ? deletedKey : docKeys_store(&t->keys, key, strlen(key)),
+                           .score = score,
+                           .flags = flags,
+                           .payload = dpl,
+                           .maxFreq = 1};
   ++t->size;
-  t->memsize += sizeof(RSDocumentMetadata) + strlen(key);
-  DocIdMap_Put(&t->dim, key, docId);
+  ++t->generation;
+  if (!deleted) {
+    docIdMap_put(t, t->docs[docId].key, docId);
+  }
   return docId;
 }
 
@@ -160,7 +316,6 @@ void dmd_free(RSDocumentMetadata *md) {
     md->sortVector = NULL;
     md->flags &= ~Document_HasSortVector;
   }
-  rm_free(md->key);
 }
 void DocTable_Free(DocTable *t) {
   // we start at docId 1, not 0
@@ -170,22 +325,41 @@ void DocTable_Free(DocTable *t) {
   if (t->docs) {
     rm_free(t->docs);
   }
-  DocIdMap_Free(&t->dim);
+  docKeys_free(&t->keys);
+  rm_free(t->dim.slots);
+}
+
+DocTableMemUsage DocTable_MemUsage(DocTable *t) {
+  DocTableMemUsage ret = {.metadata = t->cap * sizeof(RSDocumentMetadata),
+                          .keys = t->keys.memsize,
+                          .idMap = t->dim.cap * sizeof(t_docId),
+                          .payloads = t->payloadsSize,
+                          .sortVectors = t->sortVectorsSize};
+  ret.total = ret.metadata + ret.keys + ret.idMap + ret.payloads + ret.sortVectors;
+  return ret;
 }
 
 int DocTable_Delete(DocTable *t, const char *key) {
-  t_docId docId = DocIdMap_Get(&t->dim, key);
+  t_docId docId = docIdMap_get(t, key);
   if (docId && docId <= t->maxDocId) {
 
     RSDocumentMetadata *md = &t->docs[docId];
     if (md->payload) {
+      t->payloadsSize -= md->payload->len + sizeof(RSPayload);
       rm_free(md->payload->data);
       rm_free(md->payload);
       md->payload = NULL;
     }
 
     md->flags |= Document_Deleted;
-    return DocIdMap_Delete(&t->dim, key);
+    ++t->generation;
+    // key may be the document's own key, so it's not used once the keys are compacted
+    int rc = docIdMap_delete(t, key);
+    t->keys.deadsize += strlen(md->key) + 1;
+    if (t->keys.deadsize > DOCTABLE_KEYS_CHUNK_SIZE && t->keys.deadsize * 2 > t->keys.memsize) {
+      docKeys_compact(t);
+    }
+    return rc;
   }
   return 0;
 }
@@ -220,9 +394,15 @@ void DocTable_RdbLoad(DocTable *t, RedisModuleIO *rdb, int encver) {
   t->size = sz;
   for (size_t i = 1; i < sz; i++) {
     size_t len;
-    t->docs[i].key = RedisModule_LoadStringBuffer(rdb, &len);
-
+    char *key = RedisModule_LoadStringBuffer(rdb, &len);
     t->docs[i].flags = RedisModule_LoadUnsigned(rdb);
+    // the keys of deleted documents are not loaded back. The saved length includes the null
+    // terminator
+    t->docs[i].key = t->docs[i].flags & Document_Deleted
+                         ? deletedKey
+                         : docKeys_store(&t->keys, key, strlen(key));
+    RedisModule_Free(key);
+
     t->docs[i].maxFreq = 0;
     if (encver > 1) {
       t->docs[i].maxFreq = RedisModule_LoadUnsigned(rdb);
@@ -234,17 +414,18 @@ void DocTable_RdbLoad(DocTable *t, RedisModuleIO *rdb, int encver) {
       t->docs[i].payload = RedisModule_Alloc(sizeof(RSPayload));
       t->docs[i].payload->data = RedisModule_LoadStringBuffer(rdb, &t->docs[i].payload->len);
       t->docs[i].payload->len--;
-      t->memsize += t->docs[i].payload->len + sizeof(RSPayload);
+      t->payloadsSize += t->docs[i].payload->len + sizeof(RSPayload);
     }
+    t->docs[i].sortVector = NULL;
     if (t->docs[i].flags & Document_HasSortVector) {
       t->docs[i].sortVector = SortingVector_RdbLoad(rdb, encver);
+      t->sortVectorsSize += sortingVector_memUsage(t->docs[i].sortVector);
     }
 
     // We always save deleted docs to rdb, but we don't want to load them back to the id map
     if (!(t->docs[i].flags & Document_Deleted)) {
-      DocIdMap_Put(&t->dim, t->docs[i].key, i);
+      docIdMap_put(t, t->docs[i].key, i);
     }
-    t->memsize += sizeof(RSDocumentMetadata) + len;
   }
 }
 
@@ -265,40 +446,3 @@ void DocTable_AOFRewrite(DocTable *t, RedisModuleString *key, RedisModuleIO *aof
     RedisModule_FreeString(ctx, ss);
   }
 }
-
-DocIdMap NewDocIdMap() {
-
-  TrieMap *m = NewTrieMap();
-  return (DocIdMap){m};
-}
-
-t_docId DocIdMap_Get(DocIdMap *m, const char *key) {
-
-  void *val = TrieMap_Find(m->tm, (char *)key, strlen(key));
-  if (val && val != TRIEMAP_NOTFOUND) {
-    return *((t_docId *)val);
-  }
-  return 0;
-}
-
-void *_docIdMap_replace(void *oldval, void *newval) {
-  if (oldval) {
-    rm_free(oldval);
-  }
-  return newval;
-}
-
-void DocIdMap_Put(DocIdMap *m, const char *key, t_docId docId) {
-
-  t_docId *pd = rm_malloc(sizeof(t_docId));
-  *pd = docId;
-  TrieMap_Add(m->tm, (char *)key, strlen(key), pd, _docIdMap_replace);
-}
-
-void DocIdMap_Free(DocIdMap *m) {
-  TrieMap_Free(m->tm, RedisModule_Free);
-}
-
-int DocIdMap_Delete(DocIdMap *m, const char *key) {
-  return TrieMap_Delete(m->tm, (char *)key, strlen(key), RedisModule_Free);
-}
\ No newline at end of file
@@ -7,19 +7,34 @@
 #include "redisearch.h"
 #include "sortable.h"
 
-/* Map between external id an incremental id */
-typedef struct { TrieMap *tm; } DocIdMap;
+/* The keys of the documents are stored once, in chunks. Keys are appended to the last chunk, and a
+ * key that doesn't fit in it starts a new one. The keys of deleted documents stay in their chunks
+ * until they take up more than half of them, and the keys of the live documents are then copied to
+ * new chunks. Deleted documents are left with an empty key */
+#define DOCTABLE_KEYS_CHUNK_SIZE (64 * 1024)
 
-DocIdMap NewDocIdMap();
-/* Get docId from a did-map. Returns 0  if the key is not in the map */
-t_docId DocIdMap_Get(DocIdMap *m, const char *key);
-
-/* Put a new doc id in the map if it does not already exist */
-void DocIdMap_Put(DocIdMap *m, const char *key, t_docId docId);
+typedef struct {
+  char **chunks;
+  size_t numChunks;
+  // the space used in the last chunk, and its size
+  size_t offset;
+  size_t chunkSize;
+  // the total size of the chunks
+  size_t memsize;
+  // the space taken by the keys of deleted documents
+  size_t deadsize;
+} DocKeys;
 
-int DocIdMap_Delete(DocIdMap *m, const char *key);
-/* Free the doc id map */
-void DocIdMap_Free(DocIdMap *m);
+/* Map between external keys and incremental ids. It is an open addressing hash table of docIds,
+ * which compares keys with the keys of the documents in the table, so keys are not stored twice */
+typedef struct {
+  t_docId *slots;
+  // the number of slots, a power of 2
+  size_t cap;
+  // the number of live ids, and of slots that are taken by either a live or a deleted id
+  size_t size;
+  size_t used;
+} DocIdMap;
 
 /* The DocTable is a simple mapping between incremental ids and the original document key and
  * metadata. It is also responsible for storing the id incrementor for the index and assigning
@@ -33,12 +48,28 @@ typedef struct {
   size_t size;
   t_docId maxDocId;
   size_t cap;
-  size_t memsize;
+  // the memory used by the payloads and the sorting vectors of the documents
+  size_t payloadsSize;
+  size_t sortVectorsSize;
+  // bumped by every change to the documents of the table. Cached query results computed at an
+  // older generation are stale
+  uint64_t generation;
   RSDocumentMetadata *docs;
+  DocKeys keys;
   DocIdMap dim;
 
 } DocTable;
 
+/* The memory used by each component of the table, in bytes */
+typedef struct {
+  size_t metadata;
+  size_t keys;
+  size_t idMap;
+  size_t payloads;
+  size_t sortVectors;
+  size_t total;
+} DocTableMemUsage;
+
 /* Creates a new DocTable with a given capacity */
 DocTable NewDocTable(size_t cap);
 
@@ -75,6 +106,9 @@ RSPayload *DocTable_GetPayload(DocTable *t, t_docId dodcId);
 /** Get the docId of a key if it exists in the table, or 0 if it doesnt */
 t_docId DocTable_GetId(DocTable *dt, const char *key);
 
+/* Get the memory used by each component of the table */
+DocTableMemUsage DocTable_MemUsage(DocTable *t);
+
 /* Free the table and all the keys of documents */
 void DocTable_Free(DocTable *t);
 
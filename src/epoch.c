@@ -0,0 +1,123 @@
+#include "epoch.h"
+#include "rmalloc.h"
+#include <pthread.h>
+
+typedef struct {
+  void *p;
+  void (*freeFunc)(void *);
+  // the epoch the memory was retired in
+  t_epoch epoch;
+} retiredMem;
+
+static pthread_mutex_t epochLock = PTHREAD_MUTEX_INITIALIZER;
+static t_epoch currentEpoch = 1;
+
+// the epochs active readers entered at, 0 for a free slot
+static t_epoch *readers = NULL;
+static int numReaderSlots = 0;
+static int numReaders = 0;
+
+static retiredMem *retired = NULL;
+static size_t numRetired = 0;
+static size_t retiredCap = 0;
+
+/* The oldest epoch of an active reader, or 0 if there are none. Called with the lock held */
+static t_epoch oldestReader() {
+  t_epoch ret = 0;
+  for (int i = 0; i < numReaderSlots; i++) {
+    if (readers[i] && (!ret || readers[i] < ret)) ret = readers[i];
+  }
+  return ret;
+}
+
+/* Free the retired memory no reader can see */
+static void reclaim() {
+  pthread_mutex_lock(&epochLock);
+  t_epoch oldest = oldestReader();
+  retiredMem *done = NULL;
+  size_t numDone = 0, n = 0;
+  for (size_t i = 0; i < numRetired; i++) {
+    if (oldest && retired[i].epoch >= oldest) {
+      retired[n++] = retired[i];
+      continue;
+    }
+    if (!done) done = rm_malloc((numRetired - i) * sizeof(retiredMem));
+    done[numDone++] = retired[i];
+  }
+  numRetired = n;
+  pthread_mutex_unlock(&epochLock);
+
+  // free functions may retire memory themselves, so they're called without the lock
+  for (size_t i = 0; i < numDone; i++) {
+    done[i].freeFunc(done[i].p);
+  }
+  rm_free(done);
+}
+
+int Epoch_Enter() {
+  pthread_mutex_lock(&epochLock);
+  int slot = 0;
+  while (slot < numReaderSlots && readers[slot]) slot++;
+  if (slot == numReaderSlots) {
+    numReaderSlots = numReaderSlots ? numReaderSlots * 2 : 8;
+    readers = rm_realloc(readers, numReaderSlots * sizeof(t_epoch));
+    for (int i = slot; i < numReaderSlots; i++) readers[i] = 0;
+  }
+  readers[slot] = currentEpoch;
+  numReaders++;
+  pthread_mutex_unlock(&epochLock);
+  return slot;
+}
+
+void Epoch_Exit(int handle) {
+  pthread_mutex_lock(&epochLock);
+  readers[handle] = 0;
+  numReaders--;
+  int pending = numRetired > 0;
+  pthread_mutex_unlock(&epochLock);
+
+  if (pending) reclaim();
+}
+
+t_epoch Epoch_Current() {
+  pthread_mutex_lock(&epochLock);
+  t_epoch ret = currentEpoch;
+  pthread_mutex_unlock(&epochLock);
+  return ret;
+}
+
+int Epoch_InUse(t_epoch e) {
+  if (!e) return 0;
+  pthread_mutex_lock(&epochLock);
+  int ret = 0;
+  for (int i = 0; numReaders && i < numReaderSlots && !ret; i++) {
+    ret = readers[i] && readers[i] <= e;
+  }
+  pthread_mutex_unlock(&epochLock);
+  return ret;
+}
+
+void Epoch_Retire(void *p, void (*freeFunc)(void *)) {
+  pthread_mutex_lock(&epochLock);
+  if (!numReaders) {
+    pthread_mutex_unlock(&epochLock);
+    freeFunc(p);
+    return;
+  }
+
+  if (numRetired == retiredCap) {
+    retiredCap = retiredCap ? retiredCap * 2 : 16;
+    retired = rm_realloc(retired, retiredCap * sizeof(retiredMem));
+  }
+  // readers entering from now on can't see p
+  retired[numRetired++] = (retiredMem){.p = p, .freeFunc = freeFunc, .epoch = currentEpoch++};
+  pthread_mutex_unlock(&epochLock);
+}
+
+static void freeMem(void *p) {
+  rm_free(p);
+}
+
+void Epoch_RetireMem(void *p) {
+  Epoch_Retire(p, freeMem);
+}
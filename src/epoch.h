@@ -0,0 +1,40 @@
+#ifndef __RS_EPOCH_H__
+#define __RS_EPOCH_H__
+
+#include <stdint.h>
+
+/** Read epochs.
+ *
+ * Queries take snapshots of the index structures while holding the global lock, and then read them
+ * without it, while the main thread keeps writing to the index. To make that safe, writers never
+ * change or free memory a snapshot may point to. They copy it instead, and hand the old copy over
+ * to Epoch_Retire.
+ *
+ * A reader enters an epoch before taking its snapshots, and exits it when it is done with them.
+ * Retired memory is freed once every reader that entered before it was retired has exited. When
+ * there are no readers, retiring memory frees it right away.
+ */
+
+typedef uint64_t t_epoch;
+
+/* Enter a read epoch. Returns a handle to pass to Epoch_Exit */
+int Epoch_Enter();
+
+/* Exit a read epoch, freeing whatever memory no other reader can still see */
+void Epoch_Exit(int handle);
+
+/* The current epoch. Structures record it when a snapshot of them is taken, so that writers can
+ * tell whether they must copy before they write */
+t_epoch Epoch_Current();
+
+/* Can a snapshot taken at epoch e still be in use, i.e. is any reader that entered at or before e
+ * still active? */
+int Epoch_InUse(t_epoch e);
+
+/* Free p with freeFunc once no active reader can see it */
+void Epoch_Retire(void *p, void (*freeFunc)(void *));
+
+/* Retire memory allocated with rm_malloc */
+void Epoch_RetireMem(void *p);
+
+#endif
@@ -8,4 +8,13 @@
 
 int DefaultExtensionInit(RSExtensionCtx *ctx);
 
+/* The default TF-IDF scorer. The query prunes unions of terms that are scored with it */
+double TFIDFScorer(RSScoringFunctionCtx *ctx, RSIndexResult *h, RSDocumentMetadata *dmd,
+                   double minScore);
+
+/* The DISMAX scorer. Like TF-IDF, it only reads the index results and document metadata, so queries
+ * scored with either can run in parallel threads */
+double DisMaxScorer(RSScoringFunctionCtx *ctx, RSIndexResult *h, RSDocumentMetadata *dmd,
+                    double minScore);
+
 #endif
\ No newline at end of file
@@ -45,9 +45,9 @@ void ForwardIndexFree(ForwardIndex *idx) {
   // TODO: check if we need to rm_free each entry separately
 }
 
-// void ForwardIndex_NormalizeFreq(ForwardIndex *idx, ForwardIndexEntry *e) {
-//   e->freq = e->freq / idx->maxFreq;
-// }
+void ForwardIndex_NormalizeFreq(ForwardIndex *idx, ForwardIndexEntry *e) {
+  e->normFreq = idx->maxFreq ? (float)e->freq / (float)idx->maxFreq : 1;
+}
 
 int forwardIndexTokenFunc(void *ctx, Token t) {
   ForwardIndex *idx = ctx;
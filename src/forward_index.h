@@ -11,6 +11,8 @@ typedef struct {
   const char *term;
   size_t len;
   uint32_t freq;
+  // the frequency normalized by the document's max term frequency
+  float normFreq;
   float docScore;
   t_fieldMask fieldMask;
   VarintVectorWriter *vw;
@@ -1,18 +1,67 @@
 #include "index.h"
 #include "geo_index.h"
 #include "rmutil/util.h"
+#include "rmutil/strings.h"
 #include "rmalloc.h"
 #include "id_list.h"
+#include <math.h>
 
 #define GEOINDEX_KEY_FMT "geo:%s/%s"
 
+RedisModuleType *GeoIndexType = NULL;
+
 RedisModuleString *fmtGeoIndexKey(GeoIndex *gi) {
   return RedisModule_CreateStringPrintf(gi->ctx->redisCtx, GEOINDEX_KEY_FMT, gi->ctx->spec->name,
                                         gi->sp->name);
 }
 
-/* Add a docId to a geoindex key. Right now we just use redis' own GEOADD */
+/* Open the geo index of a field. Indexes created by older versions are redis geo sets, in which case
+ * we return NULL and set legacy, and they are still used through the GEO commands */
+static GeoHashIndex *openGeoIndex(GeoIndex *gi, int write, int *legacy) {
+  RedisModuleString *ks = fmtGeoIndexKey(gi);
+  RedisModuleKey *key = RedisModule_OpenKey(gi->ctx->redisCtx, ks,
+                                            REDISMODULE_READ | (write ? REDISMODULE_WRITE : 0));
+  RedisModule_FreeString(gi->ctx->redisCtx, ks);
+
+  *legacy = 0;
+  int type = RedisModule_KeyType(key);
+  if (type == REDISMODULE_KEYTYPE_ZSET) {
+    *legacy = 1;
+    return NULL;
+  }
+  if (type != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) != GeoIndexType) {
+    return NULL;
+  }
+
+  if (type == REDISMODULE_KEYTYPE_EMPTY) {
+    if (!write) return NULL;
+    GeoHashIndex *idx = NewGeoHashIndex();
+    RedisModule_ModuleTypeSetValue(key, GeoIndexType, idx);
+    return idx;
+  }
+  return RedisModule_ModuleTypeGetValue(key);
+}
+
+/* Add a docId to the geo index of a field */
 int GeoIndex_AddStrings(GeoIndex *gi, t_docId docId, char *slon, char *slat) {
+  char *end;
+  double lon = strtod(slon, &end);
+  if (end == slon || *end) return REDISMODULE_ERR;
+  double lat = strtod(slat, &end);
+  if (end == slat || *end) return REDISMODULE_ERR;
+  if (lon < GEO_LON_MIN || lon > GEO_LON_MAX || lat < GEO_LAT_MIN || lat > GEO_LAT_MAX) {
+    return REDISMODULE_ERR;
+  }
+
+  int legacy;
+  GeoHashIndex *idx = openGeoIndex(gi, 1, &legacy);
+  if (idx) {
+    GeoHashIndex_Add(idx, docId, lon, lat);
+    return REDISMODULE_OK;
+  }
+  if (!legacy) {
+    return REDISMODULE_ERR;
+  }
 
   RedisModuleString *ks = fmtGeoIndexKey(gi);
 
@@ -29,22 +78,59 @@ int GeoIndex_AddStrings(GeoIndex *gi, t_docId docId, char *slon, char *slat) {
   return REDISMODULE_OK;
 }
 
+/* Parse a BOX or POLYGON filter, after the property and the filter type */
+static int geoFilter_parseArea(GeoFilter *gf, RedisModuleString **argv, int argc) {
+  if (gf->type == GEO_FILTER_BOX) {
+    if (argc < 4 || RMUtil_ParseArgs(argv, argc, 0, "dddd", &gf->minLon, &gf->minLat, &gf->maxLon,
+                                     &gf->maxLat) == REDISMODULE_ERR) {
+      return REDISMODULE_ERR;
+    }
+    // the box may cross the antimeridian, but not the poles
+    if (gf->minLat > gf->maxLat || gf->minLon < GEO_LON_MIN || gf->maxLon > GEO_LON_MAX) {
+      return REDISMODULE_ERR;
+    }
+    return REDISMODULE_OK;
+  }
+
+  long long n;
+  if (argc < 1 || RedisModule_StringToLongLong(argv[0], &n) == REDISMODULE_ERR || n < 3 ||
+      n > (argc - 1) / 2) {
+    return REDISMODULE_ERR;
+  }
+  gf->numPoints = n;
+  gf->points = malloc(2 * n * sizeof(double));
+  for (long long i = 0; i < 2 * n; i++) {
+    if (RedisModule_StringToDouble(argv[i + 1], &gf->points[i]) == REDISMODULE_ERR) {
+      return REDISMODULE_ERR;
+    }
+  }
+  return REDISMODULE_OK;
+}
+
 /* Parse a geo filter from redis arguments. We assume the filter args start at argv[0], and FILTER
  * is not passed to us.
  * The GEO filter syntax is (FILTER) <property> LONG LAT DIST m|km|ft|mi
+ * or (FILTER) <property> BOX MINLONG MINLAT MAXLONG MAXLAT
+ * or (FILTER) <property> POLYGON NUM LONG LAT ...
  * Returns REDISMODUEL_OK or ERR  */
 int GeoFilter_Parse(GeoFilter *gf, RedisModuleString **argv, int argc) {
-  gf->property = NULL;
-  gf->lat = 0;
-  gf->lon = 0;
-  gf->unit = NULL;
-  gf->radius = 0;
+  *gf = (GeoFilter){.type = GEO_FILTER_RADIUS};
 
-  if (argc != 5) {
+  if (argc >= 2 && RMUtil_StringEqualsCaseC(argv[1], "BOX")) {
+    gf->type = GEO_FILTER_BOX;
+  } else if (argc >= 2 && RMUtil_StringEqualsCaseC(argv[1], "POLYGON")) {
+    gf->type = GEO_FILTER_POLYGON;
+  }
+  if (gf->type != GEO_FILTER_RADIUS) {
+    gf->property = strdup(RedisModule_StringPtrLen(argv[0], NULL));
+    return geoFilter_parseArea(gf, argv + 2, argc - 2);
+  }
+
+  if (argc < 5) {
     return REDISMODULE_ERR;
   }
 
-  if (RMUtil_ParseArgs(argv, argc, 0, "cdddc", &gf->property, &gf->lon, &gf->lat, &gf->radius,
+  if (RMUtil_ParseArgs(argv, 5, 0, "cdddc", &gf->property, &gf->lon, &gf->lat, &gf->radius,
                        &gf->unit) == REDISMODULE_ERR) {
 
     // don't dup the strings since we are exiting now
@@ -68,6 +154,7 @@ int GeoFilter_Parse(GeoFilter *gf, RedisModuleString **argv, int argc) {
 void GeoFilter_Free(GeoFilter *gf) {
   if (gf->property) free((char *)gf->property);
   if (gf->unit) free((char *)gf->unit);
+  if (gf->points) free(gf->points);
   free(gf);
 }
 
@@ -107,14 +194,522 @@ t_docId *__gr_load(GeoIndex *gi, GeoFilter *gf, size_t *num) {
   return docIds;
 }
 
+double GeoFilter_UnitFactor(const char *unit) {
+  if (!strcasecmp(unit, "m")) return 1;
+  if (!strcasecmp(unit, "km")) return 1000;
+  if (!strcasecmp(unit, "ft")) return 0.3048;
+  if (!strcasecmp(unit, "mi")) return 1609.34;
+  return -1;
+}
+
+/* Geohash cells */
+
+/* The earth radius in meters, the same as redis' GEO commands */
+#define GEO_EARTH_RADIUS 6372797.560856
+#define GEO_DEG_TO_RAD (M_PI / 180.0)
+#define GEO_DEG_TO_M (GEO_EARTH_RADIUS * GEO_DEG_TO_RAD)
+
+/* Spread the bits of x to the even bits of the result */
+static uint32_t spreadBits(uint32_t x) {
+  x &= 0xFFFF;
+  x = (x | (x << 8)) & 0x00FF00FF;
+  x = (x | (x << 4)) & 0x0F0F0F0F;
+  x = (x | (x << 2)) & 0x33333333;
+  x = (x | (x << 1)) & 0x55555555;
+  return x;
+}
+
+/* The geohash of cell x, y. Coarser cells are prefixes of finer ones, so the cells of an area are
+ * a contiguous range of finer hashes */
+static uint32_t geoHash(uint32_t x, uint32_t y) {
+  return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+/* The coordinates of the cell of a point at a given step */
+static void geoCellXY(double lon, double lat, int step, uint32_t *x, uint32_t *y) {
+  uint32_t n = 1 << step;
+  double fx = (lon - GEO_LON_MIN) / (GEO_LON_MAX - GEO_LON_MIN) * n;
+  double fy = (lat - GEO_LAT_MIN) / (GEO_LAT_MAX - GEO_LAT_MIN) * n;
+  *x = fx <= 0 ? 0 : (fx >= n ? n - 1 : (uint32_t)fx);
+  *y = fy <= 0 ? 0 : (fy >= n ? n - 1 : (uint32_t)fy);
+}
+
+static uint32_t unspreadBits(uint32_t x) {
+  x &= 0x55555555;
+  x = (x | (x >> 1)) & 0x33333333;
+  x = (x | (x >> 2)) & 0x0F0F0F0F;
+  x = (x | (x >> 4)) & 0x00FF00FF;
+  x = (x | (x >> 8)) & 0x0000FFFF;
+  return x;
+}
+
+/* The great circle distance between two points in meters */
+static double geoDistance(double lon1, double lat1, double lon2, double lat2) {
+  double u = sin((lat2 - lat1) * GEO_DEG_TO_RAD / 2);
+  double v = sin((lon2 - lon1) * GEO_DEG_TO_RAD / 2);
+  return 2.0 * GEO_EARTH_RADIUS *
+         asin(sqrt(u * u + cos(lat1 * GEO_DEG_TO_RAD) * cos(lat2 * GEO_DEG_TO_RAD) * v * v));
+}
+
+/* The coarsest step whose cells are at least radius meters wide and high everywhere in the circle,
+ * so that the circle is covered by the 3x3 cells around its center */
+static int geoRadiusStep(double lat, double radius) {
+  double maxLat = fabs(lat) + radius / GEO_DEG_TO_M;
+  double cosLat = maxLat >= 90 ? 0 : cos(maxLat * GEO_DEG_TO_RAD);
+  int step = GEO_CELL_STEP;
+  while (step > 0) {
+    double height = (GEO_LAT_MAX - GEO_LAT_MIN) / (1 << step) * GEO_DEG_TO_M;
+    double width = (GEO_LON_MAX - GEO_LON_MIN) / (1 << step) * GEO_DEG_TO_M * cosLat;
+    if (height >= radius && width >= radius) break;
+    step--;
+  }
+  return step;
+}
+
+GeoHashIndex *NewGeoHashIndex() {
+  GeoHashIndex *idx = rm_calloc(1, sizeof(GeoHashIndex));
+  return idx;
+}
+
+/* The position of the first cell with a hash not lower than the given one */
+static size_t geoHashIndex_lowerBound(GeoHashIndex *idx, uint32_t hash) {
+  size_t lo = 0, hi = idx->numCells;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (idx->cells[mid].hash < hash) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/* Get the cell of a hash, adding it if needed */
+static GeoCell *geoHashIndex_cell(GeoHashIndex *idx, uint32_t hash) {
+  size_t pos = geoHashIndex_lowerBound(idx, hash);
+  if (pos < idx->numCells && idx->cells[pos].hash == hash) {
+    return &idx->cells[pos];
+  }
+  if (idx->numCells == idx->cap) {
+    idx->cap = idx->cap ? idx->cap * 2 : 16;
+    idx->cells = rm_realloc(idx->cells, idx->cap * sizeof(GeoCell));
+  }
+  memmove(&idx->cells[pos + 1], &idx->cells[pos], (idx->numCells - pos) * sizeof(GeoCell));
+  idx->cells[pos] = (GeoCell){.hash = hash};
+  idx->numCells++;
+  return &idx->cells[pos];
+}
+
+static void geoCell_add(GeoCell *c, t_docId docId, double lon, double lat) {
+  if (c->size == c->cap) {
+    c->cap = c->cap ? c->cap * 2 : 4;
+    c->points = rm_realloc(c->points, c->cap * sizeof(GeoPoint));
+  }
+  // keep the points in docId order, ids are almost always added in increasing order
+  uint32_t i = c->size++;
+  while (i > 0 && c->points[i - 1].docId > docId) {
+    c->points[i] = c->points[i - 1];
+    i--;
+  }
+  c->points[i] = (GeoPoint){.docId = docId, .lon = lon, .lat = lat};
+}
+
+void GeoHashIndex_Add(GeoHashIndex *idx, t_docId docId, double lon, double lat) {
+  uint32_t x, y;
+  geoCellXY(lon, lat, GEO_CELL_STEP, &x, &y);
+  geoCell_add(geoHashIndex_cell(idx, geoHash(x, y)), docId, lon, lat);
+  idx->numPoints++;
+}
+
+/* The bounds of a cell */
+static void geoCellBounds(uint32_t x, uint32_t y, double *lon0, double *lat0, double *lon1,
+                          double *lat1) {
+  double w = (double)(GEO_LON_MAX - GEO_LON_MIN) / (1 << GEO_CELL_STEP);
+  double h = (GEO_LAT_MAX - GEO_LAT_MIN) / (1 << GEO_CELL_STEP);
+  *lon0 = GEO_LON_MIN + x * w;
+  *lat0 = GEO_LAT_MIN + y * h;
+  *lon1 = *lon0 + w;
+  *lat1 = *lat0 + h;
+}
+
+/* Is the point inside the polygon? The polygon is planar in lon/lat, given as lon,lat pairs */
+static int geoPointInPolygon(const double *points, size_t n, double lon, double lat) {
+  int in = 0;
+  for (size_t i = 0, j = n - 1; i < n; j = i++) {
+    double xi = points[2 * i], yi = points[2 * i + 1];
+    double xj = points[2 * j], yj = points[2 * j + 1];
+    if ((yi > lat) != (yj > lat) && lon < (xj - xi) * (lat - yi) / (yj - yi) + xi) {
+      in = !in;
+    }
+  }
+  return in;
+}
+
+/* A range of cell hashes [lo, hi) */
+typedef struct {
+  uint64_t lo;
+  uint64_t hi;
+} geoHashRange;
+
+/* A lon/lat rectangle, and the cells it spans */
+typedef struct {
+  double minLon, minLat, maxLon, maxLat;
+  uint32_t x0, y0, x1, y1;
+} geoRect;
+
+/* The most coarse areas we cover a rectangle with. We pick the finest step at which the rectangle
+ * spans no more areas than this */
+#define GEO_RECT_MAX_AREAS 16
+
+/* At most 9 areas around a circle, or two rectangles for a box crossing the antimeridian */
+#define GEO_MAX_RANGES (2 * GEO_RECT_MAX_AREAS)
+
+/* A query on the geo index: the shape we look for, and the cell ranges covering it */
+typedef struct {
+  GeoFilterType type;
+  // GEO_FILTER_RADIUS, in meters
+  double lon, lat, radius;
+  // GEO_FILTER_BOX and GEO_FILTER_POLYGON
+  geoRect rects[2];
+  int numRects;
+  const double *points;
+  size_t numPoints;
+
+  geoHashRange ranges[GEO_MAX_RANGES];
+  int numRanges;
+} geoQuery;
+
+/* How a cell relates to the shape of a query */
+typedef enum { GEO_CELL_OUTSIDE, GEO_CELL_CROSSING, GEO_CELL_INSIDE } geoCellPosition;
+
+static void geoQuery_addArea(geoQuery *q, uint32_t x, uint32_t y, int step) {
+  int shift = 2 * (GEO_CELL_STEP - step);
+  uint32_t h = geoHash(x, y);
+  q->ranges[q->numRanges++] = (geoHashRange){.lo = (uint64_t)h << shift,
+                                             .hi = (uint64_t)(h + 1) << shift};
+}
+
+static void geoQuery_initRadius(geoQuery *q, double lon, double lat, double radius) {
+  *q = (geoQuery){.type = GEO_FILTER_RADIUS, .lon = lon, .lat = lat, .radius = radius};
+
+  // the 3x3 areas around the center, at a step where they cover the circle
+  int step = geoRadiusStep(lat, radius);
+  uint32_t cx, cy, side = 1 << step;
+  geoCellXY(lon, lat, step, &cx, &cy);
+  for (int dx = -1; dx <= 1; dx++) {
+    for (int dy = -1; dy <= 1; dy++) {
+      int64_t y = (int64_t)cy + dy;
+      if (y < 0 || y >= side) continue;
+      // longitudes wrap around
+      uint32_t x = (uint32_t)(((int64_t)cx + dx + side) % side);
+      geoQuery_addArea(q, x, (uint32_t)y, step);
+    }
+  }
+}
+
+static void geoQuery_addRect(geoQuery *q, double minLon, double minLat, double maxLon,
+                             double maxLat) {
+  geoRect *r = &q->rects[q->numRects++];
+  *r = (geoRect){.minLon = minLon, .minLat = minLat, .maxLon = maxLon, .maxLat = maxLat};
+  geoCellXY(minLon, minLat, GEO_CELL_STEP, &r->x0, &r->y0);
+  geoCellXY(maxLon, maxLat, GEO_CELL_STEP, &r->x1, &r->y1);
+
+  int step = GEO_CELL_STEP;
+  uint32_t x0, y0, x1, y1;
+  while (1) {
+    geoCellXY(minLon, minLat, step, &x0, &y0);
+    geoCellXY(maxLon, maxLat, step, &x1, &y1);
+    if (step == 0 || (uint64_t)(x1 - x0 + 1) * (y1 - y0 + 1) <= GEO_RECT_MAX_AREAS) break;
+    step--;
+  }
+  for (uint32_t x = x0; x <= x1; x++) {
+    for (uint32_t y = y0; y <= y1; y++) {
+      geoQuery_addArea(q, x, y, step);
+    }
+  }
+}
+
+static void geoQuery_initBox(geoQuery *q, double minLon, double minLat, double maxLon,
+                             double maxLat) {
+  *q = (geoQuery){.type = GEO_FILTER_BOX};
+  if (minLon <= maxLon) {
+    geoQuery_addRect(q, minLon, minLat, maxLon, maxLat);
+  } else {
+    // the box crosses the antimeridian
+    geoQuery_addRect(q, minLon, minLat, GEO_LON_MAX, maxLat);
+    geoQuery_addRect(q, GEO_LON_MIN, minLat, maxLon, maxLat);
+  }
+}
+
+static void geoQuery_initPolygon(geoQuery *q, const double *points, size_t numPoints) {
+  *q = (geoQuery){.type = GEO_FILTER_POLYGON, .points = points, .numPoints = numPoints};
+  double minLon = GEO_LON_MAX, minLat = GEO_LAT_MAX, maxLon = GEO_LON_MIN, maxLat = GEO_LAT_MIN;
+  for (size_t i = 0; i < numPoints; i++) {
+    minLon = fmin(minLon, points[2 * i]);
+    maxLon = fmax(maxLon, points[2 * i]);
+    minLat = fmin(minLat, points[2 * i + 1]);
+    maxLat = fmax(maxLat, points[2 * i + 1]);
+  }
+  geoQuery_addRect(q, minLon, minLat, maxLon, maxLat);
+}
+
+/* Init a query from a parsed filter. Polygon queries point to the filter's vertices */
+static void geoQuery_initFilter(geoQuery *q, GeoFilter *gf) {
+  switch (gf->type) {
+    case GEO_FILTER_BOX:
+      geoQuery_initBox(q, gf->minLon, gf->minLat, gf->maxLon, gf->maxLat);
+      break;
+    case GEO_FILTER_POLYGON:
+      geoQuery_initPolygon(q, gf->points, gf->numPoints);
+      break;
+    default:
+      geoQuery_initRadius(q, gf->lon, gf->lat,
+                          gf->radius * GeoFilter_UnitFactor(gf->unit ? gf->unit : "km"));
+  }
+}
+
+/* Is the point inside the shape of the query? */
+static int geoQuery_contains(geoQuery *q, double lon, double lat) {
+  if (q->type == GEO_FILTER_RADIUS) {
+    return geoDistance(q->lon, q->lat, lon, lat) <= q->radius;
+  }
+  for (int i = 0; i < q->numRects; i++) {
+    geoRect *r = &q->rects[i];
+    if (lon < r->minLon || lon > r->maxLon || lat < r->minLat || lat > r->maxLat) continue;
+    return q->type == GEO_FILTER_BOX || geoPointInPolygon(q->points, q->numPoints, lon, lat);
+  }
+  return 0;
+}
+
+static geoCellPosition geoQuery_cell(geoQuery *q, uint32_t x, uint32_t y) {
+  if (q->type == GEO_FILTER_RADIUS) {
+    // the cell is inside the circle if all its corners are
+    double lon0, lat0, lon1, lat1;
+    geoCellBounds(x, y, &lon0, &lat0, &lon1, &lat1);
+    return geoQuery_contains(q, lon0, lat0) && geoQuery_contains(q, lon1, lat0) &&
+                   geoQuery_contains(q, lon0, lat1) && geoQuery_contains(q, lon1, lat1)
+               ? GEO_CELL_INSIDE
+               : GEO_CELL_CROSSING;
+  }
+
+  geoCellPosition ret = GEO_CELL_OUTSIDE;
+  for (int i = 0; i < q->numRects; i++) {
+    geoRect *r = &q->rects[i];
+    if (x < r->x0 || x > r->x1 || y < r->y0 || y > r->y1) continue;
+    // cells strictly between the ones of the rectangle's edges are entirely inside it
+    if (q->type == GEO_FILTER_BOX && x > r->x0 && x < r->x1 && y > r->y0 && y < r->y1) {
+      return GEO_CELL_INSIDE;
+    }
+    ret = GEO_CELL_CROSSING;
+  }
+  return ret;
+}
+
+static int cmpRanges(const void *p1, const void *p2) {
+  const geoHashRange *r1 = p1, *r2 = p2;
+  return r1->lo < r2->lo ? -1 : (r1->lo > r2->lo ? 1 : 0);
+}
+
+/* Collect the sorted ids of the points inside the shape of the query, scanning only the cells in
+ * its ranges */
+static t_docId *geoHashIndex_collect(GeoHashIndex *idx, geoQuery *q, size_t *num) {
+  size_t n = 0, cap = 16;
+  t_docId *ret = rm_malloc(cap * sizeof(t_docId));
+
+  // ranges of areas at different steps are either nested or disjoint, so we skip whatever a
+  // previous range already covered
+  qsort(q->ranges, q->numRanges, sizeof(geoHashRange), cmpRanges);
+  uint64_t done = 0;
+  for (int r = 0; r < q->numRanges; r++) {
+    uint64_t lo = q->ranges[r].lo > done ? q->ranges[r].lo : done, hi = q->ranges[r].hi;
+    if (lo >= hi) continue;
+    done = hi;
+
+    for (size_t c = geoHashIndex_lowerBound(idx, (uint32_t)lo);
+         c < idx->numCells && idx->cells[c].hash < hi; c++) {
+      GeoCell *cell = &idx->cells[c];
+      uint32_t x = unspreadBits(cell->hash), y = unspreadBits(cell->hash >> 1);
+      geoCellPosition pos = geoQuery_cell(q, x, y);
+      if (pos == GEO_CELL_OUTSIDE) continue;
+      // only the cells crossing the boundary of the shape need checking
+      for (uint32_t i = 0; i < cell->size; i++) {
+        GeoPoint *p = &cell->points[i];
+        if (pos == GEO_CELL_CROSSING && !geoQuery_contains(q, p->lon, p->lat)) continue;
+        if (n == cap) {
+          cap *= 2;
+          ret = rm_realloc(ret, cap * sizeof(t_docId));
+        }
+        ret[n++] = p->docId;
+      }
+    }
+  }
+
+  qsort(ret, n, sizeof(t_docId), cmp_docids);
+  *num = n;
+  return ret;
+}
+
+t_docId *GeoHashIndex_Radius(GeoHashIndex *idx, double lon, double lat, double radius,
+                             size_t *num) {
+  geoQuery q;
+  geoQuery_initRadius(&q, lon, lat, radius);
+  return geoHashIndex_collect(idx, &q, num);
+}
+
+t_docId *GeoHashIndex_Box(GeoHashIndex *idx, double minLon, double minLat, double maxLon,
+                          double maxLat, size_t *num) {
+  geoQuery q;
+  geoQuery_initBox(&q, minLon, minLat, maxLon, maxLat);
+  return geoHashIndex_collect(idx, &q, num);
+}
+
+t_docId *GeoHashIndex_Polygon(GeoHashIndex *idx, const double *points, size_t numPoints,
+                              size_t *num) {
+  geoQuery q;
+  geoQuery_initPolygon(&q, points, numPoints);
+  return geoHashIndex_collect(idx, &q, num);
+}
+
+/* Load the docs in a box or polygon from a legacy geo set. GEORADIUS can only query circles, so we
+ * get all the points with their coordinates and check them */
+static t_docId *__gr_loadArea(GeoIndex *gi, GeoFilter *gf, size_t *num) {
+  *num = 0;
+  RedisModuleString *ks = fmtGeoIndexKey(gi);
+  RedisModuleCallReply *rep =
+      RedisModule_Call(gi->ctx->redisCtx, "GEORADIUS", "sccccc", ks, "0", "0", "20100", "km",
+                       "WITHCOORD");
+  if (rep == NULL || RedisModule_CallReplyType(rep) != REDISMODULE_REPLY_ARRAY) {
+    return NULL;
+  }
+
+  geoQuery q;
+  geoQuery_initFilter(&q, gf);
+  size_t sz = RedisModule_CallReplyLength(rep), n = 0;
+  t_docId *docIds = rm_calloc(sz ? sz : 1, sizeof(t_docId));
+  for (size_t i = 0; i < sz; i++) {
+    // every element is [member, [lon, lat]]
+    RedisModuleCallReply *e = RedisModule_CallReplyArrayElement(rep, i);
+    RedisModuleCallReply *coords = RedisModule_CallReplyArrayElement(e, 1);
+    const char *s = RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(e, 0), NULL);
+    if (!s || !coords) continue;
+    double lon = strtod(RedisModule_CallReplyStringPtr(
+                            RedisModule_CallReplyArrayElement(coords, 0), NULL),
+                        NULL);
+    double lat = strtod(RedisModule_CallReplyStringPtr(
+                            RedisModule_CallReplyArrayElement(coords, 1), NULL),
+                        NULL);
+    if (geoQuery_contains(&q, lon, lat)) {
+      docIds[n++] = (t_docId)atol(s);
+    }
+  }
+
+  *num = n;
+  return docIds;
+}
+
 IndexIterator *NewGeoRangeIterator(GeoIndex *gi, GeoFilter *gf) {
   size_t sz;
-  t_docId *docIds = __gr_load(gi, gf, &sz);
+  t_docId *docIds;
+
+  int legacy;
+  GeoHashIndex *idx = openGeoIndex(gi, 0, &legacy);
+  if (idx) {
+    geoQuery q;
+    geoQuery_initFilter(&q, gf);
+    docIds = geoHashIndex_collect(idx, &q, &sz);
+  } else if (legacy) {
+    docIds = gf->type == GEO_FILTER_RADIUS ? __gr_load(gi, gf, &sz) : __gr_loadArea(gi, gf, &sz);
+    // the legacy geo sets return the ids in the order of their geohash
+    if (docIds) qsort(docIds, sz, sizeof(t_docId), cmp_docids);
+  } else {
+    // no document has the field yet
+    sz = 0;
+    docIds = rm_calloc(1, sizeof(t_docId));
+  }
   if (!docIds) {
     return NULL;
   }
 
-  IndexIterator *ret = NewIdListIterator(docIds, (t_offset)sz);
-  rm_free(docIds);
+  return NewSortedIdListIterator(docIds, (t_offset)sz);
+}
+
+void GeoHashIndex_Free(GeoHashIndex *idx) {
+  for (size_t i = 0; i < idx->numCells; i++) {
+    rm_free(idx->cells[i].points);
+  }
+  rm_free(idx->cells);
+  rm_free(idx);
+}
+
+/* Geo index data type */
+
+#define GEOINDEX_ENCVER 0
+
+int GeoIndexType_Register(RedisModuleCtx *ctx) {
+  RedisModuleTypeMethods tm = {.version = REDISMODULE_TYPE_METHOD_VERSION,
+                               .rdb_load = GeoIndexType_RdbLoad,
+                               .rdb_save = GeoIndexType_RdbSave,
+                               .aof_rewrite = GeoIndexType_AofRewrite,
+                               .free = GeoIndexType_Free,
+                               .mem_usage = GeoIndexType_MemUsage};
+
+  GeoIndexType = RedisModule_CreateDataType(ctx, "ft_geoidx", GEOINDEX_ENCVER, &tm);
+  if (GeoIndexType == NULL) {
+    return REDISMODULE_ERR;
+  }
+  return REDISMODULE_OK;
+}
+
+void *GeoIndexType_RdbLoad(RedisModuleIO *rdb, int encver) {
+  if (encver != GEOINDEX_ENCVER) {
+    return NULL;
+  }
+  GeoHashIndex *idx = NewGeoHashIndex();
+  idx->numCells = idx->cap = RedisModule_LoadUnsigned(rdb);
+  idx->cells = rm_calloc(idx->cap ? idx->cap : 1, sizeof(GeoCell));
+  for (size_t i = 0; i < idx->numCells; i++) {
+    GeoCell *c = &idx->cells[i];
+    c->hash = RedisModule_LoadUnsigned(rdb);
+    c->size = c->cap = RedisModule_LoadUnsigned(rdb);
+    c->points = rm_malloc(c->cap * sizeof(GeoPoint));
+    for (uint32_t j = 0; j < c->size; j++) {
+      c->points[j].docId = RedisModule_LoadUnsigned(rdb);
+      c->points[j].lon = RedisModule_LoadDouble(rdb);
+      c->points[j].lat = RedisModule_LoadDouble(rdb);
+    }
+    idx->numPoints += c->size;
+  }
+  return idx;
+}
+
+void GeoIndexType_RdbSave(RedisModuleIO *rdb, void *value) {
+  GeoHashIndex *idx = value;
+  RedisModule_SaveUnsigned(rdb, idx->numCells);
+  for (size_t i = 0; i < idx->numCells; i++) {
+    GeoCell *c = &idx->cells[i];
+    RedisModule_SaveUnsigned(rdb, c->hash);
+    RedisModule_SaveUnsigned(rdb, c->size);
+    for (uint32_t j = 0; j < c->size; j++) {
+      RedisModule_SaveUnsigned(rdb, c->points[j].docId);
+      RedisModule_SaveDouble(rdb, c->points[j].lon);
+      RedisModule_SaveDouble(rdb, c->points[j].lat);
+    }
+  }
+}
+
+void GeoIndexType_AofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value) {
+}
+
+void GeoIndexType_Free(void *value) {
+  GeoHashIndex_Free(value);
+}
+
+unsigned long GeoIndexType_MemUsage(const void *value) {
+  const GeoHashIndex *idx = value;
+  unsigned long ret = sizeof(GeoHashIndex) + idx->cap * sizeof(GeoCell);
+  for (size_t i = 0; i < idx->numCells; i++) {
+    ret += idx->cells[i].cap * sizeof(GeoPoint);
+  }
   return ret;
 }
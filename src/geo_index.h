@@ -14,18 +14,113 @@ typedef struct geoIndex {
 
 int GeoIndex_AddStrings(GeoIndex *gi, t_docId docId, char *slon, char *slat);
 
+typedef enum {
+  // a point and a radius
+  GEO_FILTER_RADIUS,
+  // a lon/lat rectangle. A box with minLon > maxLon crosses the antimeridian
+  GEO_FILTER_BOX,
+  // a simple polygon, with edges straight in lon/lat
+  GEO_FILTER_POLYGON,
+} GeoFilterType;
+
 typedef struct geoFilter {
 
   const char *property;
+  GeoFilterType type;
+
+  // GEO_FILTER_RADIUS
   double lat;
   double lon;
   double radius;
   const char *unit;
+
+  // GEO_FILTER_BOX
+  double minLon;
+  double minLat;
+  double maxLon;
+  double maxLat;
+
+  // GEO_FILTER_POLYGON, the vertices as lon,lat pairs
+  double *points;
+  size_t numPoints;
 } GeoFilter;
 
-/* Parse a geo filter from redis arguments. We assume the filter args start at argv[0] */
+/* Parse a geo filter from redis arguments. We assume the filter args start at argv[0], and argc is
+ * the number of arguments left, of which we use the ones the filter needs */
 int GeoFilter_Parse(GeoFilter *gf, RedisModuleString **argv, int argc);
 void GeoFilter_Free(GeoFilter *gf);
 IndexIterator *NewGeoRangeIterator(GeoIndex *gi, GeoFilter *gf);
 
-#endif
\ No newline at end of file
+/* The number of geohash bits per dimension of the cells of the geo index. Cells are about 600m by
+ * 300m at the equator */
+#define GEO_CELL_STEP 16
+
+/* The limits of the coordinates we index, the same as redis' GEOADD */
+#define GEO_LON_MIN -180
+#define GEO_LON_MAX 180
+#define GEO_LAT_MIN -85.05112878
+#define GEO_LAT_MAX 85.05112878
+
+/* A single point in a geohash cell. Points keep their exact coordinates for distance checks */
+typedef struct {
+  t_docId docId;
+  double lon;
+  double lat;
+} GeoPoint;
+
+/* A geohash cell and the points in it, in increasing docId order */
+typedef struct {
+  uint32_t hash;
+  uint32_t size;
+  uint32_t cap;
+  GeoPoint *points;
+} GeoCell;
+
+/* The native geo index of a field. Points are binned into geohash cells of GEO_CELL_STEP bits, kept
+ * sorted by their hash, so that the cells of any coarser geohash area are a contiguous range.
+ *
+ * A radius query covers the circle with the 3x3 areas of the coarsest step that contains it, and
+ * checks the exact distance only for points in cells crossing the circle's boundary. Box and
+ * polygon queries cover their bounding rectangle with a few areas, and skip the cells outside it */
+typedef struct {
+  GeoCell *cells;
+  size_t numCells;
+  size_t cap;
+  size_t numPoints;
+} GeoHashIndex;
+
+GeoHashIndex *NewGeoHashIndex();
+
+/* Add a point to the index. docIds are assumed to be added in increasing order */
+void GeoHashIndex_Add(GeoHashIndex *idx, t_docId docId, double lon, double lat);
+
+/* Get the sorted ids of the documents within radius meters of a point. The caller frees the
+ * returned array with rm_free */
+t_docId *GeoHashIndex_Radius(GeoHashIndex *idx, double lon, double lat, double radius,
+                             size_t *num);
+
+/* Get the sorted ids of the documents in a lon/lat rectangle */
+t_docId *GeoHashIndex_Box(GeoHashIndex *idx, double minLon, double minLat, double maxLon,
+                          double maxLat, size_t *num);
+
+/* Get the sorted ids of the documents in a polygon, given as numPoints lon,lat pairs */
+t_docId *GeoHashIndex_Polygon(GeoHashIndex *idx, const double *points, size_t numPoints,
+                              size_t *num);
+
+void GeoHashIndex_Free(GeoHashIndex *idx);
+
+/* Convert a distance in a GEOFILTER unit to meters. Returns -1 for an unknown unit */
+double GeoFilter_UnitFactor(const char *unit);
+
+extern RedisModuleType *GeoIndexType;
+
+int GeoIndexType_Register(RedisModuleCtx *ctx);
+void *GeoIndexType_RdbLoad(RedisModuleIO *rdb, int encver);
+void GeoIndexType_RdbSave(RedisModuleIO *rdb, void *value);
+void GeoIndexType_AofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value);
+void GeoIndexType_Free(void *value);
+unsigned long GeoIndexType_MemUsage(const void *value);
+
+RedisModuleString *fmtGeoIndexKey(GeoIndex *gi);
+
+#endif
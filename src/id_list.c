@@ -39,26 +39,17 @@ int IL_SkipTo(void *ctx, uint32_t docId, RSIndexResult **r) {
     return INDEXREAD_EOF;
   }
 
-  t_offset top = it->size - 1, bottom = it->offset;
-  t_offset i = bottom;
-  t_offset newi;
-
+  // find the first id not below docId. There is one, since the last id is not
+  t_offset bottom = it->offset, top = it->size - 1;
   while (bottom < top) {
-    t_docId did = it->docIds[i];
-    if (did == docId) {
-      break;
-    }
-    if (docId <= did) {
-      top = i;
+    t_offset mid = bottom + (top - bottom) / 2;
+    if (it->docIds[mid] < docId) {
+      bottom = mid + 1;
     } else {
-      bottom = i;
-    }
-    newi = (bottom + top) / 2;
-    if (newi == i) {
-      break;
+      top = mid;
     }
-    i = newi;
   }
+  t_offset i = bottom;
   it->offset = i + 1;
   if (it->offset == it->size) {
     it->atEOF = 1;
@@ -111,15 +102,11 @@ static int cmp_docids(const void *p1, const void *p2) {
   return (int)(*d1 - *d2);
 }
 
-IndexIterator *NewIdListIterator(t_docId *ids, t_offset num) {
-
-  // first sort the ids, so the caller will not have to deal with it
-  qsort(ids, (size_t)num, sizeof(t_docId), cmp_docids);
+IndexIterator *NewSortedIdListIterator(t_docId *ids, t_offset num) {
   IdListIterator *it = rm_new(IdListIterator);
 
   it->size = num;
-  it->docIds = rm_calloc(num, sizeof(t_docId));
-  if (num > 0) memcpy(it->docIds, ids, num * sizeof(t_docId));
+  it->docIds = ids;
   it->atEOF = 0;
   it->lastDocId = 0;
   it->res = NewVirtualResult();
@@ -133,8 +120,18 @@ IndexIterator *NewIdListIterator(t_docId *ids, t_offset num) {
   ret->HasNext = IL_HasNext;
   ret->LastDocId = IL_LastDocId;
   ret->Len = IL_Len;
+  ret->NumEstimated = IL_Len;
   ret->Read = IL_Read;
   ret->Current = IL_Current;
   ret->SkipTo = IL_SkipTo;
   return ret;
 }
+
+IndexIterator *NewIdListIterator(t_docId *ids, t_offset num) {
+
+  // first sort the ids, so the caller will not have to deal with it
+  qsort(ids, (size_t)num, sizeof(t_docId), cmp_docids);
+  t_docId *copy = rm_calloc(num, sizeof(t_docId));
+  if (num > 0) memcpy(copy, ids, num * sizeof(t_docId));
+  return NewSortedIdListIterator(copy, num);
+}
@@ -19,4 +19,8 @@ typedef struct {
  * the end and assumed to be allocated using rm_malloc */
 IndexIterator *NewIdListIterator(t_docId *ids, t_offset num);
 
+/* Create a new IdListIterator that takes ownership of a list of num document ids, allocated with
+ * rm_malloc and already sorted in ascending order. The ids are neither copied nor sorted again */
+IndexIterator *NewSortedIdListIterator(t_docId *ids, t_offset num);
+
 #endif
\ No newline at end of file
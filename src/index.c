@@ -1,5 +1,6 @@
 #include "forward_index.h"
 #include "index.h"
+#include "inverted_index.h"
 #include "varint.h"
 #include "spec.h"
 #include <math.h>
@@ -15,6 +16,24 @@ inline t_docId UI_LastDocId(void *ctx) {
   return ((UnionContext *)ctx)->minDocId;
 }
 
+/* Min heap order of the children's docIds. The heap items point into the docIds array */
+static int ui_cmpDocIds(const void *e1, const void *e2, const void *udata) {
+  const t_docId d1 = *(const t_docId *)e1, d2 = *(const t_docId *)e2;
+  return d1 < d2 ? 1 : (d1 > d2 ? -1 : 0);
+}
+
+/* All the children start out pending, so the first read or skip positions them and fills the heap */
+static void ui_initHeap(UnionContext *ui) {
+  ui->heap = malloc(heap_sizeof(ui->num));
+  heap_init(ui->heap, ui_cmpDocIds, NULL, ui->num);
+  ui->pending = malloc(ui->num * sizeof(int));
+  for (int i = 0; i < ui->num; i++) {
+    if (ui->its[i]) {
+      ui->pending[ui->numPending++] = i;
+    }
+  }
+}
+
 IndexIterator *NewUnionIterator(IndexIterator **its, int num, DocTable *dt, int quickExit) {
   // create union context
   UnionContext *ctx = calloc(1, sizeof(UnionContext));
@@ -26,6 +45,13 @@ IndexIterator *NewUnionIterator(IndexIterator **its, int num, DocTable *dt, int
   ctx->current = NewUnionResult(num);
   ctx->len = 0;
   ctx->quickExit = quickExit;
+  ctx->heap = NULL;
+  ctx->pending = NULL;
+  ctx->numPending = 0;
+  ctx->minScore = NULL;
+  if (num > UNION_HEAP_THRESHOLD) {
+    ui_initHeap(ctx);
+  }
   // bind the union iterator calls
   IndexIterator *it = malloc(sizeof(IndexIterator));
   it->ctx = ctx;
@@ -36,6 +62,7 @@ IndexIterator *NewUnionIterator(IndexIterator **its, int num, DocTable *dt, int
   it->HasNext = UI_HasNext;
   it->Free = UnionIterator_Free;
   it->Len = UI_Len;
+  it->NumEstimated = UI_NumEstimated;
   return it;
 }
 
@@ -43,6 +70,241 @@ RSIndexResult *UI_Current(void *ctx) {
   return ((UnionContext *)ctx)->current;
 }
 
+/* Take all the children positioned on the minimal docId out of the heap, and aggregate their
+ * records. They stay pending until the next read or skip */
+static int ui_heapCollect(UnionContext *ui, t_docId docId, RSIndexResult **hit) {
+  AggregateResult_Reset(ui->current);
+
+  if (!heap_count(ui->heap)) {
+    ui->atEnd = 1;
+    return INDEXREAD_EOF;
+  }
+
+  t_docId minDocId = *(t_docId *)heap_peek(ui->heap);
+  if (minDocId != docId && docId) {
+    // not found. We return the empty aggregate, just like the linear skip
+    if (hit) {
+      *hit = ui->current;
+    }
+    return INDEXREAD_NOTFOUND;
+  }
+
+  int found = 0;
+  while (heap_count(ui->heap) && *(t_docId *)heap_peek(ui->heap) == minDocId) {
+    int i = (t_docId *)heap_poll(ui->heap) - ui->docIds;
+    ui->pending[ui->numPending++] = i;
+    // in quick exit mode we only need one of the records, but we still take all the children out
+    // of the heap, so that they advance together past this docId
+    if (!found || !ui->quickExit) {
+      AggregateResult_AddChild(ui->current, ui->its[i]->Current(ui->its[i]->ctx));
+      ++found;
+    }
+  }
+
+  ui->minDocId = minDocId;
+  if (hit) {
+    *hit = found == 1 ? ui->current->agg.children[0] : ui->current;
+  }
+  return INDEXREAD_OK;
+}
+
+/* Advance the pending children to docId or past it and put them back in the heap. A docId of 0
+ * means reading the next record of each child */
+static void ui_heapAdvancePending(UnionContext *ui, t_docId docId) {
+  int numPending = ui->numPending;
+  ui->numPending = 0;
+
+  for (int p = 0; p < numPending; p++) {
+    int i = ui->pending[p];
+    IndexIterator *it = ui->its[i];
+    RSIndexResult *res = NULL;
+    int rc;
+
+    if (docId && ui->docIds[i] >= docId) {
+      // already positioned on the requested docId or past it
+      heap_offerx(ui->heap, &ui->docIds[i]);
+      continue;
+    }
+    if (docId) {
+      rc = it->SkipTo(it->ctx, docId, &res);
+    } else {
+      while (INDEXREAD_NOTFOUND == (rc = it->Read(it->ctx, &res)))
+        ;
+    }
+    if (rc == INDEXREAD_EOF) continue;
+
+    if (rc == INDEXREAD_NOTFOUND && (!res || res->docId <= docId)) {
+      // the child didn't tell us where it is. Its next read will
+      ui->docIds[i] = 0;
+      ui->pending[ui->numPending++] = i;
+      continue;
+    }
+    ui->docIds[i] = res->docId;
+    heap_offerx(ui->heap, &ui->docIds[i]);
+  }
+}
+
+static int ui_heapRead(UnionContext *ui, RSIndexResult **hit) {
+  ui_heapAdvancePending(ui, 0);
+  if (ui_heapCollect(ui, 0, hit) == INDEXREAD_EOF) {
+    return INDEXREAD_EOF;
+  }
+  ui->len++;
+  return INDEXREAD_OK;
+}
+
+static int ui_heapSkipTo(UnionContext *ui, t_docId docId, RSIndexResult **hit) {
+  // take the children that are behind docId out of the heap, and skip them all at once
+  while (heap_count(ui->heap) && *(t_docId *)heap_peek(ui->heap) < docId) {
+    ui->pending[ui->numPending++] = (t_docId *)heap_poll(ui->heap) - ui->docIds;
+  }
+  ui_heapAdvancePending(ui, docId);
+
+  // children that didn't tell us their position might still have records
+  if (!heap_count(ui->heap) && ui->numPending) {
+    AggregateResult_Reset(ui->current);
+    if (hit) {
+      *hit = ui->current;
+    }
+    return INDEXREAD_NOTFOUND;
+  }
+  return ui_heapCollect(ui, docId, hit);
+}
+
+/* The upper bound of a child's TF-IDF contribution to docId, from the block that may contain it */
+static inline double ui_childBound(UnionContext *ui, int i, t_docId docId) {
+  IndexReader *ir = ui->its[i]->ctx;
+  return ir->term->idf * IR_BlockMaxFreq(ir, docId) / FREQ_QUANTIZE_FACTOR;
+}
+
+static int ui_maxScoreRead(UnionContext *ui, RSIndexResult **hit) {
+  while (1) {
+    // the threshold only grows, so children only ever become non-essential
+    while (ui->numNonEssential < ui->numOrdered &&
+           ui->nonEssentialBound + ui->bounds[ui->order[ui->numNonEssential]] < *ui->minScore) {
+      int i = ui->order[ui->numNonEssential++];
+      ui->nonEssentialBound += ui->bounds[i];
+      ui->nonEssential[i] = 1;
+    }
+
+    int numPending = 0;
+    for (int p = 0; p < ui->numPending; p++) {
+      if (!ui->nonEssential[ui->pending[p]]) {
+        ui->pending[numPending++] = ui->pending[p];
+      }
+    }
+    ui->numPending = numPending;
+    ui_heapAdvancePending(ui, 0);
+
+    // no essential child has records left, so no document can make it past the threshold
+    if (!heap_count(ui->heap)) {
+      ui->atEnd = 1;
+      return INDEXREAD_EOF;
+    }
+
+    // take the children on the minimal docId out of the heap. Non-essential children that are still
+    // in the heap are positioned on their docId, and are dropped from the heap when they surface
+    t_docId docId = *(t_docId *)heap_peek(ui->heap);
+    int numMatched = 0, isCandidate = 0;
+    double bound = 0;
+    while (heap_count(ui->heap) && *(t_docId *)heap_peek(ui->heap) == docId) {
+      int i = (t_docId *)heap_poll(ui->heap) - ui->docIds;
+      ui->matched[numMatched++] = i;
+      if (!ui->nonEssential[i]) {
+        ui->pending[ui->numPending++] = i;
+        isCandidate = 1;
+      }
+      bound += ui_childBound(ui, i, docId);
+    }
+    if (!isCandidate) continue;
+
+    for (int k = 0; k < ui->numNonEssential; k++) {
+      int i = ui->order[k];
+      if (ui->docIds[i] < docId) {
+        bound += ui_childBound(ui, i, docId);
+      }
+    }
+    if (bound < *ui->minScore) continue;
+
+    // the candidate might make it - skip the non-essential children to it, starting from the ones
+    // with the highest bounds, and drop it as soon as the missing ones bring it below the threshold
+    for (int k = ui->numNonEssential - 1; k >= 0 && bound >= *ui->minScore; k--) {
+      int i = ui->order[k];
+      if (ui->docIds[i] >= docId) continue;
+
+      IndexIterator *it = ui->its[i];
+      RSIndexResult *res = NULL;
+      double childBound = ui_childBound(ui, i, docId);
+      int rc = it->SkipTo(it->ctx, docId, &res);
+      if (rc == INDEXREAD_OK) {
+        ui->docIds[i] = docId;
+        ui->matched[numMatched++] = i;
+        continue;
+      }
+      ui->docIds[i] = rc == INDEXREAD_NOTFOUND && res && res->docId > docId ? res->docId : docId;
+      bound -= childBound;
+    }
+    if (bound < *ui->minScore) continue;
+
+    AggregateResult_Reset(ui->current);
+    for (int m = 0; m < numMatched && !(m && ui->quickExit); m++) {
+      IndexIterator *it = ui->its[ui->matched[m]];
+      AggregateResult_AddChild(ui->current, it->Current(it->ctx));
+    }
+    ui->minDocId = docId;
+    ui->len++;
+    if (hit) {
+      *hit = ui->current->agg.numChildren == 1 ? ui->current->agg.children[0] : ui->current;
+    }
+    return INDEXREAD_OK;
+  }
+}
+
+int UI_EnableMaxScore(IndexIterator *it, const double *minScore) {
+  if (it == NULL || it->Read != UI_Read) return 0;
+  UnionContext *ui = it->ctx;
+  if (ui->minScore || ui->len || ui->atEnd) return 0;
+
+  // the bounds are only known for term readers
+  int numOrdered = 0;
+  for (int i = 0; i < ui->num; i++) {
+    if (ui->its[i] == NULL) continue;
+    if (ui->its[i]->Read != IR_Read || ((IndexReader *)ui->its[i]->ctx)->term == NULL) return 0;
+    ++numOrdered;
+  }
+  if (!numOrdered) return 0;
+
+  if (!ui->heap) {
+    ui_initHeap(ui);
+  }
+  ui->minScore = minScore;
+  ui->bounds = calloc(ui->num, sizeof(double));
+  ui->order = malloc(numOrdered * sizeof(int));
+  ui->nonEssential = calloc(ui->num, sizeof(int));
+  ui->matched = malloc(ui->num * sizeof(int));
+  ui->numOrdered = 0;
+  ui->numNonEssential = 0;
+  ui->nonEssentialBound = 0;
+
+  for (int i = 0; i < ui->num; i++) {
+    if (ui->its[i] == NULL) continue;
+    IndexReader *ir = ui->its[i]->ctx;
+    uint16_t maxFreq = 0;
+    for (uint32_t b = 0; b < ir->numBlocks; b++) {
+      maxFreq = MAX(maxFreq, ir->blocks[b].maxFreq);
+    }
+    ui->bounds[i] = ir->term->idf * maxFreq / FREQ_QUANTIZE_FACTOR;
+
+    // insertion sort by ascending bound
+    int k = ui->numOrdered++;
+    for (; k > 0 && ui->bounds[ui->order[k - 1]] > ui->bounds[i]; k--) {
+      ui->order[k] = ui->order[k - 1];
+    }
+    ui->order[k] = i;
+  }
+  return 1;
+}
+
 inline int UI_Read(void *ctx, RSIndexResult **hit) {
   UnionContext *ui = ctx;
   // nothing to do
@@ -50,6 +312,12 @@ inline int UI_Read(void *ctx, RSIndexResult **hit) {
     ui->atEnd = 1;
     return INDEXREAD_EOF;
   }
+  if (ui->minScore) {
+    return ui_maxScoreRead(ui, hit);
+  }
+  if (ui->heap) {
+    return ui_heapRead(ui, hit);
+  }
 
   int numActive = 0;
   AggregateResult_Reset(ui->current);
@@ -139,6 +407,18 @@ int UI_SkipTo(void *ctx, uint32_t docId, RSIndexResult **hit) {
   if (ui->atEnd) {
     return INDEXREAD_EOF;
   }
+  if (ui->minScore) {
+    // pruned unions are only read from the top of the query, so we just read up to docId
+    int rc = INDEXREAD_OK;
+    if (hit) *hit = ui->current;
+    while (ui->minDocId < docId && (rc = ui_maxScoreRead(ui, hit)) != INDEXREAD_EOF)
+      ;
+    if (rc == INDEXREAD_EOF) return rc;
+    return ui->minDocId == docId ? INDEXREAD_OK : INDEXREAD_NOTFOUND;
+  }
+  if (ui->heap) {
+    return ui_heapSkipTo(ui, docId, hit);
+  }
 
   AggregateResult_Reset(ui->current);
   int numActive = 0;
@@ -146,7 +426,6 @@ int UI_SkipTo(void *ctx, uint32_t docId, RSIndexResult **hit) {
   int rc = INDEXREAD_EOF;
   const int num = ui->num;
   const int quickExit = ui->quickExit;
-  t_docId minDocId = __UINT32_MAX__;
   IndexIterator *it;
   RSIndexResult *res;
   // skip all iterators to docId
@@ -171,11 +450,6 @@ int UI_SkipTo(void *ctx, uint32_t docId, RSIndexResult **hit) {
       rc = (ui->docIds[i] == docId) ? INDEXREAD_OK : INDEXREAD_NOTFOUND;
     }
 
-    // if we've read successfully, update the minimal docId we've found
-    if (ui->docIds[i] && rc != INDEXREAD_EOF) {
-      minDocId = MIN(ui->docIds[i], minDocId);
-    }
-
     // we found a hit - continue to all results matching the same docId
     if (rc == INDEXREAD_OK) {
 
@@ -210,8 +484,8 @@ int UI_SkipTo(void *ctx, uint32_t docId, RSIndexResult **hit) {
     return INDEXREAD_OK;
   }
 
-  // not found...
-  ui->minDocId = minDocId;
+  // not found... we keep minDocId at the last docId we returned, so that a following read does not
+  // pass over the records the children are now positioned on
   return INDEXREAD_NOTFOUND;
 }
 
@@ -226,6 +500,16 @@ void UnionIterator_Free(IndexIterator *it) {
   }
 
   free(ui->docIds);
+  if (ui->heap) {
+    heap_free(ui->heap);
+    free(ui->pending);
+  }
+  if (ui->minScore) {
+    free(ui->bounds);
+    free(ui->order);
+    free(ui->nonEssential);
+    free(ui->matched);
+  }
   IndexResult_Free(ui->current);
   free(ui->its);
   free(ui);
@@ -236,6 +520,19 @@ size_t UI_Len(void *ctx) {
   return ((UnionContext *)ctx)->len;
 }
 
+/* A union yields at most the results of all its children */
+size_t UI_NumEstimated(void *ctx) {
+  UnionContext *ui = ctx;
+  size_t ret = 0;
+  for (int i = 0; i < ui->num; i++) {
+    if (ui->its[i]) {
+      size_t n = ui->its[i]->NumEstimated(ui->its[i]->ctx);
+      ret = n > SIZE_MAX - ret ? SIZE_MAX : ret + n;
+    }
+  }
+  return ret;
+}
+
 void IntersectIterator_Free(IndexIterator *it) {
   if (it == NULL) return;
   IntersectContext *ui = it->ctx;
@@ -246,12 +543,35 @@ void IntersectIterator_Free(IndexIterator *it) {
     // IndexResult_Free(&ui->currentHits[i]);
   }
   free(ui->docIds);
+  free(ui->rcs);
+  free(ui->order);
   IndexResult_Free(ui->current);
   free(ui->its);
   free(it->ctx);
   free(it);
 }
 
+static size_t ii_childEstimate(IndexIterator *it) {
+  // a non existent term has no results at all
+  return it ? it->NumEstimated(it->ctx) : 0;
+}
+
+/* Order the children by their estimated number of results, so that the rarest one drives the
+ * intersection and the others are only skipped to its records. Ties keep the query order */
+static void ii_orderChildren(IntersectContext *ic) {
+  size_t *est = malloc(ic->num * sizeof(size_t));
+  for (int i = 0; i < ic->num; i++) {
+    est[i] = ii_childEstimate(ic->its[i]);
+    int j = i;
+    while (j > 0 && est[ic->order[j - 1]] > est[i]) {
+      ic->order[j] = ic->order[j - 1];
+      j--;
+    }
+    ic->order[j] = i;
+  }
+  free(est);
+}
+
 IndexIterator *NewIntersecIterator(IndexIterator **its, int num, DocTable *dt,
                                    t_fieldMask fieldMask, int maxSlop, int inOrder) {
 
@@ -265,8 +585,11 @@ IndexIterator *NewIntersecIterator(IndexIterator **its, int num, DocTable *dt,
   ctx->fieldMask = fieldMask;
   ctx->atEnd = 0;
   ctx->docIds = calloc(num, sizeof(t_docId));
+  ctx->rcs = calloc(num, sizeof(int));
+  ctx->order = calloc(num, sizeof(int));
   ctx->current = NewIntersectResult(num);
   ctx->docTable = dt;
+  ii_orderChildren(ctx);
 
   // bind the iterator calls
   IndexIterator *it = malloc(sizeof(IndexIterator));
@@ -277,6 +600,7 @@ IndexIterator *NewIntersecIterator(IndexIterator **its, int num, DocTable *dt,
   it->Current = II_Current;
   it->HasNext = II_HasNext;
   it->Len = II_Len;
+  it->NumEstimated = II_NumEstimated;
   it->Free = IntersectIterator_Free;
   return it;
 }
@@ -285,63 +609,114 @@ RSIndexResult *II_Current(void *ctx) {
   return ((IntersectContext *)ctx)->current;
 }
 
-int II_SkipTo(void *ctx, uint32_t docId, RSIndexResult **hit) {
+/* Position child i on docId or after it. Returns INDEXREAD_OK if it matched docId, INDEXREAD_EOF if
+ * the child is depleted, or INDEXREAD_NOTFOUND if it did not match, in which case docIds[i] is the
+ * lowest docId it can match next */
+static int ii_advanceChild(IntersectContext *ic, int i, t_docId docId, int drive) {
+  IndexIterator *it = ic->its[i];
+  if (!it) return INDEXREAD_EOF;
 
-  /* A seek with docId 0 is equivalent to a read */
-  if (docId == 0) {
-    return II_Read(ctx, hit);
+  // the child is already past docId, or on it
+  if (ic->docIds[i] > docId || (ic->docIds[i] == docId && ic->rcs[i] == INDEXREAD_OK)) {
+    return ic->docIds[i] == docId ? INDEXREAD_OK : INDEXREAD_NOTFOUND;
   }
-  IntersectContext *ic = ctx;
-  AggregateResult_Reset(ic->current);
-  int nfound = 0;
-
-  int rc = INDEXREAD_EOF;
-  // skip all iterators to docId
-  for (int i = 0; i < ic->num; i++) {
-    IndexIterator *it = ic->its[i];
 
-    if (!it || !it->HasNext(it->ctx)) return INDEXREAD_EOF;
+  RSIndexResult *h = NULL;
+  int rc;
+  // the driving child reads its next record if we are looking for the one after it, which saves
+  // skipping. Otherwise we skip to the requested docId
+  if (drive && ic->rcs[i] != INDEXREAD_NOTFOUND && ic->docIds[i] + 1 == docId) {
+    rc = it->Read(it->ctx, &h);
+  } else {
+    rc = it->SkipTo(it->ctx, docId, &h);
+  }
+  if (rc == INDEXREAD_EOF) return rc;
 
-    RSIndexResult *res = it->Current(it->ctx);
+  if (rc == INDEXREAD_OK) {
+    ic->docIds[i] = h->docId;
+  } else if (h && h->docId > docId) {
+    // the child skipped to its next record past docId, which is a match of its own
+    ic->docIds[i] = h->docId;
     rc = INDEXREAD_OK;
+  } else {
+    ic->docIds[i] = docId + 1;
+  }
+  ic->rcs[i] = rc;
+  return ic->docIds[i] == docId ? INDEXREAD_OK : INDEXREAD_NOTFOUND;
+}
 
-    // only read if we're not already at the final position
-    if (ic->docIds[i] != ic->lastDocId || ic->lastDocId == 0) {
-      rc = it->SkipTo(it->ctx, docId, &res);
-      if (rc != INDEXREAD_EOF) {
-        ic->docIds[i] = res->docId;
+/* Find the first docId not lower than docId that all the children match. The rarest child drives:
+ * it proposes a candidate, and the others skip to it. Whenever a child lands past the candidate,
+ * it becomes the new candidate, and the driver skips to it */
+static int ii_readFrom(IntersectContext *ic, t_docId docId, RSIndexResult **hit) {
+  if (ic->num == 0 || ic->atEnd) goto eof;
+
+  do {
+    for (int n = 0; n < ic->num;) {
+      int i = ic->order[n];
+      int rc = ii_advanceChild(ic, i, docId, n == 0);
+      if (rc == INDEXREAD_EOF) goto eof;
+      if (rc == INDEXREAD_OK) {
+        n++;
+        continue;
       }
+      // restart from the driver with the new candidate, unless the driver itself moved
+      docId = ic->docIds[i];
+      n = (n == 0 && ic->rcs[i] == INDEXREAD_OK) ? 1 : 0;
     }
 
-    if (rc == INDEXREAD_EOF) {
-      // we are at the end!
-      ic->atEnd = 1;
-      return rc;
-    } else if (rc == INDEXREAD_OK) {
-      // YAY! found!
-      AggregateResult_AddChild(ic->current, res);
-      ic->lastDocId = docId;
+    // all children match - aggregate their records in the query order
+    AggregateResult_Reset(ic->current);
+    for (int i = 0; i < ic->num; i++) {
+      AggregateResult_AddChild(ic->current, ic->its[i]->Current(ic->its[i]->ctx));
+    }
+    t_docId match = docId++;
 
-      ++nfound;
-    } else if (ic->docIds[i] > ic->lastDocId) {
-      ic->lastDocId = ic->docIds[i];
-      break;
+    // make sure the flags are matching.
+    if ((ic->current->fieldMask & ic->fieldMask) == 0) {
+      continue;
     }
-  }
 
-  if (nfound == ic->num) {
-    if (hit) {
+    // If we need to match slop and order, we do it now, and possibly skip the result
+    if (ic->maxSlop >= 0) {
+      if (!IndexResult_IsWithinRange(ic->current, ic->maxSlop, ic->inOrder)) {
+        continue;
+      }
+    }
+
+    ic->lastDocId = match;
+    ic->len++;
+    if (hit != NULL) {
       *hit = ic->current;
     }
     return INDEXREAD_OK;
+  } while (1);
+
+eof:
+  ic->atEnd = 1;
+  return INDEXREAD_EOF;
+}
+
+int II_SkipTo(void *ctx, uint32_t docId, RSIndexResult **hit) {
+
+  /* A seek with docId 0 is equivalent to a read */
+  if (docId == 0) {
+    return II_Read(ctx, hit);
   }
-  // we add the actual last doc id we read, so if anyone is looking at what we returned it would
-  // look sane
-  if (hit) {
-    (*hit)->docId = 0;  // ic->lastDocId;
+  IntersectContext *ic = ctx;
+
+  // if our current match is at or past docId, we don't need to move
+  if (!ic->lastDocId || ic->lastDocId < docId) {
+    if (ii_readFrom(ic, docId, NULL) == INDEXREAD_EOF) {
+      return INDEXREAD_EOF;
+    }
   }
 
-  return INDEXREAD_NOTFOUND;
+  // like other iterators, if we land past docId, we return the match we're positioned on
+  if (hit) {
+    *hit = ic->current;
+  }
+  return ic->lastDocId == docId ? INDEXREAD_OK : INDEXREAD_NOTFOUND;
 }
 
 int II_Next(void *ctx) {
@@ -349,87 +724,14 @@ int II_Next(void *ctx) {
 }
 
 int II_Read(void *ctx, RSIndexResult **hit) {
-  IntersectContext *ic = (IntersectContext *)ctx;
-
-  if (ic->num == 0) return INDEXREAD_EOF;
-  AggregateResult_Reset(ic->current);
-
-  int nh = 0;
-  int i = 0;
-
-  do {
-
-    nh = 0;
-    AggregateResult_Reset(ic->current);
-
-    for (i = 0; i < ic->num; i++) {
-      IndexIterator *it = ic->its[i];
-
-      if (!it) goto eof;
-
-      RSIndexResult *h = it->Current(it->ctx);
-      // skip to the next
-      int rc = INDEXREAD_OK;
-      if (ic->docIds[i] != ic->lastDocId || ic->lastDocId == 0) {
-
-        if (i == 0 && ic->docIds[i] >= ic->lastDocId) {
-          rc = it->Read(it->ctx, &h);
-        } else {
-          rc = it->SkipTo(it->ctx, ic->lastDocId, &h);
-        }
-        // printf("II %p last docId %d, it %d read docId %d(%d), rc %d\n", ic, ic->lastDocId, i,
-        //        h->docId, it->LastDocId(it->ctx), rc);
-
-        if (rc == INDEXREAD_EOF) goto eof;
-        ic->docIds[i] = h->docId;
-      }
-
-      if (ic->docIds[i] > ic->lastDocId) {
-        ic->lastDocId = ic->docIds[i];
-        break;
-      }
-      if (rc == INDEXREAD_OK) {
-        ++nh;
-        AggregateResult_AddChild(ic->current, h);
-      } else {
-        ic->lastDocId++;
-      }
-    }
-
-    if (nh == ic->num) {
-      // printf("II %p HIT @ %d\n", ic, ic->current->docId);
-      // sum up all hits
-      if (hit != NULL) {
-        *hit = ic->current;
-      }
-      // advance the doc id so next time we'll read a new record
-      ic->lastDocId++;
-
-      // // make sure the flags are matching.
-      if ((ic->current->fieldMask & ic->fieldMask) == 0) {
-        continue;
-      }
-
-      // If we need to match slop and order, we do it now, and possibly skip the result
-      if (ic->maxSlop >= 0) {
-        if (!IndexResult_IsWithinRange(ic->current, ic->maxSlop, ic->inOrder)) {
-          continue;
-        }
-      }
-
-      ic->len++;
-      return INDEXREAD_OK;
-    }
-  } while (1);
-eof:
-  ic->atEnd = 1;
-  return INDEXREAD_EOF;
+  IntersectContext *ic = ctx;
+  return ii_readFrom(ic, ic->lastDocId + 1, hit);
 }
 
 int II_HasNext(void *ctx) {
   IntersectContext *ic = ctx;
   // printf("%p %d\n", ic, ic->atEnd);
-  return ic->atEnd;
+  return !ic->atEnd;
 }
 
 t_docId II_LastDocId(void *ctx) {
@@ -440,6 +742,12 @@ size_t II_Len(void *ctx) {
   return ((IntersectContext *)ctx)->len;
 }
 
+/* An intersection yields at most as many results as its rarest child */
+size_t II_NumEstimated(void *ctx) {
+  IntersectContext *ic = ctx;
+  return ic->num ? ii_childEstimate(ic->its[ic->order[0]]) : 0;
+}
+
 void NI_Free(IndexIterator *it) {
 
   NotContext *nc = it->ctx;
@@ -511,6 +819,11 @@ size_t NI_Len(void *ctx) {
   return nc->child ? nc->child->Len(nc->child->ctx) : 0;
 }
 
+/* A NOT iterator matches anything its child doesn't, so we can't tell how many results it has */
+size_t NI_NumEstimated(void *ctx) {
+  return SIZE_MAX;
+}
+
 /* Last docId */
 t_docId NI_LastDocId(void *ctx) {
   NotContext *nc = ctx;
@@ -533,6 +846,7 @@ IndexIterator *NewNotIterator(IndexIterator *it) {
   ret->HasNext = NI_HasNext;
   ret->LastDocId = NI_LastDocId;
   ret->Len = NI_Len;
+  ret->NumEstimated = NI_NumEstimated;
   ret->Read = NI_Read;
   ret->SkipTo = NI_SkipTo;
   return ret;
@@ -618,6 +932,11 @@ size_t OI_Len(void *ctx) {
   return nc->child ? nc->child->Len(nc->child->ctx) : 0;
 }
 
+/* An optional iterator matches every document */
+size_t OI_NumEstimated(void *ctx) {
+  return SIZE_MAX;
+}
+
 /* Last docId */
 t_docId OI_LastDocId(void *ctx) {
   OptionalMatchContext *nc = ctx;
@@ -641,7 +960,93 @@ IndexIterator *NewOptionalIterator(IndexIterator *it) {
   ret->HasNext = OI_HasNext;
   ret->LastDocId = OI_LastDocId;
   ret->Len = OI_Len;
+  ret->NumEstimated = OI_NumEstimated;
   ret->Read = OI_Read;
   ret->SkipTo = OI_SkipTo;
   return ret;
 }
+
+/**********************************************************
+ * DocId range iterator
+ **********************************************************/
+
+void RI_Free(IndexIterator *it) {
+  DocIdRangeContext *rc = it->ctx;
+  IndexResult_Free(rc->current);
+  free(it->ctx);
+  free(it);
+}
+
+/* Every docId in the range matches, so we land on docId itself, or on the start of the range */
+int RI_SkipTo(void *ctx, uint32_t docId, RSIndexResult **hit) {
+  DocIdRangeContext *rc = ctx;
+  if (rc->atEnd || docId > rc->to) {
+    rc->atEnd = 1;
+    return INDEXREAD_EOF;
+  }
+
+  rc->lastDocId = rc->current->docId = MAX(docId, rc->from);
+  rc->len++;
+  if (hit) {
+    *hit = rc->current;
+  }
+  return rc->lastDocId == docId ? INDEXREAD_OK : INDEXREAD_NOTFOUND;
+}
+
+int RI_Read(void *ctx, RSIndexResult **hit) {
+  DocIdRangeContext *rc = ctx;
+  if (rc->atEnd || rc->lastDocId == rc->to) {
+    rc->atEnd = 1;
+    return INDEXREAD_EOF;
+  }
+  rc->lastDocId = rc->current->docId = rc->lastDocId ? rc->lastDocId + 1 : rc->from;
+  rc->len++;
+  if (hit) {
+    *hit = rc->current;
+  }
+  return INDEXREAD_OK;
+}
+
+int RI_HasNext(void *ctx) {
+  return !((DocIdRangeContext *)ctx)->atEnd;
+}
+
+RSIndexResult *RI_Current(void *ctx) {
+  return ((DocIdRangeContext *)ctx)->current;
+}
+
+size_t RI_Len(void *ctx) {
+  return ((DocIdRangeContext *)ctx)->len;
+}
+
+size_t RI_NumEstimated(void *ctx) {
+  DocIdRangeContext *rc = ctx;
+  return rc->to - rc->from + 1;
+}
+
+t_docId RI_LastDocId(void *ctx) {
+  return ((DocIdRangeContext *)ctx)->lastDocId;
+}
+
+IndexIterator *NewDocIdRangeIterator(t_docId from, t_docId to) {
+  DocIdRangeContext *rc = malloc(sizeof(*rc));
+  rc->from = MAX(from, 1);
+  rc->to = to;
+  rc->lastDocId = 0;
+  rc->len = 0;
+  rc->atEnd = rc->from > to;
+  rc->current = NewVirtualResult();
+  rc->current->fieldMask = RS_FIELDMASK_ALL;
+
+  IndexIterator *ret = malloc(sizeof(*ret));
+  ret->ctx = rc;
+  ret->Current = RI_Current;
+  ret->Free = RI_Free;
+  ret->HasNext = RI_HasNext;
+  ret->LastDocId = RI_LastDocId;
+  ret->Len = RI_Len;
+  ret->NumEstimated = RI_NumEstimated;
+  ret->Read = RI_Read;
+  ret->SkipTo = RI_SkipTo;
+  return ret;
+}
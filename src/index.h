@@ -6,6 +6,7 @@
 #include "index_result.h"
 #include "index_iterator.h"
 #include "redisearch.h"
+#include "util/heap.h"
 #include "util/logging.h"
 #include "varint.h"
 #include <ctype.h>
@@ -44,8 +45,30 @@ typedef struct {
   int atEnd;
   // If set to 1, we exit skips after the first hit found and not merge further results
   int quickExit;
+
+  // Unions of more than UNION_HEAP_THRESHOLD children keep them in a min heap of their docIds,
+  // instead of scanning all of them on every read. Children taken out of the heap, either because
+  // they are part of the current result or because their position is unknown, are kept in
+  // pending until the next read or skip advances them
+  heap_t *heap;
+  int *pending;
+  int numPending;
+
+  // MaxScore pruning, see UI_EnableMaxScore. The children are ordered by the upper bound of their
+  // score contribution. The lowest ones, whose bounds add up to less than *minScore, are
+  // non-essential - they are taken out of the heap and only skipped to the candidates of the others
+  const double *minScore;
+  double *bounds;
+  int *order;
+  int numOrdered;
+  int *nonEssential;
+  int numNonEssential;
+  double nonEssentialBound;
+  int *matched;
 } UnionContext;
 
+#define UNION_HEAP_THRESHOLD 4
+
 /* Create a new UnionIterator over a list of underlying child iterators.
 It will return each document of the underlying iterators, exactly once */
 IndexIterator *NewUnionIterator(IndexIterator **its, int num, DocTable *t, int quickExit);
@@ -55,12 +78,23 @@ int UI_Next(void *ctx);
 int UI_Read(void *ctx, RSIndexResult **hit);
 int UI_HasNext(void *ctx);
 size_t UI_Len(void *ctx);
+size_t UI_NumEstimated(void *ctx);
 t_docId UI_LastDocId(void *ctx);
 
+/* Let a union of term readers skip documents that cannot score at least *minScore with TF-IDF,
+using the max frequencies of the index blocks. minScore must only grow while the union is read, and
+the union must not have been read yet. Returns 1 if pruning was enabled, 0 if the iterator does not
+support it */
+int UI_EnableMaxScore(IndexIterator *it, const double *minScore);
+
 /* The context used by the intersection methods during iterating an intersect
  * iterator */
 typedef struct {
   IndexIterator **its;
+  // the positions of the children in its, ordered by their estimated number of results
+  int *order;
+  // the docId each child is positioned on, and whether it matched it (INDEXREAD_OK) or its next
+  // match is merely known to be no lower (INDEXREAD_NOTFOUND)
   t_docId *docIds;
   int *rcs;
   RSIndexResult *current;
@@ -89,6 +123,7 @@ int II_Read(void *ctx, RSIndexResult **hit);
 int II_HasNext(void *ctx);
 RSIndexResult *II_Current(void *ctx);
 size_t II_Len(void *ctx);
+size_t II_NumEstimated(void *ctx);
 t_docId II_LastDocId(void *ctx);
 
 /* A Not iterator works by wrapping another iterator, and returning OK for misses, and NOTFOUND for
@@ -114,4 +149,17 @@ typedef struct {
 /* Create a NOT iterator by wrapping another index iterator */
 IndexIterator *NewOptionalIterator(IndexIterator *it);
 
+typedef struct {
+  t_docId from;
+  t_docId to;
+  t_docId lastDocId;
+  RSIndexResult *current;
+  size_t len;
+  int atEnd;
+} DocIdRangeContext;
+
+/* Create an iterator matching every docId between from and to, inclusive. Intersecting a query with
+ * it limits the query to a range of docIds, which lets us split its execution between threads */
+IndexIterator *NewDocIdRangeIterator(t_docId from, t_docId to);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,421 @@
+#include "inverted_index.h"
+#include "qint.h"
+#include "rmalloc.h"
+#include <sys/param.h>
+
+/* Grow the buffer by len zeroed bytes past its offset */
+static void codec_extend(Buffer *b, size_t len) {
+  static char zeros[64] = {0};
+  BufferWriter bw = NewBufferWriter(b);
+  while (len) {
+    size_t n = MIN(len, sizeof(zeros));
+    Buffer_Write(&bw, zeros, n);
+    len -= n;
+  }
+}
+
+/******************************************************************************************
+ * QInt codec - every record is a qint encoded docId delta, frequency, and the field mask and
+ * offset vector size if the index stores them. The offset vector itself follows the record
+ ******************************************************************************************/
+
+static int qintCodec_HasRoom(IndexBlock *blk, t_docId docId, uint16_t maxDocs) {
+  return blk->numDocs < maxDocs;
+}
+
+static size_t qintCodec_Encode(IndexBlock *blk, IndexFlags flags, t_docId docId, uint32_t freq,
+                               t_fieldMask fieldMask, RSOffsetVector *offsets) {
+  BufferWriter bw = NewBufferWriter(&blk->data);
+  // the first record of a block is encoded as is
+  uint32_t delta = docId - (blk->numDocs ? blk->lastId : 0);
+  uint32_t offsetsSz = offsets ? offsets->len : 0;
+
+  size_t sz = 0;
+  switch (flags & (Index_StoreFieldFlags | Index_StoreTermOffsets)) {
+    // Full encoding - docId, freq, flags, offset
+    case Index_StoreTermOffsets | Index_StoreFieldFlags:
+      sz = qint_encode4(&bw, delta, freq, (uint32_t)fieldMask, offsetsSz);
+      sz += Buffer_Write(&bw, offsets->data, offsetsSz);
+      break;
+
+    // Store term offsets but not field flags
+    case Index_StoreTermOffsets:
+      sz = qint_encode3(&bw, delta, freq, offsetsSz);
+      sz += Buffer_Write(&bw, offsets->data, offsetsSz);
+      break;
+
+    // Store field mask but not term offsets
+    case Index_StoreFieldFlags:
+      sz = qint_encode3(&bw, delta, freq, (uint32_t)fieldMask);
+      break;
+
+    // Store neither -we store just freq and docId
+    default:
+      sz = qint_encode2(&bw, delta, freq);
+      break;
+  }
+  return sz;
+}
+
+static uint32_t qintCodec_Decode(IndexBlock *blk, IndexFlags flags, uint32_t *out,
+                                 uint32_t *offsetsPos) {
+  BufferReader br = NewBufferReader(&blk->data);
+  uint32_t n = 0;
+
+  switch (flags & (Index_StoreFieldFlags | Index_StoreTermOffsets)) {
+    case Index_StoreTermOffsets | Index_StoreFieldFlags:
+      n = qint_decode_block(&br, out, 4, 3, offsetsPos, blk->numDocs);
+      break;
+
+    // records are docId, freq, offsetsSz - move the offsets size to its slot
+    case Index_StoreTermOffsets:
+      n = qint_decode_block(&br, out, 3, 2, offsetsPos, blk->numDocs);
+      for (uint32_t i = 0; i < n; i++) {
+        out[i * 4 + 3] = out[i * 4 + 2];
+        out[i * 4 + 2] = RS_FIELDMASK_ALL;
+      }
+      break;
+
+    case Index_StoreFieldFlags:
+      n = qint_decode_block(&br, out, 3, -1, NULL, blk->numDocs);
+      for (uint32_t i = 0; i < n; i++) {
+        out[i * 4 + 3] = 0;
+      }
+      break;
+
+    default:
+      n = qint_decode_block(&br, out, 2, -1, NULL, blk->numDocs);
+      for (uint32_t i = 0; i < n; i++) {
+        out[i * 4 + 2] = RS_FIELDMASK_ALL;
+        out[i * 4 + 3] = 0;
+      }
+      break;
+  }
+
+  // turn the deltas into absolute docIds
+  t_docId lastId = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    lastId = out[i * 4] += lastId;
+  }
+  return n;
+}
+
+/******************************************************************************************
+ * Frame of reference codec - the block starts with the bit widths of the docId delta, frequency
+ * and field mask, followed by the records bit packed with these widths. The first docId delta is
+ * relative to the block's firstId. Appending a record that does not fit the widths repacks the
+ * block with wider fields, which is cheap given the block size.
+ ******************************************************************************************/
+
+#define FOR_HEADER_SIZE 3
+
+static inline uint8_t for_bits(uint32_t v) {
+  return v ? 32 - __builtin_clz(v) : 0;
+}
+
+/* Read a value of the given width at a bit position of the packed data */
+static inline uint32_t for_read(const char *data, size_t len, size_t bitpos, uint8_t bits) {
+  if (!bits) return 0;
+  size_t pos = bitpos >> 3;
+  uint64_t w = 0;
+  memcpy(&w, data + pos, MIN(8, len - pos));
+  return (w >> (bitpos & 7)) & ((1ULL << bits) - 1);
+}
+
+/* Write a value of the given width at a bit position of the packed data. The bits must be zero */
+static inline void for_write(char *data, size_t len, size_t bitpos, uint8_t bits, uint32_t v) {
+  if (!bits) return;
+  size_t pos = bitpos >> 3, n = MIN(8, len - pos);
+  uint64_t w = 0;
+  memcpy(&w, data + pos, n);
+  w |= (uint64_t)v << (bitpos & 7);
+  memcpy(data + pos, &w, n);
+}
+
+#define for_recordBits(widths) ((size_t)(widths)[0] + (widths)[1] + (widths)[2])
+#define for_dataSize(widths, n) (FOR_HEADER_SIZE + ((n)*for_recordBits(widths) + 7) / 8)
+
+/* Pack the nfields values of record i into packed data with room for it */
+static void for_pack(char *data, size_t len, const uint8_t *widths, int nfields, uint32_t i,
+                     const uint32_t *vals) {
+  size_t recBits = 0;
+  for (int f = 0; f < nfields; f++) recBits += widths[f];
+  size_t bitpos = i * recBits;
+  for (int f = 0; f < nfields; f++) {
+    for_write(data, len, bitpos, widths[f], vals[f]);
+    bitpos += widths[f];
+  }
+}
+
+static void for_unpack(const char *data, size_t len, const uint8_t *widths, int nfields,
+                       uint32_t i, uint32_t *vals) {
+  size_t recBits = 0;
+  for (int f = 0; f < nfields; f++) recBits += widths[f];
+  size_t bitpos = i * recBits;
+  for (int f = 0; f < nfields; f++) {
+    vals[f] = for_read(data, len, bitpos, widths[f]);
+    bitpos += widths[f];
+  }
+}
+
+/* Append a record to packed data with room for it */
+static void for_writeRecord(Buffer *b, const uint8_t *widths, uint32_t i, const uint32_t *vals) {
+  for_pack(b->data + FOR_HEADER_SIZE, b->offset - FOR_HEADER_SIZE, widths, 3, i, vals);
+}
+
+static void for_readRecord(Buffer *b, const uint8_t *widths, uint32_t i, uint32_t *vals) {
+  for_unpack(b->data + FOR_HEADER_SIZE, b->offset - FOR_HEADER_SIZE, widths, 3, i, vals);
+}
+
+static int forCodec_HasRoom(IndexBlock *blk, t_docId docId, uint16_t maxDocs) {
+  return blk->numDocs < maxDocs;
+}
+
+static size_t forCodec_Encode(IndexBlock *blk, IndexFlags flags, t_docId docId, uint32_t freq,
+                              t_fieldMask fieldMask, RSOffsetVector *offsets) {
+  Buffer *b = &blk->data;
+  size_t sz = b->offset;
+  uint32_t n = blk->numDocs;
+  uint32_t rec[3] = {docId - (n ? blk->lastId : blk->firstId), freq,
+                     flags & Index_StoreFieldFlags ? (uint32_t)fieldMask : 0};
+
+  uint8_t widths[3] = {0, 0, 0};
+  if (n) memcpy(widths, b->data, FOR_HEADER_SIZE);
+
+  uint8_t newWidths[3];
+  for (int f = 0; f < 3; f++) {
+    newWidths[f] = MAX(widths[f], for_bits(rec[f]));
+  }
+
+  if (!n || memcmp(widths, newWidths, FOR_HEADER_SIZE)) {
+    // repack the existing records with the new widths
+    uint32_t *vals = rm_malloc(3 * (n + 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < n; i++) {
+      for_readRecord(b, widths, i, &vals[i * 3]);
+    }
+    memcpy(&vals[n * 3], rec, sizeof(rec));
+
+    b->offset = 0;
+    codec_extend(b, for_dataSize(newWidths, n + 1));
+    memcpy(b->data, newWidths, FOR_HEADER_SIZE);
+    for (uint32_t i = 0; i <= n; i++) {
+      for_writeRecord(b, newWidths, i, &vals[i * 3]);
+    }
+    rm_free(vals);
+  } else {
+    codec_extend(b, for_dataSize(widths, n + 1) - b->offset);
+    for_writeRecord(b, widths, n, rec);
+  }
+
+  return b->offset - sz;
+}
+
+static uint32_t forCodec_Decode(IndexBlock *blk, IndexFlags flags, uint32_t *out,
+                                uint32_t *offsetsPos) {
+  if (!blk->numDocs) return 0;
+
+  uint8_t widths[FOR_HEADER_SIZE];
+  memcpy(widths, blk->data.data, FOR_HEADER_SIZE);
+  int hasFields = flags & Index_StoreFieldFlags;
+
+  t_docId docId = blk->firstId;
+  for (uint32_t i = 0; i < blk->numDocs; i++) {
+    uint32_t *rec = &out[i * 4];
+    for_readRecord(&blk->data, widths, i, rec);
+    rec[0] = docId += rec[0];
+    if (!hasFields) rec[2] = RS_FIELDMASK_ALL;
+    rec[3] = 0;
+  }
+  return blk->numDocs;
+}
+
+/******************************************************************************************
+ * Bitmap codec - a frame of reference codec that stores the docIds of dense blocks as a bitmap
+ * relative to the block's firstId, instead of packed deltas. Every block starts with its kind and
+ * the widths of the docId delta, frequency and field mask. Packed blocks are laid out like FOR
+ * blocks. Bitmap blocks hold the bitmap of their docId span, followed by the frequencies and field
+ * masks of the records, packed in docId order.
+ *
+ * A block is a bitmap while the bits of its span are no more than its packed deltas would take,
+ * and the span is at most BITMAP_BLOCK_SPAN. Dense bitmap blocks may grow past the record limit of
+ * the index, while sparse blocks, such as those of rare terms, stay packed
+ ******************************************************************************************/
+
+#define BITMAP_BLOCK_SPAN 4096
+#define BITMAP_HEADER_SIZE (1 + FOR_HEADER_SIZE)
+
+typedef enum { BitmapBlock_Packed = 0, BitmapBlock_Bitmap = 1 } BitmapBlockKind;
+
+/* Is a block of n records over a span of docIds, with the given docId delta width, a bitmap */
+static inline int bitmap_isDense(t_docId span, uint32_t n, uint8_t deltaBits) {
+  return span <= BITMAP_BLOCK_SPAN && span <= (size_t)n * deltaBits;
+}
+
+/* The size of the bitmap of a block whose docIds span from firstId to lastId */
+#define bitmap_size(firstId, lastId) (((lastId) - (firstId)) / 8 + 1)
+
+/* Lay the n decoded records of a block out anew, with the given kind and widths */
+static void bitmap_rewrite(IndexBlock *blk, BitmapBlockKind kind, const uint8_t *widths,
+                           const uint32_t *recs, uint32_t n, int hasFields) {
+  Buffer *b = &blk->data;
+  size_t bmSize = kind == BitmapBlock_Bitmap ? bitmap_size(blk->firstId, recs[(n - 1) * 4]) : 0;
+  size_t recBits = kind == BitmapBlock_Bitmap ? widths[1] + widths[2] : for_recordBits(widths);
+
+  b->offset = 0;
+  codec_extend(b, BITMAP_HEADER_SIZE + bmSize + (n * recBits + 7) / 8);
+  b->data[0] = kind;
+  memcpy(b->data + 1, widths, FOR_HEADER_SIZE);
+
+  char *data = b->data + BITMAP_HEADER_SIZE;
+  size_t len = b->offset - BITMAP_HEADER_SIZE;
+  t_docId lastId = blk->firstId;
+  for (uint32_t i = 0; i < n; i++) {
+    const uint32_t *rec = &recs[i * 4];
+    uint32_t vals[3] = {rec[0] - lastId, rec[1], hasFields ? rec[2] : 0};
+    lastId = rec[0];
+    if (kind == BitmapBlock_Bitmap) {
+      uint32_t bit = rec[0] - blk->firstId;
+      data[bit / 8] |= 1 << (bit % 8);
+      for_pack(data + bmSize, len - bmSize, widths + 1, 2, i, vals + 1);
+    } else {
+      for_pack(data, len, widths, 3, i, vals);
+    }
+  }
+}
+
+static int bitmapCodec_HasRoom(IndexBlock *blk, t_docId docId, uint16_t maxDocs) {
+  if (!blk->numDocs) return 1;
+
+  uint8_t deltaBits = MAX((uint8_t)blk->data.data[1], for_bits(docId - blk->lastId));
+  int dense = bitmap_isDense(docId - blk->firstId + 1, blk->numDocs + 1, deltaBits);
+  // a bitmap block ends where it stops being dense, a packed one may become a bitmap
+  if (blk->data.data[0] == BitmapBlock_Bitmap) {
+    return dense;
+  }
+  return blk->numDocs < maxDocs || dense;
+}
+
+static uint32_t bitmapCodec_Decode(IndexBlock *blk, IndexFlags flags, uint32_t *out,
+                                   uint32_t *offsetsPos);
+
+static size_t bitmapCodec_Encode(IndexBlock *blk, IndexFlags flags, t_docId docId, uint32_t freq,
+                                 t_fieldMask fieldMask, RSOffsetVector *offsets) {
+  Buffer *b = &blk->data;
+  size_t sz = b->offset;
+  uint32_t n = blk->numDocs;
+  int hasFields = flags & Index_StoreFieldFlags;
+  uint32_t rec[3] = {docId - (n ? blk->lastId : blk->firstId), freq,
+                     hasFields ? (uint32_t)fieldMask : 0};
+
+  BitmapBlockKind kind = BitmapBlock_Packed;
+  uint8_t widths[3] = {0, 0, 0};
+  if (n) {
+    kind = b->data[0];
+    memcpy(widths, b->data + 1, FOR_HEADER_SIZE);
+  }
+
+  uint8_t newWidths[3];
+  for (int f = 0; f < 3; f++) {
+    newWidths[f] = MAX(widths[f], for_bits(rec[f]));
+  }
+  BitmapBlockKind newKind = bitmap_isDense(docId - blk->firstId + 1, n + 1, newWidths[0])
+                                ? BitmapBlock_Bitmap
+                                : BitmapBlock_Packed;
+
+  // bitmap blocks keep the delta width only to tell their density, it does not affect the layout
+  if (!n || kind != newKind || widths[1] != newWidths[1] || widths[2] != newWidths[2] ||
+      (kind == BitmapBlock_Packed && widths[0] != newWidths[0])) {
+    // lay out the existing records and the new one anew
+    uint32_t *recs = rm_malloc(4 * (n + 1) * sizeof(uint32_t));
+    bitmapCodec_Decode(blk, flags, recs, NULL);
+    recs[n * 4] = docId;
+    recs[n * 4 + 1] = freq;
+    recs[n * 4 + 2] = rec[2];
+    bitmap_rewrite(blk, newKind, newWidths, recs, n + 1, hasFields);
+    rm_free(recs);
+    return b->offset - sz;
+  }
+
+  b->data[1] = newWidths[0];
+  if (kind == BitmapBlock_Packed) {
+    codec_extend(b, BITMAP_HEADER_SIZE + ((n + 1) * for_recordBits(widths) + 7) / 8 - b->offset);
+    for_pack(b->data + BITMAP_HEADER_SIZE, b->offset - BITMAP_HEADER_SIZE, widths, 3, n, rec);
+    return b->offset - sz;
+  }
+
+  // grow the bitmap to the new docId, moving the packed records after it
+  size_t recBits = widths[1] + widths[2];
+  size_t bmSize = bitmap_size(blk->firstId, blk->lastId);
+  size_t newBmSize = bitmap_size(blk->firstId, docId);
+  size_t recsSize = (n * recBits + 7) / 8;
+  codec_extend(b, BITMAP_HEADER_SIZE + newBmSize + ((n + 1) * recBits + 7) / 8 - b->offset);
+
+  char *data = b->data + BITMAP_HEADER_SIZE;
+  if (newBmSize > bmSize) {
+    memmove(data + newBmSize, data + bmSize, recsSize);
+    memset(data + bmSize, 0, newBmSize - bmSize);
+  }
+  uint32_t bit = docId - blk->firstId;
+  data[bit / 8] |= 1 << (bit % 8);
+  for_pack(data + newBmSize, b->offset - BITMAP_HEADER_SIZE - newBmSize, widths + 1, 2, n, rec + 1);
+  return b->offset - sz;
+}
+
+static uint32_t bitmapCodec_Decode(IndexBlock *blk, IndexFlags flags, uint32_t *out,
+                                   uint32_t *offsetsPos) {
+  if (!blk->numDocs) return 0;
+
+  uint8_t widths[3];
+  memcpy(widths, blk->data.data + 1, FOR_HEADER_SIZE);
+  const char *data = blk->data.data + BITMAP_HEADER_SIZE;
+  size_t len = blk->data.offset - BITMAP_HEADER_SIZE;
+  int hasFields = flags & Index_StoreFieldFlags;
+
+  if (blk->data.data[0] == BitmapBlock_Packed) {
+    t_docId docId = blk->firstId;
+    for (uint32_t i = 0; i < blk->numDocs; i++) {
+      uint32_t *rec = &out[i * 4];
+      for_unpack(data, len, widths, 3, i, rec);
+      rec[0] = docId += rec[0];
+      if (!hasFields) rec[2] = RS_FIELDMASK_ALL;
+      rec[3] = 0;
+    }
+    return blk->numDocs;
+  }
+
+  size_t bmSize = bitmap_size(blk->firstId, blk->lastId);
+  uint32_t n = 0;
+  for (size_t pos = 0; pos < bmSize; pos += 8) {
+    uint64_t w = 0;
+    memcpy(&w, data + pos, MIN(8, bmSize - pos));
+    while (w) {
+      uint32_t *rec = &out[n * 4];
+      rec[0] = blk->firstId + pos * 8 + __builtin_ctzll(w);
+      for_unpack(data + bmSize, len - bmSize, widths + 1, 2, n, rec + 1);
+      if (!hasFields) rec[2] = RS_FIELDMASK_ALL;
+      rec[3] = 0;
+      n++;
+      w &= w - 1;
+    }
+  }
+  return n;
+}
+
+static IndexCodec codecs[] = {
+        [Codec_QInt] = {.HasRoom = qintCodec_HasRoom,
+                        .Encode = qintCodec_Encode,
+                        .Decode = qintCodec_Decode},
+        [Codec_FOR] = {.HasRoom = forCodec_HasRoom,
+                       .Encode = forCodec_Encode,
+                       .Decode = forCodec_Decode},
+        [Codec_Bitmap] = {.HasRoom = bitmapCodec_HasRoom,
+                          .Encode = bitmapCodec_Encode,
+                          .Decode = bitmapCodec_Decode},
+};
+
+IndexCodec *IndexCodec_Get(IndexCodecType type) {
+  if (type >= sizeof(codecs) / sizeof(*codecs)) {
+    return NULL;
+  }
+  return &codecs[type];
+}
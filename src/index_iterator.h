@@ -37,6 +37,10 @@ typedef struct indexIterator {
   /* Return the number of results in this iterator. Used by the query execution
    * on the top iterator */
   size_t (*Len)(void *ctx);
+
+  /* Return an estimate of the number of results the iterator will yield, without reading it. Used
+   * to plan the order in which intersections advance their children */
+  size_t (*NumEstimated)(void *ctx);
 } IndexIterator;
 
 #endif
\ No newline at end of file
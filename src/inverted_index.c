@@ -4,25 +4,33 @@
 #include <stdio.h>
 #include "rmalloc.h"
 #include "qint.h"
+#include <sys/param.h>
 
-#define INDEX_BLOCK_SIZE 100
 #define INDEX_BLOCK_INITIAL_CAP 2
 
 #define INDEX_LAST_BLOCK(idx) (idx->blocks[idx->size - 1])
-#define IR_CURRENT_BLOCK(ir) (ir->idx->blocks[ir->currentBlock])
-
-size_t readEntry(BufferReader *__restrict__ br, IndexFlags idxflags, RSIndexResult *res,
-                 int singleWordMode);
-
-size_t writeEntry(BufferWriter *bw, IndexFlags idxflags, t_docId docId, t_fieldMask fieldMask,
-                  uint32_t freq, uint32_t offsetsSz, RSOffsetVector *offsets);
+#define IR_CURRENT_BLOCK(ir) (ir->blocks[ir->currentBlock])
 
 void InvertedIndex_AddBlock(InvertedIndex *idx, t_docId firstId) {
 
   idx->size++;
   idx->blocks = rm_realloc(idx->blocks, idx->size * sizeof(IndexBlock));
-  idx->blocks[idx->size - 1] = (IndexBlock){.firstId = firstId, .lastId = 0, .numDocs = 0};
-  INDEX_LAST_BLOCK(idx).data = NewBuffer(INDEX_BLOCK_INITIAL_CAP);
+  idx->blocks[idx->size - 1] =
+      (IndexBlock){.firstId = firstId, .lastId = 0, .numDocs = 0, .maxFreq = 0};
+  Buffer_Init(&INDEX_LAST_BLOCK(idx).data, INDEX_BLOCK_INITIAL_CAP);
+}
+
+/* Trim the capacity of a block's buffer to its size. Called when a block becomes read only */
+static void indexBlock_Seal(IndexBlock *blk) {
+  if (blk->data.offset && blk->data.offset < blk->data.cap) {
+    Buffer_Truncate(&blk->data, 0);
+  }
+}
+
+/* The record limit of a new block of the index */
+static uint16_t invertedIndex_blockSize(InvertedIndex *idx) {
+  uint32_t sz = idx->numDocs / INDEX_BLOCK_GROWTH;
+  return MAX(INDEX_BLOCK_SIZE, MIN(sz, INDEX_BLOCK_SIZE_MAX));
 }
 
 InvertedIndex *NewInvertedIndex(IndexFlags flags, int initBlock) {
@@ -32,6 +40,8 @@ InvertedIndex *NewInvertedIndex(IndexFlags flags, int initBlock) {
   idx->lastId = 0;
   idx->flags = flags;
   idx->numDocs = 0;
+  idx->codec = IndexCodec_Get(IndexFlags_Codec(flags));
+  idx->snapshotEpoch = 0;
   if (initBlock) {
     InvertedIndex_AddBlock(idx, 0);
   }
@@ -39,11 +49,10 @@ InvertedIndex *NewInvertedIndex(IndexFlags flags, int initBlock) {
 }
 
 void indexBlock_Free(IndexBlock *blk) {
-  Buffer_Free(blk->data);
-  free(blk->data);
+  Buffer_Free(&blk->data);
 }
 
-void InvertedIndex_Free(void *ctx) {
+static void invertedIndex_free(void *ctx) {
   InvertedIndex *idx = ctx;
   for (uint32_t i = 0; i < idx->size; i++) {
     indexBlock_Free(&idx->blocks[i]);
@@ -52,33 +61,40 @@ void InvertedIndex_Free(void *ctx) {
   rm_free(idx);
 }
 
-size_t writeEntry(BufferWriter *bw, IndexFlags idxflags, t_docId docId, t_fieldMask fieldMask,
-                  uint32_t freq, uint32_t offsetsSz, RSOffsetVector *offsets) {
-  size_t sz = 0;
-  switch (idxflags & (Index_StoreFieldFlags | Index_StoreTermOffsets)) {
-    // Full encoding - docId, freq, flags, offset
-    case Index_StoreTermOffsets | Index_StoreFieldFlags:
-      sz = qint_encode4(bw, docId, (uint32_t)freq, (uint32_t)fieldMask, (uint32_t)offsetsSz);
-      sz += Buffer_Write(bw, offsets->data, offsetsSz);
-      break;
+void InvertedIndex_Free(void *ctx) {
+  // readers may still hold snapshots of the index
+  Epoch_Retire(ctx, invertedIndex_free);
+}
 
-    // Store term offsets but not field flags
-    case Index_StoreTermOffsets:
-      sz = qint_encode3(bw, docId, (uint32_t)freq, (uint32_t)offsetsSz);
-      sz += Buffer_Write(bw, offsets->data, offsetsSz);
-      break;
+/* Make sure no snapshot a reader may still use sees the changes we're about to make. The blocks
+ * other than the last one are only replaced and never changed in place, so the snapshot keeps the
+ * old block array and the data of the last block, and we continue with copies of them */
+static void invertedIndex_unshare(InvertedIndex *idx) {
+  if (!Epoch_InUse(idx->snapshotEpoch)) {
+    idx->snapshotEpoch = 0;
+    return;
+  }
 
-    // Store field mask but not term offsets
-    case Index_StoreFieldFlags:
-      sz = qint_encode3(bw, docId, (uint32_t)freq, (uint32_t)fieldMask);
-      break;
-    // Store neither -we store just freq and docId
-    default:
-      sz = qint_encode2(bw, docId, (uint32_t)freq);
-      break;
+  IndexBlock *blocks = rm_malloc(idx->size * sizeof(IndexBlock));
+  memcpy(blocks, idx->blocks, idx->size * sizeof(IndexBlock));
+  if (idx->size) {
+    Buffer *b = &blocks[idx->size - 1].data;
+    char *data = rm_malloc(b->cap);
+    memcpy(data, b->data, b->offset);
+    Epoch_RetireMem(b->data);
+    b->data = data;
   }
+  Epoch_RetireMem(idx->blocks);
+  idx->blocks = blocks;
+  idx->snapshotEpoch = 0;
+}
 
-  return sz;
+size_t InvertedIndex_BlocksMemUsage(InvertedIndex *idx, uint32_t fromBlock) {
+  size_t ret = 0;
+  for (uint32_t i = fromBlock; i < idx->size; i++) {
+    ret += sizeof(IndexBlock) + idx->blocks[i].data.cap;
+  }
+  return ret;
 }
 
 /* Write a forward-index entry to an index writer */
@@ -86,25 +102,30 @@ size_t InvertedIndex_WriteEntry(InvertedIndex *idx,
                                 ForwardIndexEntry *ent) {  // VVW_Truncate(ent->vw);
 
   // printf("writing %s docId %d, lastDocId %d\n", ent->term, ent->docId, idx->lastId);
+  invertedIndex_unshare(idx);
   IndexBlock *blk = &INDEX_LAST_BLOCK(idx);
 
   // see if we need to grow the current block
-  if (blk->numDocs >= INDEX_BLOCK_SIZE) {
+  if (!idx->codec->HasRoom(blk, ent->docId, invertedIndex_blockSize(idx))) {
+    indexBlock_Seal(blk);
     InvertedIndex_AddBlock(idx, ent->docId);
     blk = &INDEX_LAST_BLOCK(idx);
   }
-  // // this is needed on the first block
-  if (blk->firstId == 0) {
+  // this is needed on the first block, or a block emptied by repair
+  if (blk->numDocs == 0) {
     blk->firstId = ent->docId;
   }
-  size_t ret = 0;
 
-  RSOffsetVector offsets = (RSOffsetVector){ent->vw->bw.buf->data, ent->vw->bw.buf->offset};
+  // entries of indexes without offsets, such as tags, may come without a vector writer
+  RSOffsetVector offsets = ent->vw ? (RSOffsetVector){ent->vw->bw.buf->data, ent->vw->bw.buf->offset}
+                                   : (RSOffsetVector){NULL, 0};
 
-  BufferWriter bw = NewBufferWriter(blk->data);
+  size_t ret =
+      idx->codec->Encode(blk, idx->flags, ent->docId, ent->freq, ent->fieldMask, &offsets);
 
-  ret = writeEntry(&bw, idx->flags, ent->docId - blk->lastId, ent->fieldMask, ent->freq,
-                   offsets.len, &offsets);
+  // round up, so that the quantized value stays an upper bound
+  float normFreq = MIN(1, ent->normFreq * ent->docScore);
+  blk->maxFreq = MAX(blk->maxFreq, MIN(FREQ_QUANTIZE_FACTOR, normFreq * FREQ_QUANTIZE_FACTOR + 1));
 
   idx->lastId = ent->docId;
   blk->lastId = ent->docId;
@@ -121,67 +142,65 @@ inline int IR_HasNext(void *ctx) {
 
 void indexReader_advanceBlock(IndexReader *ir) {
   ir->currentBlock++;
-  ir->br = NewBufferReader(IR_CURRENT_BLOCK(ir).data);
   ir->lastId = 0;  // IR_CURRENT_BLOCK(ir).firstId;
+  ir->blockPos = ir->blockLen = 0;
 }
 
-inline size_t readEntry(BufferReader *__restrict__ br, IndexFlags idxflags, RSIndexResult *res,
-                        int singleWordMode) {
-
-  size_t startPos = BufferReader_Offset(br);
-
-  switch ((uint32_t)idxflags) {
-    // Full encoding - load docId, freq, flags, offset
-    case Index_StoreTermOffsets | Index_StoreFieldFlags:
-
-      // size_t sz =
-      //     streamvbyte_decode((const uint8_t *)BufferReader_Current(br), arr, 4);
-      qint_decode(br, (uint32_t *)res, 4);
-      res->term.offsets = (RSOffsetVector){.data = BufferReader_Current(br), .len = res->offsetsSz};
-      Buffer_Skip(br, res->offsetsSz);
-
-      break;
-
-    // load term offsets but not field flags
-    case Index_StoreTermOffsets:
-      qint_decode3(br, &res->docId, &res->freq, &res->offsetsSz);
-      res->term.offsets = (RSOffsetVector){.data = BufferReader_Current(br), .len = res->offsetsSz};
-      Buffer_Skip(br, res->offsetsSz);
-      break;
-
-    // Load field mask but not term offsets
-    case Index_StoreFieldFlags:
-      qint_decode(br, (uint32_t *)res, 3);
-      break;
+/* Decode the records of the current block with the index codec. The block might have grown since
+ * we last decoded it, in which case we continue from the first record after the last one read.
+ * Returns the number of records left to read */
+static uint32_t indexReader_decodeBlock(IndexReader *ir) {
+  IndexBlock *blk = &IR_CURRENT_BLOCK(ir);
+  if (ir->blockCap < blk->numDocs) {
+    ir->blockCap = blk->numDocs;
+    ir->blockRecs = rm_realloc(ir->blockRecs, ir->blockCap * 4 * sizeof(uint32_t));
+    ir->blockOffsets = rm_realloc(ir->blockOffsets, ir->blockCap * sizeof(uint32_t));
+  }
 
-    // Load neither -we load just freq and docId
-    default:
-      qint_decode(br, (uint32_t *)res, 2);
-      break;
+  ir->blockLen = ir->idx->codec->Decode(blk, ir->idx->flags, ir->blockRecs, ir->blockOffsets);
+  ir->blockPos = 0;
+  if (ir->lastId) {
+    while (ir->blockPos < ir->blockLen && ir->blockRecs[ir->blockPos * 4] <= ir->lastId) {
+      ir->blockPos++;
+    }
   }
+  return ir->blockLen - ir->blockPos;
+}
 
-  return BufferReader_Offset(br) - startPos;
+/* Load a decoded record into the reader's result */
+static inline void indexReader_loadRecord(IndexReader *ir, uint32_t pos) {
+  RSIndexResult *res = ir->record;
+  uint32_t *rec = &ir->blockRecs[pos * 4];
+  res->docId = rec[0];
+  res->freq = rec[1];
+  res->fieldMask = rec[2];
+  res->offsetsSz = rec[3];
+  if (ir->idx->flags & Index_StoreTermOffsets) {
+    res->term.offsets = (RSOffsetVector){
+        .data = IR_CURRENT_BLOCK(ir).data.data + ir->blockOffsets[pos], .len = rec[3]};
+  }
 }
 
 int IR_Read(void *ctx, RSIndexResult **e) {
 
   IndexReader *ir = ctx;
 
-  int rc;
-  BufferReader *br = &ir->br;
-
   do {
-    if (BufferReader_AtEnd(br)) {
+    if (ir->blockPos == ir->blockLen) {
+      // Decode the block if we haven't yet, or if records were added to it since
+      if (ir->blockLen < IR_CURRENT_BLOCK(ir).numDocs && indexReader_decodeBlock(ir)) {
+        continue;
+      }
       // We're at the end of the last block...
-      if (ir->currentBlock + 1 == ir->idx->size) {
+      if (ir->currentBlock + 1 == ir->numBlocks) {
         goto eof;
       }
       indexReader_advanceBlock(ir);
-      br = &ir->br;
+      continue;
     }
 
-    readEntry(br, ir->readFlags, ir->record, ir->singleWordMode);
-    ir->lastId = ir->record->docId += ir->lastId;
+    indexReader_loadRecord(ir, ir->blockPos++);
+    ir->lastId = ir->record->docId;
 
     // The record doesn't match the field filter. Continue to the next one
     if (!(ir->record->fieldMask & ir->fieldMask)) {
@@ -204,55 +223,68 @@ eof:
 RSIndexResult *IR_Current(void *ctx) {
   return ((IndexReader *)ctx)->record;
 }
-inline void IR_Seek(IndexReader *ir, t_offset offset, t_docId docId) {
-  Buffer_Seek(&ir->br, offset);
-  ir->lastId = docId;
-}
-
-int _isPos(InvertedIndex *idx, uint32_t i, t_docId docId) {
-  if (idx->blocks[i].firstId <= docId &&
-      (i == idx->size - 1 || idx->blocks[i + 1].firstId > docId)) {
-    return 1;
-  }
-  return 0;
-}
-
+/* Find the first block at or after the reader's current block whose lastId is not smaller than
+ * docId. Blocks are sorted and non overlapping, so we can binary search on lastId and never decode
+ * records of blocks that cannot contain the target. Returns 1 if the reader should continue
+ * decoding from its current position, or 0 if no block can contain docId */
 int indexReader_skipToBlock(IndexReader *ir, t_docId docId) {
 
-  InvertedIndex *idx = ir->idx;
-  if (idx->size == 0 || docId < idx->blocks[0].firstId) {
+  if (ir->numBlocks == 0 || docId > ir->blocks[ir->numBlocks - 1].lastId) {
     return 0;
   }
+
   // if we don't need to move beyond the current block
-  if (_isPos(idx, ir->currentBlock, docId)) {
+  if (docId <= IR_CURRENT_BLOCK(ir).lastId) {
     return 1;
   }
 
-  uint32_t top = idx->size, bottom = ir->currentBlock;
-  uint32_t i = bottom;
-  uint32_t newi;
-
-  while (bottom <= top) {
-    if (_isPos(idx, i, docId)) {
-      ir->currentBlock = i;
-      goto found;
+  // lower bound search on lastId in the blocks following the current one. The last block
+  // satisfies the condition, so the search always ends on a valid block. Skips are usually short,
+  // so we first gallop from the current block with doubling steps to narrow the search range
+  uint32_t bottom = ir->currentBlock + 1, top = ir->numBlocks - 1;
+  for (uint32_t step = 1, probe = bottom; probe < top; probe = bottom + step - 1) {
+    if (ir->blocks[probe].lastId >= docId) {
+      top = probe;
+      break;
     }
-
-    if (docId < idx->blocks[i].firstId) {
-      top = i - 1;
-    } else {
+    bottom = probe + 1;
+    step *= 2;
+  }
+  while (bottom < top) {
+    uint32_t i = bottom + (top - bottom) / 2;
+    if (ir->blocks[i].lastId < docId) {
       bottom = i + 1;
+    } else {
+      top = i;
     }
-    i = (bottom + top) / 2;
   }
-  ir->currentBlock = i;
 
-found:
+  ir->currentBlock = bottom;
   ir->lastId = 0;
-  ir->br = NewBufferReader(IR_CURRENT_BLOCK(ir).data);
+  ir->blockPos = ir->blockLen = 0;
   return 1;
 }
 
+uint16_t IR_BlockMaxFreq(IndexReader *ir, t_docId docId) {
+  if (ir->atEnd || ir->currentBlock >= ir->numBlocks) {
+    return 0;
+  }
+
+  uint32_t bottom = ir->currentBlock, top = ir->numBlocks;
+  while (bottom < top) {
+    uint32_t i = bottom + (top - bottom) / 2;
+    if (ir->blocks[i].lastId < docId) {
+      bottom = i + 1;
+    } else {
+      top = i;
+    }
+  }
+  if (bottom == ir->numBlocks || ir->blocks[bottom].firstId > docId) {
+    return 0;
+  }
+  return ir->blocks[bottom].maxFreq;
+}
+
 /**
 Skip to the given docId, or one place after it
 @param ctx IndexReader context
@@ -272,16 +304,23 @@ int IR_SkipTo(void *ctx, uint32_t docId, RSIndexResult **hit) {
   }
 
   /* check if the id is out of range */
-  if (docId > ir->idx->lastId) {
+  if (docId > ir->maxDocId) {
     ir->atEnd = 1;
     return INDEXREAD_EOF;
   }
   // try to skip to the current block
   if (!indexReader_skipToBlock(ir, docId)) {
-    if (IR_Read(ir, hit) == INDEXREAD_EOF) {
-      return INDEXREAD_EOF;
-    }
-    return INDEXREAD_NOTFOUND;
+    ir->atEnd = 1;
+    return INDEXREAD_EOF;
+  }
+
+  // decode the block we landed on if we haven't yet, and pass over its records that are below the
+  // target without loading them
+  if (ir->blockPos == ir->blockLen && ir->blockLen < IR_CURRENT_BLOCK(ir).numDocs) {
+    indexReader_decodeBlock(ir);
+  }
+  while (ir->blockPos < ir->blockLen && ir->blockRecs[ir->blockPos * 4] < docId) {
+    ir->lastId = ir->blockRecs[ir->blockPos++ * 4];
   }
 
   int rc;
@@ -302,13 +341,17 @@ size_t IR_NumDocs(void *ctx) {
   // in single word optimized mode we only know the size of the record from
   // the header.
   if (ir->singleWordMode) {
-    return ir->idx->numDocs;
+    return ir->numDocs;
   }
 
   // otherwise we use our counter
   return ir->len;
 }
 
+size_t IR_NumEstimated(void *ctx) {
+  return ((IndexReader *)ctx)->numDocs;
+}
+
 IndexReader *NewIndexReader(InvertedIndex *idx, DocTable *docTable, t_fieldMask fieldMask,
                             IndexFlags flags, RSQueryTerm *term, int singleWordMode) {
   IndexReader *ret = rm_malloc(sizeof(IndexReader));
@@ -316,6 +359,12 @@ IndexReader *NewIndexReader(InvertedIndex *idx, DocTable *docTable, t_fieldMask
   ret->idx = idx;
   ret->term = term;
 
+  ret->blocks = idx->blocks;
+  ret->numBlocks = idx->size;
+  ret->maxDocId = idx->lastId;
+  ret->numDocs = idx->numDocs;
+  idx->snapshotEpoch = Epoch_Current();
+
   if (term) {
     // compute IDF based on num of docs in the header
     ret->term->idf = logb(1.0F + docTable->size / (idx->numDocs ? idx->numDocs : (double)1));
@@ -331,13 +380,17 @@ IndexReader *NewIndexReader(InvertedIndex *idx, DocTable *docTable, t_fieldMask
   ret->fieldMask = fieldMask;
   ret->flags = flags;
   ret->readFlags = (uint32_t)flags & (Index_StoreFieldFlags | Index_StoreTermOffsets);
-  ret->br = NewBufferReader(IR_CURRENT_BLOCK(ret).data);
+  ret->blockRecs = NULL;
+  ret->blockOffsets = NULL;
+  ret->blockCap = ret->blockPos = ret->blockLen = 0;
   return ret;
 }
 
 void IR_Free(IndexReader *ir) {
 
   IndexResult_Free(ir->record);
+  rm_free(ir->blockRecs);
+  rm_free(ir->blockOffsets);
 
   Term_Free(ir->term);
   rm_free(ir);
@@ -365,6 +418,7 @@ IndexIterator *NewReadIterator(IndexReader *ir) {
   ri->HasNext = IR_HasNext;
   ri->Free = ReadIterator_Free;
   ri->Len = IR_NumDocs;
+  ri->NumEstimated = IR_NumEstimated;
   ri->Current = IR_Current;
   return ri;
 }
@@ -377,53 +431,64 @@ typedef struct {
 
 } RepairContext;
 
-int IndexBlock_Repair(IndexBlock *blk, DocTable *dt, IndexFlags flags) {
-  t_docId lastReadId = 0;
-  blk->lastId = 0;
-  Buffer repair = *blk->data;
-  repair.offset = 0;
+/* Remove the records of deleted documents from a block, by re-encoding the remaining ones into a new
+ * buffer. Returns the number of records removed */
+static int indexBlock_repair(InvertedIndex *idx, uint32_t blockNum, DocTable *dt) {
+  IndexBlock *blk = &idx->blocks[blockNum];
+  if (!blk->numDocs) return 0;
 
-  BufferReader br = NewBufferReader(blk->data);
-  BufferWriter bw = NewBufferWriter(&repair);
+  uint32_t *recs = rm_malloc(blk->numDocs * 4 * sizeof(uint32_t));
+  uint32_t *offsetsPos = rm_malloc(blk->numDocs * sizeof(uint32_t));
+  uint32_t n = idx->codec->Decode(blk, idx->flags, recs, offsetsPos);
 
-  RSIndexResult *res = NewTokenRecord(NULL);
   int frags = 0;
-
-  while (!BufferReader_AtEnd(&br)) {
-    size_t sz = readEntry(&br, flags & (Index_StoreFieldFlags | Index_StoreTermOffsets), res, 0);
-    lastReadId = res->docId += lastReadId;
-    RSDocumentMetadata *md = DocTable_Get(dt, res->docId);
-
+  for (uint32_t i = 0; i < n; i++) {
+    RSDocumentMetadata *md = DocTable_Get(dt, recs[i * 4]);
     if (md->flags & Document_Deleted) {
-      frags += 1;
-      // printf("ignoring hole in doc %d, frags now %d\n", docId, frags);
-    } else {
-
-      if (frags) {
-        // printf("Writing entry %d, last read id %d, last blk id %d\n", docId, lastReadId,
-        //        blk->lastId);
-        writeEntry(&bw, flags, res->docId - blk->lastId, res->fieldMask, res->freq,
-                   res->term.offsets.len, &res->term.offsets);
-      } else {
-        bw.buf->offset += sz;
-        bw.pos += sz;
-      }
-      blk->lastId = res->docId;
+      // mark the record as a hole
+      recs[i * 4] = 0;
+      frags++;
     }
   }
+
   if (frags) {
-    blk->numDocs -= frags;
-    *blk->data = repair;
-    Buffer_Truncate(blk->data, 0);
+    // an emptied block keeps its id range, so that the blocks remain sorted
+    // the survivors' frequencies are still bounded by the block's maxFreq
+    IndexBlock repaired = {
+        .firstId = blk->firstId, .lastId = blk->lastId, .numDocs = 0, .maxFreq = blk->maxFreq};
+    Buffer_Init(&repaired.data, blk->data.offset ? blk->data.offset : 1);
+
+    for (uint32_t i = 0; i < n; i++) {
+      uint32_t *rec = &recs[i * 4];
+      if (!rec[0]) continue;
+
+      if (!repaired.numDocs) {
+        repaired.firstId = rec[0];
+      }
+      RSOffsetVector offsets = {.data = blk->data.data + offsetsPos[i], .len = rec[3]};
+      idx->codec->Encode(&repaired, idx->flags, rec[0], rec[1], rec[2],
+                         idx->flags & Index_StoreTermOffsets ? &offsets : NULL);
+      repaired.lastId = rec[0];
+      repaired.numDocs++;
+    }
+    indexBlock_Seal(&repaired);
+
+    // snapshots may still read the old data
+    invertedIndex_unshare(idx);
+    blk = &idx->blocks[blockNum];
+    Epoch_RetireMem(blk->data.data);
+    *blk = repaired;
   }
-  // IndexReader *ir = NewIndexReader()
+
+  rm_free(recs);
+  rm_free(offsetsPos);
   return frags;
 }
 
 int InvertedIndex_Repair(InvertedIndex *idx, DocTable *dt, uint32_t startBlock, int num) {
   int n = 0;
   while (startBlock < idx->size && (num <= 0 || n < num)) {
-    int rep = IndexBlock_Repair(&idx->blocks[startBlock], dt, idx->flags);
+    int rep = indexBlock_repair(idx, startBlock, dt);
     if (rep) {
       // printf("Repaired %d holes in block %d\n", rep, startBlock);
     }
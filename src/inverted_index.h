@@ -8,36 +8,86 @@
 #include "index_iterator.h"
 #include "index_result.h"
 #include "spec.h"
+#include "epoch.h"
 
 #include <stdint.h>
 
-/* A single block of data in the index. The index is basically a list of blocks we iterate */
+/* The record limit of blocks, for codecs that limit blocks by the number of records. The limit
+ * grows with the term's document frequency, from INDEX_BLOCK_SIZE for rare terms, to
+ * INDEX_BLOCK_SIZE_MAX for terms with more than INDEX_BLOCK_SIZE_MAX * INDEX_BLOCK_GROWTH records.
+ * Bigger blocks mean less per-block overhead and fewer blocks to search, but every skip into a
+ * block decodes it, so we stop at a modest size */
+#define INDEX_BLOCK_SIZE 100
+#define INDEX_BLOCK_SIZE_MAX 200
+#define INDEX_BLOCK_GROWTH 64
+
+/* A single block of data in the index. The index is basically a list of blocks we iterate. The
+ * Buffer struct is embedded in the block, rather than allocated on its own, but the block's data
+ * is still a separate allocation, grown from INDEX_BLOCK_INITIAL_CAP bytes as records are added */
 typedef struct {
   t_docId firstId;
   t_docId lastId;
   uint16_t numDocs;
+  // The maximal normalized frequency of the block's records, times their documents' scores,
+  // quantized by FREQ_QUANTIZE_FACTOR. This bounds the contribution of the block's records to
+  // TF-IDF scores, and lets the query skip blocks that can't make it to the top results
+  uint16_t maxFreq;
 
-  Buffer *data;
+  Buffer data;
 } IndexBlock;
 
+/* A posting list codec, determining how records are laid out in the blocks of an index. The codec
+ * is selected with the CODEC option when creating the index, and is stored in the index flags */
+typedef struct {
+  /* Can a record of docId be appended to the block, or should it go to a new block. maxDocs is the
+   * record limit of the block, for codecs that limit blocks by the number of records */
+  int (*HasRoom)(IndexBlock *blk, t_docId docId, uint16_t maxDocs);
+
+  /* Append a record to the end of a block. The block's firstId is already set, and its lastId and
+   * numDocs are those prior to the record. Returns the number of bytes the block grew by */
+  size_t (*Encode)(IndexBlock *blk, IndexFlags flags, t_docId docId, uint32_t freq,
+                   t_fieldMask fieldMask, RSOffsetVector *offsets);
+
+  /* Decode all the records of a block into out, 4 slots per record: the docId, the frequency, the
+   * field mask and the size of the offset vector. docIds are absolute, and fields the index does
+   * not store are set to their defaults. If the index stores term offsets, the position of each
+   * offset vector in the block data is written to offsetsPos. Returns the number of records */
+  uint32_t (*Decode)(IndexBlock *blk, IndexFlags flags, uint32_t *out, uint32_t *offsetsPos);
+} IndexCodec;
+
+/* Get the codec of the given type */
+IndexCodec *IndexCodec_Get(IndexCodecType type);
+
 typedef struct {
   IndexBlock *blocks;
   uint32_t size;
   IndexFlags flags;
   t_docId lastId;
   uint32_t numDocs;
+  // the codec of the index blocks, according to the flags
+  IndexCodec *codec;
+  // the epoch of the last snapshot a reader took of the blocks, 0 if none was taken since the last
+  // write. While the snapshot may be in use, the next write copies the blocks before changing them
+  t_epoch snapshotEpoch;
 } InvertedIndex;
 
 InvertedIndex *NewInvertedIndex(IndexFlags flags, int initBlock);
 void InvertedIndex_Free(void *idx);
+
+/* The memory used by the index blocks from fromBlock to the last one - their headers and the
+ * capacity of their data buffers */
+size_t InvertedIndex_BlocksMemUsage(InvertedIndex *idx, uint32_t fromBlock);
 int InvertedIndex_Repair(InvertedIndex *idx, DocTable *dt, uint32_t startBlock, int num);
 
 /* An IndexReader wraps an inverted index record for reading and iteration */
 typedef struct indexReadCtx {
-  // the underlying data buffer
-  BufferReader br;
-
   InvertedIndex *idx;
+  // the snapshot of the index the reader was created on - the block array, and the last docId and
+  // number of records at the time. Readers inside a read epoch are not affected by later writes
+  IndexBlock *blocks;
+  uint32_t numBlocks;
+  t_docId maxDocId;
+  uint32_t numDocs;
   // last docId, used for delta encoding/decoding
   t_docId lastId;
   uint32_t currentBlock;
@@ -58,6 +108,16 @@ typedef struct indexReadCtx {
   RSIndexResult *record;
   RSQueryTerm *term;
 
+  // the records of the current block, decoded by the index codec. Each record takes 4 slots -
+  // docId, freq, fieldMask and offsetsSz
+  uint32_t *blockRecs;
+  // the positions of the records' term offset vectors inside the block, if the index stores them
+  uint32_t *blockOffsets;
+  uint32_t blockCap;
+  // read position and number of decoded records in blockRecs
+  uint32_t blockPos;
+  uint32_t blockLen;
+
   int atEnd;
 } IndexReader;
 
@@ -70,15 +130,14 @@ size_t InvertedIndex_WriteEntry(InvertedIndex *idx, ForwardIndexEntry *ent);
 * optionally with a skip index, docTable and scoreIndex.
 * If singleWordMode is set to 1, we ignore the skip index and use the score
 * index.
+* The reader reads a snapshot of the index taken now. Within a read epoch the snapshot stays
+* valid while the index is written to, and can be read without the global lock
 */
 IndexReader *NewIndexReader(InvertedIndex *idx, DocTable *docTable, t_fieldMask fieldMask,
                             IndexFlags flags, RSQueryTerm *term, int singleWordMode);
 /* free an index reader */
 void IR_Free(IndexReader *ir);
 
-/* Read an entry from an inverted index */
-int IR_GenericRead(IndexReader *ir, RSIndexResult *res);
-
 /* Read an entry from an inverted index into RSIndexResult */
 int IR_Read(void *ctx, RSIndexResult **e);
 
@@ -95,15 +154,19 @@ int IR_SkipTo(void *ctx, uint32_t docId, RSIndexResult **hit);
 
 RSIndexResult *IR_Current(void *ctx);
 
+/* The maxFreq of the block that may contain docId, looking from the reader's current block on and
+ * without moving the reader. Returns 0 if no block the reader can still reach covers docId */
+uint16_t IR_BlockMaxFreq(IndexReader *ir, t_docId docId);
+
 /* The number of docs in an inverted index entry */
 size_t IR_NumDocs(void *ctx);
 
+/* The number of records in the index, regardless of how many we've read */
+size_t IR_NumEstimated(void *ctx);
+
 /* LastDocId of an inverted index stateful reader */
 t_docId IR_LastDocId(void *ctx);
 
-/* Seek the inverted index reader to a specific offset and set the last docId */
-void IR_Seek(IndexReader *ir, t_offset offset, t_docId docId);
-
 /* Create a reader iterator that iterates an inverted index record */
 IndexIterator *NewReadIterator(IndexReader *ir);
 
@@ -9,6 +9,7 @@
 #include "version.h"
 #include "forward_index.h"
 #include "geo_index.h"
+#include "tag_index.h"
 #include "index.h"
 #include "numeric_filter.h"
 #include "numeric_index.h"
@@ -28,51 +29,116 @@
 #include "ext/default.h"
 #include "search_request.h"
 #include "rmalloc.h"
+#include "qint.h"
+#include "query_cache.h"
+#include "epoch.h"
+#include "concurrent_ctx.h"
+
+/* Write the entries of a term to its inverted index, updating the index stats. The entries are all
+ * of the same term, in increasing docId order, so the term's key is opened only once */
+static void indexTermEntries(RedisSearchCtx *ctx, ForwardIndexEntry **entries, size_t n) {
+  // the index can't be opened if the term's key holds something else, or if the term is too long
+  // to be kept in the spec of a NOTERMKEYS index. The term is then not indexed at all
+  InvertedIndex *invidx = Redis_OpenInvertedIndex(ctx, entries[0]->term, entries[0]->len, 1);
+  if (!invidx) return;
+
+  for (size_t i = 0; i < n; i++) {
+    ForwardIndexEntry *entry = entries[i];
+    int isNew = IndexSpec_AddTerm(ctx->spec, entry->term, entry->len);
+    if (isNew) {
+      ctx->spec->stats.numTerms += 1;
+      ctx->spec->stats.termsSize += entry->len;
+      ctx->spec->stats.numBlocks += invidx->size;
+      ctx->spec->stats.invertedCap += InvertedIndex_BlocksMemUsage(invidx, 0);
+    }
+    // writing can only change the last block, or seal it and add new ones
+    uint32_t lastBlock = invidx->size - 1;
+    size_t blocksMem = InvertedIndex_BlocksMemUsage(invidx, lastBlock);
+    size_t sz = InvertedIndex_WriteEntry(invidx, entry);
+
+    /*******************************************
+    * update stats for the index
+    ********************************************/
+
+    /* record the change in capacity of the blocks */
+    ctx->spec->stats.invertedCap += InvertedIndex_BlocksMemUsage(invidx, lastBlock) - blocksMem;
+    ctx->spec->stats.numBlocks += invidx->size - 1 - lastBlock;
+    // ctx->spec->stats.invertedCap += w->bw.buf->cap - cap;
+    // ctx->spec->stats.skipIndexesSize += w->skipIndexWriter.buf->cap - skcap;
+    // ctx->spec->stats.scoreIndexesSize += w->scoreWriter.bw.buf->cap - sccap;
+    /* record the actual size consumption change */
+    ctx->spec->stats.invertedSize += sz;
+
+    ctx->spec->stats.numRecords++;
+
+    /* Record the space saved for offset vectors */
+    if (ctx->spec->flags & Index_StoreTermOffsets) {
+      ctx->spec->stats.offsetVecsSize += entry->vw->bw.buf->offset;
+      ctx->spec->stats.offsetVecRecords += entry->vw->nmemb;
+    }
+  }
+}
 
-/* Add a parsed document to the index. If replace is set, we will add it be deleting an older
- * version of it first */
-int AddDocument(RedisSearchCtx *ctx, Document doc, const char **errorString, int nosave,
-                int replace) {
-  int isnew = 1;
-
+/* Put a document in the document table, and save it as a hash unless nosave is set */
+static int addDocument_put(RedisSearchCtx *ctx, Document *doc, const char **errorString,
+                           int nosave, int replace) {
   // if we're in replace mode, first we need to try and delete the older version of the document
   if (replace) {
-    DocTable_Delete(&ctx->spec->docs, RedisModule_StringPtrLen(doc.docKey, NULL));
+    DocTable_Delete(&ctx->spec->docs, RedisModule_StringPtrLen(doc->docKey, NULL));
   }
 
-  doc.docId = DocTable_Put(&ctx->spec->docs, RedisModule_StringPtrLen(doc.docKey, NULL), doc.score,
-                           0, doc.payload, doc.payloadSize);
+  doc->docId = DocTable_Put(&ctx->spec->docs, RedisModule_StringPtrLen(doc->docKey, NULL),
+                            doc->score, 0, doc->payload, doc->payloadSize);
 
   // Make sure the document is not already in the index - it needs to be
   // incremental!
-  if (doc.docId == 0 || !isnew) {
+  if (doc->docId == 0) {
     *errorString = "Document already in index";
     return REDISMODULE_ERR;
   }
 
   // first save the document as hash
-  if (nosave == 0 && Redis_SaveDocument(ctx, &doc) != REDISMODULE_OK) {
+  if (nosave == 0 && Redis_SaveDocument(ctx, doc) != REDISMODULE_OK) {
     *errorString = "Could not save document data";
     return REDISMODULE_ERR;
   }
+  return REDISMODULE_OK;
+}
 
-  ForwardIndex *idx = NewForwardIndex(doc);
-  RSSortingVector *sv = NULL;
-  if (ctx->spec->sortables) {
-    sv = NewSortingVector(ctx->spec->sortables->len);
-  }
-
+/* Tokenize the text fields of a document into a new forward index, putting their sortable values
+ * in sv. fields are the specs of the document's fields, NULL for the fields not in the index, and
+ * texts are their texts, which tokenizing modifies, and which the entries of the forward index
+ * point into. This reads nothing else, so async adds run it without the global lock */
+static ForwardIndex *addDocument_tokenize(FieldSpec **fields, StopWordList *stopwords,
+                                          Document *doc, char **texts, RSSortingVector *sv) {
+  ForwardIndex *idx = NewForwardIndex(*doc);
   int totalTokens = 0;
 
-  for (int i = 0; i < doc.numFields; i++) {
-    // printf("Tokenizing %s: %s\n",
-    // RedisModule_StringPtrLen(doc.fields[i].name, NULL),
-    //        RedisModule_StringPtrLen(doc.fields[i].text, NULL));
+  for (int i = 0; i < doc->numFields; i++) {
+    FieldSpec *fs = fields[i];
+    if (fs == NULL || fs->type != F_FULLTEXT) {
+      continue;
+    }
+
+    if (sv && fs->sortable) {
+      RSSortingVector_Put(sv, fs->sortIdx, texts[i], RS_SORTABLE_STR);
+    }
+
+    totalTokens = tokenize(texts[i], fs->weight, fs->id, idx, forwardIndexTokenFunc, idx->stemmer,
+                           totalTokens, stopwords);
+  }
+  return idx;
+}
 
+/* Index the numeric, geo and tag fields of a document already put in the document table, and set its
+ * forward index and sorting vector */
+static int addDocument_indexFields(RedisSearchCtx *ctx, Document *doc, ForwardIndex *idx,
+                                   RSSortingVector *sv, const char **errorString) {
+  for (int i = 0; i < doc->numFields; i++) {
     size_t len;
-    const char *f = doc.fields[i].name;
+    const char *f = doc->fields[i].name;
     len = strlen(f);
-    const char *c = RedisModule_StringPtrLen(doc.fields[i].text, NULL);
+    const char *c = RedisModule_StringPtrLen(doc->fields[i].text, NULL);
 
     FieldSpec *fs = IndexSpec_GetField(ctx->spec, f, len);
     if (fs == NULL) {
@@ -81,24 +147,16 @@ int AddDocument(RedisSearchCtx *ctx, Document doc, const char **errorString, int
     }
 
     switch (fs->type) {
-      case F_FULLTEXT:
-        if (sv && fs->sortable) {
-          RSSortingVector_Put(sv, fs->sortIdx, (void *)c, RS_SORTABLE_STR);
-        }
-
-        totalTokens = tokenize(c, fs->weight, fs->id, idx, forwardIndexTokenFunc, idx->stemmer,
-                               totalTokens, ctx->spec->stopwords);
-        break;
       case F_NUMERIC: {
         double score;
 
-        if (RedisModule_StringToDouble(doc.fields[i].text, &score) == REDISMODULE_ERR) {
+        if (RedisModule_StringToDouble(doc->fields[i].text, &score) == REDISMODULE_ERR) {
           *errorString = "Could not parse numeric index value";
-          goto error;
+          return REDISMODULE_ERR;
         }
 
         NumericRangeTree *rt = OpenNumericIndex(ctx, fs->name);
-        NumericRangeTree_Add(rt, doc.docId, score);
+        NumericRangeTree_Add(rt, doc->docId, score);
 
         // If this is a sortable numeric value - copy the value to the sorting vector
         if (sv && fs->sortable) {
@@ -111,85 +169,365 @@ int AddDocument(RedisSearchCtx *ctx, Document doc, const char **errorString, int
         char *pos = strpbrk(c, " ,");
         if (!pos) {
           *errorString = "Invalid lon/lat format. Use \"lon lat\" or \"lon,lat\"";
-          goto error;
+          return REDISMODULE_ERR;
         }
         *pos = '\0';
         pos++;
         char *slon = (char *)c, *slat = (char *)pos;
 
         GeoIndex gi = {.ctx = ctx, .sp = fs};
-        if (GeoIndex_AddStrings(&gi, doc.docId, slon, slat) == REDISMODULE_ERR) {
+        if (GeoIndex_AddStrings(&gi, doc->docId, slon, slat) == REDISMODULE_ERR) {
           *errorString = "Could not index geo value";
-          goto error;
+          return REDISMODULE_ERR;
         }
       }
 
       break;
 
+      case F_TAG: {
+        size_t n;
+        const char *data = RedisModule_StringPtrLen(doc->fields[i].text, &n);
+        Vector *values = TagIndex_Preprocess(fs->tagSep, data, n);
+        TagIndex *ti = Vector_Size(values) ? TagIndex_Open(ctx, fs->name, 1) : NULL;
+        if (ti) {
+          TagIndex_Index(ti, values, doc->docId);
+        }
+        int rc = Vector_Size(values) && !ti ? REDISMODULE_ERR : REDISMODULE_OK;
+        for (size_t j = 0; j < Vector_Size(values); j++) {
+          char *val;
+          Vector_Get(values, j, &val);
+          rm_free(val);
+        }
+        Vector_Free(values);
+        if (rc == REDISMODULE_ERR) {
+          *errorString = "Could not open tag index for indexing";
+          return REDISMODULE_ERR;
+        }
+        break;
+      }
+
       default:
         break;
     }
   }
 
-  RSDocumentMetadata *md = DocTable_Get(&ctx->spec->docs, doc.docId);
+  // the forward index may have been built before the document got its id
+  idx->docId = doc->docId;
+  ForwardIndexIterator it = ForwardIndex_Iterate(idx);
+  ForwardIndexEntry *entry;
+  while ((entry = ForwardIndexIterator_Next(&it)) != NULL) {
+    entry->docId = doc->docId;
+  }
+
+  RSDocumentMetadata *md = DocTable_Get(&ctx->spec->docs, doc->docId);
   md->maxFreq = idx->maxFreq;
   if (sv) {
-    DocTable_SetSortingVector(&ctx->spec->docs, doc.docId, sv);
+    DocTable_SetSortingVector(&ctx->spec->docs, doc->docId, sv);
   }
+  return REDISMODULE_OK;
+}
 
-  // printf("totaltokens :%d\n", totalTokens);
-  if (totalTokens > 0) {
-    ForwardIndexIterator it = ForwardIndex_Iterate(idx);
+/* The first phase of adding a document: put it in the document table, save it as a hash, tokenize
+ * its text fields and index its numeric and geo fields. Returns the forward index of the document,
+ * whose entries are then written to the inverted indexes, or NULL on error */
+static ForwardIndex *addDocument_prepare(RedisSearchCtx *ctx, Document *doc,
+                                         const char **errorString, int nosave, int replace) {
+  if (addDocument_put(ctx, doc, errorString, nosave, replace) == REDISMODULE_ERR) {
+    return NULL;
+  }
 
-    ForwardIndexEntry *entry = ForwardIndexIterator_Next(&it);
+  // the document is saved, so its texts can be tokenized in place
+  char *texts[doc->numFields];
+  FieldSpec *fields[doc->numFields];
+  for (int i = 0; i < doc->numFields; i++) {
+    texts[i] = (char *)RedisModule_StringPtrLen(doc->fields[i].text, NULL);
+    fields[i] = IndexSpec_GetField(ctx->spec, doc->fields[i].name, strlen(doc->fields[i].name));
+  }
+  RSSortingVector *sv = NULL;
+  if (ctx->spec->sortables) {
+    sv = NewSortingVector(ctx->spec->sortables->len);
+  }
 
-    while (entry != NULL) {
-      // ForwardIndex_NormalizeFreq(idx, entry);
-      int isNew = IndexSpec_AddTerm(ctx->spec, entry->term, entry->len);
-      InvertedIndex *invidx = Redis_OpenInvertedIndex(ctx, entry->term, entry->len, 1);
-      if (isNew) {
-        ctx->spec->stats.numTerms += 1;
-        ctx->spec->stats.termsSize += entry->len;
-      }
-      size_t sz = InvertedIndex_WriteEntry(invidx, entry);
-
-      /*******************************************
-      * update stats for the index
-      ********************************************/
-
-      /* record the change in capacity of the buffer */
-      // ctx->spec->stats.invertedCap += w->bw.buf->cap - cap;
-      // ctx->spec->stats.skipIndexesSize += w->skipIndexWriter.buf->cap - skcap;
-      // ctx->spec->stats.scoreIndexesSize += w->scoreWriter.bw.buf->cap - sccap;
-      /* record the actual size consumption change */
-      ctx->spec->stats.invertedSize += sz;
-
-      ctx->spec->stats.numRecords++;
-      /* increment the number of terms if this is a new term*/
-
-      /* Record the space saved for offset vectors */
-      if (ctx->spec->flags & Index_StoreTermOffsets) {
-        ctx->spec->stats.offsetVecsSize += entry->vw->bw.buf->offset;
-        ctx->spec->stats.offsetVecRecords += entry->vw->nmemb;
-      }
-      // Redis_CloseWriter(w);
+  ForwardIndex *idx = addDocument_tokenize(fields, ctx->spec->stopwords, doc, texts, sv);
+  if (addDocument_indexFields(ctx, doc, idx, sv, errorString) == REDISMODULE_ERR) {
+    if (sv) SortingVector_Free(sv);
+    ForwardIndexFree(idx);
+    return NULL;
+  }
+  return idx;
+}
 
-      entry = ForwardIndexIterator_Next(&it);
-    }
-    // ctx->spec->stats->numDocuments += 1;
+/* Write the entries of a document's forward index to the inverted indexes */
+static void addDocument_writeEntries(RedisSearchCtx *ctx, ForwardIndex *idx) {
+  ForwardIndexIterator it = ForwardIndex_Iterate(idx);
+  ForwardIndexEntry *entry;
+  while ((entry = ForwardIndexIterator_Next(&it)) != NULL) {
+    ForwardIndex_NormalizeFreq(idx, entry);
+    indexTermEntries(ctx, &entry, 1);
   }
+}
+
+/* The last phase of adding a document, once its entries are written to the inverted indexes */
+static void addDocument_finish(RedisSearchCtx *ctx, ForwardIndex *idx) {
   ctx->spec->stats.numDocuments += 1;
+  // the document table changed when the document was put in it, but results cached since then
+  // don't have it in the inverted indexes
+  ++ctx->spec->docs.generation;
   ForwardIndexFree(idx);
+}
+
+/* Add a parsed document to the index. If replace is set, we will add it be deleting an older
+ * version of it first */
+int AddDocument(RedisSearchCtx *ctx, Document doc, const char **errorString, int nosave,
+                int replace) {
+  ForwardIndex *idx = addDocument_prepare(ctx, &doc, errorString, nosave, replace);
+  if (!idx) {
+    return REDISMODULE_ERR;
+  }
+
+  addDocument_writeEntries(ctx, idx);
+  addDocument_finish(ctx, idx);
   return REDISMODULE_OK;
+}
 
-error:
-  ForwardIndexFree(idx);
+/* Order forward index entries by term, and then by docId */
+static int cmpEntries(const void *p1, const void *p2) {
+  const ForwardIndexEntry *e1 = *(const ForwardIndexEntry **)p1;
+  const ForwardIndexEntry *e2 = *(const ForwardIndexEntry **)p2;
+  int rc = memcmp(e1->term, e2->term, MIN(e1->len, e2->len));
+  if (!rc && e1->len != e2->len) {
+    rc = e1->len < e2->len ? -1 : 1;
+  }
+  if (!rc) {
+    rc = e1->docId < e2->docId ? -1 : (e1->docId > e2->docId ? 1 : 0);
+  }
+  return rc;
+}
+
+/* Add a batch of parsed documents to the index. All the documents are tokenized first, and then the
+ * entries of each term in all of them are written together, in docId order, opening the term's
+ * inverted index once. errors receives the error of every document that could not be added, or
+ * NULL. Returns the number of documents added */
+int AddDocuments(RedisSearchCtx *ctx, Document *docs, int n, const char **errors, int nosave,
+                 int replace) {
+  ForwardIndex **idxs = rm_calloc(n, sizeof(ForwardIndex *));
+  ForwardIndexEntry **entries = NULL;
+  size_t numEntries = 0, cap = 0;
+  int added = 0;
+
+  for (int i = 0; i < n; i++) {
+    errors[i] = NULL;
+    if (!(idxs[i] = addDocument_prepare(ctx, &docs[i], &errors[i], nosave, replace))) {
+      if (!errors[i]) errors[i] = "Could not index document";
+      continue;
+    }
+    added++;
+
+    ForwardIndexIterator it = ForwardIndex_Iterate(idxs[i]);
+    ForwardIndexEntry *entry;
+    while ((entry = ForwardIndexIterator_Next(&it)) != NULL) {
+      ForwardIndex_NormalizeFreq(idxs[i], entry);
+      if (numEntries == cap) {
+        cap = cap ? cap * 2 : 1024;
+        entries = rm_realloc(entries, cap * sizeof(ForwardIndexEntry *));
+      }
+      entries[numEntries++] = entry;
+    }
+  }
+
+  qsort(entries, numEntries, sizeof(ForwardIndexEntry *), cmpEntries);
+  for (size_t i = 0, j; i < numEntries; i = j) {
+    for (j = i + 1; j < numEntries && entries[j]->len == entries[i]->len &&
+                    !memcmp(entries[j]->term, entries[i]->term, entries[i]->len);
+         j++)
+      ;
+    indexTermEntries(ctx, &entries[i], j - i);
+  }
+
+  for (int i = 0; i < n; i++) {
+    if (idxs[i]) addDocument_finish(ctx, idxs[i]);
+  }
+  rm_free(entries);
+  rm_free(idxs);
+  return added;
+}
+
+/* A document added with FT.ADD ASYNC. Its key and fields are copied out of the command arguments,
+ * tokenized on the indexing thread pool, and merged into the index under the global lock */
+typedef struct {
+  RedisModuleBlockedClient *bc;
+  char *indexName;
+  // the document is tokenized with copies of the specs of its text fields, NULL named for the other
+  // fields, and its own reference to the stopwords. The index might be dropped meanwhile, so it is
+  // looked up by name again under the lock
+  FieldSpec *fieldSpecs;
+  StopWordList *stopwords;
+  int numSortables;
+
+  char *key;
+  size_t keyLen;
+  double score;
+  char *language;
+  char *payload;
+  size_t payloadSize;
+  int numFields;
+  char **names;
+  char **texts;
+  size_t *textLens;
+  int nosave;
+  int replace;
+} asyncAddJob;
+
+static char *copyString(const char *s, size_t len) {
+  char *ret = rm_malloc(len + 1);
+  memcpy(ret, s, len);
+  ret[len] = '\0';
+  return ret;
+}
 
-  return REDISMODULE_ERR;
+static void asyncAddJob_free(asyncAddJob *job) {
+  for (int i = 0; i < job->numFields; i++) {
+    rm_free(job->names[i]);
+    rm_free(job->texts[i]);
+  }
+  rm_free(job->names);
+  rm_free(job->texts);
+  rm_free(job->textLens);
+  rm_free(job->fieldSpecs);
+  StopWordList_Free(job->stopwords);
+  rm_free(job->indexName);
+  rm_free(job->key);
+  rm_free(job->language);
+  rm_free(job->payload);
+  rm_free(job);
+}
+
+/* Check that the document was tokenized the way the index found under the lock would tokenize it.
+ * The index may have been dropped and created again meanwhile */
+static int asyncAdd_sameSpec(asyncAddJob *job, IndexSpec *sp) {
+  if (sp->stopwords != job->stopwords ||
+      (sp->sortables ? sp->sortables->len : 0) != job->numSortables) {
+    return 0;
+  }
+  for (int i = 0; i < job->numFields; i++) {
+    FieldSpec *fs = IndexSpec_GetField(sp, job->names[i], strlen(job->names[i]));
+    FieldSpec *old = &job->fieldSpecs[i];
+    int text = fs && fs->type == F_FULLTEXT;
+    if (text != (old->name != NULL)) return 0;
+    if (text && (fs->id != old->id || fs->weight != old->weight || fs->sortable != old->sortable ||
+                 fs->sortIdx != old->sortIdx)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void asyncAdd_run(void *p) {
+  asyncAddJob *job = p;
+
+  Document doc = NewDocument(NULL, job->score, job->numFields, job->language, job->payload,
+                             job->payloadSize);
+  // tokenizing modifies the texts, so it gets its own copies
+  char *texts[job->numFields];
+  FieldSpec *fields[job->numFields];
+  for (int i = 0; i < job->numFields; i++) {
+    doc.fields[i].name = job->names[i];
+    texts[i] = copyString(job->texts[i], job->textLens[i]);
+    fields[i] = job->fieldSpecs[i].name ? &job->fieldSpecs[i] : NULL;
+  }
+  RSSortingVector *sv = job->numSortables ? NewSortingVector(job->numSortables) : NULL;
+  ForwardIndex *idx = addDocument_tokenize(fields, job->stopwords, &doc, texts, sv);
+
+  RedisModuleCtx *ctx = RedisModule_GetThreadSafeContext(job->bc);
+  RedisModule_AutoMemory(ctx);
+  RedisModule_ThreadSafeContextLock(ctx);
+
+  const char *err = NULL;
+  IndexSpec *sp = IndexSpec_Load(ctx, job->indexName, 1);
+  if (!sp) {
+    err = "Unknown Index name";
+    goto end;
+  }
+  if (!asyncAdd_sameSpec(job, sp)) {
+    err = "Index was recreated while indexing the document";
+    goto end;
+  }
+
+  RedisSearchCtx sctx = {ctx, sp};
+  doc.docKey = RedisModule_CreateString(ctx, job->key, job->keyLen);
+  for (int i = 0; i < job->numFields; i++) {
+    doc.fields[i].text = RedisModule_CreateString(ctx, job->texts[i], job->textLens[i]);
+  }
+  if (addDocument_put(&sctx, &doc, &err, job->nosave, job->replace) == REDISMODULE_ERR ||
+      addDocument_indexFields(&sctx, &doc, idx, sv, &err) == REDISMODULE_ERR) {
+    goto end;
+  }
+  sv = NULL;
+  addDocument_writeEntries(&sctx, idx);
+  addDocument_finish(&sctx, idx);
+  idx = NULL;
+
+end:
+  if (err) {
+    RedisModule_ReplyWithError(ctx, err);
+  } else {
+    RedisModule_ReplyWithSimpleString(ctx, "OK");
+  }
+  RedisModule_ThreadSafeContextUnlock(ctx);
+  RedisModule_UnblockClient(job->bc, NULL);
+  RedisModule_FreeThreadSafeContext(ctx);
+
+  if (idx) ForwardIndexFree(idx);
+  if (sv) SortingVector_Free(sv);
+  for (int i = 0; i < job->numFields; i++) {
+    rm_free(texts[i]);
+  }
+  free(doc.fields);
+  asyncAddJob_free(job);
+}
+
+/* Add a document asynchronously: block the client, and tokenize the document on the indexing thread
+ * pool */
+static void addDocumentAsync(RedisModuleCtx *ctx, IndexSpec *sp, Document *doc, int nosave,
+                             int replace) {
+  asyncAddJob *job = rm_calloc(1, sizeof(*job));
+  job->indexName = rm_strdup(sp->name);
+  job->stopwords = StopWordList_Ref(sp->stopwords);
+  job->numSortables = sp->sortables ? sp->sortables->len : 0;
+
+  const char *key = RedisModule_StringPtrLen(doc->docKey, &job->keyLen);
+  job->key = copyString(key, job->keyLen);
+  job->score = doc->score;
+  job->language = rm_strdup(doc->language);
+  if (doc->payload) {
+    job->payload = copyString(doc->payload, doc->payloadSize);
+    job->payloadSize = doc->payloadSize;
+  }
+  job->numFields = doc->numFields;
+  job->names = rm_malloc(doc->numFields * sizeof(char *));
+  job->texts = rm_malloc(doc->numFields * sizeof(char *));
+  job->textLens = rm_malloc(doc->numFields * sizeof(size_t));
+  job->fieldSpecs = rm_calloc(doc->numFields, sizeof(FieldSpec));
+  for (int i = 0; i < doc->numFields; i++) {
+    job->names[i] = rm_strdup(doc->fields[i].name);
+    FieldSpec *fs = IndexSpec_GetField(sp, job->names[i], strlen(job->names[i]));
+    if (fs && fs->type == F_FULLTEXT) {
+      job->fieldSpecs[i] = *fs;
+      job->fieldSpecs[i].name = job->names[i];
+    }
+    const char *text = RedisModule_StringPtrLen(doc->fields[i].text, &job->textLens[i]);
+    job->texts[i] = copyString(text, job->textLens[i]);
+  }
+  job->nosave = nosave;
+  job->replace = replace;
+
+  job->bc = RedisModule_BlockClient(ctx, NULL, NULL, NULL, 0);
+  ConcurrentIndexing_ThreadPoolRun(asyncAdd_run, job);
 }
 
 /*
-## FT.ADD <index> <docId> <score> [NOSAVE] [REPLACE] [LANGUAGE <lang>] [PAYLOAD {payload}] FIELDS
+## FT.ADD <index> <docId> <score> [NOSAVE] [REPLACE] [ASYNC] [LANGUAGE <lang>] [PAYLOAD {payload}]
+FIELDS
 <field>
 <text> ....]
 Add a documet to the index.
@@ -213,6 +551,9 @@ and only index it.
 
     - REPLACE: If set, we will do an update and delete an older version of the document if it exists
 
+    - ASYNC: If set, the document is tokenized on a background thread, and only merged into the
+index under the global lock. The client is blocked until the document is indexed
+
     - FIELDS: Following the FIELDS specifier, we are looking for pairs of
 <field> <text> to be
 indexed.
@@ -238,6 +579,7 @@ int AddDocumentCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
   int nosave = RMUtil_ArgExists("NOSAVE", argv, argc, 1);
   int fieldsIdx = RMUtil_ArgExists("FIELDS", argv, argc, 1);
   int replace = RMUtil_ArgExists("REPLACE", argv, argc, 1);
+  int async = fieldsIdx && RMUtil_ArgExists("ASYNC", argv, fieldsIdx, 1);
 
   // printf("argc: %d, fieldsIdx: %d, argc - fieldsIdx: %d, nosave: %d\n", argc,
   // fieldsIdx,
@@ -294,6 +636,12 @@ int AddDocumentCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
     doc.fields[n].text = argv[i + 1];
   }
 
+  if (async) {
+    addDocumentAsync(ctx, sp, &doc, nosave, replace);
+    free(doc.fields);
+    goto cleanup;
+  }
+
   LG_DEBUG("Adding doc %s with %d fields\n", RedisModule_StringPtrLen(doc.docKey, NULL),
            doc.numFields);
   const char *msg = NULL;
@@ -310,6 +658,123 @@ cleanup:
   return REDISMODULE_OK;
 }
 
+/*
+## FT.MADD <index> [NOSAVE] [REPLACE] [LANGUAGE <lang>] DOCUMENTS {<docId> <score> [PAYLOAD
+{payload}] <nfields> <field> <text> ...} ...
+Add a batch of documents to the index.
+
+Each document is given as its id, score, optional payload, the number of its fields, and the
+<field> <text> pairs. NOSAVE, REPLACE and LANGUAGE have the same meaning as in FT.ADD, and apply to
+all the documents.
+
+The documents are all tokenized first, and then the postings of each term are written to its
+inverted index together, so batches that share terms are indexed faster than adding the documents
+one by one.
+
+Returns an array with OK for every document added, or the error it could not be added with.
+*/
+int AddDocumentsCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  int docsIdx = RMUtil_ArgExists("DOCUMENTS", argv, argc, 2);
+  if (argc < 4 || docsIdx == 0 || docsIdx == argc - 1) {
+    return RedisModule_WrongArity(ctx);
+  }
+  int nosave = RMUtil_ArgExists("NOSAVE", argv, docsIdx, 2);
+  int replace = RMUtil_ArgExists("REPLACE", argv, docsIdx, 2);
+
+  RedisModule_AutoMemory(ctx);
+
+  IndexSpec *sp = IndexSpec_Load(ctx, RedisModule_StringPtrLen(argv[1], NULL), 1);
+  if (sp == NULL) {
+    RedisModule_ReplyWithError(ctx, "Unknown Index name");
+    return REDISMODULE_OK;
+  }
+
+  RedisSearchCtx sctx = {ctx, sp};
+
+  // Parse the optional LANGUAGE flag
+  const char *lang = NULL;
+  RMUtil_ParseArgsAfter("LANGUAGE", argv, docsIdx, "c", &lang);
+  if (lang && !IsSupportedLanguage(lang, strlen(lang))) {
+    RedisModule_ReplyWithError(ctx, "Unsupported Language");
+    return REDISMODULE_OK;
+  }
+
+  // every document takes at least 3 arguments
+  int cap = (argc - docsIdx - 1) / 3;
+  Document *docs = rm_calloc(cap, sizeof(Document));
+  const char **errors = rm_calloc(cap, sizeof(const char *));
+  const char *err = NULL;
+  int n = 0;
+
+  for (int i = docsIdx + 1; i < argc; n++) {
+    if (argc - i < 3) {
+      err = "Not enough arguments for document";
+      goto cleanup;
+    }
+    RedisModuleString *docKey = argv[i++];
+
+    double ds = 0;
+    if (RedisModule_StringToDouble(argv[i++], &ds) == REDISMODULE_ERR) {
+      err = "Could not parse document score";
+      goto cleanup;
+    }
+    if (ds > 1 || ds < 0) {
+      err = "Document scores must be normalized between 0.0 ... 1.0";
+      goto cleanup;
+    }
+
+    const char *payload = NULL;
+    size_t payloadSize = 0;
+    if (!strcasecmp(RedisModule_StringPtrLen(argv[i], NULL), "PAYLOAD")) {
+      if (argc - i < 3) {
+        err = "Not enough arguments for document";
+        goto cleanup;
+      }
+      payload = RedisModule_StringPtrLen(argv[i + 1], &payloadSize);
+      i += 2;
+    }
+
+    long long numFields;
+    if (RedisModule_StringToLongLong(argv[i++], &numFields) == REDISMODULE_ERR || numFields <= 0) {
+      err = "Could not parse number of fields";
+      goto cleanup;
+    }
+    if (numFields > (argc - i) / 2) {
+      err = "Not enough arguments for document";
+      goto cleanup;
+    }
+
+    docs[n] = NewDocument(docKey, ds, numFields, lang ? lang : DEFAULT_LANGUAGE, payload,
+                          payloadSize);
+    for (int f = 0; f < numFields; f++, i += 2) {
+      docs[n].fields[f].name = RedisModule_StringPtrLen(argv[i], NULL);
+      docs[n].fields[f].text = argv[i + 1];
+    }
+  }
+
+  AddDocuments(&sctx, docs, n, errors, nosave, replace);
+
+  RedisModule_ReplyWithArray(ctx, n);
+  for (int i = 0; i < n; i++) {
+    if (errors[i]) {
+      RedisModule_ReplyWithError(ctx, errors[i]);
+    } else {
+      RedisModule_ReplyWithSimpleString(ctx, "OK");
+    }
+  }
+
+cleanup:
+  if (err) {
+    RedisModule_ReplyWithError(ctx, err);
+  }
+  for (int i = 0; i < n; i++) {
+    free(docs[i].fields);
+  }
+  rm_free(docs);
+  rm_free(errors);
+  return REDISMODULE_OK;
+}
+
 /* FT.SETPAYLOAD {index} {docId} {payload} */
 int SetPayloadCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
 
@@ -437,6 +902,10 @@ int IndexInfoCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     if (sp->fields[i].type == F_FULLTEXT) {
       __reply_kvnum(nn, "weight", sp->fields[i].weight);
     }
+    if (sp->fields[i].type == F_TAG) {
+      char sep[2] = {sp->fields[i].tagSep, '\0'};
+      __reply_kvstr(nn, "separator", sep);
+    }
     if (sp->fields[i].sortable) {
       RedisModule_ReplyWithSimpleString(ctx, "SORTABLE");
       ++nn;
@@ -445,6 +914,7 @@ int IndexInfoCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   }
   n += 2;
 
+  __reply_kvstr(n, "codec", CodecTypeNames[IndexFlags_Codec(sp->flags)]);
   __reply_kvnum(n, "num_docs", sp->stats.numDocuments);
   __reply_kvnum(n, "max_doc_id", sp->docs.maxDocId);
   __reply_kvnum(n, "num_terms", sp->stats.numTerms);
@@ -452,15 +922,29 @@ int IndexInfoCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   __reply_kvnum(n, "inverted_sz_mb", sp->stats.invertedSize / (float)0x100000);
   __reply_kvnum(n, "inverted_cap_mb", sp->stats.invertedCap / (float)0x100000);
 
-  __reply_kvnum(n, "inverted_cap_ovh", 0);
-  //(float)(sp->stats.invertedCap - sp->stats.invertedSize) / (float)sp->stats.invertedCap);
+  float capOverhead = 0;
+  if (sp->stats.invertedCap > sp->stats.invertedSize) {
+    capOverhead = (float)(sp->stats.invertedCap - sp->stats.invertedSize) /
+                  (float)sp->stats.invertedCap;
+  }
+  __reply_kvnum(n, "inverted_cap_ovh", capOverhead);
+  __reply_kvnum(n, "num_blocks", sp->stats.numBlocks);
+  __reply_kvnum(n, "records_per_block_avg",
+                sp->stats.numBlocks ? (float)sp->stats.numRecords / (float)sp->stats.numBlocks : 0);
 
   __reply_kvnum(n, "offset_vectors_sz_mb", sp->stats.offsetVecsSize / (float)0x100000);
   __reply_kvnum(n, "skip_index_size_mb", sp->stats.skipIndexesSize / (float)0x100000);
   __reply_kvnum(n, "score_index_size_mb", sp->stats.scoreIndexesSize / (float)0x100000);
 
-  __reply_kvnum(n, "doc_table_size_mb", sp->docs.memsize / (float)0x100000);
-  __reply_kvnum(n, "key_table_size_mb", TrieMap_MemUsage(sp->docs.dim.tm) / (float)0x100000);
+  DocTableMemUsage dtmem = DocTable_MemUsage(&sp->docs);
+  __reply_kvnum(n, "doc_table_size_mb", dtmem.total / (float)0x100000);
+  __reply_kvnum(n, "doc_table_meta_mb", dtmem.metadata / (float)0x100000);
+  __reply_kvnum(n, "doc_table_keys_mb", dtmem.keys / (float)0x100000);
+  __reply_kvnum(n, "doc_table_payloads_mb", dtmem.payloads / (float)0x100000);
+  __reply_kvnum(n, "doc_table_sortvecs_mb", dtmem.sortVectors / (float)0x100000);
+  __reply_kvnum(n, "key_table_size_mb", dtmem.idMap / (float)0x100000);
+  size_t qcmem = sp->queryCache ? sp->queryCache->memUsage : 0;
+  __reply_kvnum(n, "query_cache_size_mb", qcmem / (float)0x100000);
   __reply_kvnum(n, "records_per_doc_avg",
                 (float)sp->stats.numRecords / (float)sp->stats.numDocuments);
   __reply_kvnum(n, "bytes_per_record_avg",
@@ -470,6 +954,12 @@ int IndexInfoCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   __reply_kvnum(n, "offset_bits_per_record_avg",
                 8.0F * (float)sp->stats.offsetVecsSize / (float)sp->stats.offsetVecRecords);
 
+  QueryCache qc = sp->queryCache ? *sp->queryCache : (QueryCache){.size = 0};
+  __reply_kvnum(n, "query_cache_entries", qc.size);
+  __reply_kvnum(n, "query_cache_hits", qc.hits);
+  __reply_kvnum(n, "query_cache_misses", qc.misses);
+  __reply_kvnum(n, "query_cache_evictions", qc.evictions);
+
   RedisModule_ReplySetArrayLength(ctx, n);
   return REDISMODULE_OK;
 }
@@ -673,8 +1163,10 @@ cleanup:
     [INFIELDS <num> field ...]
     [LANGUAGE lang] [VERBATIM]
     [FILTER {property} {min} {max}]
-    [SLOP {slop}] [INORDER]
+    [SLOP {slop}] [INORDER] [PRUNE]
     [GEOFILTER {property} {lon} {lat} {radius} {unit}]
+    [GEOFILTER {property} BOX {minlon} {minlat} {maxlon} {maxlat}]
+    [GEOFILTER {property} POLYGON {num} {lon} {lat} ...]
 
 Seach the index with a textual query, returning either documents or just ids.
 
@@ -698,7 +1190,8 @@ results to the offset and number of results given. The default is 0 10
    - FILTER: Apply a numeric filter to a numeric field, with a minimum and maximum
 
    - GEOFILTER: Apply a radius filter to a geo field, with a given lon, lat, radius and radius
-units (m, km, mi, or ft)
+units (m, km, mi, or ft). With BOX it filters a lon/lat rectangle, and with POLYGON a polygon of num
+lon/lat vertices
 
    - PAYLOAD: Add a payload to the query that will be exposed to custrom scoring functions.
 
@@ -723,6 +1216,10 @@ terms.
 
    - INORDER: Phrase terms must appear in the document in the same order as in the query.
 
+   - PRUNE: If set, unions of terms scored with TFIDF skip the documents that can't score high
+    enough to be returned, and SORTBY queries stop once the requested page is known. The total
+    number of results is then a lower bound.
+
    - LANGUAGE lang: If set, we use a stemmer for the supplied langauge.
 Defaults
 to English.
@@ -767,7 +1264,7 @@ int SearchCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
 
 /*
 ## FT.CREATE {index} [NOOFFSETS] [NOFIELDS] [NOSCOREIDX]
-    SCHEMA {field} [TEXT [WEIGHT {weight}]] | [NUMERIC] ...
+    SCHEMA {field} [TEXT [WEIGHT {weight}]] | [NUMERIC] | [GEO] | [TAG [SEPARATOR {sep}]] ...
 
 Creates an index with the given spec. The index name will be used in all the
 key
@@ -792,6 +1289,8 @@ overwritten
       textual.
       For textual fields we optionally specify a weight. The default weight is 1.0
       The weight is a double, but does not need to be normalized.
+      Tag fields are split by their separator (a comma by default) into values which are matched
+      exactly, with the @field:{value | value} query syntax.
 
 ### Returns:
 
@@ -1037,8 +1536,69 @@ int SuggestDelCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   return RedisModule_ReplyWithLongLong(ctx, Trie_Delete(tree, (char *)str, len));
 }
 
+/* Reply with the results of a suggestion search, and free them */
+static void suggestReply(RedisModuleCtx *ctx, Vector *res, int withScores, int withPayloads) {
+  // if we also need to return scores, we need double the records
+  int mul = 1;
+  mul = withScores ? mul + 1 : mul;
+  mul = withPayloads ? mul + 1 : mul;
+  RedisModule_ReplyWithArray(ctx, Vector_Size(res) * mul);
+
+  for (int i = 0; i < Vector_Size(res); i++) {
+    TrieSearchResult *e;
+    Vector_Get(res, i, &e);
+
+    RedisModule_ReplyWithStringBuffer(ctx, e->str, e->len);
+    if (withScores) {
+      RedisModule_ReplyWithDouble(ctx, e->score);
+    }
+    if (withPayloads) {
+      if (e->payload)
+        RedisModule_ReplyWithStringBuffer(ctx, e->payload, e->plen);
+      else
+        RedisModule_ReplyWithNull(ctx);
+    }
+
+    TrieSearchResult_Free(e);
+  }
+  Vector_Free(res);
+}
+
+/* A suggestion search running on the concurrent search pool, against a snapshot of the
+ * dictionary */
+typedef struct {
+  RedisModuleBlockedClient *bc;
+  int epoch;
+  TrieNode *root;
+  char *str;
+  size_t len;
+  long num;
+  long maxDist;
+  int withScores;
+  int trim;
+  int optimize;
+  int withPayloads;
+} asyncSuggestJob;
+
+static void asyncSuggest_run(void *p) {
+  asyncSuggestJob *job = p;
+  Vector *res = Trie_SearchRoot(job->root, job->str, job->len, job->num, job->maxDist, 1,
+                                job->trim, job->optimize);
+
+  // the payloads of the results point into the snapshot, so we reply before leaving the epoch.
+  // Replies are buffered for the blocked client, and need no lock
+  RedisModuleCtx *ctx = RedisModule_GetThreadSafeContext(job->bc);
+  suggestReply(ctx, res, job->withScores, job->withPayloads);
+  Epoch_Exit(job->epoch);
+
+  RedisModule_UnblockClient(job->bc, NULL);
+  RedisModule_FreeThreadSafeContext(ctx);
+  rm_free(job->str);
+  rm_free(job);
+}
+
 /*
-## FT.SUGGET key prefix [FUZZY] [MAX num] [WITHSCORES] [TRIM] [OPTIMIZE] [WITHPAYLOADS]
+## FT.SUGGET key prefix [FUZZY] [MAX num] [WITHSCORES] [TRIM] [OPTIMIZE] [WITHPAYLOADS] [ASYNC]
 
 Get completion suggestions for a prefix
 
@@ -1061,6 +1621,10 @@ Get completion suggestions for a prefix
    - WITHPAYLOADS: If set, we also return each entry's payload as they were inserted, or nil if no
 payload
     exists.
+
+   - ASYNC: If set, the search runs on the concurrent search pool, against a snapshot of the
+     dictionary, leaving the main thread free to serve other commands and suggestion updates.
+
 ### Returns:
 
 Array reply: a list of the top suggestions matching the prefix
@@ -1069,7 +1633,7 @@ Array reply: a list of the top suggestions matching the prefix
 int SuggestGetCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   RedisModule_AutoMemory(ctx); /* Use automatic memory management. */
 
-  if (argc < 3 || argc > 10) return RedisModule_WrongArity(ctx);
+  if (argc < 3 || argc > 11) return RedisModule_WrongArity(ctx);
 
   RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
   // make sure the key is a trie
@@ -1109,32 +1673,27 @@ int SuggestGetCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   // detect WITHPAYLOADS
   int withPayloads = RMUtil_ArgExists("WITHPAYLOADS", argv, argc, 3);
 
-  Vector *res = Trie_Search(tree, s, len, num, maxDist, 1, trim, optimize);
-
-  // if we also need to return scores, we need double the records
-  int mul = 1;
-  mul = withScores ? mul + 1 : mul;
-  mul = withPayloads ? mul + 1 : mul;
-  RedisModule_ReplyWithArray(ctx, Vector_Size(res) * mul);
-
-  for (int i = 0; i < Vector_Size(res); i++) {
-    TrieSearchResult *e;
-    Vector_Get(res, i, &e);
-
-    RedisModule_ReplyWithStringBuffer(ctx, e->str, e->len);
-    if (withScores) {
-      RedisModule_ReplyWithDouble(ctx, e->score);
-    }
-    if (withPayloads) {
-      if (e->payload)
-        RedisModule_ReplyWithStringBuffer(ctx, e->payload, e->plen);
-      else
-        RedisModule_ReplyWithNull(ctx);
-    }
-
-    TrieSearchResult_Free(e);
+  // detect ASYNC, searching a snapshot of the trie on the search pool
+  if (RMUtil_ArgExists("ASYNC", argv, argc, 3)) {
+    asyncSuggestJob *job = rm_malloc(sizeof(*job));
+    *job = (asyncSuggestJob){.str = copyString(s, len),
+                             .len = len,
+                             .num = num,
+                             .maxDist = maxDist,
+                             .withScores = withScores,
+                             .trim = trim,
+                             .optimize = optimize,
+                             .withPayloads = withPayloads};
+    // the snapshot is taken inside the epoch, so writers see it is in use
+    job->epoch = Epoch_Enter();
+    job->root = Trie_Snapshot(tree);
+    job->bc = RedisModule_BlockClient(ctx, NULL, NULL, NULL, 0);
+    ConcurrentSearch_ThreadPoolRun(asyncSuggest_run, job);
+    return REDISMODULE_OK;
   }
-  Vector_Free(res);
+
+  Vector *res = Trie_Search(tree, s, len, num, maxDist, 1, trim, optimize);
+  suggestReply(ctx, res, withScores, withPayloads);
 
   return REDISMODULE_OK;
 }
@@ -1165,6 +1724,11 @@ int RediSearch_InitModuleInternal(RedisModuleCtx *ctx, RedisModuleString **argv,
 
   ConcurrentSearch_ThreadPoolStart();
   printf("Initialized thread pool!\n");
+
+  // Select the index block decoder according to the CPU features
+  if (qint_initBlockDecoder(0)) {
+    RedisModule_Log(ctx, "notice", "Using SIMD index block decoding");
+  }
   /* Load extensions if needed */
   if (argc > 0 && RMUtil_ArgIndex("EXTLOAD", argv, argc) >= 0) {
     const char *ext = NULL;
@@ -1182,6 +1746,18 @@ int RediSearch_InitModuleInternal(RedisModuleCtx *ctx, RedisModuleString **argv,
     }
   }
 
+  /* Set the size limit of the query caches, 0 disables them */
+  if (argc > 0 && RMUtil_ArgIndex("QUERY_CACHE_MB", argv, argc) >= 0) {
+    long long mb = -1;
+    if (RMUtil_ParseArgsAfter("QUERY_CACHE_MB", argv, argc, "l", &mb) == REDISMODULE_ERR ||
+        mb < 0) {
+      RedisModule_Log(ctx, "warning", "Invalid QUERY_CACHE_MB argument");
+      return REDISMODULE_ERR;
+    }
+    RSQueryCacheMaxSize = (size_t)mb * 0x100000;
+    RedisModule_Log(ctx, "notice", "Query cache size limit set to %lldMB", mb);
+  }
+
   // Register the default hard coded extension
   if (Extension_Load("DEFAULT", DefaultExtensionInit) == REDISEARCH_ERR) {
     RedisModule_Log(ctx, "warning", "Could not register default extension");
@@ -1197,8 +1773,14 @@ int RediSearch_InitModuleInternal(RedisModuleCtx *ctx, RedisModuleString **argv,
 
   RM_TRY(NumericIndexType_Register, ctx);
 
+  RM_TRY(GeoIndexType_Register, ctx);
+  RM_TRY(TagIndexType_Register, ctx);
+
   RM_TRY(RedisModule_CreateCommand, ctx, RS_ADD_CMD, AddDocumentCommand, "write deny-oom", 1, 1, 1);
 
+  RM_TRY(RedisModule_CreateCommand, ctx, RS_MADD_CMD, AddDocumentsCommand, "write deny-oom", 1, 1,
+         1);
+
   RM_TRY(RedisModule_CreateCommand, ctx, RS_SETPAYLOAD_CMD, SetPayloadCommand, "write deny-oom", 1,
          1, 1);
 
@@ -54,21 +54,310 @@ int NumericRange_Overlaps(NumericRange *n, double min, double max) {
   return rc;
 }
 
+/* Range blocks */
+
+static inline size_t nr_writeVarint(uint64_t v, unsigned char *p) {
+  size_t n = 0;
+  while (v >= 128) {
+    p[n++] = (unsigned char)(v | 128);
+    v >>= 7;
+  }
+  p[n++] = (unsigned char)v;
+  return n;
+}
+
+static inline uint64_t nr_readVarint(const unsigned char **p) {
+  const unsigned char *c = *p;
+  uint64_t v = *c & 127;
+  for (int shift = 7; *c++ & 128; shift += 7) {
+    v |= (uint64_t)(*c & 127) << shift;
+  }
+  *p = c;
+  return v;
+}
+
+/* Decode n little endian integer offsets of 1, 2 or 4 bytes */
+static void nr_decodeOffsets(const unsigned char *p, int width, size_t n, uint32_t *out) {
+  switch (width) {
+    case 1:
+      for (size_t i = 0; i < n; i++) out[i] = p[i];
+      break;
+    case 2:
+      for (size_t i = 0; i < n; i++) out[i] = p[2 * i] | (uint32_t)p[2 * i + 1] << 8;
+      break;
+    default:
+      for (size_t i = 0; i < n; i++) {
+        out[i] = p[4 * i] | (uint32_t)p[4 * i + 1] << 8 | (uint32_t)p[4 * i + 2] << 16 |
+                 (uint32_t)p[4 * i + 3] << 24;
+      }
+  }
+}
+
+/* Integer values are stored as offsets from the block's minimum. Below 2^52 the offsets are exact in
+ * a double too */
+#define NR_MAX_EXACT_INT 4503599627370496.0
+
+/* The number of bytes of the integer offsets of a block spanning the given range, 0 if too wide */
+static int nr_offsetWidth(double span) {
+  return span < 256 ? 1 : (span < 65536 ? 2 : (span < 4294967296.0 ? 4 : 0));
+}
+
+static int cmpValues(const void *p1, const void *p2) {
+  double v1 = *(const double *)p1, v2 = *(const double *)p2;
+  return v1 < v2 ? -1 : (v1 > v2 ? 1 : 0);
+}
+
+/* Compress the tail of a range into a new block */
+static void numericRange_sealTail(NumericRange *n) {
+  NumericRangeEntry *e = n->tail;
+  size_t num = n->tailSize;
+
+  NumericRangeBlock blk = {.firstId = e[0].docId, .lastId = e[num - 1].docId,
+                           .minVal = e[0].value, .maxVal = e[0].value, .num = num};
+
+  // find out which encodings the values allow
+  double dict[NR_BLOCK_SIZE];
+  int allFloat = 1, allInt = 1, hasNaN = 0;
+  for (size_t i = 0; i < num; i++) {
+    double v = dict[i] = e[i].value;
+    blk.minVal = MIN(blk.minVal, v);
+    blk.maxVal = MAX(blk.maxVal, v);
+    allFloat = allFloat && (double)(float)v == v;
+    allInt = allInt && v == floor(v) && fabs(v) < NR_MAX_EXACT_INT;
+    hasNaN |= v != v;
+  }
+
+  // the sorted distinct values, and the index of each entry's value in them
+  uint8_t idx[NR_BLOCK_SIZE];
+  size_t numDistinct = 0;
+  if (!hasNaN) {
+    qsort(dict, num, sizeof(double), cmpValues);
+    for (size_t i = 0; i < num; i++) {
+      if (!numDistinct || dict[i] != dict[numDistinct - 1]) dict[numDistinct++] = dict[i];
+    }
+    for (size_t i = 0; i < num; i++) {
+      idx[i] = (double *)bsearch(&e[i].value, dict, numDistinct, sizeof(double), cmpValues) - dict;
+    }
+  }
+
+  int intWidth = allInt ? nr_offsetWidth(blk.maxVal - blk.minVal) : 0;
+  size_t sizes[] = {[NR_VALUES_DOUBLE] = num * sizeof(double),
+                    [NR_VALUES_FLOAT] = allFloat ? num * sizeof(float) : SIZE_MAX,
+                    [NR_VALUES_INT] = intWidth ? 1 + num * intWidth : SIZE_MAX,
+                    [NR_VALUES_DICT] = hasNaN ? SIZE_MAX : 1 + numDistinct * sizeof(double) + num};
+  blk.encoding = NR_VALUES_DOUBLE;
+  for (int i = NR_VALUES_FLOAT; i <= NR_VALUES_DICT; i++) {
+    if (sizes[i] < sizes[blk.encoding]) blk.encoding = i;
+  }
+
+  // the docId deltas take at most 5 bytes each, and we only pick encodings smaller than doubles
+  unsigned char buf[NR_BLOCK_SIZE * (5 + sizeof(double)) + sizeof(double)];
+  size_t len = 0;
+  for (size_t i = 1; i < num; i++) {
+    len += nr_writeVarint(e[i].docId - e[i - 1].docId, buf + len);
+  }
+  // raw floats and doubles are aligned, so that they are read in place
+  if (blk.encoding == NR_VALUES_FLOAT || blk.encoding == NR_VALUES_DOUBLE) {
+    size_t align = blk.encoding == NR_VALUES_FLOAT ? sizeof(float) : sizeof(double);
+    while (len % align) buf[len++] = 0;
+  }
+  blk.valuesOffset = len;
+  switch (blk.encoding) {
+    case NR_VALUES_FLOAT:
+      for (size_t i = 0; i < num; i++, len += sizeof(float)) {
+        float f = e[i].value;
+        memcpy(buf + len, &f, sizeof(float));
+      }
+      break;
+    case NR_VALUES_INT:
+      buf[len++] = intWidth;
+      for (size_t i = 0; i < num; i++) {
+        uint32_t off = (uint32_t)(e[i].value - blk.minVal);
+        for (int b = 0; b < intWidth; b++) {
+          buf[len++] = off >> (8 * b);
+        }
+      }
+      break;
+    case NR_VALUES_DICT:
+      buf[len++] = numDistinct - 1;
+      memcpy(buf + len, dict, numDistinct * sizeof(double));
+      len += numDistinct * sizeof(double);
+      memcpy(buf + len, idx, num);
+      len += num;
+      break;
+    default:
+      for (size_t i = 0; i < num; i++, len += sizeof(double)) {
+        memcpy(buf + len, &e[i].value, sizeof(double));
+      }
+  }
+
+  blk.len = len;
+  blk.data = RedisModule_Alloc(len ? len : 1);
+  memcpy(blk.data, buf, len);
+
+  if (n->numBlocks == n->blocksCap) {
+    n->blocksCap = n->blocksCap ? n->blocksCap * 2 : 4;
+    n->blocks = RedisModule_Realloc(n->blocks, n->blocksCap * sizeof(NumericRangeBlock));
+  }
+  n->blocks[n->numBlocks++] = blk;
+  n->tailSize = 0;
+}
+
+/* Decode the values of a block */
+static void numericBlock_decodeValues(const NumericRangeBlock *blk, double *values) {
+  const unsigned char *p = blk->data + blk->valuesOffset;
+  switch (blk->encoding) {
+    case NR_VALUES_FLOAT: {
+      const float *vals = (const float *)p;
+      for (size_t i = 0; i < blk->num; i++) {
+        values[i] = vals[i];
+      }
+    } break;
+    case NR_VALUES_INT: {
+      uint32_t offsets[NR_BLOCK_SIZE];
+      nr_decodeOffsets(p + 1, *p, blk->num, offsets);
+      for (size_t i = 0; i < blk->num; i++) {
+        values[i] = blk->minVal + offsets[i];
+      }
+    } break;
+    case NR_VALUES_DICT: {
+      double dict[256];
+      size_t numDistinct = (size_t)*p++ + 1;
+      memcpy(dict, p, numDistinct * sizeof(double));
+      p += numDistinct * sizeof(double);
+      for (size_t i = 0; i < blk->num; i++) {
+        values[i] = dict[p[i]];
+      }
+    } break;
+    default:
+      memcpy(values, p, blk->num * sizeof(double));
+  }
+}
+
+size_t NumericRange_DecodeBlock(const NumericRange *r, uint32_t b, t_docId *docIds,
+                                double *values) {
+  if (b >= r->numBlocks) {
+    for (size_t i = 0; i < r->tailSize; i++) {
+      if (docIds) docIds[i] = r->tail[i].docId;
+      if (values) values[i] = r->tail[i].value;
+    }
+    return r->tailSize;
+  }
+
+  const NumericRangeBlock *blk = &r->blocks[b];
+  if (docIds) {
+    const unsigned char *p = blk->data;
+    t_docId id = docIds[0] = blk->firstId;
+    for (size_t i = 1; i < blk->num; i++) {
+      docIds[i] = id += (t_docId)nr_readVarint(&p);
+    }
+  }
+  if (values) {
+    numericBlock_decodeValues(blk, values);
+  }
+  return blk->num;
+}
+
+/* Does any of n pairs of 32 bit words equal the given ones? Comparing words rather than doubles or
+ * with early exits lets the compiler vectorize the loop */
+static int nr_hasWords(const uint32_t *words, size_t n, int pairs, const uint32_t *target) {
+  int found = 0;
+  if (pairs) {
+    for (size_t i = 0; i < n; i++) {
+      found |= (words[2 * i] == target[0]) & (words[2 * i + 1] == target[1]);
+    }
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      found |= words[i] == target[0];
+    }
+  }
+  return found;
+}
+
+/* Does the block have an entry with the value? We compare the encoded values where we can */
+static int numericBlock_hasValue(const NumericRangeBlock *blk, double value) {
+  const unsigned char *p = blk->data + blk->valuesOffset;
+  // non zero numbers are equal only if their representations are. Zeros and NaNs are compared as
+  // doubles
+  int exact = value != 0 && value == value;
+
+  switch (blk->encoding) {
+    case NR_VALUES_FLOAT: {
+      float f = value;
+      if ((double)f != value) return 0;
+      const float *vals = (const float *)p;
+      if (exact) {
+        uint32_t target;
+        memcpy(&target, &f, sizeof(float));
+        return nr_hasWords((const uint32_t *)p, blk->num, 0, &target);
+      }
+      for (size_t i = 0; i < blk->num; i++) {
+        if (vals[i] == f) return 1;
+      }
+    } break;
+    case NR_VALUES_INT: {
+      double off = value - blk->minVal;
+      if (off != floor(off)) return 0;
+      uint32_t offsets[NR_BLOCK_SIZE], target = (uint32_t)off;
+      nr_decodeOffsets(p + 1, *p, blk->num, offsets);
+      return nr_hasWords(offsets, blk->num, 0, &target);
+    }
+    case NR_VALUES_DICT: {
+      // the dictionary has the sorted distinct values of the block
+      size_t bottom = 0, top = (size_t)*p++ + 1;
+      while (bottom < top) {
+        size_t mid = (bottom + top) / 2;
+        double v;
+        memcpy(&v, p + mid * sizeof(double), sizeof(double));
+        if (v == value) return 1;
+        if (v < value) {
+          bottom = mid + 1;
+        } else {
+          top = mid;
+        }
+      }
+    } break;
+    default: {
+      const double *vals = (const double *)p;
+      if (exact) {
+        uint32_t target[2];
+        memcpy(target, &value, sizeof(double));
+        return nr_hasWords((const uint32_t *)p, blk->num, 1, target);
+      }
+      for (size_t i = 0; i < blk->num; i++) {
+        if (vals[i] == value) return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/* Does the range have an entry with the value? Only blocks whose limits contain it are checked */
+static int numericRange_hasValue(NumericRange *n, double value) {
+  for (size_t i = 0; i < n->tailSize; i++) {
+    if (n->tail[i].value == value) return 1;
+  }
+
+  for (uint32_t b = 0; b < n->numBlocks; b++) {
+    NumericRangeBlock *blk = &n->blocks[b];
+    if (value < blk->minVal || value > blk->maxVal) continue;
+    if (value == blk->minVal || value == blk->maxVal || numericBlock_hasValue(blk, value)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
 int NumericRange_Add(NumericRange *n, t_docId docId, double value, int checkCard) {
   // printf("Adding %d %f to %f..%f\n", docId, value, n->minVal, n->maxVal);
-  if (n->size >= n->cap) {
-    n->cap += n->cap ? MIN(n->cap / 2, 1024 * 1024) : 2;
-    n->entries = RedisModule_Realloc(n->entries, n->cap * sizeof(NumericRangeEntry));
+  if (n->tailSize >= n->tailCap) {
+    n->tailCap = n->tailCap ? MIN(n->tailCap * 2, NR_BLOCK_SIZE) : 2;
+    n->tail = RedisModule_Realloc(n->tail, n->tailCap * sizeof(NumericRangeEntry));
   }
 
   int add = 1;
-  if (checkCard) {
-    for (int i = 0; i < n->size; i++) {
-      if (n->entries[i].value == value) {
-        add = 0;
-        break;
-      }
-    }
+  if (checkCard && n->card && value >= n->minVal && value <= n->maxVal) {
+    add = !numericRange_hasValue(n, value);
   }
 
   if (value < n->minVal || n->card == 0) n->minVal = value;
@@ -76,7 +365,11 @@ int NumericRange_Add(NumericRange *n, t_docId docId, double value, int checkCard
 
   if (add) ++n->card;
 
-  n->entries[n->size++] = (NumericRangeEntry){.docId = docId, .value = value};
+  n->tail[n->tailSize++] = (NumericRangeEntry){.docId = docId, .value = value};
+  n->size++;
+  if (n->tailSize == NR_BLOCK_SIZE) {
+    numericRange_sealTail(n);
+  }
   return n->card;
 }
 
@@ -97,9 +390,13 @@ double NumericRange_Split(NumericRange *n, NumericRangeNode **lp, NumericRangeNo
   *rp = NewLeafNode(n->size / 2 + 1, split, n->maxVal,
                     MIN(NR_MAXRANGE_CARD, 1 + n->splitCard * NR_EXPONENT));
 
-  for (uint32_t i = 0; i < n->size; i++) {
-    NumericRange_Add(n->entries[i].value < split ? (*lp)->range : (*rp)->range, n->entries[i].docId,
-                     n->entries[i].value, 1);
+  t_docId docIds[NR_BLOCK_SIZE];
+  double values[NR_BLOCK_SIZE];
+  for (uint32_t b = 0; b <= n->numBlocks; b++) {
+    size_t num = NumericRange_DecodeBlock(n, b, docIds, values);
+    for (size_t i = 0; i < num; i++) {
+      NumericRange_Add(values[i] < split ? (*lp)->range : (*rp)->range, docIds[i], values[i], 1);
+    }
   }
   // TimeSampler_End(&ts);
 
@@ -119,18 +416,82 @@ NumericRangeNode *NewLeafNode(size_t cap, double min, double max, size_t splitCa
   n->maxDepth = 0;
   n->range = RedisModule_Alloc(sizeof(NumericRange));
 
+  cap = MIN(cap, NR_BLOCK_SIZE);
   *n->range = (NumericRange){.minVal = min,
                              .maxVal = max,
-                             .cap = cap,
                              .size = 0,
                              .card = 0,
                              .splitCard = splitCard,
-                             .entries = RedisModule_Calloc(cap, sizeof(NumericRangeEntry))};
+                             .tailCap = cap,
+                             .tail = RedisModule_Calloc(cap, sizeof(NumericRangeEntry))};
   return n;
 }
 
+static void numericRange_free(NumericRange *r) {
+  for (uint32_t b = 0; b < r->numBlocks; b++) {
+    RedisModule_Free(r->blocks[b].data);
+  }
+  RedisModule_Free(r->blocks);
+  RedisModule_Free(r->tail);
+  RedisModule_Free(r);
+}
+
 #define __isLeaf(n) (n->left == NULL && n->right == NULL)
 
+/* Recompute the height of a node from its children's */
+static void numericRangeNode_updateDepth(NumericRangeNode *n) {
+  n->maxDepth = __isLeaf(n) ? 0 : 1 + MAX(n->left->maxDepth, n->right->maxDepth);
+}
+
+/* Rotate the subtree of n so that one of its children takes its place. The two nodes swap their
+ * contents rather than their positions, so n's parent keeps pointing at n. n keeps its range, which
+ * still covers the whole subtree, while the child's range no longer covers its new subtree and is
+ * dropped */
+static void numericRangeNode_rotate(NumericRangeNode *n, int rightUp) {
+  NumericRangeNode *c = rightUp ? n->right : n->left;
+  NumericRangeNode *cl = c->left, *cr = c->right;
+  if (c->range) {
+    numericRange_free(c->range);
+    c->range = NULL;
+  }
+
+  double v = n->value;
+  n->value = c->value;
+  c->value = v;
+  if (rightUp) {
+    c->left = n->left;
+    c->right = cl;
+    n->left = c;
+    n->right = cr;
+  } else {
+    c->left = cr;
+    c->right = n->right;
+    n->left = cl;
+    n->right = c;
+  }
+  numericRangeNode_updateDepth(c);
+  numericRangeNode_updateDepth(n);
+}
+
+/* Update the height of a node whose subtree has grown, and rotate it if one of its children has
+ * become deeper than the other by more than one level. Increasing values, like timestamps, would
+ * otherwise grow the tree into a long chain of right children */
+static void numericRangeNode_balance(NumericRangeNode *n) {
+  numericRangeNode_updateDepth(n);
+  int balance = n->right->maxDepth - n->left->maxDepth;
+  if (balance > 1) {
+    if (n->right->left->maxDepth > n->right->right->maxDepth) {
+      numericRangeNode_rotate(n->right, 0);
+    }
+    numericRangeNode_rotate(n, 1);
+  } else if (balance < -1) {
+    if (n->left->right->maxDepth > n->left->left->maxDepth) {
+      numericRangeNode_rotate(n->left, 1);
+    }
+    numericRangeNode_rotate(n, 0);
+  }
+}
+
 int NumericRangeNode_Add(NumericRangeNode *n, t_docId docId, double value) {
 
   if (!__isLeaf(n)) {
@@ -143,12 +504,12 @@ int NumericRangeNode_Add(NumericRangeNode *n, t_docId docId, double value) {
     // recursively add to its left or right child. if the child has split we get 1 in return
     int rc = NumericRangeNode_Add((value < n->value ? n->left : n->right), docId, value);
     if (rc) {
-      // if there was a split it means our max depth has increased.
-      // we we are too deep - we don't retain this node's range anymore.
+      // if there was a split our subtree may have grown deeper, and may need rebalancing.
+      // if we are too deep - we don't retain this node's range anymore.
       // this keeps memory footprint in check
-      if (++n->maxDepth > NR_MAX_DEPTH && n->range) {
-        RedisModule_Free(n->range->entries);
-        RedisModule_Free(n->range);
+      numericRangeNode_balance(n);
+      if (n->maxDepth > NR_MAX_DEPTH && n->range) {
+        numericRange_free(n->range);
         n->range = NULL;
       }
     }
@@ -194,10 +555,10 @@ void __recursiveAddRange(Vector *v, NumericRangeNode *n, double min, double max)
     }
   }
 
-  // for non leaf nodes - we try to descend into their children
+  // for non leaf nodes - we try to descend into the children whose values may be in the range
   if (!__isLeaf(n)) {
-    __recursiveAddRange(v, n->left, min, max);
-    __recursiveAddRange(v, n->right, min, max);
+    if (min < n->value) __recursiveAddRange(v, n->left, min, max);
+    if (max >= n->value) __recursiveAddRange(v, n->right, min, max);
   } else if (NumericRange_Overlaps(n->range, min, max)) {
     Vector_Push(v, n->range);
     return;
@@ -224,9 +585,7 @@ Vector *NumericRangeNode_FindRange(NumericRangeNode *n, double min, double max)
 void NumericRangeNode_Free(NumericRangeNode *n) {
   if (!n) return;
   if (n->range) {
-
-    RedisModule_Free(n->range->entries);
-    RedisModule_Free(n->range);
+    numericRange_free(n->range);
     n->range = NULL;
   }
 
@@ -280,41 +639,76 @@ void NumericRangeTree_Free(NumericRangeTree *t) {
   RedisModule_Free(t);
 }
 
+/* Can no value between min and max match the filter? */
+static int nr_filterExcludes(NumericFilter *f, double min, double max) {
+  return max < f->min || (max == f->min && !f->inclusiveMin) || min > f->max ||
+         (min == f->max && !f->inclusiveMax);
+}
+
+/* Keep the docIds whose values match the filter, compacting them in place. Written without
+ * branches so that the compiler can vectorize it */
+static size_t nr_filterBlock(NumericFilter *f, t_docId *docIds, const double *values, size_t n) {
+  double min = f->min, max = f->max;
+  int incMin = f->inclusiveMin != 0, incMax = f->inclusiveMax != 0;
+  size_t m = 0;
+  for (size_t i = 0; i < n; i++) {
+    double v = values[i];
+    docIds[m] = docIds[i];
+    m += ((v > min) | (incMin & (v == min))) & ((v < max) | (incMax & (v == max)));
+  }
+  return m;
+}
+
+/* Decode the next block of the range, keeping the docIds matching the filter. Returns 0 if there are
+ * no more blocks */
+static int nr_nextBlock(NumericRangeIterator *it) {
+  NumericRange *rng = it->rng;
+  it->offset = it->numMatches = 0;
+  if (it->block > rng->numBlocks) return 0;
+  uint32_t b = it->block++;
+
+  // blocks entirely in the filter don't need their values decoded, and ones entirely outside of it
+  // are skipped
+  int check = it->nf != NULL;
+  if (check && b < rng->numBlocks) {
+    NumericRangeBlock *blk = &rng->blocks[b];
+    if (nr_filterExcludes(it->nf, blk->minVal, blk->maxVal)) return 1;
+    check = !NumericFilter_Match(it->nf, blk->minVal) || !NumericFilter_Match(it->nf, blk->maxVal);
+  }
+
+  double values[NR_BLOCK_SIZE];
+  size_t n = NumericRange_DecodeBlock(rng, b, it->matches, check ? values : NULL);
+  if (check) {
+    n = nr_filterBlock(it->nf, it->matches, values, n);
+  }
+  it->numMatches = n;
+
+  // if the range changed while the lock was released, we may see entries we've already read
+  while (it->offset < it->numMatches && it->matches[it->offset] <= it->lastDocId) {
+    it->offset++;
+  }
+  return 1;
+}
+
 /* Read the next entry from the iterator, into hit *e.
   *  Returns INDEXREAD_EOF if at the end */
 int NR_Read(void *ctx, RSIndexResult **r) {
 
   NumericRangeIterator *it = ctx;
 
-  if (it->atEOF || it->rng->size == 0) {
+  if (it->atEOF) {
     goto eof;
   }
 
-  int match = 0;
-  double lastValue = 0;
-  do {
-    if (it->offset == it->rng->size) {
-      goto eof;
-    }
-    it->lastDocId = it->rng->entries[it->offset].docId;
-    // lastValue = it->rng->entries[it->offset].value;
-    if (it->nf) {
-      match = NumericFilter_Match(it->nf, it->rng->entries[it->offset].value);
-    } else {
-      match = 1;
-    }
-    it->offset++;
-
-    // printf("nf %s filter doc %d (%f): %d\n", it->nf->fieldName, it->lastDocId, lastValue, match);
-  } while (!match);
+  while (it->offset == it->numMatches) {
+    if (!nr_nextBlock(it)) goto eof;
+  }
 
-  if (match) {
-    // match must be true here
-    it->rec->docId = it->lastDocId;
-    *r = it->rec;
+  it->lastDocId = it->matches[it->offset++];
+  it->rec->docId = it->lastDocId;
+  *r = it->rec;
+  return INDEXREAD_OK;
 
-    return INDEXREAD_OK;
-  }
 eof:
   it->atEOF = 1;
   return INDEXREAD_EOF;
@@ -325,47 +719,50 @@ eof:
 int NR_SkipTo(void *ctx, uint32_t docId, RSIndexResult **r) {
 
   NumericRangeIterator *it = ctx;
+  NumericRange *rng = it->rng;
 
-  if (it->atEOF || it->rng->size == 0) {
-    it->atEOF = 1;
+  if (it->atEOF) {
     return INDEXREAD_EOF;
   }
 
-  // If we are seeking beyond our last docId - just declare EOF
-  if (docId > it->rng->entries[it->rng->size - 1].docId) {
-    it->atEOF = 1;
-    it->rec->docId = 0;
-    return INDEXREAD_EOF;
+  // if the decoded block ends before docId, binary search the first later block that may have it
+  if (it->offset == it->numMatches || it->matches[it->numMatches - 1] < docId) {
+    uint32_t bottom = it->block, top = rng->numBlocks;
+    while (bottom < top) {
+      uint32_t mid = (bottom + top) / 2;
+      if (rng->blocks[mid].lastId < docId) {
+        bottom = mid + 1;
+      } else {
+        top = mid;
+      }
+    }
+    it->block = bottom;
+    it->offset = it->numMatches = 0;
   }
 
-  // Find the closest entry to the requested docId
-  int top = (int)it->rng->size - 1, bottom = (int)it->offset;
-  int i = bottom;
-
-  while (bottom <= top) {
-    t_docId did = it->rng->entries[i].docId;
-    if (did == docId) {
-      break;
+  // find the first matching entry not lower than docId, in the first block that has one
+  while (it->offset == it->numMatches || it->matches[it->numMatches - 1] < docId) {
+    if (!nr_nextBlock(it)) {
+      it->atEOF = 1;
+      it->rec->docId = 0;
+      return INDEXREAD_EOF;
     }
-    if (docId <= did) {
-      top = i - 1;
+  }
+  u_int bottom = it->offset, top = it->numMatches - 1;
+  while (bottom < top) {
+    u_int mid = (bottom + top) / 2;
+    if (it->matches[mid] < docId) {
+      bottom = mid + 1;
     } else {
-      bottom = i + 1;
+      top = mid;
     }
-    i = (bottom + top) / 2;
   }
 
-  it->offset = i;
-  it->lastDocId = it->rng->entries[i].docId;
+  it->offset = bottom + 1;
+  it->lastDocId = it->matches[bottom];
   it->rec->docId = it->lastDocId;
+  *r = it->rec;
 
-  // Now read the current entry
-  int rc = NR_Read(it, r);
-
-  // EOF or not found are returned as is
-  if (rc != INDEXREAD_OK) return rc;
-
-  // if we got ok - check if the read document was the one we wanted or not.
   // If the requested document doesn't match the filter, we should return NOTFOUND
   return it->lastDocId == docId ? INDEXREAD_OK : INDEXREAD_NOTFOUND;
 }
@@ -393,15 +790,16 @@ size_t NR_Len(void *ctx) {
   return ((NumericRangeIterator *)ctx)->rng->size;
 }
 
+size_t NR_NumEstimated(void *ctx) {
+  return ((NumericRangeIterator *)ctx)->rng->size;
+}
+
 RSIndexResult *NR_Current(void *ctx) {
   return ((NumericRangeIterator *)ctx)->rec;
 }
 
-IndexIterator *NewNumericRangeIterator(NumericRange *nr, NumericFilter *f) {
-  IndexIterator *ret = malloc(sizeof(IndexIterator));
-
-  NumericRangeIterator *it = malloc(sizeof(NumericRangeIterator));
-
+static void nr_initIterator(NumericRangeIterator *it, NumericRange *nr, NumericFilter *f,
+                            RSIndexResult *rec) {
   it->nf = NULL;
   // if this range is at either end of the filter, we need to check each record
   if (!NumericFilter_Match(f, nr->minVal) || !NumericFilter_Match(f, nr->maxVal)) {
@@ -410,14 +808,24 @@ IndexIterator *NewNumericRangeIterator(NumericRange *nr, NumericFilter *f) {
 
   it->atEOF = 0;
   it->lastDocId = 0;
+  it->block = 0;
   it->offset = 0;
+  it->numMatches = 0;
   it->rng = nr;
-  it->rec = NewVirtualResult();
+  it->rec = rec;
+}
+
+IndexIterator *NewNumericRangeIterator(NumericRange *nr, NumericFilter *f) {
+  IndexIterator *ret = malloc(sizeof(IndexIterator));
+
+  NumericRangeIterator *it = malloc(sizeof(NumericRangeIterator));
+  nr_initIterator(it, nr, f, NewVirtualResult());
   it->rec->fieldMask = RS_FIELDMASK_ALL;
   ret->ctx = it;
 
   ret->Free = NR_Free;
   ret->Len = NR_Len;
+  ret->NumEstimated = NR_NumEstimated;
   ret->HasNext = NR_HasNext;
   ret->LastDocId = NR_LastDocId;
   ret->Current = NR_Current;
@@ -427,19 +835,128 @@ IndexIterator *NewNumericRangeIterator(NumericRange *nr, NumericFilter *f) {
   return ret;
 }
 
-/* Create a union iterator from the numeric filter, over all the sub-ranges in the tree that fit
- * the
- * filter */
+/* Min heap order of the cursors' current docIds */
+static int nf_cmpCursors(const void *e1, const void *e2, const void *udata) {
+  const t_docId d1 = ((const NumericRangeIterator *)e1)->lastDocId,
+                d2 = ((const NumericRangeIterator *)e2)->lastDocId;
+  return d1 < d2 ? 1 : (d1 > d2 ? -1 : 0);
+}
+
+/* Take the cursor with the lowest docId out of the heap, advance it and put it back. Returns the
+ * docId it was on */
+static t_docId nf_heapPop(NumericFilterIterator *it) {
+  NumericRangeIterator *c = heap_poll(it->heap);
+  t_docId docId = c->lastDocId;
+  RSIndexResult *r;
+  if (NR_Read(c, &r) == INDEXREAD_OK) {
+    heap_offerx(it->heap, c);
+  }
+  return docId;
+}
+
+/* The first docId not lower than docId in the bitmap, or 0 if there is none */
+static t_docId nf_bitmapNext(NumericFilterIterator *it, t_docId docId) {
+  if (docId > it->maxDocId) return 0;
+  size_t w = docId / 64;
+  uint64_t word = it->bits[w] & (~0ULL << (docId % 64));
+  while (!word) {
+    if (++w > it->maxDocId / 64) return 0;
+    word = it->bits[w];
+  }
+  return w * 64 + __builtin_ctzll(word);
+}
+
+static int NF_Read(void *ctx, RSIndexResult **hit) {
+  NumericFilterIterator *it = ctx;
+  if (it->atEOF) return INDEXREAD_EOF;
+
+  t_docId docId = 0;
+  if (it->bits) {
+    docId = nf_bitmapNext(it, it->lastDocId + 1);
+  } else {
+    // a document added twice is only returned once
+    while (heap_count(it->heap) && (docId = nf_heapPop(it)) <= it->lastDocId) {
+      docId = 0;
+    }
+  }
+
+  if (!docId) {
+    it->atEOF = 1;
+    return INDEXREAD_EOF;
+  }
+  it->lastDocId = it->rec->docId = docId;
+  *hit = it->rec;
+  return INDEXREAD_OK;
+}
+
+static int NF_SkipTo(void *ctx, uint32_t docId, RSIndexResult **hit) {
+  NumericFilterIterator *it = ctx;
+  if (it->atEOF) return INDEXREAD_EOF;
+  if (docId <= it->lastDocId) {
+    return NF_Read(ctx, hit) == INDEXREAD_EOF ? INDEXREAD_EOF : INDEXREAD_NOTFOUND;
+  }
+
+  if (it->bits) {
+    it->lastDocId = docId - 1;
+  } else {
+    // skip the cursors that are behind docId, then read the lowest one as usual
+    RSIndexResult *r;
+    while (heap_count(it->heap) &&
+           ((NumericRangeIterator *)heap_peek(it->heap))->lastDocId < docId) {
+      NumericRangeIterator *c = heap_poll(it->heap);
+      if (NR_SkipTo(c, docId, &r) != INDEXREAD_EOF) {
+        heap_offerx(it->heap, c);
+      }
+    }
+  }
+
+  if (NF_Read(ctx, hit) == INDEXREAD_EOF) return INDEXREAD_EOF;
+  return it->lastDocId == docId ? INDEXREAD_OK : INDEXREAD_NOTFOUND;
+}
+
+static t_docId NF_LastDocId(void *ctx) {
+  return ((NumericFilterIterator *)ctx)->lastDocId;
+}
+
+static int NF_HasNext(void *ctx) {
+  return !((NumericFilterIterator *)ctx)->atEOF;
+}
+
+static size_t NF_Len(void *ctx) {
+  return ((NumericFilterIterator *)ctx)->numEntries;
+}
+
+static RSIndexResult *NF_Current(void *ctx) {
+  return ((NumericFilterIterator *)ctx)->rec;
+}
+
+static void NF_Free(IndexIterator *self) {
+  NumericFilterIterator *it = self->ctx;
+  free(it->cursors);
+  if (it->heap) heap_free(it->heap);
+  free(it->bits);
+  IndexResult_Free(it->rec);
+  free(it);
+  free(self);
+}
+
+/* The last docId in a range, or 0 if it is empty */
+static t_docId nr_lastDocId(const NumericRange *r) {
+  if (r->tailSize) return r->tail[r->tailSize - 1].docId;
+  return r->numBlocks ? r->blocks[r->numBlocks - 1].lastId : 0;
+}
+
+/* Create an iterator over the ranges of the tree that fit the filter */
 IndexIterator *NewNumericFilterIterator(NumericRangeTree *t, NumericFilter *f) {
 
   Vector *v = NumericRangeTree_Find(t, f->min, f->max);
   if (!v || Vector_Size(v) == 0) {
-    // printf("Got no filter vector\n");
+    if (v) Vector_Free(v);
     return NULL;
   }
 
   int n = Vector_Size(v);
-  // if we only selected one range - we can just iterate it without union or anything
+  // if we only selected one range - we can just iterate it without merging anything
   if (n == 1) {
     NumericRange *rng;
     Vector_Get(v, 0, &rng);
@@ -448,21 +965,57 @@ IndexIterator *NewNumericFilterIterator(NumericRangeTree *t, NumericFilter *f) {
     return it;
   }
 
-  // We create a  union iterator, advancing a union on all the selected range,
-  // treating them as one consecutive range
-  IndexIterator **its = calloc(n, sizeof(IndexIterator *));
-
-  for (size_t i = 0; i < n; i++) {
+  NumericFilterIterator *it = calloc(1, sizeof(*it));
+  it->rec = NewVirtualResult();
+  it->rec->fieldMask = RS_FIELDMASK_ALL;
+  it->cursors = malloc(n * sizeof(NumericRangeIterator));
+  for (int i = 0; i < n; i++) {
     NumericRange *rng;
     Vector_Get(v, i, &rng);
-    if (!rng) {
-      continue;
-    }
-
-    its[i] = NewNumericRangeIterator(rng, f);
+    if (!rng) continue;
+    nr_initIterator(&it->cursors[it->numCursors++], rng, f, it->rec);
+    it->numEntries += rng->size;
+    it->maxDocId = MAX(it->maxDocId, nr_lastDocId(rng));
   }
   Vector_Free(v);
-  return NewUnionIterator(its, n, NULL, 1);
+
+  if (it->numEntries * NF_BITMAP_DENSITY >= it->maxDocId) {
+    // collect the matching docIds of all the ranges now, and drop the cursors
+    it->bits = calloc(it->maxDocId / 64 + 1, sizeof(uint64_t));
+    for (size_t i = 0; i < it->numCursors; i++) {
+      NumericRangeIterator *c = &it->cursors[i];
+      while (nr_nextBlock(c)) {
+        for (u_int j = 0; j < c->numMatches; j++) {
+          it->bits[c->matches[j] / 64] |= 1ULL << (c->matches[j] % 64);
+        }
+      }
+    }
+    free(it->cursors);
+    it->cursors = NULL;
+    it->numCursors = 0;
+  } else {
+    // position each cursor on its first match
+    it->heap = malloc(heap_sizeof(it->numCursors));
+    heap_init(it->heap, nf_cmpCursors, NULL, it->numCursors);
+    for (size_t i = 0; i < it->numCursors; i++) {
+      RSIndexResult *r;
+      if (NR_Read(&it->cursors[i], &r) == INDEXREAD_OK) {
+        heap_offerx(it->heap, &it->cursors[i]);
+      }
+    }
+  }
+
+  IndexIterator *ret = malloc(sizeof(IndexIterator));
+  ret->ctx = it;
+  ret->Free = NF_Free;
+  ret->Len = NF_Len;
+  ret->NumEstimated = NF_Len;
+  ret->HasNext = NF_HasNext;
+  ret->LastDocId = NF_LastDocId;
+  ret->Current = NF_Current;
+  ret->Read = NF_Read;
+  ret->SkipTo = NF_SkipTo;
+  return ret;
 }
 
 RedisModuleType *NumericIndexType = NULL;
@@ -498,7 +1051,11 @@ void __numericIndex_memUsageCallback(NumericRangeNode *n, void *ctx) {
   *sz += sizeof(NumericRangeNode);
   if (n->range) {
     *sz += sizeof(NumericRange);
-    *sz += n->range->cap * sizeof(NumericRangeEntry);
+    *sz += n->range->tailCap * sizeof(NumericRangeEntry);
+    *sz += n->range->blocksCap * sizeof(NumericRangeBlock);
+    for (uint32_t b = 0; b < n->range->numBlocks; b++) {
+      *sz += n->range->blocks[b].len;
+    }
   }
 }
 
@@ -571,11 +1128,16 @@ void __numericIndex_rdbSaveCallback(NumericRangeNode *n, void *ctx) {
 
   if (__isLeaf(n) && n->range) {
     NumericRange *rng = n->range;
-
-    for (size_t n = 0; n < rng->size; n++) {
-      RedisModule_SaveUnsigned(rctx->rdb, rng->entries[n].docId);
-      RedisModule_SaveDouble(rctx->rdb, rng->entries[n].value);
-      ++rctx->num;
+    t_docId docIds[NR_BLOCK_SIZE];
+    double values[NR_BLOCK_SIZE];
+
+    for (uint32_t b = 0; b <= rng->numBlocks; b++) {
+      size_t num = NumericRange_DecodeBlock(rng, b, docIds, values);
+      for (size_t i = 0; i < num; i++) {
+        RedisModule_SaveUnsigned(rctx->rdb, docIds[i]);
+        RedisModule_SaveDouble(rctx->rdb, values[i]);
+        ++rctx->num;
+      }
     }
   }
 }
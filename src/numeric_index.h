@@ -9,6 +9,7 @@
 #include "redismodule.h"
 #include "search_ctx.h"
 #include "numeric_filter.h"
+#include "util/heap.h"
 
 #define RT_LEAF_CARDINALITY_MAX 500
 
@@ -19,27 +20,69 @@ typedef struct {
   double value;
 } NumericRangeEntry;
 
+/* The number of entries in a compressed block of a numeric range */
+#define NR_BLOCK_SIZE 128
+
+/* The encodings of the values of a block. We pick the smallest one that represents the block's
+ * values exactly */
+typedef enum {
+  // raw doubles
+  NR_VALUES_DOUBLE,
+  // floats, if no value loses precision as a float
+  NR_VALUES_FLOAT,
+  // varint offsets from the block's minimum, if all the values are integers
+  NR_VALUES_INT,
+  // a dictionary of the block's distinct values, and a byte per entry indexing it
+  NR_VALUES_DICT,
+} NumericValueEncoding;
+
+/* A sealed block of NR_BLOCK_SIZE entries of a range. The data holds the varint deltas of the
+ * docIds after the first one, followed by the values at valuesOffset. The block's limits let
+ * readers skip it, or skip decoding its values, without looking at the data */
+typedef struct {
+  t_docId firstId;
+  t_docId lastId;
+  double minVal;
+  double maxVal;
+  unsigned char *data;
+  uint16_t len;
+  uint16_t valuesOffset;
+  uint16_t num;
+  uint8_t encoding;
+} NumericRangeBlock;
+
 /* A numeric range is a node in a numeric range tree, representing a range of values bunched
  * toghether.
  * Since we do not know the distribution of scores ahead, we use a splitting approach - we start
  * with single value nodes, and when a node passes some cardinality we split it.
  * We save the minimum and maximum values inside the node, and when we split we split by finding the
- * median value */
+ * median value.
+ *
+ * Entries are kept in docId order. The last ones are kept as is in the tail, and every
+ * NR_BLOCK_SIZE of them are compressed into a block */
 typedef struct {
   double minVal;
   double maxVal;
 
   uint32_t size;
-  uint32_t cap;
   u_int16_t card;
   uint32_t splitCard;
-  NumericRangeEntry *entries;
+
+  NumericRangeBlock *blocks;
+  uint32_t numBlocks;
+  uint32_t blocksCap;
+
+  NumericRangeEntry *tail;
+  uint16_t tailSize;
+  uint16_t tailCap;
 } NumericRange;
 
 /* NumericRangeNode is a node in the range tree that can have a range in it or not, and can be a
  * leaf or not */
 typedef struct rtNode {
   double value;
+  // the height of the node's subtree, 0 for leaves. The tree is kept balanced by rotating nodes
+  // whose children's heights differ by more than one
   int maxDepth;
   struct rtNode *left;
   struct rtNode *right;
@@ -61,7 +104,12 @@ typedef struct {
   NumericRange *rng;
   NumericFilter *nf;
   t_docId lastDocId;
+  // the next block to decode, where rng->numBlocks is the tail
+  uint32_t block;
+  // the docIds of the decoded block that match the filter, and our position in them
   u_int offset;
+  u_int numMatches;
+  t_docId matches[NR_BLOCK_SIZE];
   int atEOF;
   RSIndexResult *rec;
 
@@ -90,9 +138,38 @@ void NR_Free(struct indexIterator *self);
 /* Return the number of results in this iterator. Used by the query execution
  * on the top iterator */
 size_t NR_Len(void *ctx);
+size_t NR_NumEstimated(void *ctx);
 
 struct indexIterator *NewNumericRangeIterator(NumericRange *nr, NumericFilter *f);
 
+/* A filter matching more than one range of a tree is iterated by a single iterator over all of them,
+ * rather than by a union of range iterators, since the ranges are disjoint and a document is in at
+ * most one of them.
+ *
+ * If the ranges have at least one entry per NF_BITMAP_DENSITY documents of their docId span, the
+ * matching docIds are collected into a bitmap when the iterator is created, and reads just scan it.
+ * Otherwise each range is iterated by its own cursor, and the cursors are kept in a min heap of
+ * their current docIds, so that a read costs O(log ranges) */
+#define NF_BITMAP_DENSITY 32
+
+typedef struct {
+  // heap mode: a cursor per range, and the ones not at EOF in a heap
+  NumericRangeIterator *cursors;
+  size_t numCursors;
+  heap_t *heap;
+
+  // bitmap mode: a bit per docId up to maxDocId
+  uint64_t *bits;
+  t_docId maxDocId;
+
+  size_t numEntries;
+  t_docId lastDocId;
+  int atEOF;
+  RSIndexResult *rec;
+} NumericFilterIterator;
+
+/* Create an iterator over the documents of a tree matching a filter. Returns NULL if no range of
+ * the tree overlaps the filter */
 struct indexIterator *NewNumericFilterIterator(NumericRangeTree *t, NumericFilter *f);
 
 /* Add an entry to a numeric range node. Returns the cardinality of the range after the
@@ -100,10 +177,14 @@ struct indexIterator *NewNumericFilterIterator(NumericRangeTree *t, NumericFilte
  * No deduplication is done */
 int NumericRange_Add(NumericRange *r, t_docId docId, double value, int checkCard);
 
+/* Decode the entries of block b of a range, where b == r->numBlocks is the tail, into docIds and
+ * values. Either may be NULL if not needed. Returns the number of entries */
+size_t NumericRange_DecodeBlock(const NumericRange *r, uint32_t b, t_docId *docIds, double *values);
+
 /* Split n into two ranges, lp for left, and rp for right. We split by the median score */
 double NumericRange_Split(NumericRange *n, NumericRangeNode **lp, NumericRangeNode **rp);
 
-/* Create a new range node with the given capacity, minimum and maximum values */
+/* Create a new range node with the given capacity hint, minimum and maximum values */
 NumericRangeNode *NewLeafNode(size_t cap, double min, double max, size_t splitCard);
 
 /* Add a value to a tree node or its children recursively. Splits the relevant node if needed.
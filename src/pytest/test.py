@@ -170,6 +170,113 @@ class SearchTestCase(ModuleTestCase('../redisearch.so')):
                 self.assertEqual(1, r.execute_command('ft.del', 'idx', did))
                 self.assertEqual(0, r.execute_command('ft.del', 'idx', did))
 
+    def testNoTermKeys(self):
+        with self.redis() as r:
+            r.flushdb()
+            self.assertOk(r.execute_command(
+                'ft.create', 'idx', 'notermkeys', 'schema', 'title', 'text', 'body', 'text'))
+            for i in range(100):
+                self.assertOk(r.execute_command('ft.add', 'idx', 'doc%d' % i, 1.0, 'fields',
+                                                'title', 'hello world', 'body', 'lorem ipsum %d' % i))
+
+            # the only keys are the documents and the index spec
+            self.assertEqual(0, len(r.keys('ft:*')))
+
+            for _ in r.retry_with_rdb_reload():
+                res = r.execute_command(
+                    'ft.search', 'idx', 'hello', 'nocontent', 'limit', 0, 0)
+                self.assertEqual(100, res[0])
+                res = r.execute_command(
+                    'ft.search', 'idx', '"lorem ipsum" 42', 'nocontent')
+                self.assertEqual([1, 'doc42'], res)
+                res = r.execute_command(
+                    'ft.search', 'idx', '@title:lorem', 'nocontent')
+                self.assertEqual([0], res)
+
+            # terms too long to be kept in the spec are skipped
+            self.assertOk(r.execute_command('ft.add', 'idx', 'long', 1.0, 'fields',
+                                            'title', 'hello ' + 'x' * 70000))
+            res = r.execute_command(
+                'ft.search', 'idx', 'hello', 'nocontent', 'limit', 0, 0)
+            self.assertEqual(101, res[0])
+
+            self.assertOk(r.execute_command('ft.drop', 'idx'))
+            self.assertEqual(0, len(r.keys('*')))
+
+    def testAsyncAdd(self):
+        with self.redis() as r:
+            r.flushdb()
+            self.assertOk(r.execute_command(
+                'ft.create', 'idx', 'schema', 'f', 'text', 'sortable', 'n', 'numeric'))
+
+            for i in range(100):
+                self.assertOk(r.execute_command('ft.add', 'idx', 'doc%d' % i, 1.0, 'async', 'fields',
+                                                'f', 'hello world %d' % i, 'n', i))
+            self.assertOk(r.execute_command('ft.add', 'idx', 'doc0', 1.0, 'replace', 'async',
+                                            'fields', 'f', 'goodbye world', 'n', 0))
+            with self.assertResponseError():
+                r.execute_command('ft.add', 'idx', 'doc1', 1.0, 'async', 'fields',
+                                  'f', 'hello world')
+            with self.assertResponseError():
+                r.execute_command('ft.add', 'idx', 'doc100', 1.0, 'async', 'fields',
+                                  'n', 'not a number')
+
+            for _ in r.retry_with_rdb_reload():
+                res = r.execute_command(
+                    'ft.search', 'idx', 'hello', 'nocontent', 'limit', 0, 0)
+                self.assertEqual(99, res[0])
+                res = r.execute_command(
+                    'ft.search', 'idx', 'goodbye', 'nocontent')
+                self.assertEqual([1, 'doc0'], res)
+                res = r.execute_command(
+                    'ft.search', 'idx', 'hello @n:[10 19]', 'nocontent', 'limit', 0, 0)
+                self.assertEqual(10, res[0])
+                res = r.execute_command('hgetall', 'doc5')
+                self.assertIn('hello world 5', res)
+
+    def testMAdd(self):
+        with self.redis() as r:
+            r.flushdb()
+            self.assertOk(r.execute_command(
+                'ft.create', 'idx', 'schema', 'f', 'text', 'n', 'numeric'))
+
+            res = r.execute_command('ft.madd', 'idx', 'documents',
+                                    'doc1', 1.0, 2, 'f', 'hello world', 'n', 1,
+                                    'doc2', 0.5, 'payload', 'foo', 1, 'f', 'hello kitty',
+                                    'doc1', 1.0, 1, 'f', 'hello again',
+                                    'doc3', 1.0, 1, 'n', 'not a number')
+            self.assertEqual('OK', res[0])
+            self.assertEqual('OK', res[1])
+            self.assertIsInstance(res[2], redis.ResponseError)
+            self.assertIsInstance(res[3], redis.ResponseError)
+
+            for _ in r.retry_with_rdb_reload():
+                res = r.execute_command(
+                    'ft.search', 'idx', 'hello', 'nocontent', 'withpayloads')
+                self.assertEqual(2, res[0])
+                self.assertEqual(['doc1', None, 'doc2', 'foo'], res[1:])
+                res = r.execute_command(
+                    'ft.search', 'idx', 'kitty', 'nocontent')
+                self.assertEqual([1, 'doc2'], res)
+                res = r.execute_command(
+                    'ft.search', 'idx', 'hello @n:[1 1]', 'nocontent')
+                self.assertEqual([1, 'doc1'], res)
+
+            # replacing documents in a batch
+            res = r.execute_command('ft.madd', 'idx', 'replace', 'documents',
+                                    'doc1', 1.0, 1, 'f', 'goodbye world',
+                                    'doc4', 1.0, 1, 'f', 'goodbye kitty')
+            self.assertEqual(['OK', 'OK'], res)
+            res = r.execute_command(
+                'ft.search', 'idx', 'goodbye', 'nocontent')
+            self.assertEqual(2, res[0])
+            res = r.execute_command(
+                'ft.search', 'idx', 'hello', 'nocontent')
+            self.assertEqual([1, 'doc2'], res)
+
+            with self.assertResponseError():
+                r.execute_command('ft.madd', 'idx', 'documents', 'doc5', 1.0, 2, 'f', 'hello')
+
     def testReplace(self):
 
         with self.redis() as r:
@@ -417,6 +524,79 @@ class SearchTestCase(ModuleTestCase('../redisearch.so')):
                 self.assertListEqual([100L, 'doc99', 'hello099 world', 'doc98', 'hello098 world', 'doc97', 'hello097 world', 'doc96',
                                       'hello096 world', 'doc95', 'hello095 world'], res)
 
+    def testSortByManyResults(self):
+        with self.redis() as r:
+            r.flushdb()
+            self.assertOk(r.execute_command(
+                'ft.create', 'idx', 'schema', 'foo', 'text', 'bar', 'numeric', 'sortable'))
+            # enough results for the query to walk the documents in sorting order
+            N = 5000
+            for i in range(N):
+                self.assertOk(r.execute_command('ft.add', 'idx', 'doc%d' % i, 1.0, 'fields',
+                                                'foo', 'hello world' if i % 3 else 'hello', 'bar', (i * 7919) % N))
+            for _ in r.retry_with_rdb_reload():
+                expected = sorted((i for i in range(N) if i % 3), key=lambda i: (i * 7919) % N)
+                # the total is exact by default
+                res = r.execute_command(
+                    'ft.search', 'idx', 'world', 'nocontent', 'sortby', 'bar', 'asc', 'limit', 0, 10)
+                self.assertEqual(len(expected), res[0])
+                self.assertListEqual(['doc%d' % i for i in expected[:10]], res[1:])
+
+                # PRUNE walks the documents in sorting order and stops early
+                res = r.execute_command(
+                    'ft.search', 'idx', 'world', 'nocontent', 'sortby', 'bar', 'asc', 'limit', 0, 10,
+                    'prune')
+                self.assertGreaterEqual(len(expected), res[0])
+                self.assertListEqual(['doc%d' % i for i in expected[:10]], res[1:])
+                res = r.execute_command(
+                    'ft.search', 'idx', 'world', 'nocontent', 'sortby', 'bar', 'desc', 'limit', 20, 10,
+                    'prune')
+                self.assertListEqual(['doc%d' % i for i in expected[::-1][20:30]], res[1:])
+
+                # documents added after the first query are in the results too
+                self.assertOk(r.execute_command('ft.add', 'idx', 'newdoc', 1.0, 'fields',
+                                                'foo', 'hello world', 'bar', -1))
+                res = r.execute_command(
+                    'ft.search', 'idx', 'world', 'nocontent', 'sortby', 'bar', 'asc', 'limit', 0, 2,
+                    'prune')
+                self.assertListEqual(['newdoc', 'doc%d' % expected[0]], res[1:])
+                r.execute_command('ft.del', 'idx', 'newdoc')
+
+    def testQueryCache(self):
+        with self.redis() as r:
+            r.flushdb()
+            self.assertOk(r.execute_command(
+                'ft.create', 'idx', 'schema', 'foo', 'text'))
+            for i in range(10):
+                self.assertOk(r.execute_command('ft.add', 'idx', 'doc%d' % i, 1.0, 'fields',
+                                                'foo', 'hello world'))
+
+            def cacheStats():
+                info = r.execute_command('ft.info', 'idx')
+                info = dict(zip(info[::2], info[1::2]))
+                return [int(float(info['query_cache_' + k])) for k in ('hits', 'misses')]
+
+            res = r.execute_command('ft.search', 'idx', 'hello world', 'nocontent')
+            self.assertEqual(10, res[0])
+            self.assertListEqual([0, 1], cacheStats())
+            # the same query tree is served from the cache
+            self.assertListEqual(res, r.execute_command(
+                'ft.search', 'idx', 'Hello   world', 'nocontent'))
+            self.assertListEqual([1, 1], cacheStats())
+            info = r.execute_command('ft.info', 'idx')
+            info = dict(zip(info[::2], info[1::2]))
+            self.assertGreater(float(info['query_cache_size_mb']), 0)
+
+            # changes to the documents invalidate the cached results
+            self.assertOk(r.execute_command('ft.add', 'idx', 'doc10', 1.0, 'fields',
+                                            'foo', 'hello world'))
+            res = r.execute_command('ft.search', 'idx', 'hello world', 'nocontent')
+            self.assertEqual(11, res[0])
+            self.assertEqual(1, r.execute_command('ft.del', 'idx', 'doc10'))
+            res = r.execute_command('ft.search', 'idx', 'hello world', 'nocontent')
+            self.assertEqual(10, res[0])
+            self.assertListEqual([1, 3], cacheStats())
+
     def testNot(self):
         with self.redis() as r:
             r.flushdb()
@@ -594,6 +774,104 @@ class SearchTestCase(ModuleTestCase('../redisearch.so')):
                 self.assertEqual(3, res[0])
                 self.assertIn('hotel94', res)
 
+    def testGeoIndex(self):
+
+        with self.redis() as r:
+            r.flushdb()
+            self.assertOk(r.execute_command('ft.create', 'idx',
+                                            'schema', 'name', 'text', 'location', 'geo'))
+            self.assertOk(r.execute_command('ft.add', 'idx', 'doc1', 1.0, 'fields',
+                                            'name', 'hello', 'location', '179.999,0'))
+            self.assertOk(r.execute_command('ft.add', 'idx', 'doc2', 1.0, 'fields',
+                                            'name', 'hello', 'location', '-179.999,0'))
+            with self.assertResponseError():
+                r.execute_command('ft.add', 'idx', 'doc3', 1.0, 'fields',
+                                  'name', 'hello', 'location', '10,89')
+            with self.assertResponseError():
+                r.execute_command('ft.add', 'idx', 'doc3', 1.0, 'fields',
+                                  'name', 'hello', 'location', '10,foo')
+
+            for _ in r.retry_with_rdb_reload():
+                # points across the antimeridian are close to each other
+                res = r.execute_command('ft.search', 'idx', 'hello', 'nocontent',
+                                        'geofilter', 'location', 180, 0, 1, 'km')
+                self.assertEqual(2, res[0])
+                res = r.execute_command('ft.search', 'idx', 'hello', 'nocontent',
+                                        'geofilter', 'location', -179.999, 0, 10, 'm')
+                self.assertListEqual([1L, 'doc2'], res)
+
+            self.assertEqual(1, r.exists('geo:idx/location'))
+            self.assertOk(r.execute_command('ft.drop', 'idx'))
+            self.assertEqual(0, r.exists('geo:idx/location'))
+
+    def testGeoBoxAndPolygon(self):
+
+        with self.redis() as r:
+            r.flushdb()
+            self.assertOk(r.execute_command('ft.create', 'idx',
+                                            'schema', 'name', 'text', 'location', 'geo'))
+            for i, hotel in enumerate(hotels):
+                self.assertOk(r.execute_command('ft.add', 'idx', 'hotel{}'.format(i), 1.0, 'fields', 'name',
+                                                hotel[0], 'location', '{},{}'.format(hotel[2], hotel[1])))
+
+            for _ in r.retry_with_rdb_reload():
+                # a box around heathrow
+                res = r.execute_command('ft.search', 'idx', 'heathrow', 'nocontent',
+                                        'geofilter', 'location', 'box', -0.5, 51.43, -0.4, 51.49)
+                self.assertIn('hotel94', res)
+                box = set(res[1:])
+
+                # the same box as a polygon
+                res = r.execute_command('ft.search', 'idx', 'heathrow', 'nocontent',
+                                        'geofilter', 'location', 'polygon', 4,
+                                        -0.5, 51.43, -0.4, 51.43, -0.4, 51.49, -0.5, 51.49)
+                self.assertEqual(box, set(res[1:]))
+
+                res = r.execute_command('ft.search', 'idx', 'heathrow', 'nocontent',
+                                        'geofilter', 'location', 'box', 10, 10, 11, 11)
+                self.assertListEqual([0L], res)
+
+            for args in (['box', 1, 2, 3], ['box', 0, 10, 1, 5], ['polygon', 2, 0, 0, 1, 1],
+                         ['polygon', 4, 0, 0, 1, 1, 2, 2], ['foo', 1, 2, 3, 'km']):
+                with self.assertResponseError():
+                    r.execute_command('ft.search', 'idx', 'hilton', 'geofilter', 'location', *args)
+
+    def testTags(self):
+
+        with self.redis() as r:
+            r.flushdb()
+            self.assertOk(r.execute_command('ft.create', 'idx', 'schema', 'title', 'text',
+                                            'tags', 'tag', 'cities', 'tag', 'separator', ';'))
+            self.assertOk(r.execute_command('ft.add', 'idx', 'doc1', 1.0, 'fields', 'title', 'hello world',
+                                            'tags', 'Foo, bar baz', 'cities', 'New York;Tel Aviv'))
+            self.assertOk(r.execute_command('ft.add', 'idx', 'doc2', 1.0, 'fields', 'title', 'hello kitty',
+                                            'tags', 'foo,foo', 'cities', 'tel aviv'))
+
+            for _ in r.retry_with_rdb_reload():
+                res = r.execute_command('ft.search', 'idx', '@tags:{foo}', 'nocontent')
+                self.assertEqual(2, res[0])
+                res = r.execute_command('ft.search', 'idx', '@tags:{ Bar Baz }', 'nocontent')
+                self.assertListEqual([1L, 'doc1'], res)
+                # values are not tokenized
+                res = r.execute_command('ft.search', 'idx', '@tags:{bar}', 'nocontent')
+                self.assertListEqual([0L], res)
+                res = r.execute_command('ft.search', 'idx', '@cities:{new york | paris}', 'nocontent')
+                self.assertListEqual([1L, 'doc1'], res)
+                res = r.execute_command('ft.search', 'idx', 'hello -@cities:{new york}', 'nocontent')
+                self.assertListEqual([1L, 'doc2'], res)
+                # tags are not text
+                res = r.execute_command('ft.search', 'idx', 'york', 'nocontent')
+                self.assertListEqual([0L], res)
+
+            with self.assertResponseError():
+                r.execute_command('ft.search', 'idx', '@tags:{foo')
+            with self.assertResponseError():
+                r.execute_command('ft.create', 'idx2', 'schema', 'tags', 'tag', 'sortable')
+
+            self.assertEqual(1, r.exists('tag:idx/cities'))
+            self.assertOk(r.execute_command('ft.drop', 'idx'))
+            self.assertEqual(0, r.exists('tag:idx/cities'))
+
     def testAddHash(self):
 
         with self.redis() as r:
@@ -695,6 +973,28 @@ class SearchTestCase(ModuleTestCase('../redisearch.so')):
                 res = r.execute_command(
                     'ft.search', 'idx', 'foo', 'scorer', 'NOSUCHSCORER')
 
+    def testPrune(self):
+        with self.redis() as r:
+            r.flushdb()
+            self.assertOk(r.execute_command(
+                'ft.create', 'idx', 'schema', 'title', 'text'))
+            for i in range(1000):
+                # five documents are much better matches than the rest
+                text = 'hello world' if i % 200 else ' '.join(['hello'] * 10)
+                self.assertOk(r.execute_command(
+                    'ft.add', 'idx', 'doc%d' % i, 1.0, 'fields', 'title', text))
+
+            # the total of a union is exact by default
+            res = r.execute_command(
+                'ft.search', 'idx', 'hello|world', 'nocontent', 'limit', 0, 5)
+            self.assertEqual(1000, res[0])
+
+            # pruning may skip documents, but returns the same top results
+            pruned = r.execute_command(
+                'ft.search', 'idx', 'hello|world', 'nocontent', 'limit', 0, 5, 'prune')
+            self.assertGreaterEqual(1000, pruned[0])
+            self.assertEqual(sorted(res[1:]), sorted(pruned[1:]))
+
     def testFieldSelectors(self):
 
         with self.redis() as r:
@@ -893,6 +1193,12 @@ class SearchTestCase(ModuleTestCase('../redisearch.so')):
                 self.assertTrue(float(rc[1]) > 0)
                 self.assertTrue(float(rc[3]) > 0)
 
+                # searching a snapshot on the search pool gives the same results
+                self.assertEqual(['hello world', 'hello werld', 'yellow world', 'hallo world'],
+                                 r.execute_command("ft.SUGGET", "ac", "hello", "FUZZY", "ASYNC"))
+                self.assertEqual(rc, r.execute_command(
+                    "ft.SUGGET", "ac", "hello", "WITHSCORES", "ASYNC"))
+
             rc = r.execute_command("ft.SUGDEL", "ac", "hello world")
             self.assertEqual(1L, rc)
             rc = r.execute_command("ft.SUGDEL", "ac", "world")
@@ -919,6 +1225,9 @@ class SearchTestCase(ModuleTestCase('../redisearch.so')):
             res = r.execute_command("FT.SUGGET", "ac", "hello")
             self.assertListEqual(['hello world',  'hello werld', 'hello nopayload', 'hello nopayload2'],
                                  res)
+            res = r.execute_command("FT.SUGGET", "ac", "hello", 'WITHPAYLOADS', 'ASYNC')
+            self.assertListEqual(['hello world', 'foo', 'hello werld', 'bar', 'hello nopayload', None, 'hello nopayload2', None],
+                                 res)
             res = r.execute_command(
                 "FT.SUGGET", "ac", "hello", 'WITHPAYLOADS', 'WITHSCORES')
             # we don't compare the scores beause they may change
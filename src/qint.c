@@ -1472,6 +1472,134 @@ size_t qint_decode4(BufferReader *br, uint32_t *i, uint32_t *i2, uint32_t *i3, u
   return offset;
 }
 
+/* The size of a record of len integers with a given leading byte */
+#define qint_recordSize(lead, len) \
+  ((len) == 4 ? configs[lead].size : (size_t)configs[lead].fields[len].offset)
+
+/* The bytes a record's fields are read from: every field is read as a whole 32 bit word, and the
+ * last one starts at most 13 bytes after the leading byte */
+#define QINT_MAX_READ 17
+
+/* Portable block decoder, using the configuration table. The word reads of a record may run past its
+ * last byte, so the records near the end of the buffer are read from a zero padded copy */
+static size_t qint_decode_block_scalar(const uint8_t *start, const uint8_t *p, const uint8_t *end,
+                                       uint32_t *out, int len, int blobField, uint32_t *blobPos,
+                                       size_t maxRecs, const uint8_t **next) {
+  size_t n = 0;
+  uint8_t tail[QINT_MAX_READ];
+  while (n < maxRecs && p < end) {
+    const uint8_t *rec = p;
+    if (end - p < QINT_MAX_READ) {
+      memset(tail, 0, sizeof(tail));
+      memcpy(tail, p, end - p);
+      rec = tail;
+    }
+    qintConfig *qc = &configs[*rec];
+    for (int i = 0; i < len; i++) {
+      uint32_t v;
+      memcpy(&v, rec + qc->fields[i].offset, sizeof(v));
+      out[i] = v & qc->fields[i].mask;
+    }
+    p += qint_recordSize(*p, len);
+    if (blobField >= 0) {
+      blobPos[n] = p - start;
+      p += out[blobField];
+    }
+    out += 4;
+    n++;
+  }
+  *next = p;
+  return n;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+
+/* pshufb masks per leading byte, moving the bytes of each of the 4 integers into its own 32 bit
+ * lane, and zeroing the unused high bytes */
+static uint8_t qint_shuffles[256][16] __attribute__((aligned(16)));
+
+static void qint_initShuffles() {
+  for (int lead = 0; lead < 256; lead++) {
+    uint8_t off = 0;
+    for (int i = 0; i < 4; i++) {
+      int nbytes = ((lead >> (i * 2)) & 0x03) + 1;
+      for (int b = 0; b < 4; b++) {
+        qint_shuffles[lead][i * 4 + b] = b < nbytes ? off + b : 0x80;
+      }
+      off += nbytes;
+    }
+  }
+}
+
+/* SSSE3 block decoder - decodes each record with a single unaligned load and shuffle. A record is
+ * at most 17 bytes long, so we only use it while a full 16 byte load past the leading byte stays
+ * inside the buffer, and leave the tail to the scalar decoder */
+__attribute__((target("ssse3"))) static size_t qint_decode_block_ssse3(
+    const uint8_t *start, const uint8_t *p, const uint8_t *end, uint32_t *out, int len,
+    int blobField, uint32_t *blobPos, size_t maxRecs, const uint8_t **next) {
+  size_t n = 0;
+  while (n < maxRecs && end - p >= QINT_MAX_READ) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + 1));
+    v = _mm_shuffle_epi8(v, _mm_load_si128((const __m128i *)qint_shuffles[*p]));
+    _mm_storeu_si128((__m128i *)out, v);
+    p += qint_recordSize(*p, len);
+    if (blobField >= 0) {
+      blobPos[n] = p - start;
+      p += out[blobField];
+    }
+    out += 4;
+    n++;
+  }
+  return n + qint_decode_block_scalar(start, p, end, out, len, blobField,
+                                      blobPos ? blobPos + n : NULL, maxRecs - n, next);
+}
+#endif
+
+typedef size_t (*qintBlockDecoder)(const uint8_t *, const uint8_t *, const uint8_t *, uint32_t *,
+                                   int, int, uint32_t *, size_t, const uint8_t **);
+
+static size_t qint_decode_block_resolve(const uint8_t *start, const uint8_t *p, const uint8_t *end,
+                                        uint32_t *out, int len, int blobField, uint32_t *blobPos,
+                                        size_t maxRecs, const uint8_t **next);
+
+/* The block decoder in use. Until qint_initBlockDecoder is called, the first call resolves it */
+static qintBlockDecoder qint_blockDecoder = qint_decode_block_resolve;
+
+static size_t qint_decode_block_resolve(const uint8_t *start, const uint8_t *p, const uint8_t *end,
+                                        uint32_t *out, int len, int blobField, uint32_t *blobPos,
+                                        size_t maxRecs, const uint8_t **next) {
+  qint_initBlockDecoder(0);
+  return qint_blockDecoder(start, p, end, out, len, blobField, blobPos, maxRecs, next);
+}
+
+int qint_initBlockDecoder(int disableSIMD) {
+  qint_blockDecoder = qint_decode_block_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (!disableSIMD && __builtin_cpu_supports("ssse3")) {
+    qint_initShuffles();
+    qint_blockDecoder = qint_decode_block_ssse3;
+    return 1;
+  }
+#endif
+  return 0;
+}
+
+size_t qint_decode_block(BufferReader *br, uint32_t *out, int len, int blobField,
+                         uint32_t *blobPos, size_t maxRecs) {
+  if (len <= 0 || len > 4 || blobField >= len) return 0;
+
+  const uint8_t *start = (const uint8_t *)br->buf->data;
+  const uint8_t *p = (const uint8_t *)BufferReader_Current(br);
+  const uint8_t *end = start + br->buf->offset;
+  const uint8_t *next = p;
+
+  size_t n = qint_blockDecoder(start, p, end, out, len, blobField, blobPos, maxRecs, &next);
+  Buffer_Skip(br, next - p);
+  return n;
+}
+
 // void printConfig(unsigned char c) {
 
 //   int off = 1;
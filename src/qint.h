@@ -44,4 +44,17 @@ size_t qint_decode3(BufferReader *br, uint32_t *i, uint32_t *i2, uint32_t *i3);
  * with encode4 or encoded array of len 4 */
 size_t qint_decode4(BufferReader *br, uint32_t *i, uint32_t *i2, uint32_t *i3, uint32_t *i4);
 
+/* Decode up to maxRecs consecutive records of len integers each, from the reader's position to the
+ * end of its buffer. Each record is written to 4 consecutive slots of out regardless of len, so the
+ * output is a flat array of fixed stride. If blobField is not negative, every record is followed by
+ * a blob whose size is the value of that field - the blob is skipped and its offset in the buffer is
+ * written to blobPos. Returns the number of records decoded */
+size_t qint_decode_block(BufferReader *br, uint32_t *out, int len, int blobField,
+                         uint32_t *blobPos, size_t maxRecs);
+
+/* Select the block decoder implementation according to the CPU features (SSSE3 shuffles or the
+ * portable scalar decoder). Called on module load, and lazily by the first block decode if it was
+ * not. If disableSIMD is set, the scalar decoder is used. Returns 1 if a SIMD decoder was selected */
+int qint_initBlockDecoder(int disableSIMD);
+
 #endif
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <sys/param.h>
 
 #include "geo_index.h"
+#include "tag_index.h"
 #include "index.h"
 #include "query.h"
 #include "query_parser/parser.h"
@@ -15,6 +16,10 @@
 #include "ext/default.h"
 #include "rmutil/sds.h"
 #include "concurrent_ctx.h"
+#include "id_list.h"
+#include "sort_index.h"
+#include "rmalloc.h"
+#include "epoch.h"
 
 #define MAX_PREFIX_EXPANSIONS 200
 
@@ -32,6 +37,14 @@ static void QueryPhraseNode_Free(QueryPhraseNode *pn) {
   }
 }
 
+static void QueryTagNode_Free(QueryTagNode *tag) {
+  for (int i = 0; i < tag->numValues; i++) {
+    rm_free(tag->values[i]);
+  }
+  rm_free(tag->values);
+  free(tag->fieldName);
+}
+
 static void QueryUnionNode_Free(QueryUnionNode *pn) {
   for (int i = 0; i < pn->numChildren; i++) {
     QueryNode_Free(pn->children[i]);
@@ -70,6 +83,9 @@ void QueryNode_Free(QueryNode *n) {
     case QN_PREFX:
       QueryTokenNode_Free(&n->pfx);
       break;
+    case QN_TAG:
+      QueryTagNode_Free(&n->tag);
+      break;
     case QN_GEO:
     case QN_IDS:
       break;
@@ -149,6 +165,29 @@ QueryNode *NewGeofilterNode(GeoFilter *flt) {
   return ret;
 }
 
+QueryNode *NewTagNode(const char *field, size_t flen, const char *str, size_t len) {
+  QueryNode *ret = NewQueryNode(QN_TAG);
+  ret->tag.fieldName = strndup(field, flen);
+
+  // strip the braces around the values
+  if (len && *str == '{') {
+    str++;
+    len--;
+  }
+  if (len && str[len - 1] == '}') {
+    len--;
+  }
+
+  Vector *values = TagIndex_Preprocess('|', str, len);
+  ret->tag.numValues = Vector_Size(values);
+  ret->tag.values = rm_calloc(ret->tag.numValues + 1, sizeof(char *));
+  for (int i = 0; i < ret->tag.numValues; i++) {
+    Vector_Get(values, i, &ret->tag.values[i]);
+  }
+  Vector_Free(values);
+  return ret;
+}
+
 static void Query_SetFilterNode(Query *q, QueryNode *n) {
   if (q->root == NULL) return;
 
@@ -341,6 +380,37 @@ static IndexIterator *Query_EvalGeofilterNode(Query *q, QueryGeofilterNode *node
   return NewGeoRangeIterator(&gi, node->gf);
 }
 
+static IndexIterator *Query_EvalTagNode(Query *q, QueryTagNode *node) {
+  FieldSpec *fs = IndexSpec_GetField(q->ctx->spec, node->fieldName, strlen(node->fieldName));
+  if (!fs || fs->type != F_TAG) {
+    return NULL;
+  }
+  TagIndex *idx = TagIndex_Open(q->ctx, fs->name, 0);
+  if (!idx) {
+    return NULL;
+  }
+
+  IndexIterator **its = calloc(node->numValues, sizeof(IndexIterator *));
+  int n = 0;
+  for (int i = 0; i < node->numValues; i++) {
+    IndexIterator *it =
+        TagIndex_OpenReader(idx, q->docTable, node->values[i], strlen(node->values[i]));
+    if (it) {
+      its[n++] = it;
+    }
+  }
+  if (n == 0) {
+    free(its);
+    return NULL;
+  }
+  if (n == 1) {
+    IndexIterator *ret = its[0];
+    free(its);
+    return ret;
+  }
+  return NewUnionIterator(its, n, q->docTable, 1);
+}
+
 static IndexIterator *Query_EvalIdFilterNode(Query *q, QueryIdFilterNode *node) {
 
   return NewIdFilterIterator(node->f);
@@ -397,6 +467,8 @@ IndexIterator *Query_EvalNode(Query *q, QueryNode *n) {
       return Query_EvalGeofilterNode(q, &n->gn);
     case QN_IDS:
       return Query_EvalIdFilterNode(q, &n->fn);
+    case QN_TAG:
+      return Query_EvalTagNode(q, &n->tag);
   }
 
   return NULL;
@@ -439,6 +511,7 @@ Query *NewQueryFromRequest(RSSearchRequest *req) {
                req->slop, req->flags & Search_InOrder, req->scorer, req->payload, req->sortBy);
 
   q->docTable = &req->sctx->spec->docs;
+  q->prune = req->flags & Search_Prune ? 1 : 0;
 
   return q;
 }
@@ -461,6 +534,7 @@ Query *NewQuery(RedisSearchCtx *ctx, const char *query, size_t len, int offset,
   ret->payload = payload;
   ret->sortKey = sk;
   ConcurrentSearchCtx_Init(ctx ? ctx->redisCtx : NULL, &ret->conc);
+  ret->epoch = -1;
 
   // ret->expander = verbatim ? NULL : expander ? GetQueryExpander(expander) : NULL;
   ret->language = lang ? lang : DEFAULT_LANGUAGE;
@@ -539,7 +613,7 @@ static sds QueryNode_DumpSds(sds s, Query *q, QueryNode *qs, int depth) {
   }
 
   if (qs->fieldMask && qs->fieldMask != RS_FIELDMASK_ALL && qs->type != QN_NUMERIC &&
-      qs->type != QN_IDS) {
+      qs->type != QN_IDS && qs->type != QN_TAG) {
     if (!q->ctx) {
       s = sdscatprintf(s, "@%x", qs->fieldMask);
     } else {
@@ -601,10 +675,26 @@ static sds QueryNode_DumpSds(sds s, Query *q, QueryNode *qs, int depth) {
       }
       s = doPad(s, depth);
       break;
-    case QN_GEO:
-
-      s = sdscatprintf(s, "GEO {%f,%f --> %f %s", qs->gn.gf->lon, qs->gn.gf->lat, qs->gn.gf->radius,
-                       qs->gn.gf->unit);
+    case QN_GEO: {
+      GeoFilter *gf = qs->gn.gf;
+      if (gf->type == GEO_FILTER_BOX) {
+        s = sdscatprintf(s, "GEO {%f,%f --> %f,%f", gf->minLon, gf->minLat, gf->maxLon, gf->maxLat);
+      } else if (gf->type == GEO_FILTER_POLYGON) {
+        s = sdscat(s, "GEO {POLYGON");
+        for (size_t i = 0; i < gf->numPoints; i++) {
+          s = sdscatprintf(s, " %f,%f", gf->points[2 * i], gf->points[2 * i + 1]);
+        }
+      } else {
+        s = sdscatprintf(s, "GEO {%f,%f --> %f %s", gf->lon, gf->lat, gf->radius, gf->unit);
+      }
+    } break;
+    case QN_TAG:
+      s = sdscatprintf(s, "TAG:@%s {\n", qs->tag.fieldName);
+      for (int i = 0; i < qs->tag.numValues; i++) {
+        s = doPad(s, depth + 1);
+        s = sdscatprintf(s, "%s\n", qs->tag.values[i]);
+      }
+      s = doPad(s, depth);
       break;
     case QN_IDS:
 
@@ -633,6 +723,67 @@ const char *Query_DumpExplain(Query *q) {
   return ret;
 }
 
+/* Append the exact values of the filters of the tree, which the explain dump rounds or omits */
+static sds query_dumpFilters(sds s, QueryNode *n) {
+  if (!n) return s;
+
+  switch (n->type) {
+    case QN_NUMERIC: {
+      NumericFilter *f = n->nn.nf;
+      s = sdscatprintf(s, "|NUMERIC %s %a %a %d %d", f->fieldName, f->min, f->max, f->inclusiveMin,
+                       f->inclusiveMax);
+    } break;
+    case QN_GEO: {
+      GeoFilter *gf = n->gn.gf;
+      s = sdscatprintf(s, "|GEO %s %d %a %a %a %s %a %a %a %a", gf->property, gf->type, gf->lon,
+                       gf->lat, gf->radius, gf->unit ? gf->unit : "", gf->minLon, gf->minLat,
+                       gf->maxLon, gf->maxLat);
+      for (size_t i = 0; i < 2 * gf->numPoints; i++) {
+        s = sdscatprintf(s, " %a", gf->points[i]);
+      }
+    } break;
+    case QN_PHRASE:
+      for (int i = 0; i < n->pn.numChildren; i++) {
+        s = query_dumpFilters(s, n->pn.children[i]);
+      }
+      break;
+    case QN_UNION:
+      for (int i = 0; i < n->un.numChildren; i++) {
+        s = query_dumpFilters(s, n->un.children[i]);
+      }
+      break;
+    case QN_NOT:
+      s = query_dumpFilters(s, n->not.child);
+      break;
+    case QN_OPTIONAL:
+      s = query_dumpFilters(s, n->opt.child);
+      break;
+    default:
+      break;
+  }
+  return s;
+}
+
+char *Query_CacheKey(Query *q) {
+  // a query payload is an input of the scorer we can't compare cheaply
+  if (!q->root || q->scorerCtx.payload.len) {
+    return NULL;
+  }
+
+  sds s = QueryNode_DumpSds(sdsnew(""), q, q->root, 0);
+  s = query_dumpFilters(s, q->root);
+  s = sdscatprintf(s, "|%p %zd %zd %llx %d %d %d", q->scorer, q->offset, q->limit,
+                   (unsigned long long)q->fieldMask, q->maxSlop, q->inOrder, q->prune);
+  if (q->sortKey) {
+    s = sdscatprintf(s, "|SORTBY %d %d", q->sortKey->index, q->sortKey->ascending);
+  }
+
+  // the cache is keyed by a trie map, which limits the key length
+  char *ret = sdslen(s) <= UINT16_MAX ? strndup(s, sdslen(s)) : NULL;
+  sdsfree(s);
+  return ret;
+}
+
 void QueryNode_Print(Query *q, QueryNode *qn, int depth) {
   sds s = QueryNode_DumpSds(sdsnew(""), q, qn, depth);
   printf("%s", s);
@@ -654,6 +805,10 @@ void Query_Free(Query *q) {
     q->scorerFree(q->scorerCtx.privdata);
   }
 
+  if (q->epoch >= 0) {
+    Epoch_Exit(q->epoch);
+  }
+
   free(q->raw);
   free(q);
 }
@@ -685,6 +840,289 @@ static int sortByCmp(const void *e1, const void *e2, const void *udata) {
   return RSSortingVector_Cmp(h1->sv, h2->sv, (RSSortingKey *)sk);
 }
 
+/* Fill a heap entry for an index result, scoring it unless the query is sorted. Returns 0 if the
+ * document was deleted */
+static int query_loadHit(Query *q, RSIndexResult *r, heapResult *h, double minScore) {
+  RSDocumentMetadata *dmd = DocTable_Get(&q->ctx->spec->docs, r->docId);
+  if (!dmd || dmd->flags & Document_Deleted) {
+    return 0;
+  }
+
+  /* Call the query scoring function to calculate the score */
+  if (q->sortKey) {
+    h->sv = dmd->sortVector;
+    h->score = 0;
+  } else {
+    h->score = q->scorer(&q->scorerCtx, r, dmd, minScore);
+    h->sv = NULL;
+  }
+  h->docId = r->docId;
+  return 1;
+}
+
+/* Offer a hit to the results heap, updating the minimal score of the heap. Returns the entry that
+ * can be reused - the hit itself if it didn't make it, the entry it replaced, or NULL */
+static heapResult *query_offerHit(Query *q, heap_t *pq, heapResult *h, double *minScore) {
+  if (heap_count(pq) < heap_size(pq)) {
+    heap_offerx(pq, h);
+    if (heap_count(pq) == heap_size(pq)) {
+      heapResult *minh = heap_peek(pq);
+      *minScore = minh->score;
+    }
+    return NULL;
+  }
+
+  /* In SORTBY mode - compare the hit with the lowest ranked entry in the heap */
+  if (q->sortKey) {
+    heapResult *minh = heap_peek(pq);
+
+    /* if the current hit should be in the heap - remoe the lowest hit and add the new hit */
+    if (sortByCmp(h, minh, q->sortKey) < 0) {
+      heapResult *ret = heap_poll(pq);
+      heap_offerx(pq, h);
+      return ret;
+    }
+    /* The current should not enter the pool, so just leave it as is */
+    return h;
+  }
+
+  /* In Scored mode - compare scores with the lowest ranked result */
+  if (h->score >= *minScore) {
+    heapResult *ret = heap_poll(pq);
+    heap_offerx(pq, h);
+
+    // get the new min score
+    heapResult *minh = heap_peek(pq);
+    *minScore = minh->score;
+    return ret;
+  }
+  return h;
+}
+
+/* Scored queries that are expected to match many documents are split into ranges of docIds, each
+ * evaluated by its own copy of the iterator tree, on its own thread. Every shard collects its own
+ * top results, and we merge them in the end.
+ *
+ * The shards never take the global lock, so only queries that read nothing but snapshots of the
+ * index are split. The others run on the query thread, which yields the lock periodically */
+#define QUERY_SHARD_MIN_RESULTS 50000
+// the smallest range of docIds worth a shard of its own
+#define QUERY_SHARD_MIN_DOCS 10000
+
+typedef struct {
+  Query *q;
+  // the query tree intersected with the shard's range
+  IndexIterator *it;
+  heap_t *pq;
+  double minScore;
+  size_t numDeleted;
+  size_t len;
+} queryShard;
+
+/* The number of shards to split the query into, or 0 if it should run on the query thread alone */
+static int query_numShards(Query *q, IndexIterator *it, int lockFree) {
+  if (!lockFree) return 0;
+  // only the built in scorers are known to be safe to call from several threads
+  if (q->sortKey || (q->scorer != TFIDFScorer && q->scorer != DisMaxScorer)) return 0;
+
+  // iterators that can't tell how many results they have are mostly negations, which only yield
+  // results within an intersection
+  size_t est = it->NumEstimated(it->ctx);
+  if (est < QUERY_SHARD_MIN_RESULTS || est == SIZE_MAX) return 0;
+
+  int n = MIN(ConcurrentSearch_NumShardThreads(),
+              q->ctx->spec->docs.maxDocId / QUERY_SHARD_MIN_DOCS);
+  return n > 1 ? n : 0;
+}
+
+static void queryShard_run(void *p) {
+  queryShard *sh = p;
+  RSIndexResult *r = NULL;
+  heapResult *pooledHit = NULL;
+  int rc;
+  while (INDEXREAD_EOF != (rc = sh->it->Read(sh->it->ctx, &r))) {
+    if (!r || rc == INDEXREAD_NOTFOUND) continue;
+    if (pooledHit == NULL) {
+      pooledHit = malloc(sizeof(heapResult));
+    }
+    // score the record of the query tree, not the intersection with the range
+    if (!query_loadHit(sh->q, r->agg.children[0], pooledHit, sh->minScore)) {
+      ++sh->numDeleted;
+      continue;
+    }
+    pooledHit = query_offerHit(sh->q, sh->pq, pooledHit, &sh->minScore);
+  }
+  free(pooledHit);
+  sh->len = sh->it->Len(sh->it->ctx);
+}
+
+/* Run the query in shards and merge their results into pq. The first shard uses the given iterator.
+ * Returns the number of results of all the shards */
+static size_t query_executeShards(Query *q, IndexIterator *it, int numShards, heap_t *pq,
+                                  double *minScore, int *numDeleted) {
+  queryShard shards[numShards];
+  void *args[numShards];
+  t_docId maxDocId = q->ctx->spec->docs.maxDocId;
+  t_docId step = maxDocId / numShards + 1;
+
+  for (int i = 0; i < numShards; i++) {
+    IndexIterator *tree = i ? Query_EvalNode(q, q->root) : it;
+    queryShard *sh = &shards[i];
+    *sh = (queryShard){.q = q, .minScore = 0, .numDeleted = 0, .len = 0};
+    if (q->prune && q->scorer == TFIDFScorer) {
+      UI_EnableMaxScore(tree, &sh->minScore);
+    }
+
+    IndexIterator **its = calloc(2, sizeof(IndexIterator *));
+    its[0] = tree;
+    its[1] = NewDocIdRangeIterator(i * step + 1, MIN(maxDocId, (i + 1) * step));
+    sh->it = NewIntersecIterator(its, 2, q->docTable, RS_FIELDMASK_ALL, -1, 0);
+    sh->pq = malloc(heap_sizeof(heap_size(pq)));
+    heap_init(sh->pq, cmpHits, NULL, heap_size(pq));
+    args[i] = sh;
+  }
+
+  ConcurrentSearchCtx_Unlock(&q->conc);
+  ConcurrentSearch_RunShards(queryShard_run, args, numShards);
+
+  size_t total = 0;
+  for (int i = 0; i < numShards; i++) {
+    queryShard *sh = &shards[i];
+    while (heap_count(sh->pq)) {
+      free(query_offerHit(q, pq, heap_poll(sh->pq), minScore));
+    }
+    total += sh->len;
+    *numDeleted += sh->numDeleted;
+    sh->it->Free(sh->it);
+    heap_free(sh->pq);
+  }
+  return total;
+}
+
+/* SORTBY queries that match many documents walk the documents in the sorting order of the field, in
+ * chunks of growing size. Every chunk is the query intersected with the ids in it. Once the heap is
+ * full and the next document in the order can't enter it, no further document can, and we stop */
+#define SORTED_WALK_MIN_CHUNK 1024
+
+typedef struct {
+  SortIndex *si;
+  RSSortingKey *sk;
+  // whether we've walked the documents added after the sort index was built
+  int newDone;
+  // the number of documents of the sort index we've walked, and the size of the next chunk
+  size_t pos;
+  size_t chunkSize;
+} sortedWalk;
+
+/* Intersect the query iterator with a list of ids allocated with rm_malloc. The id list iterator
+ * keeps its own copy of the ids, so the list is freed here */
+static IndexIterator *sortedWalk_chunk(Query *q, IndexIterator *it, t_docId *ids, size_t n) {
+  IndexIterator **its = calloc(2, sizeof(IndexIterator *));
+  its[0] = it;
+  its[1] = NewIdListIterator(ids, n);
+  rm_free(ids);
+  return NewIntersecIterator(its, 2, q->docTable, RS_FIELDMASK_ALL, -1, 0);
+}
+
+/* Create the iterator of the next chunk, evaluating the query again unless it is given. Returns
+ * NULL if there are no more documents or none of them can enter the heap */
+static IndexIterator *sortedWalk_next(Query *q, sortedWalk *sw, IndexIterator *it, heap_t *pq) {
+  SortIndex *si = sw->si;
+  DocTable *dt = &q->ctx->spec->docs;
+  t_docId *ids = NULL;
+  size_t n = 0;
+
+  if (!sw->newDone && dt->maxDocId > si->maxDocId) {
+    // the documents that are not in the sort index might go anywhere in the order, so we take
+    // them first
+    n = dt->maxDocId - si->maxDocId;
+    ids = rm_malloc(n * sizeof(t_docId));
+    for (size_t i = 0; i < n; i++) {
+      ids[i] = si->maxDocId + 1 + i;
+    }
+  } else {
+    if (sw->pos == si->len) return NULL;
+
+    const int ascending = sw->sk->ascending;
+    if (heap_count(pq) == heap_size(pq)) {
+      t_docId next = si->docIds[ascending ? sw->pos : si->len - 1 - sw->pos];
+      RSDocumentMetadata *dmd = DocTable_Get(dt, next);
+      heapResult probe = {.docId = next, .sv = dmd ? dmd->sortVector : NULL};
+      if (probe.sv && sortByCmp(&probe, heap_peek(pq), sw->sk) >= 0) {
+        return NULL;
+      }
+    }
+
+    n = MIN(sw->chunkSize, si->len - sw->pos);
+    ids = rm_malloc(n * sizeof(t_docId));
+    size_t from = ascending ? sw->pos : si->len - sw->pos - n;
+    memcpy(ids, si->docIds + from, n * sizeof(t_docId));
+    sw->pos += n;
+    sw->chunkSize *= 2;
+  }
+  sw->newDone = 1;
+
+  if (!it && !(it = Query_EvalNode(q, q->root))) {
+    rm_free(ids);
+    return NULL;
+  }
+  return sortedWalk_chunk(q, it, ids, n);
+}
+
+/* Start walking the documents in sorting order if the query was given PRUNE, and is expected to match
+ * enough of them for it to pay off. Returns the iterator of the first chunk, or the query iterator as
+ * is */
+static IndexIterator *sortedWalk_start(Query *q, sortedWalk *sw, IndexIterator *it, heap_t *pq) {
+  sw->sk = q->sortKey;
+  sw->newDone = 0;
+  sw->pos = 0;
+  sw->chunkSize = MAX(SORTED_WALK_MIN_CHUNK, 8 * heap_size(pq));
+  sw->si = NULL;
+  if (!q->prune || it->NumEstimated(it->ctx) <= sw->chunkSize) {
+    return it;
+  }
+
+  sw->si = IndexSpec_GetSortIndex(q->ctx->spec, sw->sk->index);
+  if (!sw->si) return it;
+
+  IndexIterator *chunk = sortedWalk_next(q, sw, it, pq);
+  if (!chunk) {
+    // an empty index - go over whatever the query has
+    SortIndex_Free(sw->si);
+    sw->si = NULL;
+    return it;
+  }
+  return chunk;
+}
+
+/* Can the query be executed without the global lock once it is evaluated? Term readers read
+ * snapshots of the inverted indexes, but numeric ranges are read in place. Only the built in scorers
+ * are known not to look at anything else that may change meanwhile */
+static int query_isLockFree(Query *q, QueryNode *n) {
+  if (q->scorer != TFIDFScorer && q->scorer != DisMaxScorer) return 0;
+
+  switch (n->type) {
+    case QN_NUMERIC:
+      return 0;
+    case QN_PHRASE:
+      for (int i = 0; i < n->pn.numChildren; i++) {
+        if (n->pn.children[i] && !query_isLockFree(q, n->pn.children[i])) return 0;
+      }
+      return 1;
+    case QN_UNION:
+      for (int i = 0; i < n->un.numChildren; i++) {
+        if (n->un.children[i] && !query_isLockFree(q, n->un.children[i])) return 0;
+      }
+      return 1;
+    case QN_NOT:
+      return !n->not.child || query_isLockFree(q, n->not.child);
+    case QN_OPTIONAL:
+      return !n->opt.child || query_isLockFree(q, n->opt.child);
+    default:
+      return 1;
+  }
+}
+
 QueryResult *Query_Execute(Query *query) {
   // QueryNode_Print(query, query->root, 0);
   QueryResult *res = malloc(sizeof(QueryResult));
@@ -697,6 +1135,9 @@ QueryResult *Query_Execute(Query *query) {
   // If 1, the query has SORTBY and is not score based
   int sortByMode = query->sortKey != NULL;
 
+  // the snapshots the iterators take are valid as long as we're in the epoch
+  query->epoch = Epoch_Enter();
+
   //  start lazy evaluation of all query steps
   IndexIterator *it = NULL;
   if (query->root != NULL) {
@@ -720,11 +1161,37 @@ QueryResult *Query_Execute(Query *query) {
   heapResult *pooledHit = NULL;
   double minScore = 0;
   int numDeleted = 0;
-  RSIndexResult *r = NULL;
+  size_t totalResults = 0;
+
+  // with PRUNE, SORTBY queries may stop before going over all the results. The number of results
+  // then only counts the documents we went over
+  sortedWalk sw = {.si = NULL};
+  if (sortByMode) {
+    it = sortedWalk_start(query, &sw, it, pq);
+  }
+
+  // From here on, queries that only read snapshots let writers run. The lock is only taken again to
+  // evaluate the next chunk of a sorted walk, and to collect the results in the end
+  int lockFree = query_isLockFree(query, query->root);
   ConcurrentSearchCtx *cxc = &query->conc;
 
+  int numShards = query_numShards(query, it, lockFree);
+  if (numShards) {
+    totalResults = query_executeShards(query, it, numShards, pq, &minScore, &numDeleted);
+    it = NULL;
+  } else if (lockFree) {
+    ConcurrentSearchCtx_Unlock(cxc);
+  }
+
+  // with PRUNE, TF-IDF scored unions of terms can skip the documents that can't make it into the
+  // heap. The number of results then only counts the documents we didn't skip
+  if (it && query->prune && !sortByMode && query->scorer == TFIDFScorer) {
+    UI_EnableMaxScore(it, &minScore);
+  }
+  RSIndexResult *r = NULL;
+
   // iterate the root iterator and push everything to the PQ
-  while (1) {
+  while (it) {
     // TODO - Use static allocation
     if (pooledHit == NULL) {
       pooledHit = malloc(sizeof(heapResult));
@@ -736,66 +1203,31 @@ QueryResult *Query_Execute(Query *query) {
 
     // This means we are done!
     if (rc == INDEXREAD_EOF) {
+      // unless we're walking in sorting order, and the next chunk might still have results
+      if (sw.si) {
+        totalResults += it->Len(it->ctx);
+        it->Free(it);
+        ConcurrentSearchCtx_Lock(cxc);
+        it = sortedWalk_next(query, &sw, NULL, pq);
+        if (lockFree) {
+          ConcurrentSearchCtx_Unlock(cxc);
+        }
+        if (it) continue;
+      }
       break;
     } else if (!r || rc == INDEXREAD_NOTFOUND) {
       continue;
     }
 
-    RSDocumentMetadata *dmd = DocTable_Get(&query->ctx->spec->docs, r->docId);
-
     // skip deleted documents
-    if (!dmd || dmd->flags & Document_Deleted) {
+    if (!query_loadHit(query, r, h, minScore)) {
       ++numDeleted;
       continue;
     }
 
-    /* Call the query scoring function to calculate the score */
-    if (sortByMode) {
-      h->sv = dmd->sortVector;
-      h->score = 0;
-    } else {
-      h->score = query->scorer(&query->scorerCtx, r, dmd, minScore);
-      h->sv = NULL;
-    }
-    h->docId = r->docId;
-
     CONCURRENT_CTX_TICK(cxc);
 
-    if (heap_count(pq) < heap_size(pq)) {
-      heap_offerx(pq, h);
-      pooledHit = NULL;
-      if (heap_count(pq) == heap_size(pq)) {
-        heapResult *minh = heap_peek(pq);
-        minScore = minh->score;
-      }
-    } else {
-      /* In SORTBY mode - compare the hit with the lowest ranked entry in the heap */
-      if (sortByMode) {
-        heapResult *minh = heap_peek(pq);
-
-        /* if the current hit should be in the heap - remoe the lowest hit and add the new hit */
-        if (sortByCmp(h, minh, query->sortKey) < 0) {
-          pooledHit = heap_poll(pq);
-          heap_offerx(pq, h);
-        } else {
-          /* The current should not enter the pool, so just leave it as is */
-          pooledHit = h;
-        }
-
-      } else {
-        /* In Scored mode - compare scores with the lowest ranked result */
-        if (h->score >= minScore) {
-          pooledHit = heap_poll(pq);
-          heap_offerx(pq, h);
-
-          // get the new min score
-          heapResult *minh = heap_peek(pq);
-          minScore = minh->score;
-        } else {
-          pooledHit = h;
-        }
-      }
-    }
+    pooledHit = query_offerHit(query, pq, h, &minScore);
   }
 
   //  IndexResult_Free(r);
@@ -804,8 +1236,15 @@ QueryResult *Query_Execute(Query *query) {
     free(pooledHit);
     pooledHit = NULL;
   }
-  res->totalResults = it->Len(it->ctx) - numDeleted;
-  it->Free(it);
+  if (it) {
+    totalResults += it->Len(it->ctx);
+    it->Free(it);
+  }
+  ConcurrentSearchCtx_Lock(cxc);
+  if (sw.si) {
+    SortIndex_Free(sw.si);
+  }
+  res->totalResults = totalResults - numDeleted;
 
   // if not enough results - just return nothing now
   if (heap_count(pq) <= query->offset) {
@@ -44,10 +44,16 @@ typedef struct RSQuery {
   RedisSearchCtx *ctx;
 
   ConcurrentSearchCtx conc;
+  // the read epoch the query executes in, or -1 if it was not executed. The query results point
+  // into the document table, so the query leaves the epoch only when it is freed
+  int epoch;
 
   int maxSlop;
   // Whether phrases are in order or not
   int inOrder;
+  // Whether documents that can't score or sort high enough to be returned may be skipped. The total
+  // number of results is then only a lower bound
+  int prune;
 
   // Query expander
   RSQueryTokenExpander expander;
@@ -104,6 +110,9 @@ QueryNode *NewNotNode(QueryNode *n);
 QueryNode *NewOptionalNode(QueryNode *n);
 QueryNode *NewNumericNode(NumericFilter *flt);
 QueryNode *NewIdFilterNode(IdFilter *flt);
+
+/* Create a tag node on a field from the text of its values, as in "{foo | bar baz}" */
+QueryNode *NewTagNode(const char *field, size_t flen, const char *str, size_t len);
 void Query_SetNumericFilter(Query *q, NumericFilter *nf);
 void Query_SetGeoFilter(Query *q, GeoFilter *gf);
 void Query_SetIdFilter(Query *q, IdFilter *f);
@@ -112,6 +121,11 @@ void Query_SetIdFilter(Query *q, IdFilter *f);
  */
 const char *Query_DumpExplain(Query *q);
 
+/* The key of the query's results in the query cache of the index: the canonical query tree, the
+ * exact values of its filters, and the scorer, sorting, paging and other options the results depend
+ * on. The key should be freed by the caller. Returns NULL if the results can't be cached */
+char *Query_CacheKey(Query *q);
+
 /* Only used in tests, for now */
 void QueryNode_Print(Query *q, QueryNode *qs, int depth);
 
@@ -0,0 +1,175 @@
+#include "query_cache.h"
+#include "rmalloc.h"
+
+size_t RSQueryCacheMaxSize = QUERY_CACHE_DEFAULT_SIZE;
+
+typedef struct queryCacheEntry {
+  char *key;
+  uint64_t generation;
+  // the memory taken by the entry, see queryCacheEntry_memUsage
+  size_t memUsage;
+  QueryResult res;
+  struct queryCacheEntry *prev;
+  struct queryCacheEntry *next;
+} queryCacheEntry;
+
+QueryCache *NewQueryCache(size_t maxSize) {
+  QueryCache *c = rm_malloc(sizeof(*c));
+  *c = (QueryCache){.entries = NewTrieMap(), .maxSize = maxSize};
+  return c;
+}
+
+static void queryCacheEntry_free(void *p) {
+  queryCacheEntry *e = p;
+  for (size_t i = 0; i < e->res.numResults; i++) {
+    ResultEntry *r = &e->res.results[i];
+    rm_free((char *)r->id);
+    if (r->payload) {
+      rm_free(r->payload->data);
+      rm_free(r->payload);
+    }
+    if (r->sortKey) {
+      if (r->sortKey->type == RS_SORTABLE_STR) rm_free(r->sortKey->str);
+      rm_free(r->sortKey);
+    }
+  }
+  rm_free(e->res.results);
+  rm_free(e->key);
+  rm_free(e);
+}
+
+static void queryCache_unlink(QueryCache *c, queryCacheEntry *e) {
+  if (e->prev) {
+    e->prev->next = e->next;
+  } else {
+    c->head = e->next;
+  }
+  if (e->next) {
+    e->next->prev = e->prev;
+  } else {
+    c->tail = e->prev;
+  }
+  e->prev = e->next = NULL;
+}
+
+static void queryCache_pushFront(QueryCache *c, queryCacheEntry *e) {
+  e->prev = NULL;
+  e->next = c->head;
+  if (c->head) {
+    c->head->prev = e;
+  } else {
+    c->tail = e;
+  }
+  c->head = e;
+}
+
+/* Passed to the trie map when deleting entries, which we free ourselves */
+static void queryCacheEntry_keep(void *p) {
+}
+
+static void queryCache_remove(QueryCache *c, queryCacheEntry *e) {
+  queryCache_unlink(c, e);
+  TrieMap_Delete(c->entries, e->key, strlen(e->key), queryCacheEntry_keep);
+  c->memUsage -= e->memUsage;
+  queryCacheEntry_free(e);
+  c->size--;
+}
+
+const QueryResult *QueryCache_Get(QueryCache *c, const char *key, uint64_t generation) {
+  queryCacheEntry *e = TrieMap_Find(c->entries, (char *)key, strlen(key));
+  if (e == TRIEMAP_NOTFOUND || !e) {
+    c->misses++;
+    return NULL;
+  }
+  if (e->generation != generation) {
+    queryCache_remove(c, e);
+    c->misses++;
+    return NULL;
+  }
+
+  c->hits++;
+  queryCache_unlink(c, e);
+  queryCache_pushFront(c, e);
+  return &e->res;
+}
+
+static RSPayload *copyPayload(const RSPayload *p) {
+  RSPayload *ret = rm_malloc(sizeof(*ret));
+  ret->data = rm_malloc(p->len + 1);
+  memcpy(ret->data, p->data, p->len);
+  ret->data[p->len] = '\0';
+  ret->len = p->len;
+  return ret;
+}
+
+/* The memory an entry would take for the results of a query, including their copied ids, payloads
+ * and sort keys. The trie map nodes of the keys are not counted */
+static size_t queryCacheEntry_memUsage(const char *key, const QueryResult *r) {
+  size_t sz = sizeof(queryCacheEntry) + strlen(key) + 1 +
+              (r->numResults ? r->numResults : 1) * sizeof(ResultEntry);
+  for (size_t i = 0; i < r->numResults; i++) {
+    const ResultEntry *ent = &r->results[i];
+    if (ent->id) sz += strlen(ent->id) + 1;
+    if (ent->payload) sz += sizeof(RSPayload) + ent->payload->len + 1;
+    if (ent->sortKey) {
+      sz += sizeof(RSSortableValue);
+      if (ent->sortKey->type == RS_SORTABLE_STR) sz += strlen(ent->sortKey->str) + 1;
+    }
+  }
+  return sz;
+}
+
+void QueryCache_Put(QueryCache *c, const char *key, uint64_t generation, QueryResult *r) {
+  if (r->error || r->errorString) return;
+
+  queryCacheEntry *old = TrieMap_Find(c->entries, (char *)key, strlen(key));
+  if (old != TRIEMAP_NOTFOUND && old) {
+    queryCache_remove(c, old);
+  }
+
+  size_t memUsage = queryCacheEntry_memUsage(key, r);
+  if (memUsage > c->maxSize / QUERY_CACHE_MAX_ENTRY_FRACTION) return;
+  while (c->tail && c->memUsage + memUsage > c->maxSize) {
+    queryCache_remove(c, c->tail);
+    c->evictions++;
+  }
+
+  queryCacheEntry *e = rm_malloc(sizeof(*e));
+  e->key = rm_strdup(key);
+  e->generation = generation;
+  e->memUsage = memUsage;
+  e->res = (QueryResult){.totalResults = r->totalResults, .numResults = r->numResults};
+  e->res.results = rm_calloc(r->numResults ? r->numResults : 1, sizeof(ResultEntry));
+  for (size_t i = 0; i < r->numResults; i++) {
+    const ResultEntry *src = &r->results[i];
+    ResultEntry *dst = &e->res.results[i];
+    *dst = (ResultEntry){.id = src->id ? rm_strdup(src->id) : NULL, .score = src->score};
+    if (src->payload) {
+      dst->payload = copyPayload(src->payload);
+    }
+    if (src->sortKey) {
+      dst->sortKey = rm_malloc(sizeof(RSSortableValue));
+      *dst->sortKey = *src->sortKey;
+      if (src->sortKey->type == RS_SORTABLE_STR) {
+        dst->sortKey->str = rm_strdup(src->sortKey->str);
+      }
+    }
+  }
+
+  TrieMap_Add(c->entries, e->key, strlen(e->key), e, NULL);
+  queryCache_pushFront(c, e);
+  c->size++;
+  c->memUsage += memUsage;
+}
+
+void QueryCache_Free(QueryCache *c) {
+  TrieMap_Free(c->entries, queryCacheEntry_free);
+  rm_free(c);
+}
+
+QueryCache *IndexSpec_GetQueryCache(IndexSpec *sp) {
+  if (!sp->queryCache && RSQueryCacheMaxSize) {
+    sp->queryCache = NewQueryCache(RSQueryCacheMaxSize);
+  }
+  return sp->queryCache;
+}
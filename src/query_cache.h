@@ -0,0 +1,60 @@
+#ifndef __RS_QUERY_CACHE_H__
+#define __RS_QUERY_CACHE_H__
+
+#include "query.h"
+#include "spec.h"
+#include "dep/triemap/triemap.h"
+#include <stdint.h>
+
+/* The query cache of an index keeps the results of its recent queries, so that hot queries are
+ * served without evaluating them again. Results are keyed by the canonical form of the query (see
+ * Query_CacheKey), and tagged with the generation of the document table they were computed at. Any
+ * change to the documents bumps the generation, making all the cached results stale.
+ *
+ * The cache of every index takes at most RSQueryCacheMaxSize bytes, evicting the least recently
+ * used results to make room. It is only accessed with the global lock held */
+#define QUERY_CACHE_DEFAULT_SIZE (16 * 0x100000)
+
+/* The size limit of the indexes' query caches, set with the QUERY_CACHE_MB module argument. 0
+ * disables the caches */
+extern size_t RSQueryCacheMaxSize;
+
+/* The results of a query are not cached if they would take more than this fraction of the cache,
+ * so that a single big query does not flush it */
+#define QUERY_CACHE_MAX_ENTRY_FRACTION 8
+
+struct queryCacheEntry;
+
+typedef struct QueryCache {
+  TrieMap *entries;
+  // the entries from the most recently used to the least
+  struct queryCacheEntry *head;
+  struct queryCacheEntry *tail;
+  size_t size;
+  // the memory taken by the entries and their results, and its limit
+  size_t memUsage;
+  size_t maxSize;
+
+  size_t hits;
+  size_t misses;
+  size_t evictions;
+} QueryCache;
+
+/* Create a query cache taking at most maxSize bytes */
+QueryCache *NewQueryCache(size_t maxSize);
+
+/* Get the cached results of a query, if they were computed at the given generation. Stale results
+ * are dropped. The results belong to the cache, and stay valid until it is next modified. Returns
+ * NULL if the query has no cached results */
+const QueryResult *QueryCache_Get(QueryCache *c, const char *key, uint64_t generation);
+
+/* Cache a copy of the results of a query, computed at the given generation */
+void QueryCache_Put(QueryCache *c, const char *key, uint64_t generation, QueryResult *r);
+
+void QueryCache_Free(QueryCache *c);
+
+/* Get the query cache of an index, creating it if needed. Returns NULL if query caching is
+ * disabled */
+QueryCache *IndexSpec_GetQueryCache(IndexSpec *sp);
+
+#endif
@@ -34,6 +34,9 @@ typedef enum {
 
   /* Id Filter node */
   QN_IDS,
+
+  /* Tag values node */
+  QN_TAG,
 } QueryNodeType;
 
 /* A prhase node represents a list of nodes with intersection between them, or a phrase in the case
@@ -69,6 +72,14 @@ typedef struct { struct geoFilter *gf; } QueryGeofilterNode;
 
 typedef struct { struct idFilter *f; } QueryIdFilterNode;
 
+/* A tag node matches the documents having any of its values in a tag field. The values are
+ * normalized like the indexed ones */
+typedef struct {
+  char *fieldName;
+  char **values;
+  int numValues;
+} QueryTagNode;
+
 /* QueryNode reqresents any query node in the query tree. It has a type to resolve which node it is,
  * and a union of all possible nodes  */
 typedef struct RSQueryNode {
@@ -82,6 +93,7 @@ typedef struct RSQueryNode {
     QueryNotNode not;
     QueryOptionalNode opt;
     QueryPrefixNode pfx;
+    QueryTagNode tag;
   };
   uint32_t fieldMask;
   /* The node type, for resolving the union access */
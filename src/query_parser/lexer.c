@@ -5,6 +5,7 @@
 #include <string.h>
 #include <assert.h>
 #include <math.h>
+#include <ctype.h>
 
 #include "parse.h"
 #include "parser.h"
@@ -17,11 +18,11 @@ void *RSQuery_ParseAlloc(void *(*mallocProc)(size_t));
 void RSQuery_ParseFree(void *p, void (*freeProc)(void *));
 
 
-#line 160 "lexer.rl"
+#line 190 "lexer.rl"
 
 
 
-#line 25 "lexer.c"
+#line 26 "lexer.c"
 static const char _query_actions[] = {
 	0, 1, 0, 1, 1, 1, 2, 1, 
 	7, 1, 8, 1, 9, 1, 10, 1, 
@@ -120,7 +121,7 @@ static const int query_error = -1;
 static const int query_en_main = 3;
 
 
-#line 163 "lexer.rl"
+#line 193 "lexer.rl"
 
 
 
@@ -132,7 +133,7 @@ QueryNode *Query_Parse(Query *q, char **err) {
   const char* ts = q->raw;
   const char* te = q->raw + q->len;
   
-#line 136 "lexer.c"
+#line 137 "lexer.c"
 	{
 	cs = query_start;
 	ts = 0;
@@ -140,7 +141,7 @@ QueryNode *Query_Parse(Query *q, char **err) {
 	act = 0;
 	}
 
-#line 174 "lexer.rl"
+#line 204 "lexer.rl"
   QueryToken tok = {.len = 0, .pos = 0, .s = 0};
   
   parseCtx ctx = {.root = NULL, .ok = 1, .errorMsg = NULL, .q = q};
@@ -149,7 +150,7 @@ QueryNode *Query_Parse(Query *q, char **err) {
   const char* eof = pe;
   
   
-#line 153 "lexer.c"
+#line 154 "lexer.c"
 	{
 	int _klen;
 	unsigned int _trans;
@@ -168,7 +169,7 @@ _resume:
 #line 1 "NONE"
 	{ts = p;}
 	break;
-#line 172 "lexer.c"
+#line 173 "lexer.c"
 		}
 	}
 
@@ -239,23 +240,23 @@ _eof_trans:
 	{te = p+1;}
 	break;
 	case 3:
-#line 60 "lexer.rl"
+#line 90 "lexer.rl"
 	{act = 3;}
 	break;
 	case 4:
-#line 108 "lexer.rl"
+#line 138 "lexer.rl"
 	{act = 9;}
 	break;
 	case 5:
-#line 144 "lexer.rl"
+#line 174 "lexer.rl"
 	{act = 15;}
 	break;
 	case 6:
-#line 146 "lexer.rl"
+#line 176 "lexer.rl"
 	{act = 17;}
 	break;
 	case 7:
-#line 60 "lexer.rl"
+#line 90 "lexer.rl"
 	{te = p+1;{ 
     tok.pos = ts-q->raw;
     tok.s = ts;
@@ -269,7 +270,7 @@ _eof_trans:
   }}
 	break;
 	case 8:
-#line 72 "lexer.rl"
+#line 102 "lexer.rl"
 	{te = p+1;{
     tok.pos = ts-q->raw;
     RSQuery_Parse(pParser, QUOTE, tok, &ctx);  
@@ -279,7 +280,7 @@ _eof_trans:
   }}
 	break;
 	case 9:
-#line 79 "lexer.rl"
+#line 109 "lexer.rl"
 	{te = p+1;{ 
     tok.pos = ts-q->raw;
     RSQuery_Parse(pParser, OR, tok, &ctx);
@@ -289,7 +290,7 @@ _eof_trans:
   }}
 	break;
 	case 10:
-#line 86 "lexer.rl"
+#line 116 "lexer.rl"
 	{te = p+1;{ 
     tok.pos = ts-q->raw;
     RSQuery_Parse(pParser, LP, tok, &ctx);
@@ -299,7 +300,7 @@ _eof_trans:
   }}
 	break;
 	case 11:
-#line 93 "lexer.rl"
+#line 123 "lexer.rl"
 	{te = p+1;{ 
     tok.pos = ts-q->raw;
     RSQuery_Parse(pParser, RP, tok, &ctx);
@@ -309,7 +310,7 @@ _eof_trans:
   }}
 	break;
 	case 12:
-#line 100 "lexer.rl"
+#line 130 "lexer.rl"
 	{te = p+1;{ 
      tok.pos = ts-q->raw;
      RSQuery_Parse(pParser, COLON, tok, &ctx);
@@ -319,7 +320,7 @@ _eof_trans:
    }}
 	break;
 	case 13:
-#line 115 "lexer.rl"
+#line 145 "lexer.rl"
 	{te = p+1;{ 
     tok.pos = ts-q->raw;
     RSQuery_Parse(pParser, TILDE, tok, &ctx);  
@@ -329,7 +330,7 @@ _eof_trans:
   }}
 	break;
 	case 14:
-#line 122 "lexer.rl"
+#line 152 "lexer.rl"
 	{te = p+1;{ 
     tok.pos = ts-q->raw;
     RSQuery_Parse(pParser, STAR, tok, &ctx);    
@@ -339,7 +340,7 @@ _eof_trans:
   }}
 	break;
 	case 15:
-#line 129 "lexer.rl"
+#line 159 "lexer.rl"
 	{te = p+1;{ 
     tok.pos = ts-q->raw;
     RSQuery_Parse(pParser, LSQB, tok, &ctx);  
@@ -349,7 +350,7 @@ _eof_trans:
   }}
 	break;
 	case 16:
-#line 136 "lexer.rl"
+#line 166 "lexer.rl"
 	{te = p+1;{ 
     tok.pos = ts-q->raw;
     RSQuery_Parse(pParser, RSQB, tok, &ctx);   
@@ -359,19 +360,19 @@ _eof_trans:
   }}
 	break;
 	case 17:
-#line 143 "lexer.rl"
+#line 173 "lexer.rl"
 	{te = p+1;}
 	break;
 	case 18:
-#line 144 "lexer.rl"
+#line 174 "lexer.rl"
 	{te = p+1;}
 	break;
 	case 19:
-#line 145 "lexer.rl"
+#line 175 "lexer.rl"
 	{te = p+1;}
 	break;
 	case 20:
-#line 39 "lexer.rl"
+#line 40 "lexer.rl"
 	{te = p;p--;{ 
     tok.s = ts;
     tok.len = te-ts;
@@ -386,7 +387,7 @@ _eof_trans:
   }}
 	break;
 	case 21:
-#line 51 "lexer.rl"
+#line 52 "lexer.rl"
 	{te = p;p--;{
     tok.pos = ts-q->raw;
     tok.len = te - (ts + 1);
@@ -395,10 +396,39 @@ _eof_trans:
     if (!ctx.ok) {
       {p++; goto _out; }
     }
+
+    // a tag list - @field:{foo | bar baz} - is passed whole as a single term
+    const char *lb = te;
+    while (lb < pe && isspace((unsigned char)*lb)) lb++;
+    if (lb < pe && *lb == ':') {
+      lb++;
+      while (lb < pe && isspace((unsigned char)*lb)) lb++;
+      if (lb < pe && *lb == '{') {
+        const char *rb = memchr(lb, '}', pe - lb);
+        if (!rb) {
+          ctx.ok = 0;
+          ctx.errorMsg = strdup("Unterminated tag list");
+          {p++; goto _out; }
+        }
+        tok.pos = lb-q->raw;
+        RSQuery_Parse(pParser, COLON, tok, &ctx);
+        if (!ctx.ok) {
+          {p++; goto _out; }
+        }
+        tok.s = lb;
+        tok.len = rb + 1 - lb;
+        tok.numval = 0;
+        RSQuery_Parse(pParser, TERM, tok, &ctx);
+        if (!ctx.ok) {
+          {p++; goto _out; }
+        }
+        {p = ((rb+1))-1;}
+      }
+    }
   }}
 	break;
 	case 22:
-#line 108 "lexer.rl"
+#line 138 "lexer.rl"
 	{te = p;p--;{ 
     tok.pos = ts-q->raw;
     RSQuery_Parse(pParser, MINUS, tok, &ctx);  
@@ -408,11 +438,11 @@ _eof_trans:
   }}
 	break;
 	case 23:
-#line 144 "lexer.rl"
+#line 174 "lexer.rl"
 	{te = p;p--;}
 	break;
 	case 24:
-#line 146 "lexer.rl"
+#line 176 "lexer.rl"
 	{te = p;p--;{
     tok.len = te-ts;
     tok.s = ts;
@@ -427,7 +457,7 @@ _eof_trans:
   }}
 	break;
 	case 25:
-#line 39 "lexer.rl"
+#line 40 "lexer.rl"
 	{{p = ((te))-1;}{ 
     tok.s = ts;
     tok.len = te-ts;
@@ -486,7 +516,7 @@ _eof_trans:
 	}
 	}
 	break;
-#line 490 "lexer.c"
+#line 520 "lexer.c"
 		}
 	}
 
@@ -499,7 +529,7 @@ _again:
 #line 1 "NONE"
 	{ts = 0;}
 	break;
-#line 503 "lexer.c"
+#line 533 "lexer.c"
 		}
 	}
 
@@ -517,7 +547,7 @@ _again:
 	_out: {}
 	}
 
-#line 182 "lexer.rl"
+#line 212 "lexer.rl"
   
 
   if (ctx.ok) {
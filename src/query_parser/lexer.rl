@@ -3,6 +3,7 @@
 #include <string.h>
 #include <assert.h>
 #include <math.h>
+#include <ctype.h>
 
 #include "parse.h"
 #include "parser.h"
@@ -56,6 +57,35 @@ main := |*
     if (!ctx.ok) {
       fbreak;
     }
+
+    // a tag list - @field:{foo | bar baz} - is passed whole as a single term
+    const char *lb = te;
+    while (lb < pe && isspace((unsigned char)*lb)) lb++;
+    if (lb < pe && *lb == ':') {
+      lb++;
+      while (lb < pe && isspace((unsigned char)*lb)) lb++;
+      if (lb < pe && *lb == '{') {
+        const char *rb = memchr(lb, '}', pe - lb);
+        if (!rb) {
+          ctx.ok = 0;
+          ctx.errorMsg = strdup("Unterminated tag list");
+          fbreak;
+        }
+        tok.pos = lb-q->raw;
+        RSQuery_Parse(pParser, COLON, tok, &ctx);
+        if (!ctx.ok) {
+          fbreak;
+        }
+        tok.s = lb;
+        tok.len = rb + 1 - lb;
+        tok.numval = 0;
+        RSQuery_Parse(pParser, TERM, tok, &ctx);
+        if (!ctx.ok) {
+          fbreak;
+        }
+        fexec rb+1;
+      }
+    }
   };
   inf => { 
     tok.pos = ts-q->raw;
@@ -972,16 +972,23 @@ static void yy_reduce(
       case 6: /* expr ::= modifier COLON expr */
 #line 124 "parser.y"
 {
-    if (ctx->q->ctx && ctx->q->ctx->spec) {
-        yymsp[0].minor.yy53->fieldMask = IndexSpec_GetFieldBit(ctx->q->ctx->spec, yymsp[-2].minor.yy0.s, yymsp[-2].minor.yy0.len); 
+    // the lexer passes a tag list as a single term in braces
+    if (yymsp[0].minor.yy53->type == QN_TOKEN && yymsp[0].minor.yy53->tn.len && yymsp[0].minor.yy53->tn.str[0] == '{') {
+        yylhsminor.yy53 = NewTagNode(yymsp[-2].minor.yy0.s, yymsp[-2].minor.yy0.len, yymsp[0].minor.yy53->tn.str, yymsp[0].minor.yy53->tn.len);
+        ctx->q->numTokens--;
+        QueryNode_Free(yymsp[0].minor.yy53);
+    } else {
+        if (ctx->q->ctx && ctx->q->ctx->spec) {
+            yymsp[0].minor.yy53->fieldMask = IndexSpec_GetFieldBit(ctx->q->ctx->spec, yymsp[-2].minor.yy0.s, yymsp[-2].minor.yy0.len); 
+        }
+        yylhsminor.yy53 = yymsp[0].minor.yy53; 
     }
-    yylhsminor.yy53 = yymsp[0].minor.yy53; 
 }
-#line 981 "parser.c"
+#line 988 "parser.c"
   yymsp[-2].minor.yy53 = yylhsminor.yy53;
         break;
       case 7: /* expr ::= modifierlist COLON expr */
-#line 132 "parser.y"
+#line 139 "parser.y"
 {
     yymsp[0].minor.yy53->fieldMask = 0;
     for (int i = 0; i < Vector_Size(yymsp[-2].minor.yy48); i++) {
@@ -996,41 +1003,41 @@ static void yy_reduce(
     Vector_Free(yymsp[-2].minor.yy48);
     yylhsminor.yy53=yymsp[0].minor.yy53;
 }
-#line 1000 "parser.c"
+#line 1007 "parser.c"
   yymsp[-2].minor.yy53 = yylhsminor.yy53;
         break;
       case 8: /* expr ::= LP expr RP */
-#line 147 "parser.y"
+#line 154 "parser.y"
 {
     yymsp[-2].minor.yy53 = yymsp[-1].minor.yy53;
 }
-#line 1008 "parser.c"
+#line 1015 "parser.c"
         break;
       case 9: /* expr ::= QUOTE termlist QUOTE */
-#line 151 "parser.y"
+#line 158 "parser.y"
 {
     yymsp[-1].minor.yy53->pn.exact =1;
     yymsp[-2].minor.yy53 = yymsp[-1].minor.yy53;
 }
-#line 1016 "parser.c"
+#line 1023 "parser.c"
         break;
       case 10: /* term ::= QUOTE term QUOTE */
-#line 156 "parser.y"
+#line 163 "parser.y"
 {
     yymsp[-2].minor.yy0 = yymsp[-1].minor.yy0;
 }
-#line 1023 "parser.c"
+#line 1030 "parser.c"
         break;
       case 11: /* expr ::= term */
-#line 160 "parser.y"
+#line 167 "parser.y"
 {
     yylhsminor.yy53 = NewTokenNode(ctx->q, strdupcase(yymsp[0].minor.yy0.s, yymsp[0].minor.yy0.len), yymsp[0].minor.yy0.len);
 }
-#line 1030 "parser.c"
+#line 1037 "parser.c"
   yymsp[0].minor.yy53 = yylhsminor.yy53;
         break;
       case 12: /* termlist ::= term term */
-#line 164 "parser.y"
+#line 171 "parser.y"
 {
     
     yylhsminor.yy53 = NewPhraseNode(0);
@@ -1038,51 +1045,51 @@ static void yy_reduce(
     QueryPhraseNode_AddChild(yylhsminor.yy53, NewTokenNode(ctx->q, strdupcase(yymsp[0].minor.yy0.s, yymsp[0].minor.yy0.len), yymsp[0].minor.yy0.len));
 
 }
-#line 1042 "parser.c"
+#line 1049 "parser.c"
   yymsp[-1].minor.yy53 = yylhsminor.yy53;
         break;
       case 13: /* termlist ::= termlist term */
-#line 171 "parser.y"
+#line 178 "parser.y"
 {
     yylhsminor.yy53 = yymsp[-1].minor.yy53;
     QueryPhraseNode_AddChild(yylhsminor.yy53, NewTokenNode(ctx->q, strdupcase(yymsp[0].minor.yy0.s, yymsp[0].minor.yy0.len), yymsp[0].minor.yy0.len));
 
 }
-#line 1052 "parser.c"
+#line 1059 "parser.c"
   yymsp[-1].minor.yy53 = yylhsminor.yy53;
         break;
       case 14: /* expr ::= MINUS expr */
-#line 178 "parser.y"
+#line 185 "parser.y"
 { 
     yymsp[-1].minor.yy53 = NewNotNode(yymsp[0].minor.yy53);
 }
-#line 1060 "parser.c"
+#line 1067 "parser.c"
         break;
       case 15: /* expr ::= TILDE expr */
-#line 181 "parser.y"
+#line 188 "parser.y"
 { 
     yymsp[-1].minor.yy53 = NewOptionalNode(yymsp[0].minor.yy53);
 }
-#line 1067 "parser.c"
+#line 1074 "parser.c"
         break;
       case 16: /* expr ::= term STAR */
-#line 185 "parser.y"
+#line 192 "parser.y"
 {
     yylhsminor.yy53 = NewPrefixNode(ctx->q, strdupcase(yymsp[-1].minor.yy0.s, yymsp[-1].minor.yy0.len), yymsp[-1].minor.yy0.len);
 }
-#line 1074 "parser.c"
+#line 1081 "parser.c"
   yymsp[-1].minor.yy53 = yylhsminor.yy53;
         break;
       case 17: /* modifier ::= MODIFIER */
-#line 189 "parser.y"
+#line 196 "parser.y"
 {
     yylhsminor.yy0 = yymsp[0].minor.yy0;
  }
-#line 1082 "parser.c"
+#line 1089 "parser.c"
   yymsp[0].minor.yy0 = yylhsminor.yy0;
         break;
       case 18: /* modifierlist ::= modifier OR term */
-#line 193 "parser.y"
+#line 200 "parser.y"
 {
     yylhsminor.yy48 = NewVector(char *, 2);
     char *s = strndup(yymsp[-2].minor.yy0.s, yymsp[-2].minor.yy0.len);
@@ -1090,68 +1097,68 @@ static void yy_reduce(
     s = strndup(yymsp[0].minor.yy0.s, yymsp[0].minor.yy0.len);
     Vector_Push(yylhsminor.yy48, s);
 }
-#line 1094 "parser.c"
+#line 1101 "parser.c"
   yymsp[-2].minor.yy48 = yylhsminor.yy48;
         break;
       case 19: /* modifierlist ::= modifierlist OR term */
-#line 201 "parser.y"
+#line 208 "parser.y"
 {
     char *s = strndup(yymsp[0].minor.yy0.s, yymsp[0].minor.yy0.len);
     Vector_Push(yymsp[-2].minor.yy48, s);
     yylhsminor.yy48 = yymsp[-2].minor.yy48;
 }
-#line 1104 "parser.c"
+#line 1111 "parser.c"
   yymsp[-2].minor.yy48 = yylhsminor.yy48;
         break;
       case 20: /* expr ::= modifier COLON numeric_range */
-#line 207 "parser.y"
+#line 214 "parser.y"
 {
     // we keep the capitalization as is
     yymsp[0].minor.yy54->fieldName = strndup(yymsp[-2].minor.yy0.s, yymsp[-2].minor.yy0.len);
     yylhsminor.yy53 = NewNumericNode(yymsp[0].minor.yy54);
 }
-#line 1114 "parser.c"
+#line 1121 "parser.c"
   yymsp[-2].minor.yy53 = yylhsminor.yy53;
         break;
       case 21: /* numeric_range ::= LSQB num num RSQB */
-#line 213 "parser.y"
+#line 220 "parser.y"
 {
     yymsp[-3].minor.yy54 = NewNumericFilter(yymsp[-2].minor.yy11.num, yymsp[-1].minor.yy11.num, yymsp[-2].minor.yy11.inclusive, yymsp[-1].minor.yy11.inclusive);
 }
-#line 1122 "parser.c"
+#line 1129 "parser.c"
         break;
       case 22: /* num ::= NUMBER */
-#line 217 "parser.y"
+#line 224 "parser.y"
 {
     yylhsminor.yy11.num = yymsp[0].minor.yy0.numval;
     yylhsminor.yy11.inclusive = 1;
 }
-#line 1130 "parser.c"
+#line 1137 "parser.c"
   yymsp[0].minor.yy11 = yylhsminor.yy11;
         break;
       case 23: /* num ::= LP num */
-#line 222 "parser.y"
+#line 229 "parser.y"
 {
     yymsp[-1].minor.yy11=yymsp[0].minor.yy11;
     yymsp[-1].minor.yy11.inclusive = 0;
 }
-#line 1139 "parser.c"
+#line 1146 "parser.c"
         break;
       case 24: /* num ::= MINUS num */
-#line 227 "parser.y"
+#line 234 "parser.y"
 {
     yymsp[0].minor.yy11.num = -yymsp[0].minor.yy11.num;
     yymsp[-1].minor.yy11 = yymsp[0].minor.yy11;
 }
-#line 1147 "parser.c"
+#line 1154 "parser.c"
         break;
       case 25: /* term ::= TERM */
       case 26: /* term ::= NUMBER */ yytestcase(yyruleno==26);
-#line 232 "parser.y"
+#line 239 "parser.y"
 {
     yylhsminor.yy0 = yymsp[0].minor.yy0; 
 }
-#line 1155 "parser.c"
+#line 1162 "parser.c"
   yymsp[0].minor.yy0 = yylhsminor.yy0;
         break;
       default:
@@ -1220,7 +1227,7 @@ static void yy_syntax_error(
     
     ctx->ok = 0;
     ctx->errorMsg = strdup(buf);
-#line 1224 "parser.c"
+#line 1231 "parser.c"
 /************ End %syntax_error code ******************************************/
   ParseARG_STORE; /* Suppress warning about unused %extra_argument variable */
 }
@@ -122,10 +122,17 @@ union(A) ::= union(B) OR expr(C). [ORX] {
 // }
 
 expr(A) ::= modifier(B) COLON expr(C) . [MODIFIER] {
-    if (ctx->q->ctx && ctx->q->ctx->spec) {
-        C->fieldMask = IndexSpec_GetFieldBit(ctx->q->ctx->spec, B.s, B.len); 
+    // the lexer passes a tag list as a single term in braces
+    if (C->type == QN_TOKEN && C->tn.len && C->tn.str[0] == '{') {
+        A = NewTagNode(B.s, B.len, C->tn.str, C->tn.len);
+        ctx->q->numTokens--;
+        QueryNode_Free(C);
+    } else {
+        if (ctx->q->ctx && ctx->q->ctx->spec) {
+            C->fieldMask = IndexSpec_GetFieldBit(ctx->q->ctx->spec, B.s, B.len); 
+        }
+        A = C; 
     }
-    A = C; 
 }
 
 
@@ -6,12 +6,14 @@
 #include "rmutil/util.h"
 #include "util/logging.h"
 #include "rmalloc.h"
+#include "geo_index.h"
+#include "tag_index.h"
 #include <stdio.h>
 
 RedisModuleType *InvertedIndexType;
 
 void *InvertedIndex_RdbLoad(RedisModuleIO *rdb, int encver) {
-  if (encver != 0) {
+  if (encver > INVERTED_INDEX_ENCVER) {
     return NULL;
   }
   InvertedIndex *idx = NewInvertedIndex(RedisModule_LoadUnsigned(rdb), 0);
@@ -25,11 +27,12 @@ void *InvertedIndex_RdbLoad(RedisModuleIO *rdb, int encver) {
     blk->firstId = RedisModule_LoadUnsigned(rdb);
     blk->lastId = RedisModule_LoadUnsigned(rdb);
     blk->numDocs = RedisModule_LoadUnsigned(rdb);
+    // older blocks have no bound, so they can never be skipped by their score
+    blk->maxFreq = encver >= 1 ? RedisModule_LoadUnsigned(rdb) : FREQ_QUANTIZE_FACTOR;
 
     size_t cap;
     char *data = RedisModule_LoadStringBuffer(rdb, &cap);
-    blk->data = Buffer_Wrap(data, cap);
-    blk->data->offset = cap;
+    blk->data = (Buffer){.data = data, .cap = cap, .offset = cap};
   }
   return idx;
 }
@@ -46,7 +49,8 @@ void InvertedIndex_RdbSave(RedisModuleIO *rdb, void *value) {
     RedisModule_SaveUnsigned(rdb, blk->firstId);
     RedisModule_SaveUnsigned(rdb, blk->lastId);
     RedisModule_SaveUnsigned(rdb, blk->numDocs);
-    RedisModule_SaveStringBuffer(rdb, blk->data->data, blk->data->offset);
+    RedisModule_SaveUnsigned(rdb, blk->maxFreq);
+    RedisModule_SaveStringBuffer(rdb, blk->data.data, blk->data.offset);
   }
 }
 void InvertedIndex_Digest(RedisModuleDigest *digest, void *value) {
@@ -62,7 +66,7 @@ int InvertedIndex_RegisterType(RedisModuleCtx *ctx) {
                                .aof_rewrite = InvertedIndex_AofRewrite,
                                .free = InvertedIndex_Free};
 
-  InvertedIndexType = RedisModule_CreateDataType(ctx, "ft_invidx", 0, &tm);
+  InvertedIndexType = RedisModule_CreateDataType(ctx, "ft_invidx", INVERTED_INDEX_ENCVER, &tm);
   if (InvertedIndexType == NULL) {
     RedisModule_Log(ctx, "error", "Could not create inverted index type");
     return REDISMODULE_ERR;
@@ -184,8 +188,29 @@ const char *Redis_SelectRandomTerm(RedisSearchCtx *ctx, size_t *tlen) {
 //   return NewScoreIndex(b);
 // }
 
+/* Open the inverted index of a term kept in the spec of a NOTERMKEYS index */
+static InvertedIndex *openTermIndex(RedisSearchCtx *ctx, const char *term, size_t len, int write) {
+  if (len > UINT16_MAX) {
+    return NULL;
+  }
+  InvertedIndex *idx = TrieMap_Find(ctx->spec->termIndexes, (char *)term, len);
+  if (idx != TRIEMAP_NOTFOUND) {
+    return idx;
+  }
+  if (!write) {
+    return NULL;
+  }
+  idx = NewInvertedIndex(ctx->spec->flags, 1);
+  TrieMap_Add(ctx->spec->termIndexes, (char *)term, len, idx, NULL);
+  return idx;
+}
+
 InvertedIndex *Redis_OpenInvertedIndex(RedisSearchCtx *ctx, const char *term, size_t len,
                                        int write) {
+  if (ctx->spec->flags & Index_NoTermKeys) {
+    return openTermIndex(ctx, term, len, write);
+  }
+
   RedisModuleString *termKey = fmtRedisTermKey(ctx, term, len);
   RedisModuleKey *k = RedisModule_OpenKey(ctx->redisCtx, termKey,
                                           REDISMODULE_READ | (write ? REDISMODULE_WRITE : 0));
@@ -215,6 +240,11 @@ InvertedIndex *Redis_OpenInvertedIndex(RedisSearchCtx *ctx, const char *term, si
 
 IndexReader *Redis_OpenReader(RedisSearchCtx *ctx, RSToken *tok, DocTable *dt, int singleWordMode,
                               t_fieldMask fieldMask) {
+  if (ctx->spec->flags & Index_NoTermKeys) {
+    InvertedIndex *idx = openTermIndex(ctx, tok->str, tok->len, 0);
+    return idx ? NewIndexReader(idx, dt, fieldMask, ctx->spec->flags, NewTerm(tok), singleWordMode)
+               : NULL;
+  }
 
   RedisModuleString *termKey = fmtRedisTermKey(ctx, tok->str, tok->len);
   RedisModuleKey *k = RedisModule_OpenKey(ctx->redisCtx, termKey, REDISMODULE_READ);
@@ -490,17 +520,23 @@ int Redis_DropIndex(RedisSearchCtx *ctx, int deleteDocuments) {
     }
   }
 
-  RedisModuleString *pf = fmtRedisTermKey(ctx, "*", 1);
-  const char *prefix = RedisModule_StringPtrLen(pf, NULL);
-
-  // // Delete the actual index sub keys
-  Redis_ScanKeys(ctx->redisCtx, prefix, Redis_DropScanHandler, ctx);
+  // Delete the actual index sub keys. The terms of NOTERMKEYS indexes are freed with the spec
+  if (!(ctx->spec->flags & Index_NoTermKeys)) {
+    RedisModuleString *pf = fmtRedisTermKey(ctx, "*", 1);
+    const char *prefix = RedisModule_StringPtrLen(pf, NULL);
+    Redis_ScanKeys(ctx->redisCtx, prefix, Redis_DropScanHandler, ctx);
+  }
 
-  // Delete the numeric indexes
+  // Delete the numeric, geo and tag indexes
   for (size_t i = 0; i < ctx->spec->numFields; i++) {
-    const FieldSpec *spec = ctx->spec->fields + i;
+    FieldSpec *spec = ctx->spec->fields + i;
     if (spec->type == F_NUMERIC) {
       Redis_DeleteKey(ctx->redisCtx, fmtRedisNumericIndexKey(ctx, spec->name));
+    } else if (spec->type == F_GEO) {
+      GeoIndex gi = {.ctx = ctx, .sp = spec};
+      Redis_DeleteKey(ctx->redisCtx, fmtGeoIndexKey(&gi));
+    } else if (spec->type == F_TAG) {
+      Redis_DeleteKey(ctx->redisCtx, TagIndex_FormatName(ctx, spec->name));
     }
   }
 
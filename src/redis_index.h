@@ -7,7 +7,8 @@
 #include "search_ctx.h"
 #include "spec.h"
 
-/* Open an inverted index reader on a redis DMA string, for a specific term.
+/* Open an inverted index reader on a redis DMA string, for a specific term. The terms of NOTERMKEYS
+ * indexes are looked up in the spec instead of the keyspace.
  * If singleWordMode is set to 1, we do not load the skip index, only the score index
  */
 IndexReader *Redis_OpenReader(RedisSearchCtx *ctx, RSToken *tok, DocTable *dt,
@@ -58,6 +59,9 @@ RedisModuleString *fmtRedisNumericIndexKey(RedisSearchCtx *ctx, const char *fiel
 
 extern RedisModuleType *InvertedIndexType;
 
+/* The encoding version of inverted indexes. Version 1 added the max frequency of the blocks */
+#define INVERTED_INDEX_ENCVER 1
+
 void InvertedIndex_Free(void *idx);
 void *InvertedIndex_RdbLoad(RedisModuleIO *rdb, int encver);
 void InvertedIndex_RdbSave(RedisModuleIO *rdb, void *value);
@@ -5,6 +5,7 @@
 #include "ext/default.h"
 #include "extension.h"
 #include "query.h"
+#include "query_cache.h"
 #include "concurrent_ctx.h"
 #include "redismodule.h"
 #include "rmalloc.h"
@@ -86,6 +87,9 @@ RSSearchRequest *ParseRequest(RedisSearchCtx *ctx, RedisModuleString **argv, int
   // Parse NOSTOPWORDS argument
   if (RMUtil_ArgExists("NOSTOPWORDS", argv, argc, 3)) req->flags |= Search_NoStopwrods;
 
+  // Parse PRUNE argument
+  if (RMUtil_ArgExists("PRUNE", argv, argc, 3)) req->flags |= Search_Prune;
+
   if (RMUtil_ArgExists("INORDER", argv, argc, 3)) {
     req->flags |= Search_InOrder;
     // the slop will be parsed later, this is just the default when INORDER and no SLOP
@@ -126,9 +130,9 @@ RSSearchRequest *ParseRequest(RedisSearchCtx *ctx, RedisModuleString **argv, int
 
   // parse geo filter if present
   int gfIdx = RMUtil_ArgExists("GEOFILTER", argv, argc, 3);
-  if (gfIdx > 0 && gfIdx + 6 <= argc) {
+  if (gfIdx > 0) {
     req->geoFilter = malloc(sizeof(GeoFilter));
-    if (GeoFilter_Parse(req->geoFilter, &argv[gfIdx + 1], 5) == REDISMODULE_ERR) {
+    if (GeoFilter_Parse(req->geoFilter, &argv[gfIdx + 1], argc - gfIdx - 1) == REDISMODULE_ERR) {
       *errStr = "Invalid geo filter";
       goto err;
     }
@@ -326,13 +330,33 @@ void threadProcessQuery(void *p) {
     req->numericFilters = NULL;
   }
 
-  // Execute the query
+  // Serve hot queries from the cache of the index, as long as the documents didn't change since
+  IndexSpec *sp = req->sctx->spec;
+  QueryCache *cache = IndexSpec_GetQueryCache(sp);
+  char *cacheKey = cache ? Query_CacheKey(q) : NULL;
+  const QueryResult *cached =
+      cacheKey ? QueryCache_Get(cache, cacheKey, sp->docs.generation) : NULL;
+  if (cached) {
+    QueryResult_Serialize((QueryResult *)cached, req->sctx, req);
+    free(cacheKey);
+    Query_Free(q);
+    goto end;
+  }
+
+  // Execute the query. The documents may change while it runs, so the results belong to the
+  // generation it started at
+  uint64_t generation = sp->docs.generation;
   QueryResult *r = Query_Execute(q);
   if (r == NULL) {
     RedisModule_ReplyWithError(ctx, QUERY_ERROR_INTERNAL_STR);
+    free(cacheKey);
     goto end;
   }
 
+  if (cacheKey) {
+    QueryCache_Put(cache, cacheKey, generation, r);
+    free(cacheKey);
+  }
   QueryResult_Serialize(r, req->sctx, req);
   QueryResult_Free(r);
   Query_Free(q);
@@ -20,6 +20,8 @@ typedef enum {
 
   Search_WithSortKeys = 0x40,
 
+  Search_Prune = 0x80,
+
 } RSSearchFlags;
 
 #define RS_DEFAULT_QUERY_FLAGS 0x00
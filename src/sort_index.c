@@ -0,0 +1,66 @@
+#include "sort_index.h"
+#include "rmalloc.h"
+#include <sys/param.h>
+
+typedef struct {
+  const RSSortableValue *val;
+  t_docId docId;
+} sortIndexEntry;
+
+static int sortIndex_cmpEntries(const void *e1, const void *e2) {
+  const sortIndexEntry *s1 = e1, *s2 = e2;
+  int rc = RSSortableValue_Cmp(s1->val, s2->val);
+  if (rc) return rc;
+  return s1->docId < s2->docId ? -1 : (s1->docId > s2->docId ? 1 : 0);
+}
+
+static SortIndex *newSortIndex(DocTable *dt, int sortIdx) {
+  SortIndex *si = rm_malloc(sizeof(SortIndex));
+  si->maxDocId = dt->maxDocId;
+  si->refcount = 1;
+  si->len = 0;
+
+  // deleted documents and documents without a sorting vector are left out. Queries never return
+  // them anyway
+  sortIndexEntry *ents = rm_malloc((dt->maxDocId + 1) * sizeof(sortIndexEntry));
+  for (t_docId id = 1; id <= dt->maxDocId; id++) {
+    RSDocumentMetadata *dmd = DocTable_Get(dt, id);
+    if (!dmd || dmd->flags & Document_Deleted || !dmd->sortVector ||
+        sortIdx >= dmd->sortVector->len) {
+      continue;
+    }
+    ents[si->len++] = (sortIndexEntry){.val = &dmd->sortVector->values[sortIdx], .docId = id};
+  }
+  qsort(ents, si->len, sizeof(sortIndexEntry), sortIndex_cmpEntries);
+
+  si->docIds = rm_malloc(MAX(si->len, 1) * sizeof(t_docId));
+  for (size_t i = 0; i < si->len; i++) {
+    si->docIds[i] = ents[i].docId;
+  }
+  rm_free(ents);
+  return si;
+}
+
+SortIndex *IndexSpec_GetSortIndex(IndexSpec *sp, int sortIdx) {
+  if (!sp->sortables || sortIdx < 0 || sortIdx >= sp->sortables->len) {
+    return NULL;
+  }
+  if (!sp->sortIndexes) {
+    sp->sortIndexes = rm_calloc(sp->sortables->len, sizeof(SortIndex *));
+  }
+
+  SortIndex *si = sp->sortIndexes[sortIdx];
+  if (!si || (sp->docs.maxDocId - si->maxDocId) * SORT_INDEX_REBUILD_RATIO > si->len) {
+    // queries still walking the old index keep their reference to it
+    if (si) SortIndex_Free(si);
+    si = sp->sortIndexes[sortIdx] = newSortIndex(&sp->docs, sortIdx);
+  }
+  si->refcount++;
+  return si;
+}
+
+void SortIndex_Free(SortIndex *si) {
+  if (--si->refcount) return;
+  rm_free(si->docIds);
+  rm_free(si);
+}
@@ -0,0 +1,36 @@
+#ifndef __SORT_INDEX_H__
+#define __SORT_INDEX_H__
+
+#include "redisearch.h"
+#include "spec.h"
+
+/* A SortIndex orders the documents of a spec by the value of one of its sortable fields. It lets
+ * SORTBY queries walk the documents in sorting order, and stop once the top results are known,
+ * instead of sorting all the matching documents.
+ *
+ * The index is built lazily from the sorting vectors in the DocTable, and covers the documents up
+ * to the table's maxDocId at the time. Documents added later are not in it, and the index is only
+ * rebuilt once they are a large enough portion of the table */
+typedef struct SortIndex {
+  // the docIds ordered by the field's value in ascending order, and by docId among equal values
+  t_docId *docIds;
+  size_t len;
+  // the largest docId when the index was built
+  t_docId maxDocId;
+  // the spec holds a reference, and so does every query walking the index
+  int refcount;
+} SortIndex;
+
+/* Rebuild a sort index once documents that are not in it are more than 1/SORT_INDEX_REBUILD_RATIO
+ * of the documents that are */
+#define SORT_INDEX_REBUILD_RATIO 8
+
+/* Get the sort index of the sortable field at sortIdx, building it if needed. The caller gets a
+ * reference to the index, which it must release with SortIndex_Free. Returns NULL if the spec has
+ * no such sortable field */
+SortIndex *IndexSpec_GetSortIndex(IndexSpec *sp, int sortIdx);
+
+/* Release a reference to a sort index, freeing it with the last one */
+void SortIndex_Free(SortIndex *si);
+
+#endif
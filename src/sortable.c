@@ -21,24 +21,21 @@ RSSortingVector *NewSortingVector(int len) {
   return ret;
 }
 
-/* Internal compare function between members of the sorting vectors, sorted by sk */
-inline int RSSortingVector_Cmp(RSSortingVector *self, RSSortingVector *other, RSSortingKey *sk) {
-
-  RSSortableValue v1 = self->values[sk->index];
-  RSSortableValue v2 = other->values[sk->index];
+/* Compare two sortable values of the same field in ascending order. NIL values come first */
+inline int RSSortableValue_Cmp(const RSSortableValue *v1, const RSSortableValue *v2) {
   int rc = 0;
-  if (v2.type == RS_SORTABLE_NIL) {
-    rc = v1.type == RS_SORTABLE_NIL ? 0 : 1;
+  if (v2->type == RS_SORTABLE_NIL) {
+    rc = v1->type == RS_SORTABLE_NIL ? 0 : 1;
   } else {
 
-    assert(v1.type == v2.type || v1.type == RS_SORTABLE_NIL);
-    switch (v1.type) {
+    assert(v1->type == v2->type || v1->type == RS_SORTABLE_NIL);
+    switch (v1->type) {
       case RS_SORTABLE_NUM: {
-        rc = v1.num < v2.num ? -1 : (v2.num < v1.num ? 1 : 0);
+        rc = v1->num < v2->num ? -1 : (v2->num < v1->num ? 1 : 0);
         break;
       }
       case RS_SORTABLE_STR: {
-        rc = strcmp(v1.str, v2.str);
+        rc = strcmp(v1->str, v2->str);
         break;
       }
 
@@ -47,6 +44,12 @@ inline int RSSortingVector_Cmp(RSSortingVector *self, RSSortingVector *other, RS
         break;
     }
   }
+  return rc;
+}
+
+/* Internal compare function between members of the sorting vectors, sorted by sk */
+inline int RSSortingVector_Cmp(RSSortingVector *self, RSSortingVector *other, RSSortingKey *sk) {
+  int rc = RSSortableValue_Cmp(&self->values[sk->index], &other->values[sk->index]);
   return sk->ascending ? rc : -rc;
 }
 
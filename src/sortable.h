@@ -76,6 +76,9 @@ int RSSortingTable_ParseKey(RSSortingTable *tbl, RSSortingKey *k, RedisModuleStr
 /* Get the field index by name from the sorting table. Returns -1 if the field was not found */
 int RSSortingTable_GetFieldIdx(RSSortingTable *tbl, const char *field);
 
+/* Compare two sortable values of the same field in ascending order. NIL values come first */
+int RSSortableValue_Cmp(const RSSortableValue *v1, const RSSortableValue *v2);
+
 /* Internal compare function between members of the sorting vectors, sorted by sk */
 int RSSortingVector_Cmp(RSSortingVector *self, RSSortingVector *other, RSSortingKey *sk);
 
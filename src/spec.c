@@ -7,6 +7,10 @@
 #include <math.h>
 #include <ctype.h>
 #include "rmalloc.h"
+#include "sort_index.h"
+#include "epoch.h"
+#include "query_cache.h"
+#include "redis_index.h"
 
 RedisModuleType *IndexSpecType;
 
@@ -51,7 +55,7 @@ char *GetFieldNameByBit(IndexSpec *sp, uint32_t id) {
 * Returns REDISMODULE_ERR if there's a parsing error.
 * The command only receives the relvant part of argv.
 *
-* The format currently is FT.CREATE {index} [NOOFFSETS] [NOFIELDS] [NOSCOREIDX]
+* The format currently is FT.CREATE {index} [NOOFFSETS] [NOFIELDS] [NOSCOREIDX] [NOTERMKEYS]
     SCHEMA {field} [TEXT [WEIGHT {weight}]] | [NUMERIC]
 */
 IndexSpec *IndexSpec_ParseRedisArgs(RedisModuleCtx *ctx, RedisModuleString *name,
@@ -96,6 +100,7 @@ int __parseFieldSpec(const char **argv, int *offset, int argc, FieldSpec *sp) {
   if (*offset >= argc) return 0;
   sp->sortIdx = -1;
   sp->sortable = 0;
+  sp->tagSep = TAG_FIELD_DEFAULT_SEP;
   // the field name comes here
   sp->name = rm_strdup(argv[*offset]);
 
@@ -134,13 +139,26 @@ int __parseFieldSpec(const char **argv, int *offset, int argc, FieldSpec *sp) {
     sp->type = F_GEO;
     sp->weight = 0;
     ++*offset;
+
+  } else if (!strcasecmp(argv[*offset], SPEC_TAG_STR)) {  // tag field
+    sp->type = F_TAG;
+    sp->weight = 0;
+    if (++*offset == argc) return 1;
+
+    // the separator must be a single character
+    if (!strcasecmp(argv[*offset], SPEC_SEPARATOR_STR)) {
+      if (++*offset == argc) return 0;
+      if (strlen(argv[*offset]) != 1) return 0;
+      sp->tagSep = argv[*offset][0];
+      ++*offset;
+    }
   } else {  // not numeric and not text - nothing more supported currently
     return 0;
   }
 
   if (*offset < argc && !strcasecmp(argv[*offset], SPEC_SORTABLE_STR)) {
-    // cannot sort by geo fields
-    if (sp->type == F_GEO) {
+    // cannot sort by geo or tag fields
+    if (sp->type == F_GEO || sp->type == F_TAG) {
       return 0;
     }
     sp->sortable = 1;
@@ -158,7 +176,7 @@ void _spec_buildSortingTable(IndexSpec *spec, int len) {
     }
   }
 }
-/* The format currently is FT.CREATE {index} [NOOFFSETS] [NOFIELDS] [NOSCOREIDX]
+/* The format currently is FT.CREATE {index} [NOOFFSETS] [NOFIELDS] [NOSCOREIDX] [NOTERMKEYS]
     SCHEMA {field} [TEXT [WEIGHT {weight}]] | [NUMERIC]
   */
 IndexSpec *IndexSpec_Parse(const char *name, const char **argv, int argc, char **err) {
@@ -183,6 +201,35 @@ IndexSpec *IndexSpec_Parse(const char *name, const char **argv, int argc, char *
     spec->flags &= ~Index_StoreScoreIndexes;
   }
 
+  if (__argExists(SPEC_NOTERMKEYS_STR, argv, argc, schemaOffset)) {
+    spec->flags |= Index_NoTermKeys;
+    spec->termIndexes = NewTrieMap();
+  }
+
+  int codecIndex = __findOffset(SPEC_CODEC_STR, argv, argc);
+  if (codecIndex >= 0 && codecIndex < schemaOffset) {
+    if (codecIndex + 1 >= schemaOffset) {
+      *err = "No codec given";
+      goto failure;
+    }
+    int codec = -1;
+    for (int c = 0; c < sizeof(CodecTypeNames) / sizeof(*CodecTypeNames); c++) {
+      if (!strcasecmp(argv[codecIndex + 1], CodecTypeNames[c])) {
+        codec = c;
+        break;
+      }
+    }
+    if (codec < 0) {
+      *err = "Unknown codec";
+      goto failure;
+    }
+    if (codec != Codec_QInt && spec->flags & Index_StoreTermOffsets) {
+      *err = "This codec requires NOOFFSETS";
+      goto failure;
+    }
+    spec->flags |= codec << INDEX_CODEC_SHIFT;
+  }
+
   int swIndex = __findOffset(SPEC_STOPWORDS_STR, argv, argc);
   if (swIndex >= 0 && swIndex + 1 < schemaOffset) {
     int listSize = atoi(argv[swIndex + 1]);
@@ -238,12 +285,15 @@ int IndexSpec_AddTerm(IndexSpec *sp, const char *term, size_t len) {
   return Trie_InsertStringBuffer(sp->terms, (char *)term, len, 1, 1, NULL);
 }
 
-void IndexSpec_Free(void *ctx) {
+static void indexSpec_free(void *ctx) {
   IndexSpec *spec = ctx;
 
   if (spec->terms) {
     TrieType_Free(spec->terms);
   }
+  if (spec->termIndexes) {
+    TrieMap_Free(spec->termIndexes, InvertedIndex_Free);
+  }
   DocTable_Free(&spec->docs);
   if (spec->fields != NULL) {
     for (int i = 0; i < spec->numFields; i++) {
@@ -252,6 +302,18 @@ void IndexSpec_Free(void *ctx) {
     rm_free(spec->fields);
   }
   rm_free(spec->name);
+  if (spec->flags & Index_HasCustomStopwords) {
+    StopWordList_Free(spec->stopwords);
+  }
+  if (spec->sortIndexes) {
+    for (int i = 0; i < spec->sortables->len; i++) {
+      if (spec->sortIndexes[i]) SortIndex_Free(spec->sortIndexes[i]);
+    }
+    rm_free(spec->sortIndexes);
+  }
+  if (spec->queryCache) {
+    QueryCache_Free(spec->queryCache);
+  }
   if (spec->sortables) {
     SortingTable_Free(spec->sortables);
     spec->sortables = NULL;
@@ -259,6 +321,11 @@ void IndexSpec_Free(void *ctx) {
   rm_free(spec);
 }
 
+void IndexSpec_Free(void *ctx) {
+  // queries running without the lock may still read the document table
+  Epoch_Retire(ctx, indexSpec_free);
+}
+
 /* Load the spec from the saved version */
 IndexSpec *IndexSpec_Load(RedisModuleCtx *ctx, const char *name, int openWrite) {
 
@@ -328,7 +395,10 @@ IndexSpec *NewIndexSpec(const char *name, size_t numFields) {
   sp->docs = NewDocTable(1000);
   sp->stopwords = DefaultStopWordList();
   sp->terms = NewTrie();
+  sp->termIndexes = NULL;
   sp->sortables = NULL;
+  sp->sortIndexes = NULL;
+  sp->queryCache = NULL;
   memset(&sp->stats, 0, sizeof(sp->stats));
   return sp;
 }
@@ -340,6 +410,7 @@ void __fieldSpec_rdbSave(RedisModuleIO *rdb, FieldSpec *f) {
   RedisModule_SaveDouble(rdb, f->weight);
   RedisModule_SaveUnsigned(rdb, f->sortable);
   RedisModule_SaveSigned(rdb, f->sortIdx);
+  RedisModule_SaveUnsigned(rdb, f->tagSep);
 }
 
 void __fieldSpec_rdbLoad(RedisModuleIO *rdb, FieldSpec *f, int encver) {
@@ -352,9 +423,13 @@ void __fieldSpec_rdbLoad(RedisModuleIO *rdb, FieldSpec *f, int encver) {
     f->sortable = RedisModule_LoadUnsigned(rdb);
     f->sortIdx = RedisModule_LoadSigned(rdb);
   }
+  f->tagSep = TAG_FIELD_DEFAULT_SEP;
+  if (encver >= 8) {
+    f->tagSep = RedisModule_LoadUnsigned(rdb);
+  }
 }
 
-void __indexStats_rdbLoad(RedisModuleIO *rdb, IndexStats *stats) {
+void __indexStats_rdbLoad(RedisModuleIO *rdb, IndexStats *stats, int encver) {
   stats->numDocuments = RedisModule_LoadUnsigned(rdb);
   stats->numTerms = RedisModule_LoadUnsigned(rdb);
   stats->numRecords = RedisModule_LoadUnsigned(rdb);
@@ -365,6 +440,10 @@ void __indexStats_rdbLoad(RedisModuleIO *rdb, IndexStats *stats) {
   stats->offsetVecsSize = RedisModule_LoadUnsigned(rdb);
   stats->offsetVecRecords = RedisModule_LoadUnsigned(rdb);
   stats->termsSize = RedisModule_LoadUnsigned(rdb);
+  // block stats were added in version 6
+  if (encver >= 6) {
+    stats->numBlocks = RedisModule_LoadUnsigned(rdb);
+  }
 }
 
 void __indexStats_rdbSave(RedisModuleIO *rdb, IndexStats *stats) {
@@ -378,6 +457,35 @@ void __indexStats_rdbSave(RedisModuleIO *rdb, IndexStats *stats) {
   RedisModule_SaveUnsigned(rdb, stats->offsetVecsSize);
   RedisModule_SaveUnsigned(rdb, stats->offsetVecRecords);
   RedisModule_SaveUnsigned(rdb, stats->termsSize);
+  RedisModule_SaveUnsigned(rdb, stats->numBlocks);
+}
+
+/* The inverted indexes of NOTERMKEYS indexes are saved with the version of their own encoding,
+ * followed by the terms and their indexes */
+void __termIndexes_rdbSave(RedisModuleIO *rdb, TrieMap *m) {
+  RedisModule_SaveUnsigned(rdb, INVERTED_INDEX_ENCVER);
+  RedisModule_SaveUnsigned(rdb, m->cardinality);
+
+  TrieMapIterator *it = TrieMap_Iterate(m, "", 0);
+  char *str;
+  tm_len_t len;
+  void *ptr;
+  while (TrieMapIterator_Next(it, &str, &len, &ptr)) {
+    RedisModule_SaveStringBuffer(rdb, str, len);
+    InvertedIndex_RdbSave(rdb, ptr);
+  }
+  TrieMapIterator_Free(it);
+}
+
+void __termIndexes_rdbLoad(RedisModuleIO *rdb, TrieMap *m) {
+  int encver = RedisModule_LoadUnsigned(rdb);
+  size_t n = RedisModule_LoadUnsigned(rdb);
+  for (size_t i = 0; i < n; i++) {
+    size_t len;
+    char *term = RedisModule_LoadStringBuffer(rdb, &len);
+    TrieMap_Add(m, term, len, InvertedIndex_RdbLoad(rdb, encver), NULL);
+    RedisModule_Free(term);
+  }
 }
 
 void *IndexSpec_RdbLoad(RedisModuleIO *rdb, int encver) {
@@ -386,8 +494,11 @@ void *IndexSpec_RdbLoad(RedisModuleIO *rdb, int encver) {
   }
   IndexSpec *sp = rm_malloc(sizeof(IndexSpec));
   sp->terms = NULL;
+  sp->termIndexes = NULL;
   sp->docs = NewDocTable(1000);
   sp->sortables = NULL;
+  sp->sortIndexes = NULL;
+  sp->queryCache = NULL;
   sp->name = RedisModule_LoadStringBuffer(rdb, NULL);
   sp->flags = (IndexFlags)RedisModule_LoadUnsigned(rdb);
 
@@ -407,7 +518,7 @@ void *IndexSpec_RdbLoad(RedisModuleIO *rdb, int encver) {
     _spec_buildSortingTable(sp, maxSortIdx + 1);
   }
 
-  __indexStats_rdbLoad(rdb, &sp->stats);
+  __indexStats_rdbLoad(rdb, &sp->stats, encver);
 
   DocTable_RdbLoad(&sp->docs, rdb, encver);
   /* For version 3 or up - load the generic trie */
@@ -422,6 +533,14 @@ void *IndexSpec_RdbLoad(RedisModuleIO *rdb, int encver) {
   } else {
     sp->stopwords = DefaultStopWordList();
   }
+
+  // NOTERMKEYS was added in version 7
+  if (sp->flags & Index_NoTermKeys) {
+    sp->termIndexes = NewTrieMap();
+    if (encver >= 7) {
+      __termIndexes_rdbLoad(rdb, sp->termIndexes);
+    }
+  }
   return sp;
 }
 
@@ -446,6 +565,10 @@ void IndexSpec_RdbSave(RedisModuleIO *rdb, void *value) {
   if (sp->flags & Index_HasCustomStopwords) {
     StopWordList_RdbSave(rdb, sp->stopwords);
   }
+
+  if (sp->flags & Index_NoTermKeys) {
+    __termIndexes_rdbSave(rdb, sp->termIndexes);
+  }
 }
 
 void IndexSpec_Digest(RedisModuleDigest *digest, void *value) {
@@ -470,6 +593,13 @@ void IndexSpec_AofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *valu
   if (!(sp->flags & Index_StoreScoreIndexes)) {
     __vpushStr(args, ctx, SPEC_NOSCOREIDX_STR);
   }
+  if (sp->flags & Index_NoTermKeys) {
+    __vpushStr(args, ctx, SPEC_NOTERMKEYS_STR);
+  }
+  if (IndexFlags_Codec(sp->flags) != Codec_QInt) {
+    __vpushStr(args, ctx, SPEC_CODEC_STR);
+    __vpushStr(args, ctx, CodecTypeNames[IndexFlags_Codec(sp->flags)]);
+  }
 
   // write SCHEMA keyword
   __vpushStr(args, ctx, SPEC_SCHEMA_STR);
@@ -493,6 +623,15 @@ void IndexSpec_AofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *valu
       case F_GEO:
         __vpushStr(args, ctx, sp->fields[i].name);
         __vpushStr(args, ctx, GEO_STR);
+        break;
+      case F_TAG:
+        __vpushStr(args, ctx, sp->fields[i].name);
+        __vpushStr(args, ctx, SPEC_TAG_STR);
+        if (sp->fields[i].tagSep != TAG_FIELD_DEFAULT_SEP) {
+          __vpushStr(args, ctx, SPEC_SEPARATOR_STR);
+          Vector_Push(args, RedisModule_CreateStringPrintf(ctx, "%c", sp->fields[i].tagSep));
+        }
+        break;
       default:
 
         break;
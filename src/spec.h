@@ -9,6 +9,7 @@
 #include "trie/trie_type.h"
 #include "sortable.h"
 #include "stopwords.h"
+#include "dep/triemap/triemap.h"
 
 typedef enum fieldType { F_FULLTEXT, F_NUMERIC, F_GEO, F_TAG } FieldType;
 
@@ -18,12 +19,18 @@ typedef enum fieldType { F_FULLTEXT, F_NUMERIC, F_GEO, F_TAG } FieldType;
 #define SPEC_NOOFFSETS_STR "NOOFFSETS"
 #define SPEC_NOFIELDS_STR "NOFIELDS"
 #define SPEC_NOSCOREIDX_STR "NOSCOREIDX"
+#define SPEC_NOTERMKEYS_STR "NOTERMKEYS"
 #define SPEC_SCHEMA_STR "SCHEMA"
 #define SPEC_TEXT_STR "TEXT"
 #define SPEC_WEIGHT_STR "WEIGHT"
 #define SPEC_TAG_STR "TAG"
+#define SPEC_SEPARATOR_STR "SEPARATOR"
+
+/* The default separator of the values of a tag field */
+#define TAG_FIELD_DEFAULT_SEP ','
 #define SPEC_SORTABLE_STR "SORTABLE"
 #define SPEC_STOPWORDS_STR "STOPWORDS"
+#define SPEC_CODEC_STR "CODEC"
 
 static const char *SpecTypeNames[] = {[F_FULLTEXT] = SPEC_TEXT_STR, [F_NUMERIC] = NUMERIC_STR,
                                       [F_GEO] = GEO_STR, [F_TAG] = SPEC_TAG_STR};
@@ -44,8 +51,8 @@ typedef struct fieldSpec {
   int sortable;
   int sortIdx;
 
-  // TODO: const char **separators;
-  // size_t numSeparators;
+  // the character separating the values of a tag field
+  char tagSep;
   // TODO: More options here..
 } FieldSpec;
 
@@ -60,6 +67,7 @@ typedef struct {
   size_t offsetVecsSize;
   size_t offsetVecRecords;
   size_t termsSize;
+  size_t numBlocks;
 } IndexStats;
 
 typedef enum {
@@ -67,10 +75,31 @@ typedef enum {
   Index_StoreFieldFlags = 0x02,
   Index_StoreScoreIndexes = 0x04,
   Index_HasCustomStopwords = 0x08,
+  // bits 4-5 hold the posting list codec, see IndexCodecType
+  Index_CodecMask = 0x30,
+  // the inverted indexes of the terms are kept in the spec, not in a redis key per term
+  Index_NoTermKeys = 0x40,
 } IndexFlags;
 
+/* The posting list codecs an index can be created with */
+typedef enum {
+  // qint encoded records, supporting all the index flags. This is the default
+  Codec_QInt = 0,
+  // frame of reference - bit packed docId deltas, frequencies and field masks. Requires NOOFFSETS
+  Codec_FOR = 1,
+  // FOR, with the docIds of dense blocks kept as bitmaps. Requires NOOFFSETS
+  Codec_Bitmap = 2,
+} IndexCodecType;
+
+#define INDEX_CODEC_SHIFT 4
+#define IndexFlags_Codec(flags) ((IndexCodecType)(((flags)&Index_CodecMask) >> INDEX_CODEC_SHIFT))
+
+static const char *CodecTypeNames[] = {
+    [Codec_QInt] = "QINT", [Codec_FOR] = "FOR", [Codec_Bitmap] = "BITMAP",
+};
+
 #define INDEX_DEFAULT_FLAGS Index_StoreTermOffsets | Index_StoreFieldFlags | Index_StoreScoreIndexes
-#define INDEX_CURRENT_VERSION 5
+#define INDEX_CURRENT_VERSION 8
 #define INDEX_MIN_COMPAT_VERSION 2
 
 typedef struct {
@@ -82,8 +111,14 @@ typedef struct {
   IndexFlags flags;
 
   Trie *terms;
+  // the inverted indexes of NOTERMKEYS indexes by term, saved as part of the spec
+  TrieMap *termIndexes;
 
   RSSortingTable *sortables;
+  // lazily built orderings of the documents by each sortable field, see sort_index.h
+  struct SortIndex **sortIndexes;
+  // the results of recent queries, see query_cache.h
+  struct QueryCache *queryCache;
 
   DocTable docs;
 
@@ -6,7 +6,11 @@
 
 #define MAX_STOPWORDLIST_SIZE 1024
 
-typedef struct StopWordList { TrieMap *m; } StopWordList;
+typedef struct StopWordList {
+  TrieMap *m;
+  // async adds tokenize with the list off the global lock, so the count is changed atomically
+  size_t refcount;
+} StopWordList;
 
 StopWordList *__default_stopwords = NULL;
 
@@ -47,6 +51,7 @@ StopWordList *NewStopWordListCStr(const char **strs, size_t len) {
   }
   StopWordList *sl = rm_malloc(sizeof(*sl));
   sl->m = NewTrieMap();
+  sl->refcount = 1;
 
   for (size_t i = 0; i < len; i++) {
 
@@ -70,11 +75,17 @@ StopWordList *NewStopWordListCStr(const char **strs, size_t len) {
   return sl;
 }
 
+StopWordList *StopWordList_Ref(StopWordList *sl) {
+  if (sl) __sync_add_and_fetch(&sl->refcount, 1);
+  return sl;
+}
+
 /* Free a stopword list's memory */
 void StopWordList_Free(StopWordList *sl) {
-  if (sl) {
-    TrieMap_Free(sl->m, NULL);
+  if (!sl || __sync_sub_and_fetch(&sl->refcount, 1)) {
+    return;
   }
+  TrieMap_Free(sl->m, NULL);
   rm_free(sl);
 }
 
@@ -83,6 +94,7 @@ StopWordList *StopWordList_RdbLoad(RedisModuleIO *rdb, int encver) {
   uint64_t elements = RedisModule_LoadUnsigned(rdb);
   StopWordList *sl = rm_malloc(sizeof(*sl));
   sl->m = NewTrieMap();
+  sl->refcount = 1;
 
   while (elements--) {
     size_t len;
@@ -26,7 +26,10 @@ struct StopWordList *NewStopWordList(RedisModuleString **strs, size_t len);
 /* Create a new stopword list from a list of NULL-terminated C strings */
 struct StopWordList *NewStopWordListCStr(const char **strs, size_t len);
 
-/* Free a stopword list's memory */
+/* Take another reference to a stopword list, released with StopWordList_Free */
+struct StopWordList *StopWordList_Ref(struct StopWordList *sl);
+
+/* Release a reference to a stopword list, freeing it with the last one */
 void StopWordList_Free(struct StopWordList *sl);
 
 /* Load a stopword list from RDB */
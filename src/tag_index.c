@@ -0,0 +1,175 @@
+#include "tag_index.h"
+#include "redis_index.h"
+#include "rmalloc.h"
+#include <ctype.h>
+
+#define TAGINDEX_KEY_FMT "tag:%s/%s"
+
+RedisModuleType *TagIndexType = NULL;
+
+TagIndex *NewTagIndex() {
+  TagIndex *idx = rm_malloc(sizeof(TagIndex));
+  idx->values = NewTrieMap();
+  return idx;
+}
+
+Vector *TagIndex_Preprocess(char sep, const char *data, size_t len) {
+  Vector *ret = NewVector(char *, 4);
+  const char *end = data + len;
+  while (data <= end) {
+    const char *next = memchr(data, sep, end - data);
+    if (!next) next = end;
+
+    // trim the value, and skip it if nothing is left
+    const char *s = data, *e = next;
+    while (s < e && isspace((unsigned char)*s)) s++;
+    while (e > s && isspace((unsigned char)e[-1])) e--;
+    if (e > s && e - s <= UINT16_MAX) {
+      char *val = rm_strndup(s, e - s);
+      for (char *c = val; *c; c++) {
+        *c = tolower((unsigned char)*c);
+      }
+      Vector_Push(ret, val);
+    }
+    data = next + 1;
+  }
+  return ret;
+}
+
+size_t TagIndex_Index(TagIndex *idx, Vector *values, t_docId docId) {
+  size_t ret = 0;
+  for (size_t i = 0; i < Vector_Size(values); i++) {
+    char *val;
+    Vector_Get(values, i, &val);
+    size_t len = strlen(val);
+
+    InvertedIndex *iv = TrieMap_Find(idx->values, val, len);
+    if (iv == TRIEMAP_NOTFOUND) {
+      iv = NewInvertedIndex(TAG_INDEX_FLAGS, 1);
+      TrieMap_Add(idx->values, val, len, iv, NULL);
+    } else if (iv->lastId == docId) {
+      // the value appears more than once in the document
+      continue;
+    }
+
+    ForwardIndexEntry ent = {
+        .docId = docId, .freq = 1, .normFreq = 1, .docScore = 1, .fieldMask = RS_FIELDMASK_ALL};
+    ret += InvertedIndex_WriteEntry(iv, &ent);
+  }
+  return ret;
+}
+
+IndexIterator *TagIndex_OpenReader(TagIndex *idx, DocTable *dt, const char *value, size_t len) {
+  if (len > UINT16_MAX) return NULL;
+  InvertedIndex *iv = TrieMap_Find(idx->values, (char *)value, len);
+  if (iv == TRIEMAP_NOTFOUND || !iv) {
+    return NULL;
+  }
+
+  RSToken tok = {.str = (char *)value, .len = len};
+  IndexReader *r = NewIndexReader(iv, dt, RS_FIELDMASK_ALL, iv->flags, NewTerm(&tok), 0);
+  return NewReadIterator(r);
+}
+
+RedisModuleString *TagIndex_FormatName(RedisSearchCtx *ctx, const char *field) {
+  return RedisModule_CreateStringPrintf(ctx->redisCtx, TAGINDEX_KEY_FMT, ctx->spec->name, field);
+}
+
+TagIndex *TagIndex_Open(RedisSearchCtx *ctx, const char *field, int write) {
+  RedisModuleString *ks = TagIndex_FormatName(ctx, field);
+  RedisModuleKey *key =
+      RedisModule_OpenKey(ctx->redisCtx, ks, REDISMODULE_READ | (write ? REDISMODULE_WRITE : 0));
+  RedisModule_FreeString(ctx->redisCtx, ks);
+
+  int type = RedisModule_KeyType(key);
+  if (type == REDISMODULE_KEYTYPE_EMPTY) {
+    if (!write) return NULL;
+    TagIndex *idx = NewTagIndex();
+    RedisModule_ModuleTypeSetValue(key, TagIndexType, idx);
+    return idx;
+  }
+  if (RedisModule_ModuleTypeGetType(key) != TagIndexType) {
+    return NULL;
+  }
+  return RedisModule_ModuleTypeGetValue(key);
+}
+
+void TagIndex_Free(void *p) {
+  TagIndex *idx = p;
+  TrieMap_Free(idx->values, InvertedIndex_Free);
+  rm_free(idx);
+}
+
+/* Tag index data type */
+
+#define TAGINDEX_ENCVER 0
+
+int TagIndexType_Register(RedisModuleCtx *ctx) {
+  RedisModuleTypeMethods tm = {.version = REDISMODULE_TYPE_METHOD_VERSION,
+                               .rdb_load = TagIndexType_RdbLoad,
+                               .rdb_save = TagIndexType_RdbSave,
+                               .aof_rewrite = TagIndexType_AofRewrite,
+                               .free = TagIndex_Free,
+                               .mem_usage = TagIndexType_MemUsage};
+
+  TagIndexType = RedisModule_CreateDataType(ctx, "ft_tagidx", TAGINDEX_ENCVER, &tm);
+  if (TagIndexType == NULL) {
+    return REDISMODULE_ERR;
+  }
+  return REDISMODULE_OK;
+}
+
+/* The posting lists are saved with the version of their own encoding, followed by the values and
+ * their posting lists */
+void *TagIndexType_RdbLoad(RedisModuleIO *rdb, int encver) {
+  if (encver != TAGINDEX_ENCVER) {
+    return NULL;
+  }
+  TagIndex *idx = NewTagIndex();
+  int ivEncver = RedisModule_LoadUnsigned(rdb);
+  size_t n = RedisModule_LoadUnsigned(rdb);
+  for (size_t i = 0; i < n; i++) {
+    size_t len;
+    char *val = RedisModule_LoadStringBuffer(rdb, &len);
+    InvertedIndex *iv = InvertedIndex_RdbLoad(rdb, ivEncver);
+    if (iv) {
+      TrieMap_Add(idx->values, val, len, iv, NULL);
+    }
+    RedisModule_Free(val);
+  }
+  return idx;
+}
+
+void TagIndexType_RdbSave(RedisModuleIO *rdb, void *value) {
+  TagIndex *idx = value;
+  RedisModule_SaveUnsigned(rdb, INVERTED_INDEX_ENCVER);
+  RedisModule_SaveUnsigned(rdb, idx->values->cardinality);
+
+  TrieMapIterator *it = TrieMap_Iterate(idx->values, "", 0);
+  char *str;
+  tm_len_t len;
+  void *ptr;
+  while (TrieMapIterator_Next(it, &str, &len, &ptr)) {
+    RedisModule_SaveStringBuffer(rdb, str, len);
+    InvertedIndex_RdbSave(rdb, ptr);
+  }
+  TrieMapIterator_Free(it);
+}
+
+void TagIndexType_AofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value) {
+}
+
+unsigned long TagIndexType_MemUsage(const void *value) {
+  const TagIndex *idx = value;
+  unsigned long ret = sizeof(TagIndex) + TrieMap_MemUsage(idx->values);
+
+  TrieMapIterator *it = TrieMap_Iterate(idx->values, "", 0);
+  char *str;
+  tm_len_t len;
+  void *ptr;
+  while (TrieMapIterator_Next(it, &str, &len, &ptr)) {
+    ret += sizeof(InvertedIndex) + InvertedIndex_BlocksMemUsage(ptr, 0);
+  }
+  TrieMapIterator_Free(it);
+  return ret;
+}
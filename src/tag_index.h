@@ -0,0 +1,53 @@
+#ifndef __TAG_INDEX_H__
+#define __TAG_INDEX_H__
+
+#include "redisearch.h"
+#include "redismodule.h"
+#include "search_ctx.h"
+#include "inverted_index.h"
+#include "index_iterator.h"
+#include "rmutil/vector.h"
+#include "dep/triemap/triemap.h"
+
+/* The posting lists of tags keep only docIds, bit packed with the frame of reference codec. There
+ * are no frequencies to speak of, no field bits and no offsets */
+#define TAG_INDEX_FLAGS ((IndexFlags)(Codec_FOR << INDEX_CODEC_SHIFT))
+
+/* The index of a tag field maps each distinct value of the field to the posting list of the
+ * documents having it. Values are not tokenized or stemmed - a document's field is split by the
+ * field's separator, and each value is trimmed and lowercased, and is then matched exactly */
+typedef struct {
+  TrieMap *values;
+} TagIndex;
+
+TagIndex *NewTagIndex();
+
+/* Split the text of a tag field into its normalized values. Empty values are dropped. Returns a
+ * vector of strings, which the caller frees along with the vector */
+Vector *TagIndex_Preprocess(char sep, const char *data, size_t len);
+
+/* Add a document to the posting lists of its values. Values repeated in the document are only
+ * indexed once. Returns the number of bytes the posting lists grew by */
+size_t TagIndex_Index(TagIndex *idx, Vector *values, t_docId docId);
+
+/* Open an iterator on the documents having a value, or return NULL if no document has it. The
+ * value is expected to be normalized */
+IndexIterator *TagIndex_OpenReader(TagIndex *idx, DocTable *dt, const char *value, size_t len);
+
+/* Open the tag index of a field, creating it if needed and write is set. Returns NULL if the index
+ * does not exist, or if its key holds something else */
+TagIndex *TagIndex_Open(RedisSearchCtx *ctx, const char *field, int write);
+
+RedisModuleString *TagIndex_FormatName(RedisSearchCtx *ctx, const char *field);
+
+void TagIndex_Free(void *p);
+
+extern RedisModuleType *TagIndexType;
+
+int TagIndexType_Register(RedisModuleCtx *ctx);
+void *TagIndexType_RdbLoad(RedisModuleIO *rdb, int encver);
+void TagIndexType_RdbSave(RedisModuleIO *rdb, void *value);
+void TagIndexType_AofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value);
+unsigned long TagIndexType_MemUsage(const void *value);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+#include "test_util.h"
+#include "time_sample.h"
+
+/* Run a benchmark function. Benchmarks report their timings, and return non zero if they failed to
+ * set up what they measure */
+#define BENCHFUNC(f)                      \
+  printf("  Benchmark %s\n", __STRING(f)); \
+  fflush(stdout);                          \
+  if (f()) {                               \
+    printf(" %s FAILED!\n", __STRING(f));  \
+    exit(1);                               \
+  }
+
+#define BENCHMARK_MAIN(body)                         \
+  int main(int argc, char **argv) {                  \
+    printf("Starting Benchmark '%s'...\n", argv[0]); \
+    body;                                            \
+    printf("\n--------------------\n\n");            \
+    return 0;                                        \
+  }
+
+#endif
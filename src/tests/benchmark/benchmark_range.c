@@ -0,0 +1,81 @@
+#include "../../numeric_index.h"
+#include "../../index.h"
+#include "../../rmutil/alloc.h"
+#include "../../rmalloc.h"
+#include "benchmark.h"
+#include <math.h>
+#include <stdio.h>
+
+int benchmarkMonotonicNumericRangeTree() {
+  NumericRangeTree *t = NewNumericRangeTree();
+  int N = 10000000;
+  TimeSample ts;
+  TimeSampler_Start(&ts);
+  for (int i = 0; i < N; i++) {
+    NumericRangeTree_Add(t, i + 1, 1500000000 + i / 10);
+  }
+  TimeSampler_End(&ts);
+  printf("inserted %d increasing values in %lldms, %zd ranges, depth %d\n", N,
+         TimeSampler_DurationMS(&ts), t->numRanges, t->root->maxDepth);
+
+  // the last hour, day and week, with 10 docs per second
+  int spans[] = {3600, 86400, 7 * 86400};
+  for (int s = 0; s < sizeof(spans) / sizeof(spans[0]); s++) {
+    NumericFilter *flt = NewNumericFilter(1500000000 + N / 10 - spans[s], INFINITY, 1, 1);
+    size_t num = 0;
+    TimeSampler_Start(&ts);
+    for (int i = 0; i < 100; i++) {
+      IndexIterator *it = NewNumericFilterIterator(t, flt);
+      RSIndexResult *res;
+      while (it->Read(it->ctx, &res) != INDEXREAD_EOF) {
+        num++;
+      }
+      it->Free(it);
+    }
+    TimeSampler_End(&ts);
+    printf("query of the last %ds: %zd results in %.03fms\n", spans[s], num / 100,
+           (double)TimeSampler_DurationNS(&ts) / 100000000.0);
+    NumericFilter_Free(flt);
+  }
+  NumericRangeTree_Free(t);
+  return 0;
+}
+
+int benchmarkNumericRangeTree() {
+  NumericRangeTree *t = NewNumericRangeTree();
+  int count = 1;
+  for (int i = 0; i < 100000; i++) {
+
+    count += NumericRangeTree_Add(t, i, (double)(rand() % 500000));
+  }
+  // printf("created %d range leaves\n", count);
+
+  TIME_SAMPLE_RUN_LOOP(1000, {
+    Vector *v = NumericRangeTree_Find(t, 1000, 20000);
+    // printf("%d\n", v->top);
+    Vector_Free(v);
+  });
+
+  TimeSample ts;
+
+  NumericFilter *flt = NewNumericFilter(1000, 50000, 0, 0);
+  IndexIterator *it = NewNumericFilterIterator(t, flt);
+  ASSERT(it->HasNext(it->ctx));
+
+  // ASSERT_EQUAL(it->Len(it->ctx), N);
+  count = 0;
+
+  RSIndexResult *res = NULL;
+
+  it->Free(it);
+
+  NumericRangeTree_Free(t);
+  return 0;
+}
+
+BENCHMARK_MAIN({
+  RMUTil_InitAlloc();
+
+  BENCHFUNC(benchmarkNumericRangeTree);
+  BENCHFUNC(benchmarkMonotonicNumericRangeTree);
+});
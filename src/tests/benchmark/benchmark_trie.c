@@ -0,0 +1,197 @@
+#include "../../trie/trie.h"
+#include "../../trie/levenshtein.h"
+#include "../../trie/rune_util.h"
+#include "../../trie/trie_type.h"
+#include "benchmark.h"
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+
+/* A random word of 2 to 5 syllables, so that words share prefixes like real terms do */
+static void randomWord(char *buf) {
+  static const char *cons = "bcdfghklmnprstvz", *vows = "aeiou";
+  int n = 2 + rand() % 4;
+  for (int i = 0; i < n; i++) {
+    *buf++ = cons[rand() % 16];
+    *buf++ = vows[rand() % 5];
+    if (rand() % 3 == 0) *buf++ = cons[rand() % 16];
+  }
+  *buf = 0;
+}
+
+static int benchmarkTrieLookups(TrieNode *root, int expected) {
+  TimeSample ts;
+  rune *s;
+  t_len len;
+  float score;
+  TrieIterator *it = TrieNode_Iterate(root, NULL, NULL, NULL);
+  TimeSampler_Start(&ts);
+  while (TrieIterator_Next(it, &s, &len, NULL, &score, NULL)) {
+    TimeSampler_Tick(&ts);
+  }
+  TimeSampler_End(&ts);
+  TrieIterator_Free(it);
+  ASSERT_EQUAL(expected, ts.num);
+  printf("iteration: %.0fns per term", 1000000 * TimeSampler_IterationMS(&ts));
+
+  // prefix and fuzzy lookups, as in FT.SUGGET
+  const char *terms[] = {"ba", "kema", "zuto", "dafipo"};
+  for (int prefix = 1; prefix >= 0; prefix--) {
+    int matches = 0;
+    TimeSampler_Start(&ts);
+    for (int x = 0; x < 100; x++) {
+      const char *t = terms[x % 4];
+      size_t rlen;
+      rune *runes = strToFoldedRunes((char *)t, &rlen);
+      DFAFilter fc = NewDFAFilter(runes, rlen, prefix ? 0 : 1, prefix);
+      it = TrieNode_Iterate(root, FilterFunc, StackPop, &fc);
+      int dist = 0;
+      while (TrieIterator_Next(it, &s, &len, NULL, &score, &dist)) {
+        matches++;
+      }
+      TrieIterator_Free(it);
+      DFAFilter_Free(&fc);
+      free(runes);
+      TimeSampler_Tick(&ts);
+    }
+    TimeSampler_End(&ts);
+    printf(", %s: %.02fms per lookup (%d matches)", prefix ? "prefix" : "fuzzy",
+           TimeSampler_IterationMS(&ts), matches / 100);
+  }
+  printf("\n");
+
+  return 0;
+}
+
+int benchmarkTrie() {
+  rune *rootRunes = strToRunes("", NULL);
+  TrieNode *root = __newTrieNode(rootRunes, 0, 0, NULL, 0, 0, 0, 0);
+  free(rootRunes);
+
+  int N = 1000000, added = 0;
+  char buf[32];
+  srand(1337);
+  size_t heap = mallinfo2().uordblks;
+  TimeSample ts;
+  TimeSampler_Start(&ts);
+  for (int i = 0; i < N; i++) {
+    randomWord(buf);
+    size_t rlen;
+    rune *runes = strToRunes(buf, &rlen);
+    added += TrieNode_Add(&root, runes, rlen, NULL, 1 + rand() % 1000, ADD_REPLACE);
+    free(runes);
+    TimeSampler_Tick(&ts);
+  }
+  TimeSampler_End(&ts);
+  heap = mallinfo2().uordblks - heap;
+  printf("%d terms: %.02fMB, %.0fns per insert\n", added, heap / (double)0x100000,
+         1000000 * TimeSampler_IterationMS(&ts));
+
+  // the first iteration sorts the children of the mutable nodes
+  if (benchmarkTrieLookups(root, added)) return -1;
+  if (benchmarkTrieLookups(root, added)) return -1;
+
+  size_t blockSize;
+  TimeSampler_Start(&ts);
+  void *block = TrieNode_Freeze(root, &blockSize);
+  TimeSampler_End(&ts);
+  ASSERT(block != NULL);
+  printf("frozen in %lldms: %.02fMB\n", TimeSampler_DurationMS(&ts),
+         (blockSize + TrieNode_MemUsage(root)) / (double)0x100000);
+  if (benchmarkTrieLookups(root, added)) return -1;
+
+  TrieNode_Free(root);
+  free(block);
+  return 0;
+}
+
+void RMUTil_InitAlloc();
+
+/* Replay typing words keystroke by keystroke into fuzzy FT.SUGGET queries, some with a typo */
+int benchmarkSuggestTrace() {
+  RMUTil_InitAlloc();
+  Trie *t = NewTrie();
+  char buf[32];
+  srand(1337);
+  for (int i = 0; i < 1000000; i++) {
+    randomWord(buf);
+    Trie_InsertStringBuffer(t, buf, strlen(buf), 1 + rand() % 1000, 0, NULL);
+  }
+
+  char words[100][32];
+  for (int i = 0; i < 100; i++) {
+    randomWord(words[i]);
+    if (i % 3 == 0) words[i][rand() % strlen(words[i])] = 'a' + rand() % 26;
+  }
+
+  // FT.SUGGET does prefix and FUZZY searches
+  for (int maxDist = 0; maxDist <= 1; maxDist++) {
+    TimeSample ts, sts, fts;
+    int results = 0;
+    uint32_t hash = 0;
+    TimeSampler_Start(&ts);
+    for (int i = 0; i < 100; i++) {
+      for (size_t n = 1; n <= strlen(words[i]); n++) {
+        // queries are null terminated, like redis strings
+        snprintf(buf, n + 1, "%s", words[i]);
+        Vector *res = Trie_Search(t, buf, n, 5, maxDist, 1, 0, 0);
+        for (int j = 0; j < Vector_Size(res); j++) {
+          TrieSearchResult *e;
+          Vector_Get(res, j, &e);
+          for (size_t k = 0; k < e->len; k++) hash = hash * 31 + e->str[k];
+          TrieSearchResult_Free(e);
+          results++;
+        }
+        Vector_Free(res);
+        TimeSampler_Tick(&ts);
+      }
+    }
+    TimeSampler_End(&ts);
+
+    // the short prefixes of the first keystrokes
+    TimeSampler_Start(&sts);
+    for (int i = 0; i < 100; i++) {
+      for (size_t n = 1; n <= 2; n++) {
+        // queries are null terminated, like redis strings
+        snprintf(buf, n + 1, "%s", words[i]);
+        Vector *res = Trie_Search(t, buf, n, 5, maxDist, 1, 0, 0);
+        for (int j = 0; j < Vector_Size(res); j++) {
+          TrieSearchResult *e;
+          Vector_Get(res, j, &e);
+          TrieSearchResult_Free(e);
+        }
+        Vector_Free(res);
+        TimeSampler_Tick(&sts);
+      }
+    }
+    TimeSampler_End(&sts);
+
+    // the part of it spent on preparing the levenshtein filter
+    TimeSampler_Start(&fts);
+    for (int i = 0; i < 100; i++) {
+      for (size_t n = 1; n <= strlen(words[i]); n++) {
+        size_t rlen;
+        snprintf(buf, n + 1, "%s", words[i]);
+        rune *runes = strToFoldedRunes(buf, &rlen);
+        DFAFilter fc = NewDFAFilter(runes, rlen, maxDist, 1);
+        DFAFilter_Free(&fc);
+        free(runes);
+        TimeSampler_Tick(&fts);
+      }
+    }
+    TimeSampler_End(&fts);
+    ASSERT(results > 0);
+    printf("distance %d: %.02fus per keystroke, %.02fus on 1-2 letter prefixes, %.02fus preparing "
+           "the filter (%d results, hash %08x)\n",
+           maxDist, 1000 * TimeSampler_IterationMS(&ts), 1000 * TimeSampler_IterationMS(&sts),
+           1000 * TimeSampler_IterationMS(&fts), results, hash);
+  }
+
+  TrieType_Free(t);
+  return 0;
+}
+
+BENCHMARK_MAIN({
+  BENCHFUNC(benchmarkTrie);
+  BENCHFUNC(benchmarkSuggestTrace);
+});
@@ -6,6 +6,14 @@
 #include "../spec.h"
 #include "../tokenize.h"
 #include "../varint.h"
+#include "../qint.h"
+#include "../sort_index.h"
+#include "../query_cache.h"
+#include "../concurrent_ctx.h"
+#include "../redis_index.h"
+#include "../tag_index.h"
+#include "../id_list.h"
+#include "../rmalloc.h"
 #include "test_util.h"
 #include "time_sample.h"
 #include "../rmutil/alloc.h"
@@ -133,6 +141,7 @@ int testIndexReadWrite() {
     h.fieldMask = 1;
     h.freq = (1 + i % 100) / (float)101;
     h.docScore = (1 + (i + 2) % 30) / (float)31;
+    h.normFreq = 1;
 
     h.vw = NewVarintVectorWriter(8);
     for (int n = 0; n < i % 4; n++) {
@@ -206,6 +215,7 @@ InvertedIndex *createIndex(int size, int idStep) {
     h.docId = id;
     h.fieldMask = 1;
     h.freq = 1;
+    h.normFreq = 1;
     h.docScore = 1;
     h.stringFreeable = 0;
     h.term = "hello";
@@ -257,6 +267,52 @@ int testReadIterator() {
   return 0;
 }
 
+void writeTestEntry(InvertedIndex *idx, t_docId docId) {
+  ForwardIndexEntry h = {.docId = docId, .fieldMask = 1, .freq = 1, .normFreq = 1, .docScore = 1};
+  h.vw = NewVarintVectorWriter(8);
+  VVW_Write(h.vw, 1);
+  InvertedIndex_WriteEntry(idx, &h);
+  VVW_Free(h.vw);
+}
+
+int testReadSnapshot() {
+  InvertedIndex *idx = createIndex(150, 1);
+  int epoch = Epoch_Enter();
+
+  IndexReader *r = NewIndexReader(idx, NULL, RS_FIELDMASK_ALL, INDEX_DEFAULT_FLAGS, NULL, 0);
+  IndexIterator *it = NewReadIterator(r);
+  RSIndexResult *h = NULL;
+  for (int i = 1; i <= 120; i++) {
+    ASSERT_EQUAL(INDEXREAD_OK, it->Read(it->ctx, &h));
+    ASSERT_EQUAL(i, h->docId);
+  }
+
+  // the writes go to copies of the blocks the reader sees, and new blocks
+  for (t_docId id = 151; id <= 400; id++) {
+    writeTestEntry(idx, id);
+  }
+  ASSERT(idx->size > r->numBlocks);
+  ASSERT(idx->blocks != r->blocks);
+
+  int n = 120;
+  while (INDEXREAD_EOF != it->Read(it->ctx, &h)) {
+    ASSERT_EQUAL(++n, h->docId);
+  }
+  ASSERT_EQUAL(150, n);
+  ASSERT_EQUAL(150, it->Len(it->ctx));
+  it->Free(it);
+
+  // a new reader sees the writes
+  r = NewIndexReader(idx, NULL, RS_FIELDMASK_ALL, INDEX_DEFAULT_FLAGS, NULL, 0);
+  it = NewReadIterator(r);
+  ASSERT_EQUAL(INDEXREAD_OK, it->SkipTo(it->ctx, 400, &h));
+  it->Free(it);
+
+  Epoch_Exit(epoch);
+  InvertedIndex_Free(idx);
+  return 0;
+}
+
 int testUnion() {
   InvertedIndex *w = createIndex(10, 2);
   InvertedIndex *w2 = createIndex(10, 3);
@@ -285,6 +341,284 @@ int testUnion() {
   return 0;
 }
 
+static int unionHeapContains(t_docId docId, int numChildren, int size) {
+  int n = 0;
+  for (int step = 2; step < numChildren + 2; step++) {
+    if (docId % step == 0 && docId / step <= size) n++;
+  }
+  return n;
+}
+
+int testUnionHeap() {
+  // enough children for the union to keep them in a heap. Child n has the multiples of n + 2
+  int N = 20, size = 50;
+  InvertedIndex *idxs[N];
+  for (int n = 0; n < N; n++) {
+    idxs[n] = createIndex(size, n + 2);
+  }
+
+  IndexIterator **irs = calloc(N, sizeof(IndexIterator *));
+  for (int n = 0; n < N; n++) {
+    irs[n] = NewReadIterator(NewIndexReader(idxs[n], NULL, RS_FIELDMASK_ALL, idxs[n]->flags, NULL, 0));
+  }
+  IndexIterator *ui = NewUnionIterator(irs, N, NULL, 0);
+  ASSERT(((UnionContext *)ui->ctx)->heap != NULL);
+
+  RSIndexResult *h = NULL;
+  t_docId expected = 0;
+  int total = 0;
+  while (ui->Read(ui->ctx, &h) != INDEXREAD_EOF) {
+    // the next docId any of the children has
+    while (!unionHeapContains(++expected, N, size))
+      ;
+    ASSERT_EQUAL(expected, h->docId);
+    int numChildren = h->type == RSResultType_Union ? h->agg.numChildren : 1;
+    ASSERT_EQUAL(unionHeapContains(expected, N, size), numChildren);
+    total++;
+  }
+  ASSERT_EQUAL((N + 1) * size, expected);
+  ASSERT_EQUAL(total, ui->Len(ui->ctx));
+  ui->Free(ui);
+
+  // skipping, with both a heap and a linear union
+  int numChildren[] = {N, UNION_HEAP_THRESHOLD};
+  for (int c = 0; c < 2; c++) {
+    int num = numChildren[c];
+    irs = calloc(num, sizeof(IndexIterator *));
+    for (int n = 0; n < num; n++) {
+      irs[n] =
+          NewReadIterator(NewIndexReader(idxs[n], NULL, RS_FIELDMASK_ALL, idxs[n]->flags, NULL, 0));
+    }
+    ui = NewUnionIterator(irs, num, NULL, 0);
+    for (t_docId docId = 1; docId < (num + 1) * size; docId += 37) {
+      int rc = ui->SkipTo(ui->ctx, docId, &h);
+      int expectedRc = unionHeapContains(docId, num, size) ? INDEXREAD_OK : INDEXREAD_NOTFOUND;
+      ASSERT_EQUAL(expectedRc, rc);
+      if (rc == INDEXREAD_OK) {
+        ASSERT_EQUAL(docId, h->docId);
+      }
+
+      // reading after a skip continues from the first docId after the target
+      expected = docId;
+      while (!unionHeapContains(++expected, num, size))
+        ;
+      ASSERT_EQUAL(INDEXREAD_OK, ui->Read(ui->ctx, &h));
+      ASSERT_EQUAL(expected, h->docId);
+    }
+    ASSERT_EQUAL(INDEXREAD_EOF, ui->SkipTo(ui->ctx, (num + 1) * size + 1, &h));
+    ui->Free(ui);
+  }
+
+  for (int n = 0; n < N; n++) {
+    InvertedIndex_Free(idxs[n]);
+  }
+  return 0;
+}
+
+int benchmarkUnionHeap() {
+  // a prefix expansion to many rare terms, each appearing in a small subset of the documents
+  int N = 200, size = 5000;
+  InvertedIndex *idxs[N];
+  for (int n = 0; n < N; n++) {
+    idxs[n] = createIndex(size, 100 + rand() % 200);
+  }
+
+  int numChildren[] = {4, 200};
+  for (int c = 0; c < 2; c++) {
+    int num = numChildren[c];
+    IndexIterator **irs = calloc(num, sizeof(IndexIterator *));
+    for (int n = 0; n < num; n++) {
+      irs[n] =
+          NewReadIterator(NewIndexReader(idxs[n], NULL, RS_FIELDMASK_ALL, idxs[n]->flags, NULL, 0));
+    }
+    IndexIterator *ui = NewUnionIterator(irs, num, NULL, 1);
+
+    TimeSample ts;
+    RSIndexResult *h = NULL;
+    TimeSampler_Start(&ts);
+    while (ui->Read(ui->ctx, &h) != INDEXREAD_EOF) {
+      TimeSampler_Tick(&ts);
+    }
+    TimeSampler_End(&ts);
+    printf("union of %d terms: %d reads in %lldns, %.02fns/read\n", num, ts.num,
+           TimeSampler_DurationNS(&ts), (double)TimeSampler_DurationNS(&ts) / ts.num);
+    ui->Free(ui);
+  }
+
+  for (int n = 0; n < N; n++) {
+    InvertedIndex_Free(idxs[n]);
+  }
+  return 0;
+}
+
+/* An index of the multiples of step up to max, where normFreq(docId) is the normalized frequency of
+ * every record */
+static InvertedIndex *createScoredIndex(t_docId max, int step, float (*normFreq)(t_docId)) {
+  InvertedIndex *idx = NewInvertedIndex(INDEX_DEFAULT_FLAGS, 1);
+  for (t_docId id = step; id <= max; id += step) {
+    ForwardIndexEntry h;
+    h.docId = id;
+    h.fieldMask = 1;
+    h.freq = 1;
+    h.normFreq = normFreq(id);
+    h.docScore = 1;
+    h.vw = NewVarintVectorWriter(8);
+    VVW_Write(h.vw, 1);
+    VVW_Truncate(h.vw);
+    InvertedIndex_WriteEntry(idx, &h);
+    VVW_Free(h.vw);
+  }
+  return idx;
+}
+
+static float commonNormFreq(t_docId id) {
+  return 0.01;
+}
+static float midNormFreq(t_docId id) {
+  return id <= 1000 ? 0.5 : 0.1;
+}
+static float rareNormFreq(t_docId id) {
+  return (id / 97) % 2 ? 1 : 0.25;
+}
+
+int testUnionMaxScore() {
+  // a common term with low frequencies, a term in every 5th document with high frequencies in its
+  // first half, and a rare term
+  t_docId D = 2000;
+  InvertedIndex *idxs[3] = {createScoredIndex(D, 1, commonNormFreq),
+                            createScoredIndex(D, 5, midNormFreq),
+                            createScoredIndex(D, 97, rareNormFreq)};
+  // the readers only take the number of documents from the table, for the terms' idf
+  DocTable dt = {.size = D};
+
+  IndexIterator **irs = calloc(3, sizeof(IndexIterator *));
+  IndexReader *readers[3];
+  for (int n = 0; n < 3; n++) {
+    RSToken tok = {.str = "term", .len = 4};
+    readers[n] =
+        NewIndexReader(idxs[n], &dt, RS_FIELDMASK_ALL, idxs[n]->flags, NewTerm(&tok), 0);
+    irs[n] = NewReadIterator(readers[n]);
+  }
+
+  // the block bounds are rounded up from the frequencies of their records
+  uint16_t commonMax = 0.01F * FREQ_QUANTIZE_FACTOR + 1;
+  ASSERT_EQUAL(commonMax, IR_BlockMaxFreq(readers[0], 1));
+  ASSERT_EQUAL(0, IR_BlockMaxFreq(readers[0], D + 1));
+  ASSERT(IR_BlockMaxFreq(readers[1], 5) > IR_BlockMaxFreq(readers[1], D));
+  ASSERT_EQUAL(0, IR_BlockMaxFreq(readers[2], 5));
+  ASSERT_EQUAL(FREQ_QUANTIZE_FACTOR, IR_BlockMaxFreq(readers[2], 97));
+
+  IndexIterator *ui = NewUnionIterator(irs, 3, NULL, 0);
+  double minScore = 0;
+  ASSERT(UI_EnableMaxScore(ui, &minScore));
+
+  // without a threshold nothing is skipped
+  RSIndexResult *h = NULL;
+  for (t_docId id = 1; id <= 100; id++) {
+    ASSERT_EQUAL(INDEXREAD_OK, ui->Read(ui->ctx, &h));
+    ASSERT_EQUAL(id, h->docId);
+  }
+
+  // only the rare term can bring a document to the threshold. Every document that has it must still
+  // be returned, along with the records of the other terms
+  minScore = 2;
+  t_docId expected = 97 * 2;
+  int total = 100;
+  while (ui->Read(ui->ctx, &h) != INDEXREAD_EOF) {
+    ASSERT_EQUAL(expected, h->docId);
+    int numChildren = h->agg.numChildren;
+    int expectedChildren = expected % 5 ? 2 : 3;
+    ASSERT_EQUAL(expectedChildren, numChildren);
+    expected += 97;
+    total++;
+  }
+  ASSERT(expected > D);
+  ASSERT_EQUAL(total, ui->Len(ui->ctx));
+
+  // only unions of term readers can be pruned
+  IndexIterator **its = calloc(2, sizeof(IndexIterator *));
+  its[0] = NewReadIterator(NewIndexReader(idxs[0], NULL, RS_FIELDMASK_ALL, idxs[0]->flags, NULL, 0));
+  its[1] = NewReadIterator(NewIndexReader(idxs[1], NULL, RS_FIELDMASK_ALL, idxs[1]->flags, NULL, 0));
+  IndexIterator *plain = NewUnionIterator(its, 2, NULL, 0);
+  ASSERT_EQUAL(0, UI_EnableMaxScore(plain, &minScore));
+
+  plain->Free(plain);
+  ui->Free(ui);
+  for (int n = 0; n < 3; n++) {
+    InvertedIndex_Free(idxs[n]);
+  }
+  return 0;
+}
+
+typedef struct {
+  IndexIterator *it;
+  t_docId from, to;
+  int num;
+  int errors;
+} rangeShard;
+
+static void countRangeShard(void *p) {
+  rangeShard *sh = p;
+  RSIndexResult *h = NULL;
+  while (sh->it->Read(sh->it->ctx, &h) != INDEXREAD_EOF) {
+    // the query's own record comes first in the intersection with the range
+    if (h->docId < sh->from || h->docId > sh->to || h->agg.children[0]->docId != h->docId) {
+      sh->errors++;
+    }
+    sh->num++;
+  }
+}
+
+int testDocIdRangeShards() {
+  InvertedIndex *w = createIndex(1000, 2);
+  InvertedIndex *w2 = createIndex(1000, 3);
+
+  IndexIterator *rng = NewDocIdRangeIterator(10, 12);
+  RSIndexResult *h = NULL;
+  ASSERT_EQUAL(INDEXREAD_NOTFOUND, rng->SkipTo(rng->ctx, 5, &h));
+  ASSERT_EQUAL(10, h->docId);
+  ASSERT_EQUAL(INDEXREAD_OK, rng->Read(rng->ctx, &h));
+  ASSERT_EQUAL(11, h->docId);
+  ASSERT_EQUAL(INDEXREAD_OK, rng->SkipTo(rng->ctx, 12, &h));
+  ASSERT_EQUAL(INDEXREAD_EOF, rng->Read(rng->ctx, &h));
+  rng->Free(rng);
+
+  // the union of the multiples of 2 and 3, split into ranges run in parallel
+  int numShards = 4, total = 0;
+  t_docId step = 3000 / numShards;
+  rangeShard shards[numShards];
+  void *args[numShards];
+  for (int i = 0; i < numShards; i++) {
+    IndexIterator **irs = calloc(2, sizeof(IndexIterator *));
+    irs[0] = NewReadIterator(NewIndexReader(w, NULL, RS_FIELDMASK_ALL, w->flags, NULL, 0));
+    irs[1] = NewReadIterator(NewIndexReader(w2, NULL, RS_FIELDMASK_ALL, w2->flags, NULL, 0));
+    IndexIterator **its = calloc(2, sizeof(IndexIterator *));
+    its[0] = NewUnionIterator(irs, 2, NULL, 0);
+    its[1] = NewDocIdRangeIterator(i * step + 1, (i + 1) * step);
+    shards[i] = (rangeShard){.it = NewIntersecIterator(its, 2, NULL, RS_FIELDMASK_ALL, -1, 0),
+                             .from = i * step + 1,
+                             .to = (i + 1) * step};
+    args[i] = &shards[i];
+  }
+  ConcurrentSearch_RunShards(countRangeShard, args, numShards);
+
+  for (int i = 0; i < numShards; i++) {
+    ASSERT_EQUAL(0, shards[i].errors);
+    int expected = 0;
+    for (t_docId id = shards[i].from; id <= shards[i].to; id++) {
+      if ((id % 2 == 0 && id <= 2000) || id % 3 == 0) expected++;
+    }
+    ASSERT_EQUAL(expected, shards[i].num);
+    total += shards[i].num;
+    shards[i].it->Free(shards[i].it);
+  }
+  ASSERT_EQUAL(1000 + 1000 - 333, total);
+
+  InvertedIndex_Free(w);
+  InvertedIndex_Free(w2);
+  return 0;
+}
+
 int testNot() {
   InvertedIndex *w = createIndex(16, 1);
   // not all numbers that divide by 3
@@ -395,6 +729,299 @@ int testIntersection() {
   return 0;
 }
 
+int testBlockSizes() {
+  // blocks of rare terms keep the base size, and grow with the document frequency
+  InvertedIndex *idx = createIndex(1000, 1);
+  ASSERT_EQUAL(10, idx->size);
+  InvertedIndex_Free(idx);
+
+  idx = createIndex(100000, 1);
+  ASSERT(idx->size < 1000);
+  ASSERT_EQUAL(INDEX_BLOCK_SIZE, idx->blocks[0].numDocs);
+  ASSERT(idx->blocks[idx->size - 2].numDocs > INDEX_BLOCK_SIZE);
+  ASSERT(idx->blocks[idx->size - 2].numDocs <= INDEX_BLOCK_SIZE_MAX);
+
+  // all blocks but the last one are trimmed to their size
+  for (uint32_t i = 0; i < idx->size - 1; i++) {
+    ASSERT_EQUAL(idx->blocks[i].data.offset, idx->blocks[i].data.cap);
+  }
+
+  // reading through blocks of varying sizes
+  IndexReader *r = NewIndexReader(idx, NULL, RS_FIELDMASK_ALL, idx->flags, NULL, 0);
+  RSIndexResult *h = NULL;
+  t_docId expected = 1;
+  while (IR_Read(r, &h) != INDEXREAD_EOF) {
+    ASSERT_EQUAL(expected, h->docId);
+    expected++;
+  }
+  ASSERT_EQUAL(100001, expected);
+  IR_Free(r);
+  InvertedIndex_Free(idx);
+  return 0;
+}
+
+int testSkipTo() {
+  // ids 3,6,9... spread over many blocks
+  InvertedIndex *idx = createIndex(1000, 3);
+  ASSERT(idx->size >= 10);
+  IndexReader *ir = NewIndexReader(idx, NULL, RS_FIELDMASK_ALL, idx->flags, NULL, 0);
+  RSIndexResult *h = NULL;
+
+  // exact hits, moving forward across blocks
+  t_docId targets[] = {3, 30, 303, 1200, 2100, 2700, 3000};
+  for (int i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+    ASSERT_EQUAL(INDEXREAD_OK, IR_SkipTo(ir, targets[i], &h));
+    ASSERT_EQUAL(targets[i], h->docId);
+  }
+  IR_Free(ir);
+
+  // misses land on the next id
+  ir = NewIndexReader(idx, NULL, RS_FIELDMASK_ALL, idx->flags, NULL, 0);
+  ASSERT_EQUAL(INDEXREAD_NOTFOUND, IR_SkipTo(ir, 301, &h));
+  ASSERT_EQUAL(303, h->docId);
+  ASSERT_EQUAL(INDEXREAD_OK, IR_Read(ir, &h));
+  ASSERT_EQUAL(306, h->docId);
+  ASSERT_EQUAL(INDEXREAD_NOTFOUND, IR_SkipTo(ir, 2999, &h));
+  ASSERT_EQUAL(3000, h->docId);
+  ASSERT_EQUAL(INDEXREAD_EOF, IR_SkipTo(ir, 3001, &h));
+  IR_Free(ir);
+
+  InvertedIndex_Free(idx);
+  return 0;
+}
+
+int testIdList() {
+  // the ids are sorted and copied
+  t_docId ids[] = {30, 10, 20};
+  IndexIterator *it = NewIdListIterator(ids, 3);
+  ids[0] = 0;
+  RSIndexResult *h = NULL;
+  ASSERT_EQUAL(INDEXREAD_OK, it->Read(it->ctx, &h));
+  ASSERT_EQUAL(10, h->docId);
+  ASSERT_EQUAL(INDEXREAD_OK, it->SkipTo(it->ctx, 30, &h));
+  ASSERT_EQUAL(30, h->docId);
+  ASSERT_EQUAL(INDEXREAD_EOF, it->Read(it->ctx, &h));
+  it->Free(it);
+
+  // a sorted list is taken as it is, and freed with the iterator
+  size_t n = 1000;
+  t_docId *sorted = rm_malloc(n * sizeof(t_docId));
+  for (size_t i = 0; i < n; i++) {
+    sorted[i] = (i + 1) * 3;
+  }
+  it = NewSortedIdListIterator(sorted, n);
+  ASSERT_EQUAL(n, it->Len(it->ctx));
+  ASSERT_EQUAL(INDEXREAD_NOTFOUND, it->SkipTo(it->ctx, 301, &h));
+  ASSERT_EQUAL(303, h->docId);
+  ASSERT_EQUAL(INDEXREAD_OK, it->Read(it->ctx, &h));
+  ASSERT_EQUAL(306, h->docId);
+  ASSERT_EQUAL(INDEXREAD_EOF, it->SkipTo(it->ctx, 3001, &h));
+  it->Free(it);
+  return 0;
+}
+
+int testIntersectionRareCommon() {
+
+  // a common term appearing in every document, and a rare one appearing in one of every 1000
+  InvertedIndex *common = createIndex(1000000, 1);
+  InvertedIndex *rare = createIndex(1000, 1000);
+
+  // baseline: decoding the whole common term, which is what scanning records costs
+  TimeSample ts;
+  RSIndexResult *h = NULL;
+  IndexReader *r = NewIndexReader(common, NULL, RS_FIELDMASK_ALL, common->flags, NULL, 0);
+  TimeSampler_Start(&ts);
+  while (IR_Read(r, &h) != INDEXREAD_EOF) {
+    TimeSampler_Tick(&ts);
+  }
+  TimeSampler_End(&ts);
+  IR_Free(r);
+  ASSERT_EQUAL(1000000, ts.num);
+  long long scanNS = TimeSampler_DurationNS(&ts);
+
+  IndexIterator **irs = calloc(2, sizeof(IndexIterator *));
+  irs[0] = NewReadIterator(NewIndexReader(rare, NULL, RS_FIELDMASK_ALL, rare->flags, NULL, 0));
+  irs[1] = NewReadIterator(NewIndexReader(common, NULL, RS_FIELDMASK_ALL, common->flags, NULL, 0));
+  IndexIterator *ii = NewIntersecIterator(irs, 2, NULL, RS_FIELDMASK_ALL, -1, 0);
+
+  TimeSampler_Start(&ts);
+  while (ii->Read(ii->ctx, &h) != INDEXREAD_EOF) {
+    ASSERT_EQUAL(1000 * (ts.num + 1), h->docId);
+    TimeSampler_Tick(&ts);
+  }
+  TimeSampler_End(&ts);
+  ASSERT_EQUAL(1000, ts.num);
+
+  printf("rare AND common: %d intersections in %lldns (full scan of common term: %lldns)\n",
+         ts.num, TimeSampler_DurationNS(&ts), scanNS);
+
+  ii->Free(ii);
+  InvertedIndex_Free(common);
+  InvertedIndex_Free(rare);
+  return 0;
+}
+
+int testIntersectionOrder() {
+  InvertedIndex *common = createIndex(10000, 1);
+  InvertedIndex *rare = createIndex(10, 700);
+  InvertedIndex *mid = createIndex(1000, 7);
+
+  // the common term comes first in the query, but the rare one drives the intersection
+  IndexIterator **irs = calloc(3, sizeof(IndexIterator *));
+  irs[0] = NewReadIterator(NewIndexReader(common, NULL, RS_FIELDMASK_ALL, common->flags, NULL, 0));
+  irs[1] = NewReadIterator(NewIndexReader(mid, NULL, RS_FIELDMASK_ALL, mid->flags, NULL, 0));
+  irs[2] = NewReadIterator(NewIndexReader(rare, NULL, RS_FIELDMASK_ALL, rare->flags, NULL, 0));
+  IndexIterator *ii = NewIntersecIterator(irs, 3, NULL, RS_FIELDMASK_ALL, -1, 0);
+  ASSERT_EQUAL(10, ii->NumEstimated(ii->ctx));
+
+  RSIndexResult *h = NULL;
+  int n = 0;
+  while (ii->Read(ii->ctx, &h) != INDEXREAD_EOF) {
+    n++;
+    ASSERT_EQUAL(700 * n, h->docId);
+    // the children of the result are kept in the query order
+    ASSERT_EQUAL(3, h->agg.numChildren);
+    ASSERT_EQUAL(700 * n, h->agg.children[2]->docId);
+  }
+  ASSERT_EQUAL(10, n);
+  ASSERT(!ii->HasNext(ii->ctx));
+  // the common term was only skipped to the rare term's records
+  ASSERT(IR_NumDocs(irs[0]->ctx) <= 10);
+  ii->Free(ii);
+
+  // an intersection nested in a union
+  IndexIterator **uirs = calloc(2, sizeof(IndexIterator *));
+  irs = calloc(2, sizeof(IndexIterator *));
+  irs[0] = NewReadIterator(NewIndexReader(common, NULL, RS_FIELDMASK_ALL, common->flags, NULL, 0));
+  irs[1] = NewReadIterator(NewIndexReader(rare, NULL, RS_FIELDMASK_ALL, rare->flags, NULL, 0));
+  uirs[0] = NewIntersecIterator(irs, 2, NULL, RS_FIELDMASK_ALL, -1, 0);
+  uirs[1] = NewReadIterator(NewIndexReader(mid, NULL, RS_FIELDMASK_ALL, mid->flags, NULL, 0));
+  ASSERT(uirs[0]->HasNext(uirs[0]->ctx));
+  IndexIterator *ui = NewUnionIterator(uirs, 2, NULL, 0);
+  ASSERT_EQUAL(1010, ui->NumEstimated(ui->ctx));
+
+  n = 0;
+  t_docId last = 0;
+  while (ui->Read(ui->ctx, &h) != INDEXREAD_EOF) {
+    ASSERT(h->docId > last);
+    ASSERT(h->docId % 7 == 0 || h->docId % 700 == 0);
+    last = h->docId;
+    n++;
+  }
+  // multiples of 700 are also multiples of 7
+  ASSERT_EQUAL(1000, n);
+  ui->Free(ui);
+
+  InvertedIndex_Free(common);
+  InvertedIndex_Free(rare);
+  InvertedIndex_Free(mid);
+  return 0;
+}
+
+int testQintBlockDecode() {
+  // records of 4 integers of mixed widths, each followed by a blob sized by the last integer
+  Buffer *b = NewBuffer(1024);
+  BufferWriter bw = NewBufferWriter(b);
+  int N = 1000;
+  uint32_t expected[N * 4];
+  srand(1337);
+  for (int i = 0; i < N; i++) {
+    uint32_t *rec = &expected[i * 4];
+    rec[0] = rand() >> (rand() % 32);
+    rec[1] = rand() % 300;
+    rec[2] = rand() >> (rand() % 32);
+    rec[3] = rand() % 8;
+    qint_encode4(&bw, rec[0], rec[1], rec[2], rec[3]);
+    Buffer_Write(&bw, "xxxxxxxx", rec[3]);
+  }
+
+  uint32_t out[N * 4];
+  uint32_t blobs[N];
+  for (int simd = 0; simd < 2; simd++) {
+    qint_initBlockDecoder(!simd);
+    BufferReader br = NewBufferReader(b);
+    ASSERT_EQUAL(N, qint_decode_block(&br, out, 4, 3, blobs, N));
+    ASSERT(BufferReader_AtEnd(&br));
+    for (int i = 0; i < N * 4; i++) {
+      ASSERT_EQUAL(expected[i], out[i]);
+    }
+    for (int i = 0; i < N; i++) {
+      if (expected[i * 4 + 3]) ASSERT_EQUAL('x', b->data[blobs[i]]);
+    }
+
+    // partial decodes continue from the reader position
+    br = NewBufferReader(b);
+    ASSERT_EQUAL(10, qint_decode_block(&br, out, 4, 3, blobs, 10));
+    ASSERT_EQUAL(N - 10, qint_decode_block(&br, out, 4, 3, blobs, N));
+    ASSERT_EQUAL(expected[40], out[0]);
+  }
+  Buffer_Free(b);
+  free(b);
+
+  // 2 integers per record, no blobs - compare against single record decoding
+  b = NewBuffer(1024);
+  bw = NewBufferWriter(b);
+  for (int i = 0; i < N; i++) {
+    qint_encode2(&bw, i * 1000, i % 100);
+  }
+  BufferReader br = NewBufferReader(b);
+  ASSERT_EQUAL(N, qint_decode_block(&br, out, 2, -1, NULL, N));
+  br = NewBufferReader(b);
+  for (int i = 0; i < N; i++) {
+    uint32_t i1, i2;
+    qint_decode2(&br, &i1, &i2);
+    ASSERT_EQUAL(i1, out[i * 4]);
+    ASSERT_EQUAL(i2, out[i * 4 + 1]);
+  }
+  Buffer_Free(b);
+  free(b);
+  return 0;
+}
+
+int benchmarkQintBlockDecode() {
+  Buffer *b = NewBuffer(1024);
+  BufferWriter bw = NewBufferWriter(b);
+  int N = 100;
+  for (int i = 0; i < N; i++) {
+    qint_encode4(&bw, 1 + i % 300, 1 + i % 3, 1 << (i % 20), 0);
+  }
+
+  uint32_t out[N * 4];
+  uint32_t blobs[N];
+  uint32_t arr[4];
+  TimeSample ts;
+  TimeSampler_Start(&ts);
+  for (int x = 0; x < 20000; x++) {
+    BufferReader br = NewBufferReader(b);
+    for (int i = 0; i < N; i++) {
+      qint_decode(&br, arr, 4);
+    }
+    TimeSampler_Tick(&ts);
+  }
+  TimeSampler_End(&ts);
+  printf("qint decode: %.0fns per block", 1000000 * TimeSampler_IterationMS(&ts));
+
+  for (int simd = 0; simd < 2; simd++) {
+    if (simd && !qint_initBlockDecoder(0)) break;
+    if (!simd) qint_initBlockDecoder(1);
+    TimeSampler_Start(&ts);
+    for (int x = 0; x < 20000; x++) {
+      BufferReader br = NewBufferReader(b);
+      qint_decode_block(&br, out, 4, 3, blobs, N);
+      TimeSampler_Tick(&ts);
+    }
+    TimeSampler_End(&ts);
+    printf(", %s block decode: %.0fns", simd ? "simd" : "scalar",
+           1000000 * TimeSampler_IterationMS(&ts));
+  }
+  printf("\n");
+  qint_initBlockDecoder(0);
+
+  Buffer_Free(b);
+  free(b);
+  return 0;
+}
+
 int testBuffer() {
   // TEST_START();
 
@@ -484,6 +1111,124 @@ int testTokenize() {
 //   return 0;
 // }
 
+static void sortIndexAddDoc(IndexSpec *s, int i, double val) {
+  char key[32];
+  sprintf(key, "doc%d", i);
+  t_docId id = DocTable_Put(&s->docs, key, 1, Document_DefaultFlags, NULL, 0);
+  RSSortingVector *sv = NewSortingVector(s->sortables->len);
+  RSSortingVector_Put(sv, 0, &val, RS_SORTABLE_NUM);
+  DocTable_SetSortingVector(&s->docs, id, sv);
+}
+
+int testSortIndex() {
+  const char *args[] = {"SCHEMA", "foo", "numeric", "sortable"};
+  char *err = NULL;
+  IndexSpec *s = IndexSpec_Parse("idx", args, sizeof(args) / sizeof(const char *), &err);
+  ASSERT(s != NULL);
+  ASSERT(IndexSpec_GetSortIndex(s, 1) == NULL);
+
+  // descending values, with every value appearing twice
+  int N = 100;
+  for (int i = 0; i < N; i++) {
+    sortIndexAddDoc(s, i, (N - i) / 2);
+  }
+  DocTable_Delete(&s->docs, "doc3");
+
+  SortIndex *si = IndexSpec_GetSortIndex(s, 0);
+  ASSERT(si != NULL);
+  ASSERT_EQUAL(N - 1, si->len);
+  ASSERT_EQUAL(N, si->maxDocId);
+  for (size_t i = 1; i < si->len; i++) {
+    RSSortableValue *v1 = &DocTable_Get(&s->docs, si->docIds[i - 1])->sortVector->values[0];
+    RSSortableValue *v2 = &DocTable_Get(&s->docs, si->docIds[i])->sortVector->values[0];
+    ASSERT(v1->num <= v2->num);
+    // equal values are ordered by docId
+    ASSERT(v1->num < v2->num || si->docIds[i - 1] < si->docIds[i]);
+    ASSERT(si->docIds[i] != 4);
+  }
+
+  // a few new documents don't rebuild the index, and queries keep their reference to it
+  sortIndexAddDoc(s, N, 0);
+  SortIndex *si2 = IndexSpec_GetSortIndex(s, 0);
+  ASSERT(si == si2);
+  ASSERT_EQUAL(3, si->refcount);
+  SortIndex_Free(si2);
+
+  for (int i = N + 1; i < N + N / SORT_INDEX_REBUILD_RATIO + 1; i++) {
+    sortIndexAddDoc(s, i, 0);
+  }
+  si2 = IndexSpec_GetSortIndex(s, 0);
+  ASSERT(si != si2);
+  ASSERT_EQUAL(1, si->refcount);
+  ASSERT_EQUAL(s->docs.maxDocId, si2->maxDocId);
+  ASSERT_EQUAL(0, DocTable_Get(&s->docs, si2->docIds[0])->sortVector->values[0].num);
+  SortIndex_Free(si);
+  SortIndex_Free(si2);
+
+  IndexSpec_Free(s);
+  return 0;
+}
+
+int testQueryCache() {
+  char key[32];
+  RSPayload pl = {.data = "payload", .len = 7};
+  ResultEntry ents[2] = {{.id = "doc1", .score = 2, .payload = &pl}, {.id = "doc2", .score = 1}};
+  QueryResult r = {.totalResults = 5, .numResults = 2, .results = ents};
+
+  // find the size of a single entry, and size the cache for 16 of them
+  QueryCache *c = NewQueryCache(1 << 20);
+  QueryCache_Put(c, "query 00", 1, &r);
+  size_t entrySize = c->memUsage;
+  ASSERT(entrySize > sizeof(ents) + strlen("payload") + strlen("query 00"));
+  QueryCache_Free(c);
+
+  int n = 16;
+  c = NewQueryCache(n * entrySize);
+  for (int i = 0; i < n; i++) {
+    sprintf(key, "query %02d", i);
+    QueryCache_Put(c, key, 1, &r);
+  }
+  ASSERT(c->size == n);
+  ASSERT(c->memUsage == n * entrySize);
+
+  const QueryResult *cr = QueryCache_Get(c, "query 00", 1);
+  ASSERT(cr != NULL);
+  ASSERT_EQUAL(5, cr->totalResults);
+  ASSERT_EQUAL(2, cr->numResults);
+  ASSERT_STRING_EQ("doc2", cr->results[1].id);
+  ASSERT(cr->results[0].payload != NULL && cr->results[0].payload != &pl);
+  ASSERT(!strncmp("payload", cr->results[0].payload->data, 7));
+  ASSERT(cr->results[1].payload == NULL);
+
+  // the least recently used query is evicted
+  QueryCache_Put(c, "query 99", 1, &r);
+  ASSERT(c->size == n);
+  ASSERT(c->evictions == 1);
+  ASSERT(QueryCache_Get(c, "query 01", 1) == NULL);
+  ASSERT(QueryCache_Get(c, "query 00", 1) != NULL);
+
+  // results of another generation are stale
+  ASSERT(QueryCache_Get(c, "query 02", 2) == NULL);
+  ASSERT(QueryCache_Get(c, "query 02", 1) == NULL);
+  ASSERT(c->size == n - 1);
+  ASSERT(c->memUsage == (n - 1) * entrySize);
+  ASSERT(c->hits == 2);
+  ASSERT(c->misses == 3);
+
+  // results taking too much of the cache are not cached
+  ResultEntry many[64];
+  for (int i = 0; i < 64; i++) {
+    many[i] = (ResultEntry){.id = "doc", .score = i};
+  }
+  QueryResult big = {.totalResults = 64, .numResults = 64, .results = many};
+  QueryCache_Put(c, "big query", 1, &big);
+  ASSERT(QueryCache_Get(c, "big query", 1) == NULL);
+  ASSERT(c->size == n - 1);
+  QueryCache_Free(c);
+
+  return 0;
+}
+
 int testIndexSpec() {
 
   const char *title = "title", *body = "body", *foo = "foo", *bar = "bar";
@@ -507,6 +1252,8 @@ int testIndexSpec() {
   ASSERT(s->flags & Index_StoreFieldFlags);
   ASSERT(s->flags & Index_StoreTermOffsets);
   ASSERT(s->flags & Index_HasCustomStopwords);
+  ASSERT(!(s->flags & Index_NoTermKeys));
+  ASSERT(s->termIndexes == NULL);
 
   ASSERT(IndexSpec_IsStopWord(s, "hello", 5));
   ASSERT(IndexSpec_IsStopWord(s, "world", 5));
@@ -560,8 +1307,21 @@ int testIndexSpec() {
 
   IndexSpec_Free(s);
 
+  const char *codecArgs[] = {"NOOFFSETS", "CODEC", "for", "SCHEMA", title, "text"};
+  s = IndexSpec_Parse("idx", codecArgs, sizeof(codecArgs) / sizeof(const char *), &err);
+  ASSERT(s != NULL);
+  ASSERT_EQUAL(Codec_FOR, IndexFlags_Codec(s->flags));
+  ASSERT(s->flags & Index_StoreFieldFlags);
+  IndexSpec_Free(s);
+
+  const char *badCodecArgs[] = {"CODEC", "bitmap", "SCHEMA", title, "text"};
+  s = IndexSpec_Parse("idx", badCodecArgs, sizeof(badCodecArgs) / sizeof(const char *), &err);
+  ASSERT(s == NULL);
+  ASSERT(err != NULL);
+  err = NULL;
+
   const char *args2[] = {
-      "NOOFFSETS", "NOFIELDS", "NOSCOREIDX", "SCHEMA", title, "text",
+      "NOOFFSETS", "NOFIELDS", "NOSCOREIDX", "NOTERMKEYS", "SCHEMA", title, "text",
   };
   s = IndexSpec_Parse("idx", args2, sizeof(args2) / sizeof(const char *), &err);
   if (err != NULL) {
@@ -574,6 +1334,21 @@ int testIndexSpec() {
   ASSERT(!(s->flags & Index_StoreScoreIndexes));
   ASSERT(!(s->flags & Index_StoreFieldFlags));
   ASSERT(!(s->flags & Index_StoreTermOffsets));
+  ASSERT(s->flags & Index_NoTermKeys);
+
+  // the terms of NOTERMKEYS indexes are kept in the spec
+  RedisSearchCtx ctx = {.spec = s};
+  ASSERT(Redis_OpenInvertedIndex(&ctx, "hello", 5, 0) == NULL);
+  InvertedIndex *idx = Redis_OpenInvertedIndex(&ctx, "hello", 5, 1);
+  ASSERT(idx != NULL);
+  ASSERT(Redis_OpenInvertedIndex(&ctx, "hello", 5, 0) == idx);
+  ASSERT(Redis_OpenInvertedIndex(&ctx, "hell", 4, 0) == NULL);
+  // terms too long for the spec's trie map are not indexed
+  char *longTerm = calloc(70000, 1);
+  memset(longTerm, 'a', 70000);
+  ASSERT(Redis_OpenInvertedIndex(&ctx, longTerm, 70000, 1) == NULL);
+  free(longTerm);
+  ASSERT_EQUAL(1, s->termIndexes->cardinality);
   IndexSpec_Free(s);
 
   return 0;
@@ -590,6 +1365,7 @@ int testIndexFlags() {
   h.docId = 1234;
   h.fieldMask = 0x01;
   h.freq = 1;
+  h.normFreq = 1;
   h.docScore = 100;
   h.vw = NewVarintVectorWriter(8);
   for (int n = 0; n < 10; n++) {
@@ -626,6 +1402,104 @@ int testIndexFlags() {
   return 0;
 }
 
+/* the docIds of testCodecs - a dense run followed by a sparse tail */
+static t_docId codecTestDocId(int i) {
+  return i < 3000 ? i + 1 : 3000 + (i - 2999) * 997;
+}
+
+int testCodecs() {
+  struct {
+    IndexCodecType codec;
+    IndexFlags flags;
+  } cases[] = {
+      {Codec_QInt, 0},
+      {Codec_QInt, INDEX_DEFAULT_FLAGS},
+      {Codec_FOR, 0},
+      {Codec_FOR, Index_StoreFieldFlags},
+      {Codec_Bitmap, 0},
+      {Codec_Bitmap, Index_StoreFieldFlags},
+  };
+  int N = 3100;
+
+  for (int c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+    IndexFlags flags = cases[c].flags | cases[c].codec << INDEX_CODEC_SHIFT;
+    InvertedIndex *idx = NewInvertedIndex(flags, 1);
+    ASSERT(idx->codec == IndexCodec_Get(cases[c].codec));
+    ASSERT_EQUAL(cases[c].codec, IndexFlags_Codec(idx->flags));
+
+    size_t sz = 0;
+    for (int i = 0; i < N; i++) {
+      ForwardIndexEntry h;
+      h.docId = codecTestDocId(i);
+      h.fieldMask = 1 << (i % 3);
+      h.freq = 1 + i % 7;
+      h.normFreq = 1;
+      h.docScore = 1;
+      h.vw = NewVarintVectorWriter(8);
+      VVW_Write(h.vw, i);
+      VVW_Truncate(h.vw);
+      sz += InvertedIndex_WriteEntry(idx, &h);
+      VVW_Free(h.vw);
+    }
+    ASSERT_EQUAL(N, idx->numDocs);
+    // printf("codec %s flags %x: %zd bytes in %d blocks\n", CodecTypeNames[cases[c].codec],
+    //        cases[c].flags, sz, idx->size);
+    if (cases[c].codec == Codec_Bitmap) {
+      // the dense run takes a single bitmap block, the sparse tail a packed one
+      ASSERT_EQUAL(2, idx->size);
+    }
+
+    IndexReader *ir = NewIndexReader(idx, NULL, RS_FIELDMASK_ALL, flags, NULL, 0);
+    RSIndexResult *h = NULL;
+    int i = 0;
+    while (IR_Read(ir, &h) != INDEXREAD_EOF) {
+      ASSERT_EQUAL(codecTestDocId(i), h->docId);
+      ASSERT_EQUAL(1 + i % 7, h->freq);
+      if (flags & Index_StoreFieldFlags) {
+        t_fieldMask mask = 1 << (i % 3);
+        ASSERT_EQUAL(mask, h->fieldMask);
+      }
+      i++;
+    }
+    ASSERT_EQUAL(N, i);
+    IR_Free(ir);
+
+    ir = NewIndexReader(idx, NULL, RS_FIELDMASK_ALL, flags, NULL, 0);
+    ASSERT_EQUAL(INDEXREAD_OK, IR_SkipTo(ir, 1500, &h));
+    ASSERT_EQUAL(1500, h->docId);
+    ASSERT_EQUAL(INDEXREAD_NOTFOUND, IR_SkipTo(ir, 3001, &h));
+    ASSERT_EQUAL(3997, h->docId);
+    ASSERT_EQUAL(INDEXREAD_OK, IR_SkipTo(ir, codecTestDocId(N - 1), &h));
+    ASSERT_EQUAL(INDEXREAD_EOF, IR_Read(ir, &h));
+    IR_Free(ir);
+
+    // delete every other document of the dense run, and repair the index
+    DocTable dt = NewDocTable(N);
+    char key[16];
+    for (t_docId id = 1; id <= codecTestDocId(N - 1); id++) {
+      sprintf(key, "doc%d", id);
+      ASSERT_EQUAL(id, DocTable_Put(&dt, key, 1, Document_DefaultFlags, NULL, 0));
+    }
+    for (int i = 0; i < 3000; i += 2) {
+      sprintf(key, "doc%d", codecTestDocId(i));
+      DocTable_Delete(&dt, key);
+    }
+    InvertedIndex_Repair(idx, &dt, 0, -1);
+    ir = NewIndexReader(idx, NULL, RS_FIELDMASK_ALL, flags, NULL, 0);
+    i = 1;
+    while (IR_Read(ir, &h) != INDEXREAD_EOF) {
+      ASSERT_EQUAL(codecTestDocId(i), h->docId);
+      i += i < 2999 ? 2 : 1;
+    }
+    ASSERT_EQUAL(N, i);
+    IR_Free(ir);
+
+    DocTable_Free(&dt);
+    InvertedIndex_Free(idx);
+  }
+  return 0;
+}
+
 int testDocTable() {
 
   char buf[16];
@@ -642,7 +1516,16 @@ int testDocTable() {
   ASSERT_EQUAL(N + 1, dt.size);
   ASSERT_EQUAL(N, dt.maxDocId);
   ASSERT(dt.cap > dt.size);
-  ASSERT_EQUAL(6780, (int)dt.memsize);
+
+  // the keys are stored once, in a single chunk
+  ASSERT_EQUAL(1, dt.keys.numChunks);
+  ASSERT_EQUAL(DOCTABLE_KEYS_CHUNK_SIZE, dt.keys.memsize);
+  ASSERT_EQUAL(N, dt.dim.size);
+  DocTableMemUsage mem = DocTable_MemUsage(&dt);
+  ASSERT_EQUAL(dt.cap * sizeof(RSDocumentMetadata), mem.metadata);
+  ASSERT_EQUAL(N * sizeof(RSPayload) + 590, mem.payloads);
+  ASSERT_EQUAL(0, mem.sortVectors);
+  ASSERT_EQUAL(mem.metadata + mem.keys + mem.idMap + mem.payloads, mem.total);
 
   for (int i = 0; i < N; i++) {
     sprintf(buf, "doc_%d", i);
@@ -663,7 +1546,7 @@ int testDocTable() {
     ASSERT_EQUAL((int)dmd->score, i);
     ASSERT_EQUAL((int)dmd->flags, (int)(Document_DefaultFlags | Document_HasPayload));
 
-    t_docId xid = DocIdMap_Get(&dt.dim, buf);
+    t_docId xid = DocTable_GetId(&dt, buf);
 
     ASSERT_EQUAL((int)xid, i + 1);
 
@@ -672,10 +1555,59 @@ int testDocTable() {
     ASSERT((int)(dmd->flags & Document_Deleted));
   }
 
-  ASSERT(0 == DocIdMap_Get(&dt.dim, "foo bar"));
+  ASSERT(0 == DocTable_GetId(&dt, "foo bar"));
+  ASSERT_EQUAL(0, dt.dim.size);
+  ASSERT_EQUAL(0, DocTable_MemUsage(&dt).payloads);
+
+  // deleted keys can be put again, taking a new id
+  ASSERT_EQUAL(N + 1, DocTable_Put(&dt, "doc_0", 1, Document_DefaultFlags, NULL, 0));
+  ASSERT_EQUAL(N + 1, DocTable_GetId(&dt, "doc_0"));
+  ASSERT_EQUAL(0, DocTable_Put(&dt, "doc_0", 1, Document_DefaultFlags, NULL, 0));
+  ASSERT_STRING_EQ("doc_0", DocTable_GetKey(&dt, 1));
 
   ASSERT(NULL == DocTable_Get(&dt, N + 2));
   DocTable_Free(&dt);
+
+  // many keys, spanning several chunks and growing the id map
+  dt = NewDocTable(10);
+  N = 100000;
+  for (int i = 0; i < N; i++) {
+    sprintf(buf, "key:%d", i);
+    ASSERT_EQUAL(i + 1, DocTable_Put(&dt, buf, 1, Document_DefaultFlags, NULL, 0));
+  }
+  ASSERT(dt.keys.numChunks > 1);
+  for (int i = 0; i < N; i += 2) {
+    sprintf(buf, "key:%d", i);
+    ASSERT_EQUAL(1, DocTable_Delete(&dt, buf));
+  }
+  for (int i = 0; i < N; i++) {
+    sprintf(buf, "key:%d", i);
+    ASSERT_EQUAL((i % 2 ? i + 1 : 0), DocTable_GetId(&dt, buf));
+    ASSERT_STRING_EQ(buf, DocTable_GetKey(&dt, i + 1));
+  }
+  DocTable_Free(&dt);
+
+  // replacing the same documents over and over doesn't grow the keys without bound
+  dt = NewDocTable(10);
+  for (int i = 0; i < 1000; i++) {
+    sprintf(buf, "doc:%d", i);
+    DocTable_Put(&dt, buf, 1, Document_DefaultFlags, NULL, 0);
+  }
+  for (int n = 0; n < 500; n++) {
+    for (int i = 0; i < 1000; i++) {
+      sprintf(buf, "doc:%d", i);
+      ASSERT_EQUAL(1, DocTable_Delete(&dt, buf));
+      ASSERT_EQUAL(dt.maxDocId + 1, DocTable_Put(&dt, buf, 1, Document_DefaultFlags, NULL, 0));
+    }
+    ASSERT((DocTable_MemUsage(&dt).keys <= 4 * DOCTABLE_KEYS_CHUNK_SIZE));
+  }
+  for (int i = 0; i < 1000; i++) {
+    sprintf(buf, "doc:%d", i);
+    t_docId id = DocTable_GetId(&dt, buf);
+    ASSERT_EQUAL((500 * 1000 + i + 1), id);
+    ASSERT_STRING_EQ(buf, DocTable_GetKey(&dt, id));
+  }
+  DocTable_Free(&dt);
   return 0;
 }
 
@@ -741,6 +1673,179 @@ int testSortable() {
   return 0;
 }
 
+static void freeTagValues(Vector *values) {
+  for (size_t i = 0; i < Vector_Size(values); i++) {
+    char *val;
+    Vector_Get(values, i, &val);
+    rm_free(val);
+  }
+  Vector_Free(values);
+}
+
+static int tagValueCount(TagIndex *idx, const char *val) {
+  DocTable dt = {.size = 10000};
+  IndexIterator *it = TagIndex_OpenReader(idx, &dt, val, strlen(val));
+  if (!it) return -1;
+  int n = 0;
+  RSIndexResult *h = NULL;
+  while (it->Read(it->ctx, &h) != INDEXREAD_EOF) {
+    n++;
+  }
+  it->Free(it);
+  return n;
+}
+
+int testTagIndex() {
+  const char *text = " Foo, bar  Baz ,,FOO,  ";
+  Vector *v = TagIndex_Preprocess(',', text, strlen(text));
+  ASSERT_EQUAL(3, Vector_Size(v));
+  char *val;
+  Vector_Get(v, 0, &val);
+  ASSERT_STRING_EQ("foo", val);
+  Vector_Get(v, 1, &val);
+  ASSERT_STRING_EQ("bar  baz", val);
+  Vector_Get(v, 2, &val);
+  ASSERT_STRING_EQ("foo", val);
+
+  // repeated values are indexed once
+  TagIndex *idx = NewTagIndex();
+  ASSERT(TagIndex_Index(idx, v, 1) > 0);
+  freeTagValues(v);
+
+  // bytes above 0x7f are kept as they are
+  const char *utf8 = " \xc3\x89t\xc3\xa9,\xa0";
+  v = TagIndex_Preprocess(',', utf8, strlen(utf8));
+  ASSERT_EQUAL(2, Vector_Size(v));
+  Vector_Get(v, 0, &val);
+  ASSERT_STRING_EQ("\xc3\x89t\xc3\xa9", val);
+  Vector_Get(v, 1, &val);
+  ASSERT_STRING_EQ("\xa0", val);
+  freeTagValues(v);
+  ASSERT_EQUAL(2, idx->values->cardinality);
+  ASSERT_EQUAL(1, tagValueCount(idx, "foo"));
+  ASSERT_EQUAL(1, tagValueCount(idx, "bar  baz"));
+  ASSERT_EQUAL(-1, tagValueCount(idx, "bar"));
+  ASSERT_EQUAL(-1, tagValueCount(idx, "Foo"));
+
+  int N = 10000;
+  for (t_docId id = 2; id <= N; id++) {
+    const char *t = id % 2 ? "odd;all" : "even;all";
+    v = TagIndex_Preprocess(';', t, strlen(t));
+    TagIndex_Index(idx, v, id);
+    freeTagValues(v);
+  }
+  ASSERT_EQUAL(N / 2, tagValueCount(idx, "even"));
+  ASSERT_EQUAL(N - 1, tagValueCount(idx, "all"));
+
+  DocTable dt = {.size = N};
+  IndexIterator *it = TagIndex_OpenReader(idx, &dt, "odd", 3);
+  RSIndexResult *h = NULL;
+  ASSERT_EQUAL(INDEXREAD_OK, it->SkipTo(it->ctx, 1001, &h));
+  ASSERT_EQUAL(1001, h->docId);
+  ASSERT_EQUAL(INDEXREAD_NOTFOUND, it->SkipTo(it->ctx, 5000, &h));
+  ASSERT_EQUAL(5001, h->docId);
+  ASSERT_EQUAL(INDEXREAD_EOF, it->SkipTo(it->ctx, N + 1, &h));
+  it->Free(it);
+  TagIndex_Free(idx);
+
+  // the spec of tag fields
+  const char *args[] = {"SCHEMA", "tags", "tag", "places", "tag", "separator", ";"};
+  char *err = NULL;
+  IndexSpec *s = IndexSpec_Parse("idx", args, sizeof(args) / sizeof(const char *), &err);
+  ASSERT(s != NULL);
+  FieldSpec *fs = IndexSpec_GetField(s, "tags", 4);
+  ASSERT_EQUAL(F_TAG, fs->type);
+  ASSERT_EQUAL(',', fs->tagSep);
+  fs = IndexSpec_GetField(s, "places", 6);
+  ASSERT_EQUAL(F_TAG, fs->type);
+  ASSERT_EQUAL(';', fs->tagSep);
+  IndexSpec_Free(s);
+
+  const char *sortableArgs[] = {"SCHEMA", "tags", "tag", "sortable"};
+  s = IndexSpec_Parse("idx", sortableArgs, 4, &err);
+  ASSERT(s == NULL);
+  const char *sepArgs[] = {"SCHEMA", "tags", "tag", "separator", ";;"};
+  s = IndexSpec_Parse("idx", sepArgs, 5, &err);
+  ASSERT(s == NULL);
+  return 0;
+}
+
+int benchmarkTagIndex() {
+  // every document has 3 tags out of a 1000, indexed as tags and as a text field
+  int N = 1000000, numValues = 1000;
+  TagIndex *idx = NewTagIndex();
+  InvertedIndex *textIdx[numValues];
+  for (int i = 0; i < numValues; i++) {
+    textIdx[i] = NewInvertedIndex(INDEX_DEFAULT_FLAGS, 1);
+  }
+
+  srand(1337);
+  for (t_docId id = 1; id <= N; id++) {
+    char buf[64];
+    int vals[3];
+    for (int j = 0; j < 3; j++) {
+      // a skewed distribution, like real tags
+      vals[j] = (rand() % numValues) * (rand() % numValues) / numValues;
+    }
+    sprintf(buf, "tag%d,tag%d,tag%d", vals[0], vals[1], vals[2]);
+    Vector *v = TagIndex_Preprocess(',', buf, strlen(buf));
+    TagIndex_Index(idx, v, id);
+    freeTagValues(v);
+
+    for (int j = 0; j < 3; j++) {
+      if (textIdx[vals[j]]->lastId == id) continue;
+      ForwardIndexEntry h = {.docId = id, .fieldMask = 1, .freq = 1, .normFreq = 1, .docScore = 1};
+      h.vw = NewVarintVectorWriter(8);
+      VVW_Write(h.vw, j + 1);
+      VVW_Truncate(h.vw);
+      InvertedIndex_WriteEntry(textIdx[vals[j]], &h);
+      VVW_Free(h.vw);
+    }
+  }
+
+  size_t tagSize = 0, textSize = 0;
+  for (int i = 0; i < numValues; i++) {
+    textSize += InvertedIndex_BlocksMemUsage(textIdx[i], 0);
+  }
+  tagSize = TagIndexType_MemUsage(idx);
+  printf("tag index: %.02fMB, text field: %.02fMB\n", tagSize / (double)0x100000,
+         textSize / (double)0x100000);
+
+  // a query for any of two common values
+  const char *q[] = {"tag1", "tag2"};
+  DocTable dt = {.size = N};
+  for (int tags = 0; tags < 2; tags++) {
+    TimeSample ts;
+    int total = 0;
+    TimeSampler_Start(&ts);
+    for (int x = 0; x < 10; x++) {
+      IndexIterator **its = calloc(2, sizeof(IndexIterator *));
+      for (int j = 0; j < 2; j++) {
+        InvertedIndex *iv = textIdx[j + 1];
+        its[j] =
+            tags ? TagIndex_OpenReader(idx, &dt, q[j], strlen(q[j]))
+                 : NewReadIterator(NewIndexReader(iv, NULL, RS_FIELDMASK_ALL, iv->flags, NULL, 0));
+      }
+      IndexIterator *ui = NewUnionIterator(its, 2, NULL, 1);
+      RSIndexResult *h = NULL;
+      while (ui->Read(ui->ctx, &h) != INDEXREAD_EOF) {
+        total++;
+      }
+      ui->Free(ui);
+      TimeSampler_Tick(&ts);
+    }
+    TimeSampler_End(&ts);
+    printf("%s: %d reads in %.02fms per query\n", tags ? "tag index" : "text field", total / 10,
+           TimeSampler_IterationMS(&ts));
+  }
+
+  TagIndex_Free(idx);
+  for (int i = 0; i < numValues; i++) {
+    InvertedIndex_Free(textIdx[i]);
+  }
+  return 0;
+}
+
 TEST_MAIN({
 
   // LOGGING_INIT(L_INFO);
@@ -751,14 +1856,31 @@ TEST_MAIN({
   TESTFUNC(testIndexReadWrite);
 
   TESTFUNC(testReadIterator);
+  TESTFUNC(testReadSnapshot);
   TESTFUNC(testIntersection);
+  TESTFUNC(testSkipTo);
+  TESTFUNC(testIdList);
+  TESTFUNC(testIntersectionRareCommon);
+  TESTFUNC(testIntersectionOrder);
+  TESTFUNC(testBlockSizes);
   TESTFUNC(testNot);
   TESTFUNC(testUnion);
+  TESTFUNC(testUnionHeap);
+  TESTFUNC(benchmarkUnionHeap);
+  TESTFUNC(testUnionMaxScore);
+  TESTFUNC(testDocIdRangeShards);
 
   TESTFUNC(testBuffer);
+  TESTFUNC(testQintBlockDecode);
+  TESTFUNC(benchmarkQintBlockDecode);
   TESTFUNC(testTokenize);
   TESTFUNC(testIndexSpec);
+  TESTFUNC(testSortIndex);
+  TESTFUNC(testQueryCache);
+  TESTFUNC(testTagIndex);
+  TESTFUNC(benchmarkTagIndex);
   TESTFUNC(testIndexFlags);
+  TESTFUNC(testCodecs);
   TESTFUNC(testDocTable);
   TESTFUNC(testSortable);
 });
\ No newline at end of file
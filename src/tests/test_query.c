@@ -95,6 +95,12 @@ int testQueryParser() {
 
   assertInvalidQuery("@number:[100 foo]");
 
+  assertValidQuery("@tags:{foo}");
+  assertValidQuery("@tags:{foo | bar baz} hello");
+  assertValidQuery("@tags : { foo|bar }|@title:hello");
+  assertValidQuery("hello -@tags:{foo}");
+  assertInvalidQuery("@tags:{foo | bar");
+
   assertInvalidQuery("(foo");
   assertInvalidQuery("\"foo");
   assertInvalidQuery("");
@@ -230,10 +236,70 @@ int testFieldSpec() {
   ASSERT_EQUAL(n->nn.nf->inclusiveMin, 1);
   ASSERT_EQUAL(n->nn.nf->inclusiveMax, 0);
   Query_Free(q);
+
+  // test tag lists, whose values are not tokenized
+  qt = "@tags:{ Foo | bar Baz|} hello";
+  q = NewQuery(&ctx, qt, strlen(qt), 0, 1, 0xff, 0, "en", DefaultStopWordList(), NULL, -1, 0, NULL,
+               (RSPayload){}, NULL);
+  n = Query_Parse(q, &err);
+  if (err) FAIL("Error parsing query: %s", err);
+  ASSERT(n != NULL);
+  QueryNode_Print(q, n, 0);
+  ASSERT_EQUAL(n->type, QN_PHRASE);
+  ASSERT_EQUAL(n->pn.numChildren, 2)
+  ASSERT_EQUAL(q->numTokens, 1)
+  n = n->pn.children[0];
+  ASSERT_EQUAL(n->type, QN_TAG);
+  ASSERT_STRING_EQ("tags", n->tag.fieldName);
+  ASSERT_EQUAL(n->tag.numValues, 2);
+  ASSERT_STRING_EQ("foo", n->tag.values[0]);
+  ASSERT_STRING_EQ("bar baz", n->tag.values[1]);
+  Query_Free(q);
   IndexSpec_Free(ctx.spec);
 
   return 0;
 }
+char *queryCacheKey(RedisSearchCtx *ctx, char *qt, int offset, RSPayload payload) {
+  char *err = NULL;
+  Query *q = NewQuery(ctx, qt, strlen(qt), offset, 10, 0xff, 0, "en", DefaultStopWordList(), NULL,
+                      -1, 0, NULL, payload, NULL);
+  Query_Parse(q, &err);
+  char *key = Query_CacheKey(q);
+  Query_Free(q);
+  return key;
+}
+
+int testQueryCacheKey() {
+  char *err = NULL;
+  static const char *args[] = {"SCHEMA", "title", "text", "bar", "numeric"};
+  RedisSearchCtx ctx = {
+      .spec = IndexSpec_Parse("idx", args, sizeof(args) / sizeof(const char *), &err)};
+
+  // the key is that of the parsed query, not its text
+  char *k1 = queryCacheKey(&ctx, "hello  World @bar:[1 2]", 0, (RSPayload){});
+  char *k2 = queryCacheKey(&ctx, "hello world @bar:[1 2]", 0, (RSPayload){});
+  ASSERT(k1 != NULL);
+  ASSERT_STRING_EQ(k1, k2);
+  free(k2);
+
+  // filters are compared exactly
+  k2 = queryCacheKey(&ctx, "hello world @bar:[1 2.0000001]", 0, (RSPayload){});
+  ASSERT(strcmp(k1, k2));
+  free(k2);
+
+  k2 = queryCacheKey(&ctx, "hello world @bar:[1 2]", 10, (RSPayload){});
+  ASSERT(strcmp(k1, k2));
+  free(k2);
+
+  // queries with a payload are not cached
+  k2 = queryCacheKey(&ctx, "hello world @bar:[1 2]", 0, (RSPayload){.data = "foo", .len = 3});
+  ASSERT(k2 == NULL);
+
+  free(k1);
+  IndexSpec_Free(ctx.spec);
+  return 0;
+}
+
 void benchmarkQueryParser() {
   char *qt = "(hello|world) \"another world\"";
   char *err = NULL;
@@ -249,6 +315,7 @@ TEST_MAIN({
   // LOGGING_INIT(L_INFO);
   TESTFUNC(testQueryParser);
   TESTFUNC(testFieldSpec);
+  TESTFUNC(testQueryCacheKey);
   benchmarkQueryParser();
 
 });
@@ -4,6 +4,9 @@
 #include "time_sample.h"
 #include "../index.h"
 #include "../rmutil/alloc.h"
+#include "../geo_index.h"
+#include "../rmalloc.h"
+#include <math.h>
 
 // Helper so we get the same pseudo-random numbers
 // in tests across environments
@@ -49,6 +52,87 @@ int testNumericRangeTree() {
   return 0;
 }
 
+static double blockValFloat(int i) {
+  return i * 0.25;
+}
+static double blockValInt(int i) {
+  return 1500000000.0 + i * 7;
+}
+static double blockValDict(int i) {
+  return (i % 5) * 1.1;
+}
+static double blockValDouble(int i) {
+  return i * 1.1;
+}
+
+int testNumericRangeBlocks() {
+  // each kind of values should get its own encoding, and decode back exactly
+  struct {
+    NumericValueEncoding encoding;
+    double (*gen)(int i);
+  } cases[] = {
+      {NR_VALUES_FLOAT, blockValFloat},
+      {NR_VALUES_INT, blockValInt},
+      {NR_VALUES_DICT, blockValDict},
+      {NR_VALUES_DOUBLE, blockValDouble},
+  };
+  int N = NR_BLOCK_SIZE * 10 + 17;
+
+  for (int c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+    NumericRangeNode *node = NewLeafNode(2, 0, 0, 1000000);
+    NumericRange *r = node->range;
+    for (int i = 0; i < N; i++) {
+      NumericRange_Add(r, 3 * i + 1, cases[c].gen(i), 1);
+    }
+    ASSERT_EQUAL(r->size, N);
+    ASSERT_EQUAL(r->numBlocks, (N / NR_BLOCK_SIZE));
+    ASSERT_EQUAL(r->tailSize, (N % NR_BLOCK_SIZE));
+    ASSERT_EQUAL(r->card, (cases[c].encoding == NR_VALUES_DICT ? 5 : N));
+    for (uint32_t b = 0; b < r->numBlocks; b++) {
+      ASSERT_EQUAL(r->blocks[b].encoding, cases[c].encoding);
+    }
+
+    t_docId docIds[NR_BLOCK_SIZE];
+    double values[NR_BLOCK_SIZE];
+    int i = 0;
+    for (uint32_t b = 0; b <= r->numBlocks; b++) {
+      size_t n = NumericRange_DecodeBlock(r, b, docIds, values);
+      for (size_t j = 0; j < n; j++, i++) {
+        ASSERT_EQUAL(docIds[j], (3 * i + 1));
+        ASSERT_EQUAL(values[j], cases[c].gen(i));
+      }
+    }
+    ASSERT_EQUAL(i, N);
+
+    // skip to entries in and out of the filter, across blocks
+    NumericFilter *flt = NewNumericFilter(cases[c].gen(100), cases[c].gen(N - 100), 1, 0);
+    IndexIterator *it = NewNumericRangeIterator(r, flt);
+    RSIndexResult *res;
+    int last = N - 1;
+    while (!NumericFilter_Match(flt, cases[c].gen(last))) last--;
+    for (int i = 0; i < N; i += 37) {
+      t_docId target = 3 * i + 1;
+      int rc = it->SkipTo(it->ctx, target, &res);
+      if (i > last) {
+        ASSERT_EQUAL(rc, INDEXREAD_EOF);
+        break;
+      }
+      if (NumericFilter_Match(flt, cases[c].gen(i))) {
+        ASSERT_EQUAL(rc, INDEXREAD_OK);
+        ASSERT_EQUAL(res->docId, target);
+      } else {
+        ASSERT_EQUAL(rc, INDEXREAD_NOTFOUND);
+        ASSERT(res->docId > target);
+        ASSERT(NumericFilter_Match(flt, cases[c].gen((res->docId - 1) / 3)));
+      }
+    }
+    it->Free(it);
+    NumericFilter_Free(flt);
+    NumericRangeNode_Free(node);
+  }
+  return 0;
+}
+
 #define _min(x, y) (x < y ? x : y)
 #define _max(x, y) (x < y ? y : x)
 
@@ -130,34 +214,215 @@ int testRangeIterator() {
   return 0;
 }
 
-int benchmarkNumericRangeTree() {
-  NumericRangeTree *t = NewNumericRangeTree();
-  int count = 1;
-  for (int i = 0; i < 100000; i++) {
+static double testGeoDistance(double lon1, double lat1, double lon2, double lat2) {
+  double r = M_PI / 180.0;
+  double u = sin((lat2 - lat1) * r / 2), v = sin((lon2 - lon1) * r / 2);
+  return 2.0 * 6372797.560856 * asin(sqrt(u * u + cos(lat1 * r) * cos(lat2 * r) * v * v));
+}
+
+int testGeoHashIndex() {
+  GeoHashIndex *idx = NewGeoHashIndex();
+  int N = 50000;
+  double *lons = malloc(N * sizeof(double)), *lats = malloc(N * sizeof(double));
+  for (int i = 0; i < N; i++) {
+    // most points around a city, the rest anywhere
+    if (i % 10) {
+      lons[i] = 34.78 + ((double)rand() / RAND_MAX - 0.5) * 0.5;
+      lats[i] = 32.08 + ((double)rand() / RAND_MAX - 0.5) * 0.5;
+    } else {
+      lons[i] = ((double)rand() / RAND_MAX - 0.5) * 359.9;
+      lats[i] = ((double)rand() / RAND_MAX - 0.5) * 170;
+    }
+    GeoHashIndex_Add(idx, i + 1, lons[i], lats[i]);
+  }
+  ASSERT_EQUAL(idx->numPoints, N);
+
+  struct {
+    double lon, lat, radius;
+  } queries[] = {{34.78, 32.08, 10},      {34.78, 32.08, 1000},  {34.78, 32.08, 20000},
+                 {34.9, 32.2, 5000},      {179.99, 0, 500000},   {-179.99, 10, 2000000},
+                 {0, 84.9, 3000000},      {34.78, 32.08, 1e8},   {-70, -60, 100000}};
+  for (int q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+    size_t n;
+    t_docId *ids = GeoHashIndex_Radius(idx, queries[q].lon, queries[q].lat, queries[q].radius, &n);
+    size_t expected = 0, j = 0;
+    for (int i = 0; i < N; i++) {
+      if (testGeoDistance(queries[q].lon, queries[q].lat, lons[i], lats[i]) > queries[q].radius) {
+        continue;
+      }
+      expected++;
+      // results are sorted, so they should match the points in order
+      ASSERT(j < n);
+      ASSERT_EQUAL(ids[j++], i + 1);
+    }
+    ASSERT_EQUAL(n, expected);
+    rm_free(ids);
+  }
+
+  struct {
+    double minLon, minLat, maxLon, maxLat;
+  } boxes[] = {{34.7, 32.0, 34.8, 32.1},   {34.78, 32.08, 34.781, 32.081}, {-10, -10, 10, 10},
+               {170, -50, -170, 50},       {-180, -85, 180, 85},           {34.5, 31, 36, 32.1}};
+  for (int q = 0; q < sizeof(boxes) / sizeof(boxes[0]); q++) {
+    size_t n;
+    t_docId *ids = GeoHashIndex_Box(idx, boxes[q].minLon, boxes[q].minLat, boxes[q].maxLon,
+                                    boxes[q].maxLat, &n);
+    size_t j = 0;
+    for (int i = 0; i < N; i++) {
+      int inLon = boxes[q].minLon <= boxes[q].maxLon
+                      ? lons[i] >= boxes[q].minLon && lons[i] <= boxes[q].maxLon
+                      : lons[i] >= boxes[q].minLon || lons[i] <= boxes[q].maxLon;
+      if (!inLon || lats[i] < boxes[q].minLat || lats[i] > boxes[q].maxLat) continue;
+      ASSERT(j < n);
+      ASSERT_EQUAL(ids[j++], i + 1);
+    }
+    ASSERT_EQUAL(n, j);
+    rm_free(ids);
+  }
 
-    count += NumericRangeTree_Add(t, i, (double)(rand() % 500000));
+  // a triangle with its tip in the city, and a concave polygon
+  double triangle[] = {34.78, 32.08, 34.6, 31.9, 34.9, 31.95};
+  double concave[] = {34.6, 31.9, 34.95, 31.9, 34.95, 32.3, 34.78, 32.0, 34.6, 32.3};
+  double *polygons[] = {triangle, concave};
+  size_t numPoints[] = {3, 5};
+  for (int q = 0; q < 2; q++) {
+    size_t n;
+    t_docId *ids = GeoHashIndex_Polygon(idx, polygons[q], numPoints[q], &n);
+    size_t j = 0;
+    for (int i = 0; i < N; i++) {
+      // the same ray casting test, done naively
+      int in = 0;
+      for (size_t a = 0; a < numPoints[q]; a++) {
+        size_t b = (a + numPoints[q] - 1) % numPoints[q];
+        double xa = polygons[q][2 * a], ya = polygons[q][2 * a + 1];
+        double xb = polygons[q][2 * b], yb = polygons[q][2 * b + 1];
+        if ((ya > lats[i]) != (yb > lats[i]) &&
+            lons[i] < (xb - xa) * (lats[i] - ya) / (yb - ya) + xa) {
+          in = !in;
+        }
+      }
+      if (!in) continue;
+      ASSERT(j < n);
+      ASSERT_EQUAL(ids[j++], i + 1);
+    }
+    ASSERT(j > 0);
+    ASSERT_EQUAL(n, j);
+    rm_free(ids);
   }
-  // printf("created %d range leaves\n", count);
 
-  TIME_SAMPLE_RUN_LOOP(1000, {
-    Vector *v = NumericRangeTree_Find(t, 1000, 20000);
-    // printf("%d\n", v->top);
+  ASSERT_EQUAL(GeoFilter_UnitFactor("km"), 1000);
+  ASSERT_EQUAL(GeoFilter_UnitFactor("MI"), 1609.34);
+  ASSERT_EQUAL(GeoFilter_UnitFactor("yd"), -1);
+
+  free(lons);
+  free(lats);
+  GeoHashIndex_Free(idx);
+  return 0;
+}
+
+int testNumericFilterIterator() {
+  NumericRangeTree *t = NewNumericRangeTree();
+  int N = 1000000;
+  double *lookup = calloc(N + 1, sizeof(double));
+  for (t_docId docId = 1; docId <= N; docId++) {
+    lookup[docId] = (double)(prng() % N);
+    NumericRangeTree_Add(t, docId, lookup[docId]);
+  }
+
+  // narrow filters merge their ranges with a heap, wide ones with a bitmap
+  double widths[] = {N / 200, N / 50, N / 4, N};
+  for (int w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+    NumericFilter *flt = NewNumericFilter(N / 8, N / 8 + widths[w], 1, 0);
+    Vector *v = NumericRangeTree_Find(t, flt->min, flt->max);
+    ASSERT(Vector_Size(v) > 1);
     Vector_Free(v);
-  });
 
-  TimeSample ts;
+    IndexIterator *it = NewNumericFilterIterator(t, flt);
+    NumericFilterIterator *nfi = it->ctx;
+    ASSERT_EQUAL((nfi->bits != NULL), (w >= 2));
+
+    // read everything
+    RSIndexResult *res;
+    t_docId expected = 0;
+    while (it->Read(it->ctx, &res) != INDEXREAD_EOF) {
+      do {
+        expected++;
+      } while (!NumericFilter_Match(flt, lookup[expected]));
+      ASSERT_EQUAL(res->docId, expected);
+      ASSERT_EQUAL(it->LastDocId(it->ctx), expected);
+    }
+    while (++expected <= N) {
+      ASSERT(!NumericFilter_Match(flt, lookup[expected]));
+    }
+    ASSERT(!it->HasNext(it->ctx));
+    it->Free(it);
 
-  NumericFilter *flt = NewNumericFilter(1000, 50000, 0, 0);
-  IndexIterator *it = NewNumericFilterIterator(t, flt);
-  ASSERT(it->HasNext(it->ctx));
+    // skip to increasing targets, some matching and some not
+    it = NewNumericFilterIterator(t, flt);
+    t_docId next = 1;
+    for (t_docId target = 1; target <= N; target += 1 + prng() % 30000) {
+      int rc = it->SkipTo(it->ctx, target, &res);
+      for (next = target; next <= N && !NumericFilter_Match(flt, lookup[next]); next++)
+        ;
+      if (next > N) {
+        ASSERT_EQUAL(rc, INDEXREAD_EOF);
+        break;
+      }
+      ASSERT_EQUAL(rc, (next == target ? INDEXREAD_OK : INDEXREAD_NOTFOUND));
+      ASSERT_EQUAL(res->docId, next);
+      target = next;
+    }
+    it->Free(it);
+    NumericFilter_Free(flt);
+  }
 
-  // ASSERT_EQUAL(it->Len(it->ctx), N);
-  count = 0;
+  free(lookup);
+  NumericRangeTree_Free(t);
+  return 0;
+}
 
-  RSIndexResult *res = NULL;
+/* Check the structure of a subtree, returning the number of entries in its leaves. Values in the
+ * subtree are in [min,max) */
+static size_t checkRangeNode(NumericRangeNode *n, double min, double max, int *ok) {
+  if (!n->left || !n->right) {
+    *ok = *ok && !n->left && !n->right && n->maxDepth == 0 && n->range &&
+          n->range->minVal >= min && n->range->maxVal <= max;
+    return n->range ? n->range->size : 0;
+  }
+  size_t size = checkRangeNode(n->left, min, n->value, ok) +
+                checkRangeNode(n->right, n->value, max, ok);
+  int hl = n->left->maxDepth, hr = n->right->maxDepth;
+  *ok = *ok && n->maxDepth == 1 + (hl > hr ? hl : hr) && abs(hl - hr) <= 1;
+  // a retained range has all the entries of the subtree
+  *ok = *ok && (!n->range || n->range->size == size);
+  return size;
+}
 
+int testNumericRangeTreeBalance() {
+  // increasing values, like timestamps, split the rightmost leaf over and over
+  NumericRangeTree *t = NewNumericRangeTree();
+  int N = 500000;
+  for (int i = 0; i < N; i++) {
+    NumericRangeTree_Add(t, i + 1, 1500000000 + i / 3);
+  }
+  ASSERT(t->numRanges > 100);
+  int ok = 1;
+  ASSERT_EQUAL(checkRangeNode(t->root, -INFINITY, INFINITY, &ok), N);
+  ASSERT(ok);
+  // an AVL tree is at most 1.44 times deeper than a perfectly balanced one
+  ASSERT(t->root->maxDepth <= 1.44 * log2(t->numRanges + 1));
+
+  NumericFilter *flt = NewNumericFilter(1500000000 + N / 6, 1500000000 + N / 4, 1, 1);
+  IndexIterator *it = NewNumericFilterIterator(t, flt);
+  RSIndexResult *res;
+  t_docId expected = 3 * (N / 6) + 1;
+  while (it->Read(it->ctx, &res) != INDEXREAD_EOF) {
+    ASSERT_EQUAL(res->docId, expected);
+    expected++;
+  }
+  ASSERT_EQUAL(expected, 3 * (N / 4) + 4);
   it->Free(it);
-
+  NumericFilter_Free(flt);
   NumericRangeTree_Free(t);
   return 0;
 }
@@ -167,5 +432,8 @@ TEST_MAIN({
 
   TESTFUNC(testNumericRangeTree);
   TESTFUNC(testRangeIterator);
-  benchmarkNumericRangeTree();
+  TESTFUNC(testNumericRangeBlocks);
+  TESTFUNC(testNumericFilterIterator);
+  TESTFUNC(testNumericRangeTreeBalance);
+  TESTFUNC(testGeoHashIndex);
 });
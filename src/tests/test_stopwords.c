@@ -20,6 +20,10 @@ int testStopwordList() {
   ASSERT(!StopWordList_Contains(sl, NULL, 0));
   ASSERT(!StopWordList_Contains(NULL, NULL, 0));
 
+  // the list lives until its last reference is released
+  ASSERT(StopWordList_Ref(sl) == sl);
+  StopWordList_Free(sl);
+  ASSERT(StopWordList_Contains(sl, "foo", 3));
   StopWordList_Free(sl);
   for (int i = 0; i < sizeof(terms) / sizeof(const char *); i++) {
     free(terms[i]);
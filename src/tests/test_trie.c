@@ -1,6 +1,7 @@
 #include "../trie/trie.h"
 #include "../trie/levenshtein.h"
 #include "../trie/rune_util.h"
+#include "../trie/trie_type.h"
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
@@ -330,10 +331,309 @@ int testDFAFilter() {
   return 0;
 }
 
+/* A random word of 2 to 5 syllables, so that words share prefixes like real terms do */
+static void randomWord(char *buf) {
+  static const char *cons = "bcdfghklmnprstvz", *vows = "aeiou";
+  int n = 2 + rand() % 4;
+  for (int i = 0; i < n; i++) {
+    *buf++ = cons[rand() % 16];
+    *buf++ = vows[rand() % 5];
+    if (rand() % 3 == 0) *buf++ = cons[rand() % 16];
+  }
+  *buf = 0;
+}
+
+int testLevenshteinAutomaton() {
+  // walk the universal automata alongside the sparse automaton on random strings
+  srand(42);
+  for (int maxDist = 0; maxDist <= LEV_MAX_DIST; maxDist++) {
+    LevenshteinAutomaton *la = GetLevenshteinAutomaton(maxDist);
+    ASSERT(la == GetLevenshteinAutomaton(maxDist));
+    for (int x = 0; x < 2000; x++) {
+      rune str[8], word[10];
+      int len = rand() % 8, wlen = rand() % 10;
+      for (int i = 0; i < len; i++) str[i] = 'a' + rand() % 3;
+      for (int i = 0; i < wlen; i++) word[i] = 'a' + rand() % 3;
+
+      SparseAutomaton sa = NewSparseAutomaton(str, len, maxDist);
+      sparseVector *v = SparseAutomaton_Start(&sa);
+      int state = 0, pos = 0;
+      for (int i = 0; i < wlen && state >= 0; i++) {
+        int rem = MIN(len - pos, la->width);
+        int vec = 0;
+        for (int j = 0; j < rem; j++) {
+          if (str[pos + j] == word[i]) vec |= 1 << j;
+        }
+        levTransition t = la->trans[((state * (la->width + 1) + rem) << la->width) | vec];
+        state = t.state;
+        pos += t.shift;
+
+        sparseVector *nv = SparseAutomaton_Step(&sa, v, word[i]);
+        sparseVector_free(v);
+        v = nv;
+        ASSERT_EQUAL((state < 0), (v->len == 0));
+      }
+      if (state >= 0) {
+        levState *st = &la->states[state];
+        ASSERT_EQUAL(st->v->len, v->len);
+        for (int j = 0; j < v->len; j++) {
+          ASSERT_EQUAL((st->v->entries[j].idx + pos), v->entries[j].idx);
+          ASSERT_EQUAL(st->v->entries[j].val, v->entries[j].val);
+        }
+        ASSERT_EQUAL(SparseAutomaton_IsMatch(&sa, v), (st->lastIdx == len - pos));
+      }
+      sparseVector_free(v);
+    }
+  }
+  return 0;
+}
+
+int testFreeze() {
+  rune *rootRunes = strToRunes("", NULL);
+  TrieNode *root = __newTrieNode(rootRunes, 0, 0, NULL, 0, 0, 0, 0);
+  free(rootRunes);
+
+  char *terms[] = {"hello", "help", "helter skelter", "heltar skelter", "\xc4\x8c\xc4\x87",
+                   "\xc4\x8c\xc4\x8d", "world"};
+  for (int i = 0; i < 7; i++) {
+    ASSERT_EQUAL(1, __trie_add(&root, terms[i], i % 2 ? "pl" : NULL, i + 1, ADD_REPLACE));
+  }
+  size_t blockSize;
+  void *block = TrieNode_Freeze(root, &blockSize);
+  ASSERT(block != NULL);
+  ASSERT(blockSize > 0);
+  ASSERT_EQUAL(__trieNode_Sizeof(root->numChildren, 0), TrieNode_MemUsage(root));
+
+  // the frozen nodes are found and iterated in score order as before
+  size_t rlen;
+  for (int i = 0; i < 7; i++) {
+    rune *runes = strToRunes(terms[i], &rlen);
+    ASSERT(TrieNode_Find(root, runes, rlen) == i + 1);
+    free(runes);
+  }
+  rune *s;
+  t_len len;
+  float score;
+  RSPayload payload;
+  int n = 0;
+  TrieIterator *it = TrieNode_Iterate(root, NULL, NULL, NULL);
+  while (TrieIterator_Next(it, &s, &len, &payload, &score, NULL)) {
+    size_t slen;
+    char *str = runesToStr(s, len, &slen);
+    int i = (int)score - 1;
+    ASSERT_STRING_EQ(terms[i], str);
+    ASSERT_EQUAL((i % 2 ? 2 : 0), payload.len);
+    free(str);
+    n++;
+  }
+  TrieIterator_Free(it);
+  ASSERT_EQUAL(7, n);
+
+  // changes copy the frozen nodes they touch
+  ASSERT_EQUAL(0, __trie_add(&root, "hello", "pl", 10, ADD_REPLACE));
+  ASSERT_EQUAL(0, __trie_add(&root, "help", "xy", 11, ADD_REPLACE));
+  ASSERT_EQUAL(1, __trie_add(&root, "hel", NULL, 12, ADD_REPLACE));
+  ASSERT_EQUAL(1, __trie_add(&root, "\xc4\x8c\xc4\x88", NULL, 13, ADD_REPLACE));
+  ASSERT(TrieNode_MemUsage(root) > __trieNode_Sizeof(root->numChildren, 0));
+  rune *runes = strToRunes("helter skelter", &rlen);
+  ASSERT_EQUAL(1, TrieNode_Delete(root, runes, rlen));
+  ASSERT(TrieNode_Find(root, runes, rlen) == 0);
+  free(runes);
+
+  char *found[] = {"hello", "help", "hel", "\xc4\x8c\xc4\x88", "world"};
+  float scores[] = {10, 11, 12, 13, 7};
+  for (int i = 0; i < 5; i++) {
+    runes = strToRunes(found[i], &rlen);
+    ASSERT(TrieNode_Find(root, runes, rlen) == scores[i]);
+    free(runes);
+  }
+
+  // freezing again moves the new nodes to the new block
+  void *block2 = TrieNode_Freeze(root, &blockSize);
+  ASSERT(block2 != NULL);
+  free(block);
+  ASSERT_EQUAL(__trieNode_Sizeof(root->numChildren, 0), TrieNode_MemUsage(root));
+  n = 0;
+  it = TrieNode_Iterate(root, NULL, NULL, NULL);
+  while (TrieIterator_Next(it, &s, &len, &payload, &score, NULL)) {
+    n++;
+  }
+  TrieIterator_Free(it);
+  ASSERT_EQUAL(8, n);
+
+  TrieNode_Free(root);
+  free(block2);
+  return 0;
+}
+
+static int cmpFloatDesc(const void *p1, const void *p2) {
+  float f1 = *(float *)p1, f2 = *(float *)p2;
+  return f1 < f2 ? 1 : (f1 > f2 ? -1 : 0);
+}
+
+int testBestFirst() {
+  rune *rootRunes = strToRunes("", NULL);
+  TrieNode *root = __newTrieNode(rootRunes, 0, 0, NULL, 0, 0, 0, 0);
+  free(rootRunes);
+
+  int N = 10000;
+  float *scores = calloc(N, sizeof(float));
+  char buf[32];
+  srand(1337);
+  int n = 0;
+  for (int i = 0; i < N; i++) {
+    randomWord(buf);
+    float score = 1 + rand() % 100000;
+    if (__trie_add(&root, buf, NULL, score, ADD_REPLACE)) scores[n++] = score;
+  }
+  qsort(scores, n, sizeof(float), cmpFloatDesc);
+
+  // collect the top 10 scores, raising minScore as we go
+  float top[10];
+  int numTop = 0;
+  rune *s;
+  t_len len;
+  float score;
+  TrieIterator *it = TrieNode_IterateBestFirst(root, NULL, NULL, NULL, NULL, NULL);
+  while (TrieIterator_Next(it, &s, &len, NULL, &score, NULL)) {
+    if (numTop < 10) {
+      top[numTop++] = score;
+    } else if (score > top[9]) {
+      top[9] = score;
+    }
+    qsort(top, numTop, sizeof(float), cmpFloatDesc);
+    if (numTop == 10) it->minScore = top[9];
+  }
+  ASSERT_EQUAL(10, numTop);
+  for (int i = 0; i < 10; i++) {
+    ASSERT(top[i] == scores[i]);
+  }
+  // only a fraction of the trie is visited
+  ASSERT(it->nodesConsumed < n / 10);
+  TrieIterator_Free(it);
+
+  // without raising minScore, everything is visited
+  int count = 0;
+  it = TrieNode_IterateBestFirst(root, NULL, NULL, NULL, NULL, NULL);
+  while (TrieIterator_Next(it, &s, &len, NULL, &score, NULL)) {
+    count++;
+  }
+  TrieIterator_Free(it);
+  ASSERT_EQUAL(n, count);
+
+  free(scores);
+  TrieNode_Free(root);
+  return 0;
+}
+
+void RMUTil_InitAlloc();
+
+int testSuggestExactMatch() {
+  RMUTil_InitAlloc();
+  Trie *t = NewTrie();
+  char buf[32];
+  // the exact match of a query comes first, even when its score would have it pruned
+  for (int i = 0; i < 1000; i++) {
+    sprintf(buf, "hello%d", i);
+    Trie_InsertStringBuffer(t, buf, strlen(buf), 100 + i, 0, NULL);
+  }
+  Trie_InsertStringBuffer(t, "hellz", 5, 1, 0, NULL);
+
+  for (int maxDist = 0; maxDist <= 1; maxDist++) {
+    Vector *res = Trie_Search(t, "hellz", 5, 5, maxDist, 1, 0, 0);
+    ASSERT_EQUAL((maxDist ? 5 : 1), Vector_Size(res));
+    for (int i = 0; i < Vector_Size(res); i++) {
+      TrieSearchResult *e;
+      Vector_Get(res, i, &e);
+      if (i == 0) {
+        ASSERT_STRING_EQ("hellz", e->str);
+      } else {
+        // the rest are the highest scoring fuzzy completions
+        ASSERT(strlen(e->str) == 8 && e->str[5] == '9');
+      }
+      TrieSearchResult_Free(e);
+    }
+    Vector_Free(res);
+  }
+
+  TrieType_Free(t);
+  return 0;
+}
+
+static float findScore(TrieNode *root, char *str) {
+  size_t rlen;
+  rune *runes = strToRunes(str, &rlen);
+  float ret = TrieNode_Find(root, runes, rlen);
+  free(runes);
+  return ret;
+}
+
+int testSnapshot() {
+  RMUTil_InitAlloc();
+  Trie *t = NewTrie();
+  char *terms[] = {"hello", "help", "helm", "world", "word", "\xc4\x8c\xc4\x88"};
+  for (int i = 0; i < 6; i++) {
+    Trie_InsertStringBuffer(t, terms[i], strlen(terms[i]), i + 1, 0, NULL);
+  }
+  Trie_Freeze(t);
+
+  int epoch = Epoch_Enter();
+  TrieNode *snap = Trie_Snapshot(t);
+
+  // writers copy the nodes they change, frozen or not, while the snapshot stays as it was
+  ASSERT_EQUAL(1, Trie_InsertStringBuffer(t, "helper", 6, 10, 0, NULL));
+  ASSERT_EQUAL(0, Trie_InsertStringBuffer(t, "hello", 5, 10, 1, NULL));
+  ASSERT_EQUAL(1, Trie_Delete(t, "helm", 4));
+  ASSERT_EQUAL(1, Trie_Delete(t, "word", 4));
+  ASSERT_EQUAL(1, Trie_InsertStringBuffer(t, "hex", 3, 12, 0, NULL));
+  ASSERT_EQUAL(0, Trie_Delete(t, "wor", 3));
+  ASSERT(t->root != snap);
+
+  float before[] = {1, 2, 3, 4, 5, 6};
+  float after[] = {11, 2, 0, 4, 0, 6};
+  for (int i = 0; i < 6; i++) {
+    ASSERT(findScore(snap, terms[i]) == before[i]);
+    ASSERT(findScore(t->root, terms[i]) == after[i]);
+  }
+  ASSERT(findScore(snap, "helper") == 0);
+  ASSERT(findScore(t->root, "helper") == 10);
+
+  Vector *res = Trie_SearchRoot(snap, "hel", 3, 5, 0, 1, 0, 0);
+  ASSERT_EQUAL(3, Vector_Size(res));
+  for (int i = 0; i < Vector_Size(res); i++) {
+    TrieSearchResult *e;
+    Vector_Get(res, i, &e);
+    ASSERT_STRING_EQ(terms[2 - i], e->str);
+    TrieSearchResult_Free(e);
+  }
+  Vector_Free(res);
+
+  // leaving the epoch frees the nodes the writers unlinked, and the trie is changed in place again
+  Epoch_Exit(epoch);
+  ASSERT_EQUAL(1, Trie_Delete(t, "hex", 3));
+  ASSERT_EQUAL(5, t->size);
+  res = Trie_Search(t, "hel", 3, 5, 0, 1, 0, 0);
+  ASSERT_EQUAL(3, Vector_Size(res));
+  for (int i = 0; i < Vector_Size(res); i++) {
+    TrieSearchResult *e;
+    Vector_Get(res, i, &e);
+    TrieSearchResult_Free(e);
+  }
+  Vector_Free(res);
+
+  TrieType_Free(t);
+  return 0;
+}
+
 TEST_MAIN({
   TESTFUNC(testRuneUtil);
+  TESTFUNC(testLevenshteinAutomaton);
   TESTFUNC(testDFAFilter);
   TESTFUNC(testTrie);
   TESTFUNC(testPayload);
   TESTFUNC(testUnicode);
+  TESTFUNC(testFreeze);
+  TESTFUNC(testBestFirst);
+  TESTFUNC(testSuggestExactMatch);
+  TESTFUNC(testSnapshot);
 });
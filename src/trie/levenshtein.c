@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <sys/param.h>
 #include <string.h>
+#include <pthread.h>
 #include "levenshtein.h"
 #include "rune_util.h"
 
@@ -75,24 +76,7 @@ inline int SparseAutomaton_CanMatch(SparseAutomaton *a, sparseVector *v) {
   return v->len > 0;
 }
 
-dfaNode *__newDfaNode(int distance, sparseVector *state) {
-  dfaNode *ret = calloc(1, sizeof(dfaNode));
-  ret->fallback = NULL;
-  ret->distance = distance;
-  ret->v = state;
-  ret->edges = NULL;
-  ret->numEdges = 0;
-
-  return ret;
-}
-
-void __dfaNode_free(dfaNode *d) {
-  sparseVector_free(d->v);
-  if (d->edges) free(d->edges);
-  free(d);
-}
-
-int __sv_equals(sparseVector *sv1, sparseVector *sv2) {
+static int __sv_equals(sparseVector *sv1, sparseVector *sv2) {
   if (sv1->len != sv2->len) return 0;
 
   for (int i = 0; i < sv1->len; i++) {
@@ -104,171 +88,181 @@ int __sv_equals(sparseVector *sv1, sparseVector *sv2) {
   return 1;
 }
 
-dfaNode *__dfn_getCache(Vector *cache, sparseVector *v) {
-  size_t n = Vector_Size(cache);
-  for (int i = 0; i < n; i++) {
-    dfaNode *dfn;
-    Vector_Get(cache, i, &dfn);
-
-    if (__sv_equals(v, dfn->v)) {
-      return dfn;
+/* Find a state of a universal automaton, or add it if it's new. Returns the state's index */
+static int levAutomaton_getState(LevenshteinAutomaton *a, sparseVector *v, int start) {
+  for (int i = 0; i < a->numStates; i++) {
+    if (a->states[i].start == start && __sv_equals(a->states[i].v, v)) {
+      sparseVector_free(v);
+      return i;
     }
   }
-  return NULL;
-}
 
-void __dfn_putCache(Vector *cache, dfaNode *dfn) {
-  Vector_Push(cache, dfn);
+  size_t numTrans = (a->width + 1) << a->width;
+  a->states = realloc(a->states, (a->numStates + 1) * sizeof(levState));
+  a->trans = realloc(a->trans, (a->numStates + 1) * numTrans * sizeof(levTransition));
+  a->states[a->numStates] = (levState){.v = v,
+                                       .start = start,
+                                       .lastIdx = v->entries[v->len - 1].idx,
+                                       .distance = v->entries[v->len - 1].val};
+  return a->numStates++;
 }
 
-inline dfaNode *__dfn_getEdge(dfaNode *n, rune r) {
-  for (int i = 0; i < n->numEdges; i++) {
-    if (n->edges[i].r == r) {
-      return n->edges[i].n;
-    }
+/* Step a universal automaton state on a characteristic vector, with rem characters left in the
+ * window. This runs the sparse automaton on a string made of the vector, where a 1 stands for a
+ * character equal to the one we step on. States that are not at the start of the string are
+ * shifted by a dummy character, so the automaton does not take them to be there.
+ * Returns the new state, relative to its position, which is put in shift, or NULL if it is a dead
+ * end */
+static sparseVector *levState_step(LevenshteinAutomaton *a, levState *st, int rem, int vec,
+                                   int *shift) {
+  rune str[2 * LEV_MAX_DIST + 2] = {0};
+  int off = st->start ? 0 : 1;
+  for (int i = 0; i < rem; i++) {
+    str[i + off] = (vec >> i) & 1;
   }
-  return NULL;
-}
+  SparseAutomaton sa = NewSparseAutomaton(str, rem + off, a->maxDist);
 
-void __dfn_addEdge(dfaNode *n, rune r, dfaNode *child) {
-  n->edges = realloc(n->edges, sizeof(dfaEdge) * (n->numEdges + 1));
-  n->edges[n->numEdges++] = (dfaEdge){.r = r, .n = child};
+  sparseVector *v = newSparseVectorCap(st->v->len);
+  for (int i = 0; i < st->v->len; i++) {
+    sparseVector_append(&v, st->v->entries[i].idx + off, st->v->entries[i].val);
+  }
+  sparseVector *nv = SparseAutomaton_Step(&sa, v, 1);
+  sparseVector_free(v);
+  if (nv->len == 0) {
+    sparseVector_free(nv);
+    return NULL;
+  }
+
+  *shift = nv->entries[0].idx - off;
+  for (int i = 0; i < nv->len; i++) {
+    nv->entries[i].idx -= *shift + off;
+  }
+  return nv;
 }
 
-void dfa_build(dfaNode *parent, SparseAutomaton *a, Vector *cache) {
-  parent->match = SparseAutomaton_IsMatch(a, parent->v);
-
-  for (int i = 0; i < parent->v->len; i++) {
-    if (parent->v->entries[i].idx < a->len) {
-      rune c = a->string[parent->v->entries[i].idx];
-      // printf("%c ---> ", c);
-      dfaNode *edge = __dfn_getEdge(parent, c);
-      if (edge == NULL) {
-        sparseVector *nv = SparseAutomaton_Step(a, parent->v, c);
-
-        if (nv->len > 0) {
-          dfaNode *dfn = __dfn_getCache(cache, nv);
-          if (dfn == NULL) {
-            int dist = nv->entries[nv->len - 1].val;
-            edge = __newDfaNode(dist, nv);
-            __dfn_addEdge(parent, c, edge);
-            __dfn_putCache(cache, edge);
-            dfa_build(edge, a, cache);
-            continue;
-          } else {
-            __dfn_addEdge(parent, c, dfn);
-          }
+static LevenshteinAutomaton *newLevenshteinAutomaton(int maxDist) {
+  LevenshteinAutomaton *a = calloc(1, sizeof(*a));
+  a->maxDist = maxDist;
+  a->width = 2 * maxDist + 1;
+
+  SparseAutomaton sa = NewSparseAutomaton(NULL, 0, maxDist);
+  levAutomaton_getState(a, SparseAutomaton_Start(&sa), 1);
+
+  // new states are added as we go over the transitions of the ones we have
+  for (int s = 0; s < a->numStates; s++) {
+    for (int rem = 0; rem <= a->width; rem++) {
+      for (int vec = 0; vec < 1 << a->width; vec++) {
+        levTransition *t = &a->trans[((s * (a->width + 1) + rem) << a->width) | vec];
+        *t = (levTransition){.state = -1, .shift = 0};
+        // there are no characters past the end of the string
+        if (vec >> rem) continue;
+
+        int shift;
+        sparseVector *nv = levState_step(a, &a->states[s], rem, vec, &shift);
+        if (nv) {
+          int start = a->states[s].start && shift == 0;
+          int ns = levAutomaton_getState(a, nv, start);
+          // the transitions may have moved with the new state
+          t = &a->trans[((s * (a->width + 1) + rem) << a->width) | vec];
+          *t = (levTransition){.state = ns, .shift = shift};
         }
-        sparseVector_free(nv);
       }
     }
   }
+  return a;
+}
 
-  // if (parent->distance < a->max) {
-  sparseVector *nv = SparseAutomaton_Step(a, parent->v, 1);
-
-  if (nv->len > 0) {
-    dfaNode *dfn = __dfn_getCache(cache, nv);
-    if (dfn) {
-      parent->fallback = dfn;
-    } else {
-      int dist = nv->entries[nv->len - 1].val;
-      // printf("DEFAULT EDGE! edge %s - dist %d\n", a->string, dist);
-      parent->fallback = __newDfaNode(dist, nv);
-      __dfn_putCache(cache, parent->fallback);
-      dfa_build(parent->fallback, a, cache);
-      return;
-    }
-  }
-  sparseVector_free(nv);
+static LevenshteinAutomaton *levAutomata[LEV_MAX_DIST + 1];
+static pthread_once_t levAutomataOnce = PTHREAD_ONCE_INIT;
 
-  //}
+static void buildLevenshteinAutomata() {
+  for (int i = 0; i <= LEV_MAX_DIST; i++) {
+    levAutomata[i] = newLevenshteinAutomaton(i);
+  }
 }
 
-DFAFilter NewDFAFilter(rune *str, size_t len, int maxDist, int prefixMode) {
-  Vector *cache = NewVector(dfaNode *, 8);
-
-  SparseAutomaton a = NewSparseAutomaton(str, len, maxDist);
+LevenshteinAutomaton *GetLevenshteinAutomaton(int maxDist) {
+  pthread_once(&levAutomataOnce, buildLevenshteinAutomata);
+  return levAutomata[MIN(maxDist, LEV_MAX_DIST)];
+}
 
-  sparseVector *v = SparseAutomaton_Start(&a);
-  dfaNode *dr = __newDfaNode(0, v);
-  __dfn_putCache(cache, dr);
-  dfa_build(dr, &a, cache);
+/* An entry in the stack of a DFA filter. A state of -1 means we're in prefix mode, and we're done
+ * matching our prefix */
+typedef struct {
+  int state;
+  int pos;
+  int minDist;
+} dfaStackEntry;
 
+DFAFilter NewDFAFilter(rune *str, size_t len, int maxDist, int prefixMode) {
   DFAFilter ret;
-  ret.cache = cache;
-  ret.stack = NewVector(dfaNode *, 8);
-  ret.distStack = NewVector(int, 8);
-  ret.a = a;
+  ret.a = GetLevenshteinAutomaton(maxDist);
+  ret.str = malloc(sizeof(rune) * (len + 1));
+  memcpy(ret.str, str, sizeof(rune) * len);
+  ret.len = len;
+  ret.stack = NewVector(dfaStackEntry, 8);
   ret.prefixMode = prefixMode;
-  Vector_Push(ret.stack, dr);
-  Vector_Push(ret.distStack, (maxDist + 1));
+  dfaStackEntry root = {.state = 0, .pos = 0, .minDist = ret.a->maxDist + 1};
+  __vector_PushPtr(ret.stack, &root);
 
   return ret;
 }
 
 void DFAFilter_Free(DFAFilter *fc) {
-  for (int i = 0; i < Vector_Size(fc->cache); i++) {
-    dfaNode *dn;
-    Vector_Get(fc->cache, i, &dn);
-
-    if (dn) __dfaNode_free(dn);
-  }
-
-  Vector_Free(fc->cache);
+  free(fc->str);
   Vector_Free(fc->stack);
-  Vector_Free(fc->distStack);
 }
 
 FilterCode FilterFunc(rune b, void *ctx, int *matched, void *matchCtx) {
   DFAFilter *fc = ctx;
-  dfaNode *dn;
-  int minDist;
-
-  Vector_Get(fc->stack, Vector_Size(fc->stack) - 1, &dn);
-  Vector_Get(fc->distStack, Vector_Size(fc->distStack) - 1, &minDist);
+  LevenshteinAutomaton *a = fc->a;
+  dfaStackEntry cur;
+  Vector_Get(fc->stack, Vector_Size(fc->stack) - 1, &cur);
 
-  // a null node means we're in prefix mode, and we're done matching our prefix
-  if (dn == NULL) {
+  // we're in prefix mode, and we're done matching our prefix
+  if (cur.state < 0) {
     *matched = 1;
-    Vector_Push(fc->stack, NULL);
-    Vector_Push(fc->distStack, minDist);
+    __vector_PushPtr(fc->stack, &cur);
     return F_CONTINUE;
   }
 
-  *matched = dn->match;
+  levState *st = &a->states[cur.state];
+  int rem = MIN((int)fc->len - cur.pos, a->width);
+  *matched = st->lastIdx == rem;
 
   if (*matched) {
-    // printf("MATCH %c, dist %d\n", b, dn->distance);
     int *pdist = matchCtx;
     if (pdist) {
-      *pdist = MIN(dn->distance, minDist);
+      *pdist = MIN(st->distance, cur.minDist);
     }
   }
 
   rune foldedRune = runeFold(b);
 
-  // get the next state change
-  dfaNode *next = __dfn_getEdge(dn, foldedRune);
-  if (!next) next = dn->fallback;
+  // get the next state change from the characteristic vector of the rune
+  int vec = 0;
+  for (int i = 0; i < rem; i++) {
+    if (fc->str[cur.pos + i] == foldedRune) vec |= 1 << i;
+  }
+  levTransition t = a->trans[((cur.state * (a->width + 1) + rem) << a->width) | vec];
 
   // we can continue - push the state on the stack
-  if (next) {
-    if (next->match) {
-      // printf("MATCH NEXT %c, dist %d\n", b, next->distance);
+  if (t.state >= 0) {
+    dfaStackEntry next = {.state = t.state, .pos = cur.pos + t.shift};
+    levState *nst = &a->states[t.state];
+    if (nst->lastIdx == MIN((int)fc->len - next.pos, a->width)) {
       *matched = 1;
       int *pdist = matchCtx;
       if (pdist) {
-        *pdist = MIN(next->distance, minDist);
+        *pdist = MIN(nst->distance, cur.minDist);
       }
-      //    if (fc->prefixMode) next = NULL;
     }
-    Vector_Push(fc->stack, next);
-    Vector_Push(fc->distStack, MIN(next->distance, minDist));
+    next.minDist = MIN(nst->distance, cur.minDist);
+    __vector_PushPtr(fc->stack, &next);
     return F_CONTINUE;
   } else if (fc->prefixMode && *matched) {
-    Vector_Push(fc->stack, NULL);
-    Vector_Push(fc->distStack, minDist);
+    cur.state = -1;
+    __vector_PushPtr(fc->stack, &cur);
     return F_CONTINUE;
   }
 
@@ -280,6 +274,5 @@ void StackPop(void *ctx, int numLevels) {
 
   for (int i = 0; i < numLevels; i++) {
     Vector_Pop(fc->stack, NULL);
-    Vector_Pop(fc->distStack, NULL);
   }
 }
@@ -11,8 +11,9 @@
 * sparse vectors, as described and implemented here:
 * http://julesjacobs.github.io/2015/06/17/disqus-levenshtein-simple-and-fast.html
 *
-* We then convert the automaton to a simple DFA that is faster to evaluate during the query stage.
-* This DFA is used while traversing a Trie to decide where to stop.
+* The automaton is used to build universal automata, which are turned into DFAs that are faster to
+* evaluate during the query stage, and are shared by all queries. These are used while traversing
+* a Trie to decide where to stop.
 */
 typedef struct {
     const rune *string;
@@ -20,34 +21,6 @@ typedef struct {
     int max;
 } SparseAutomaton;
 
-struct dfaEdge; 
-
-/* dfaNode is DFA graph node constructed using the Levenshtein automaton */
-typedef struct dfaNode {
-    int distance;
-
-    int match;
-    sparseVector *v;
-    struct dfaEdge *edges;
-    size_t numEdges;
-    struct dfaNode *fallback;
-} dfaNode;
-
-typedef struct dfaEdge {
-    dfaNode *n;
-    rune r;
-} dfaEdge;
-
-/* Get an edge for a dfa node given the next rune */
-dfaNode *__dfn_getEdge(dfaNode *n, rune r);
-
-
-/* Create a new DFA node */
-dfaNode *__newDfaNode(int distance, sparseVector *state);
-
-/* Recusively build the DFA node and all its descendants */
-void dfa_build(dfaNode *parent, SparseAutomaton *a, Vector *cache);
-
 /* Create a new Sparse Levenshtein Automaton  for string s and length len, with a maximal edit
  * distance of maxEdits */
 SparseAutomaton NewSparseAutomaton(const rune *s, size_t len, int maxEdits);
@@ -64,23 +37,64 @@ int SparseAutomaton_IsMatch(SparseAutomaton *a, sparseVector *v);
 /* Can the current state lead to a possible match, or is this a dead end? */
 int SparseAutomaton_CanMatch(SparseAutomaton *a, sparseVector *v);
 
-/* DFAFilter is a constructed DFA used to filter the traversal on the trie */
+/* The maximal edit distance of the universal automata, and of a DFAFilter */
+#define LEV_MAX_DIST 2
+
+/* The transition of a universal automaton state on a characteristic vector. A state of -1 is a
+ * dead end */
+typedef struct {
+    int16_t state;
+    uint8_t shift;
+} levTransition;
+
+/* A state of a universal automaton - a state of the sparse automaton, with its indexes relative to
+ * the position of the state in the string */
 typedef struct {
-    // a cache of the DFA states, allowing us to re-use the same state whenever we need it
-    Vector *cache;
-    // A stack of the states leading up to the current state
+    sparseVector *v;
+    // whether the state is at the start of the string
+    int start;
+    // the relative index of the state's last entry, and the distance it stands for
+    int lastIdx;
+    int distance;
+} levState;
+
+/* A universal (parametric) Levenshtein automaton, as described by Schulz & Mihov. It is independent
+ * of the query string, so it is built once for each maximal distance, and shared by all queries.
+ *
+ * A state only looks at the next 2*maxDist+1 characters of the string from its position. Stepping
+ * on a character c depends on the characteristic vector of c in this window, whose i-th bit tells
+ * whether the i-th character equals c, and on how many characters are left in the window. The
+ * transition gives the next state, and how far it moves along the string */
+typedef struct {
+    int maxDist;
+    // the window size, 2*maxDist+1
+    int width;
+    size_t numStates;
+    levState *states;
+    // numStates * (width+1) * 2^width transitions, by state, remaining length and vector
+    levTransition *trans;
+} LevenshteinAutomaton;
+
+/* Get the shared universal automaton of maxDist, building it on first use */
+LevenshteinAutomaton *GetLevenshteinAutomaton(int maxDist);
+
+/* DFAFilter runs a universal Levenshtein automaton on a string, used to filter the traversal on
+ * the trie */
+typedef struct {
+    LevenshteinAutomaton *a;
+    // a copy of the filter's string
+    rune *str;
+    size_t len;
+    // A stack of the states leading up to the current state, with their positions in the string
+    // and the minimal distance leading to them, used for prefix matching
     Vector *stack;
-    // A stack of the minimal distance for each state, used for prefix matching
-    Vector *distStack;
     // whether the filter works in prefix mode or not
     int prefixMode;
-
-    SparseAutomaton a;
 } DFAFilter;
 
 /* Create a new DFA filter  using a Levenshtein automaton, for the given string  and maximum
- * distance. If prefixMode is 1, we match prefixes within the given distance, and then continue
- * onwards to all suffixes. */
+ * distance, of up to LEV_MAX_DIST. If prefixMode is 1, we match prefixes within the given distance,
+ * and then continue onwards to all suffixes. */
 DFAFilter NewDFAFilter(rune *str, size_t len, int maxDist, int prefixMode);
 
 /* A callback function for the DFA Filter, passed to the Trie iterator */
@@ -9,42 +9,198 @@ size_t __triePayload_Sizeof(uint32_t len) {
 }
 
 size_t __trieNode_Sizeof(t_len numChildren, t_len slen) {
-  return sizeof(TrieNode) + numChildren * sizeof(TrieNode *) + sizeof(rune) * (slen + 1);
+  return sizeof(TrieNode) + numChildren * sizeof(TrieNode *) + slen;
 }
 
-TriePayload *triePayload_New(const char *payload, uint32_t plen);
+/* The allocated size of a node that is not frozen, including its payload */
+static size_t trieNode_allocSize(TrieNode *n) {
+  TriePayload *p = __trieNode_payload(n);
+  return __trieNode_Sizeof(n->numChildren, n->len) + (p ? __triePayload_Sizeof(p->len) : 0);
+}
 
-// Allocate a new trie payload struct
-inline TriePayload *triePayload_New(const char *payload, uint32_t plen) {
+/* The number of bytes of a utf-8 character, by its first byte */
+static inline int utf8_charLen(unsigned char c) {
+  if (c < 0x80) return 1;
+  if (c < 0xE0) return 2;
+  if (c < 0xF0) return 3;
+  return 4;
+}
 
-  TriePayload *p = malloc(sizeof(TriePayload) + sizeof(char) * (plen + 1));
-  p->len = plen;
-  memcpy(p->data, payload, sizeof(char) * plen);
-  return p;
+#define utf8_isContinuation(c) (((c)&0xC0) == 0x80)
+
+/* Encode runes as utf-8 into buf, which must have room for 4 bytes per rune. Returns the encoded
+ * length */
+static t_len utf8_encode(const rune *str, t_len len, unsigned char *buf) {
+  unsigned char *p = buf;
+  for (t_len i = 0; i < len; i++) {
+    uint32_t r = str[i];
+    if (r < 0x80) {
+      *p++ = r;
+    } else if (r < 0x800) {
+      *p++ = 0xC0 | (r >> 6);
+      *p++ = 0x80 | (r & 0x3F);
+    } else if (r < 0x10000) {
+      *p++ = 0xE0 | (r >> 12);
+      *p++ = 0x80 | ((r >> 6) & 0x3F);
+      *p++ = 0x80 | (r & 0x3F);
+    } else {
+      *p++ = 0xF0 | (r >> 18);
+      *p++ = 0x80 | ((r >> 12) & 0x3F);
+      *p++ = 0x80 | ((r >> 6) & 0x3F);
+      *p++ = 0x80 | (r & 0x3F);
+    }
+  }
+  return p - buf;
 }
 
-TrieNode *__newTrieNode(rune *str, t_len offset, t_len len, const char *payload, size_t plen,
-                        t_len numChildren, float score, int terminal) {
-  TrieNode *n = calloc(1, __trieNode_Sizeof(numChildren, len - offset));
-  n->len = len - offset;
+/* Decode the utf-8 character at str, setting n to its byte length */
+static inline rune utf8_decode(const unsigned char *str, int *n) {
+  *n = utf8_charLen(*str);
+  switch (*n) {
+    case 1:
+      return str[0];
+    case 2:
+      return ((str[0] & 0x1F) << 6) | (str[1] & 0x3F);
+    case 3:
+      return ((str[0] & 0x0F) << 12) | ((str[1] & 0x3F) << 6) | (str[2] & 0x3F);
+    default:
+      return ((str[0] & 0x07) << 18) | ((str[1] & 0x3F) << 12) | ((str[2] & 0x3F) << 6) |
+             (str[3] & 0x3F);
+  }
+}
+
+/* Does the string of a child node start with the character at str */
+static inline int trieNode_startsWith(TrieNode *n, const unsigned char *str) {
+  return memcmp(n->str, str, utf8_charLen(*str)) == 0;
+}
+
+static TrieNode *trieNode_new(const unsigned char *str, t_len len, const char *payload,
+                              size_t plen, t_len numChildren, float score, int terminal) {
+  int hasPayload = payload != NULL && plen > 0;
+  size_t size = __trieNode_Sizeof(numChildren, len) + (hasPayload ? __triePayload_Sizeof(plen) : 0);
+  TrieNode *n = calloc(1, size);
+  n->len = len;
   n->numChildren = numChildren;
   n->score = score;
-  n->flags = 0 | (terminal ? TRIENODE_TERMINAL : 0);
-  n->maxChildScore = 0; 
-  memcpy(n->str, str + offset, sizeof(rune) * (len - offset));
-  if (payload != NULL && plen > 0) {
-    n->payload = triePayload_New(payload, plen);
+  n->flags = 0 | (terminal ? TRIENODE_TERMINAL : 0) | (hasPayload ? TRIENODE_PAYLOAD : 0);
+  n->maxChildScore = 0;
+  memcpy(n->str, str, len);
+  if (hasPayload) {
+    TriePayload *p = __trieNode_payload(n);
+    p->len = plen;
+    memcpy(p->data, payload, sizeof(char) * plen);
   }
   return n;
 }
 
-TrieNode *__trie_AddChild(TrieNode *n, rune *str, t_len offset, t_len len, RSPayload *payload,
-                          float score) {
+TrieNode *__newTrieNode(rune *str, t_len offset, t_len len, const char *payload, size_t plen,
+                        t_len numChildren, float score, int terminal) {
+  unsigned char buf[(len - offset) * 4 + 1];
+  t_len blen = utf8_encode(str + offset, len - offset, buf);
+  return trieNode_new(buf, blen, payload, plen, numChildren, score, terminal);
+}
+
+/* Copy a frozen node out of its block, so that it can be changed. The node's children stay
+ * frozen. Nodes that are not frozen are returned as is */
+static TrieNode *trieNode_thaw(TrieNode *n) {
+  if (!__trieNode_isFrozen(n)) return n;
+
+  TriePayload *p = __trieNode_payload(n);
+  TrieNode *ret = trieNode_new(n->str, n->len, p ? p->data : NULL, p ? p->len : 0, n->numChildren,
+                               n->score, 0);
+  ret->flags = n->flags & ~TRIENODE_FROZEN;
+  ret->maxChildScore = n->maxChildScore;
+  for (t_len i = 0; i < n->numChildren; i++) {
+    __trieNode_children(ret)[i] = __trieNode_child(n, i);
+  }
+  return ret;
+}
+
+/* Free a single node the trie no longer links to. Readers of a shared trie may still see it, so
+ * it is retired instead */
+static void trieNode_release(TrieNode *n, TrieRetireFunc retire) {
+  if (__trieNode_isFrozen(n)) return;
+  if (retire) {
+    retire(n);
+  } else {
+    free(n);
+  }
+}
+
+/* Copy a node of a shared trie so that it can be changed, retiring the original */
+static TrieNode *trieNode_copy(TrieNode *n, TrieRetireFunc retire) {
+  if (__trieNode_isFrozen(n)) return trieNode_thaw(n);
+
+  size_t size = trieNode_allocSize(n);
+  TrieNode *ret = malloc(size);
+  memcpy(ret, n, size);
+  retire(n);
+  return ret;
+}
+
+/* Copy the nodes on the way to str, which are the only ones adding or deleting it changes in
+ * place. Their children stay shared with the original nodes */
+static void trieNode_copyPath(TrieNode **np, const unsigned char *str, t_len len,
+                              TrieRetireFunc retire) {
+  t_len offset = 0;
+  while (np) {
+    TrieNode *n = *np = trieNode_copy(*np, retire);
+    t_len i = 0;
+    for (; i < n->len && offset < len && n->str[i] == str[offset]; i++, offset++)
+      ;
+    if (i < n->len || offset == len) return;
+
+    np = NULL;
+    for (t_len c = 0; c < n->numChildren; c++) {
+      if (trieNode_startsWith(__trieNode_children(n)[c], str + offset)) {
+        np = &__trieNode_children(n)[c];
+        break;
+      }
+    }
+  }
+}
+
+/* Replace the payload of a node, returning the node, which may have moved */
+static TrieNode *trieNode_setPayload(TrieNode *n, RSPayload *payload) {
+  int hasPayload = payload != NULL && payload->data != NULL && payload->len > 0;
+  TriePayload *p = __trieNode_payload(n);
+  if (!p && !hasPayload) return n;
+  // a payload of the same length is just overwritten, even in a frozen node
+  if (p && hasPayload && p->len == payload->len) {
+    memcpy(p->data, payload->data, sizeof(char) * p->len);
+    return n;
+  }
+
+  n = trieNode_thaw(n);
+  n->flags &= ~TRIENODE_PAYLOAD;
+  size_t size = __trieNode_Sizeof(n->numChildren, n->len);
+  if (hasPayload) {
+    n = realloc(n, size + __triePayload_Sizeof(payload->len));
+    n->flags |= TRIENODE_PAYLOAD;
+    p = __trieNode_payload(n);
+    p->len = payload->len;
+    memcpy(p->data, payload->data, sizeof(char) * p->len);
+  } else {
+    n = realloc(n, size);
+  }
+  return n;
+}
+
+TrieNode *__trie_AddChild(TrieNode *n, const unsigned char *str, t_len offset, t_len len,
+                          RSPayload *payload, float score) {
+  n = trieNode_thaw(n);
+  TriePayload *p = __trieNode_payload(n);
+  size_t psize = p ? __triePayload_Sizeof(p->len) : 0;
   n->numChildren++;
-  n = realloc((void *)n, __trieNode_Sizeof(n->numChildren, n->len));
+  n = realloc((void *)n, __trieNode_Sizeof(n->numChildren, n->len) + psize);
+  // the payload comes after the children, so it moves up to make room for the new child
+  if (psize) {
+    p = __trieNode_payload(n);
+    memmove(p, (char *)p - sizeof(TrieNode *), psize);
+  }
   // a newly added child must be a terminal node
-  TrieNode *child = __newTrieNode(str, offset, len, payload ? payload->data : NULL,
-                                  payload ? payload->len : 0, 0, score, 1);
+  TrieNode *child = trieNode_new(str + offset, len - offset, payload ? payload->data : NULL,
+                                 payload ? payload->len : 0, 0, score, 1);
   __trieNode_children(n)[n->numChildren - 1] = child;
   n->flags &= ~TRIENODE_SORTED;  // the node is now not sorted
 
@@ -52,10 +208,13 @@ TrieNode *__trie_AddChild(TrieNode *n, rune *str, t_len offset, t_len len, RSPay
 }
 
 TrieNode *__trie_SplitNode(TrieNode *n, t_len offset) {
+  n = trieNode_thaw(n);
+
   // Copy the current node's data and children to a new child node
-  TrieNode *newChild = __newTrieNode(n->str, offset, n->len, n->payload ? n->payload->data : NULL,
-                                     n->payload ? n->payload->len : 0, n->numChildren, n->score,
-                                     __trieNode_isTerminal(n));
+  TriePayload *p = __trieNode_payload(n);
+  TrieNode *newChild = trieNode_new(n->str + offset, n->len - offset, p ? p->data : NULL,
+                                    p ? p->len : 0, n->numChildren, n->score,
+                                    __trieNode_isTerminal(n));
   newChild->maxChildScore = n->maxChildScore;
   newChild->flags = n->flags;
   TrieNode **children = __trieNode_children(n);
@@ -66,80 +225,73 @@ TrieNode *__trie_SplitNode(TrieNode *n, t_len offset) {
   n->numChildren = 1;
   n->len = offset;
   n->score = 0;
-  // the parent node is now non terminal and non sorted
-  n->flags &= ~(TRIENODE_SORTED | TRIENODE_TERMINAL | TRIENODE_DELETED);
+  // the parent node is now non terminal and non sorted, and has no payload
+  n->flags &= ~(TRIENODE_SORTED | TRIENODE_TERMINAL | TRIENODE_DELETED | TRIENODE_PAYLOAD);
 
   n->maxChildScore = MAX(n->maxChildScore, newChild->score);
-  if (n->payload != NULL) {
-    free(n->payload);
-    n->payload = NULL;
-  }
   n = realloc(n, __trieNode_Sizeof(n->numChildren, n->len));
   __trieNode_children(n)[0] = newChild;
 
   return n;
 }
 
-/* If a node has a single child after delete, we can merged them. This deletes
- * the node and returns a newly allocated node */
-TrieNode *__trieNode_MergeWithSingleChild(TrieNode *n) {
+static TrieNode *trieNode_mergeWithSingleChild(TrieNode *n, TrieRetireFunc retire) {
 
   if (__trieNode_isTerminal(n) || n->numChildren != 1) {
     return n;
   }
-  TrieNode *ch = *__trieNode_children(n);
+  TrieNode *ch = __trieNode_child(n, 0);
 
   // Copy the current node's data and children to a new child node
-  rune nstr[n->len + ch->len + 1];
-  memcpy(nstr, n->str, sizeof(rune) * n->len);
-  memcpy(&nstr[n->len], ch->str, sizeof(rune) * ch->len);
-  TrieNode *merged = __newTrieNode(
-      nstr, 0, n->len + ch->len, ch->payload ? ch->payload->data : NULL,
-      ch->payload ? ch->payload->len : 0, ch->numChildren, ch->score, __trieNode_isTerminal(ch));
+  unsigned char nstr[n->len + ch->len + 1];
+  memcpy(nstr, n->str, n->len);
+  memcpy(&nstr[n->len], ch->str, ch->len);
+  TriePayload *p = __trieNode_payload(ch);
+  TrieNode *merged =
+      trieNode_new(nstr, n->len + ch->len, p ? p->data : NULL, p ? p->len : 0, ch->numChildren,
+                   ch->score, __trieNode_isTerminal(ch));
   merged->maxChildScore = ch->maxChildScore;
   merged->numChildren = ch->numChildren;
-  merged->flags = ch->flags;
-  TrieNode **children = __trieNode_children(ch);
-  TrieNode **newChildren = __trieNode_children(merged);
-  memcpy(newChildren, children, sizeof(TrieNode *) * merged->numChildren);
-  if (ch->payload) {
-    free(ch->payload);
-    ch->payload = NULL;
-  }
-  if (n->payload != NULL) {
-    free(n->payload);
-    n->payload = NULL;
+  merged->flags = ch->flags & ~TRIENODE_FROZEN;
+  for (t_len i = 0; i < merged->numChildren; i++) {
+    __trieNode_children(merged)[i] = __trieNode_child(ch, i);
   }
-  free(n);
-  free(ch);
+  trieNode_release(n, retire);
+  trieNode_release(ch, retire);
 
   return merged;
 }
 
+/* If a node has a single child after delete, we can merged them. This deletes
+ * the node and returns a newly allocated node */
+TrieNode *__trieNode_MergeWithSingleChild(TrieNode *n) {
+  return trieNode_mergeWithSingleChild(n, NULL);
+}
+
 void TrieNode_Print(TrieNode *n, int idx, int depth) {
   for (int i = 0; i < depth; i++) {
     printf("  ");
   }
   printf("%d) Score %f, max ChildScore %f\n", idx, n->score, n->maxChildScore);
   for (int i = 0; i < n->numChildren; i++) {
-    TrieNode_Print(__trieNode_children(n)[i], i, depth + 1);
+    TrieNode_Print(__trieNode_child(n, i), i, depth + 1);
   }
 }
 
-int TrieNode_Add(TrieNode **np, rune *str, t_len len, RSPayload *payload, float score,
-                 TrieAddOp op) {
-  if (score == 0 || len == 0) {
-    return 0;
-  }
-
+static int trieNode_add(TrieNode **np, const unsigned char *str, t_len len, RSPayload *payload,
+                        float score, TrieAddOp op) {
   TrieNode *n = *np;
 
-  int offset = 0;
+  t_len offset = 0;
   for (; offset < len && offset < n->len; offset++) {
     if (str[offset] != n->str[offset]) {
       break;
     }
   }
+  // nodes are only split at character boundaries
+  while (offset > 0 && offset < n->len && utf8_isContinuation(n->str[offset])) {
+    offset--;
+  }
   // we broke off before the end of the string
   if (offset < n->len) {
     // split the node and create 2 child nodes:
@@ -153,16 +305,7 @@ int TrieNode_Add(TrieNode **np, rune *str, t_len len, RSPayload *payload, float
     if (offset == len) {
       n->score = score;
       n->flags |= TRIENODE_TERMINAL;
-      TrieNode *newChild = __trieNode_children(n)[0];
-      n = realloc(n, __trieNode_Sizeof(n->numChildren, n->len));
-      if (n->payload != NULL) {
-        free(n->payload);
-        n->payload = NULL;
-      }
-      if (payload != NULL && payload->data != NULL && payload->len > 0) {
-        n->payload = triePayload_New(payload->data, payload->len);
-      }
-      __trieNode_children(n)[0] = newChild;
+      n = trieNode_setPayload(n, payload);
     } else {
       // we add a child
       n = __trie_AddChild(n, str, offset, len, payload, score);
@@ -188,23 +331,8 @@ int TrieNode_Add(TrieNode **np, rune *str, t_len len, RSPayload *payload, float
       case ADD_REPLACE:
       default:
         n->score = score;
-    }    
-    if (n->payload != NULL) {
-      free(n->payload);
-      n->payload = NULL;
-    }
-    if (payload != NULL && payload->data != NULL && payload->len > 0) {
-      n->payload = calloc(1, __triePayload_Sizeof(payload->len));
-      n->payload->len = payload->len;
-      memcpy(n->payload->data, payload->data, sizeof(char)*n->payload->len);  
-    }
-    if (n->payload != NULL) {
-      free(n->payload);
-      n->payload = NULL;
-    }
-    if (payload != NULL && payload->data != NULL && payload->len > 0) {
-      n->payload = triePayload_New(payload->data, payload->len);
     }
+    n = trieNode_setPayload(n, payload);
     // set the node as terminal
     n->flags |= TRIENODE_TERMINAL;
     // if it was deleted, make sure it's not now
@@ -213,12 +341,18 @@ int TrieNode_Add(TrieNode **np, rune *str, t_len len, RSPayload *payload, float
     return (term && !deleted) ? 0 : 1;
   }
 
-  // proceed to the next child or add a new child for the current rune
+  // proceed to the next child or add a new child for the current character
   for (t_len i = 0; i < n->numChildren; i++) {
-    TrieNode *child = __trieNode_children(n)[i];
-    if (str[offset] == child->str[0]) {
-      int rc = TrieNode_Add(&child, str + offset, len - offset, payload, score, op);
-      __trieNode_children(n)[i] = child;
+    TrieNode *child = __trieNode_child(n, i);
+    if (trieNode_startsWith(child, str + offset)) {
+      TrieNode *old = child;
+      int rc = trieNode_add(&child, str + offset, len - offset, payload, score, op);
+      // a frozen node is copied out of its block only if the child has moved
+      if (child != old) {
+        n = trieNode_thaw(n);
+        __trieNode_children(n)[i] = child;
+        *np = n;
+      }
       return rc;
     }
   }
@@ -226,7 +360,33 @@ int TrieNode_Add(TrieNode **np, rune *str, t_len len, RSPayload *payload, float
   return 1;
 }
 
-float TrieNode_Find(TrieNode *n, rune *str, t_len len) {
+int TrieNode_Add(TrieNode **np, rune *str, t_len len, RSPayload *payload, float score,
+                 TrieAddOp op) {
+  if (score == 0 || len == 0) {
+    return 0;
+  }
+
+  unsigned char buf[len * 4];
+  t_len blen = utf8_encode(str, len, buf);
+  return trieNode_add(np, buf, blen, payload, score, op);
+}
+
+int TrieNode_AddShared(TrieNode **np, rune *str, t_len len, RSPayload *payload, float score,
+                       TrieAddOp op, TrieRetireFunc retire) {
+  if (score == 0 || len == 0) {
+    return 0;
+  }
+
+  unsigned char buf[len * 4];
+  t_len blen = utf8_encode(str, len, buf);
+  trieNode_copyPath(np, buf, blen, retire);
+  return trieNode_add(np, buf, blen, payload, score, op);
+}
+
+float TrieNode_Find(TrieNode *n, rune *rstr, t_len rlen) {
+  unsigned char str[rlen * 4 + 1];
+  t_len len = utf8_encode(rstr, rlen, str);
+
   t_len offset = 0;
   while (n && offset < len) {
     // printf("n %.*s offset %d, len %d\n", n->len, n->str, offset,
@@ -248,9 +408,9 @@ float TrieNode_Find(TrieNode *n, rune *str, t_len len) {
       t_len i = 0;
       TrieNode *nextChild = NULL;
       for (; i < n->numChildren; i++) {
-        TrieNode *child = __trieNode_children(n)[i];
+        TrieNode *child = __trieNode_child(n, i);
 
-        if (str[offset] == child->str[0]) {
+        if (trieNode_startsWith(child, str + offset)) {
           nextChild = child;
           break;
         }
@@ -273,10 +433,12 @@ void __trieNode_sortChildren(TrieNode *n);
 *   1. If a child should be deleted - delete it and reduce the child count
 *   2. If a child has a single child - merge them
 *   3. recalculate the max child score
+* The node itself must not be frozen
 */
-void __trieNode_optimizeChildren(TrieNode *n) {
+static void trieNode_optimizeChildren(TrieNode *n, TrieRetireFunc retire) {
 
   int i = 0;
+  t_len numChildren = n->numChildren;
   TrieNode **nodes = __trieNode_children(n);
   n->maxChildScore = n->score;
   // free deleted terminal nodes
@@ -284,7 +446,7 @@ void __trieNode_optimizeChildren(TrieNode *n) {
 
     // if this is a deleted node with no children - remove it
     if (nodes[i]->numChildren == 0 && __trieNode_isDeleted(nodes[i])) {
-      TrieNode_Free(nodes[i]);
+      trieNode_release(nodes[i], retire);
 
       nodes[i] = NULL;
       // just "fill" the hole with the next node up
@@ -300,19 +462,32 @@ void __trieNode_optimizeChildren(TrieNode *n) {
       // this node is ok!
       // if needed - merge this node with it its single child
       if (nodes[i] && nodes[i]->numChildren == 1) {
-        nodes[i] = __trieNode_MergeWithSingleChild(nodes[i]);
+        nodes[i] = trieNode_mergeWithSingleChild(nodes[i], retire);
       }
       n->maxChildScore = MAX(n->maxChildScore, nodes[i]->maxChildScore);
     }
     i++;
   }
 
+  // the payload follows the children, so it moves down over the removed ones
+  TriePayload *p = __trieNode_payload(n);
+  if (p && numChildren != n->numChildren) {
+    TriePayload *old = (TriePayload *)&nodes[numChildren];
+    memmove(p, old, __triePayload_Sizeof(old->len));
+  }
+
   __trieNode_sortChildren(n);
 }
 
-int TrieNode_Delete(TrieNode *n, rune *str, t_len len) {
+void __trieNode_optimizeChildren(TrieNode *n) {
+  trieNode_optimizeChildren(n, NULL);
+}
+
+static int trieNode_delete(TrieNode *n, const unsigned char *str, t_len len,
+                           TrieRetireFunc retire) {
   t_len offset = 0;
   static TrieNode *stack[MAX_STRING_LEN];
+  static t_len childIdx[MAX_STRING_LEN];
   int stackPos = 0;
   int rc = 0;
   while (n && offset < len) {
@@ -329,6 +504,14 @@ int TrieNode_Delete(TrieNode *n, rune *str, t_len len) {
       // this means we've found what we're looking for
       if (localOffset == n->len) {
         if (!(n->flags & TRIENODE_DELETED)) {
+          // frozen nodes on the way are copied out of their block, as they are about to change
+          for (int j = 1; j < stackPos; j++) {
+            if (__trieNode_isFrozen(stack[j])) {
+              stack[j] = trieNode_thaw(stack[j]);
+              __trieNode_children(stack[j - 1])[childIdx[j]] = stack[j];
+            }
+          }
+          n = stack[stackPos - 1];
 
           n->flags |= TRIENODE_DELETED;
           n->flags &= ~TRIENODE_TERMINAL;
@@ -344,10 +527,11 @@ int TrieNode_Delete(TrieNode *n, rune *str, t_len len) {
       t_len i = 0;
       TrieNode *nextChild = NULL;
       for (; i < n->numChildren; i++) {
-        TrieNode *child = __trieNode_children(n)[i];
+        TrieNode *child = __trieNode_child(n, i);
 
-        if (str[offset] == child->str[0]) {
+        if (trieNode_startsWith(child, str + offset)) {
           nextChild = child;
+          childIdx[stackPos] = i;
           break;
         }
       }
@@ -363,23 +547,104 @@ int TrieNode_Delete(TrieNode *n, rune *str, t_len len) {
 end:
 
   while (stackPos--) {
-    __trieNode_optimizeChildren(stack[stackPos]);
+    if (!__trieNode_isFrozen(stack[stackPos])) {
+      trieNode_optimizeChildren(stack[stackPos], retire);
+    }
   }
   return rc;
 }
 
+int TrieNode_Delete(TrieNode *n, rune *rstr, t_len rlen) {
+  unsigned char str[rlen * 4 + 1];
+  t_len len = utf8_encode(rstr, rlen, str);
+  return trieNode_delete(n, str, len, NULL);
+}
+
+int TrieNode_DeleteShared(TrieNode **np, rune *rstr, t_len rlen, TrieRetireFunc retire) {
+  unsigned char str[rlen * 4 + 1];
+  t_len len = utf8_encode(rstr, rlen, str);
+  trieNode_copyPath(np, str, len, retire);
+  return trieNode_delete(*np, str, len, retire);
+}
+
 void TrieNode_Free(TrieNode *n) {
+  // the descendants of a frozen node are all in its block
+  if (__trieNode_isFrozen(n)) return;
+
   for (t_len i = 0; i < n->numChildren; i++) {
     TrieNode *child = __trieNode_children(n)[i];
     TrieNode_Free(child);
   }
-  if (n->payload != NULL) {
-    free(n->payload);
-    n->payload = NULL;
-  }
   free(n);
 }
 
+size_t TrieNode_MemUsage(TrieNode *n) {
+  if (__trieNode_isFrozen(n)) return 0;
+
+  size_t ret = trieNode_allocSize(n);
+  for (t_len i = 0; i < n->numChildren; i++) {
+    ret += TrieNode_MemUsage(__trieNode_children(n)[i]);
+  }
+  return ret;
+}
+
+/* The size of a node and its descendants once frozen */
+static size_t trieNode_frozenSize(TrieNode *n) {
+  TriePayload *p = __trieNode_payload(n);
+  size_t ret = sizeof(TrieNode) + n->len + n->numChildren * sizeof(uint32_t) +
+               (p ? __triePayload_Sizeof(p->len) : 0);
+  for (t_len i = 0; i < n->numChildren; i++) {
+    ret += trieNode_frozenSize(__trieNode_child(n, i));
+  }
+  return ret;
+}
+
+/* Write a frozen copy of a node and its descendants at buf, the children following their parent
+ * in the order they are iterated. Returns the number of bytes written */
+static size_t trieNode_freezeTo(TrieNode *n, char *buf) {
+  if (!__trieNode_isFrozen(n)) {
+    __trieNode_sortChildren(n);
+  }
+  TrieNode *fn = (TrieNode *)buf;
+  memcpy(fn, n, sizeof(TrieNode) + n->len);
+  fn->flags |= TRIENODE_FROZEN | TRIENODE_SORTED;
+
+  size_t off = sizeof(TrieNode) + n->len + n->numChildren * sizeof(uint32_t);
+  TriePayload *p = __trieNode_payload(n);
+  if (p) {
+    memcpy(buf + off, p, __triePayload_Sizeof(p->len));
+    off += __triePayload_Sizeof(p->len);
+  }
+  for (t_len i = 0; i < n->numChildren; i++) {
+    __trieNode_frozenChildren(fn)[i] = off;
+    off += trieNode_freezeTo(__trieNode_child(n, i), buf + off);
+  }
+  return off;
+}
+
+void *TrieNode_Freeze(TrieNode *n, size_t *blockSize) {
+  *blockSize = 0;
+  if (__trieNode_isFrozen(n) || n->numChildren == 0) return NULL;
+
+  size_t size = 0;
+  for (t_len i = 0; i < n->numChildren; i++) {
+    size += trieNode_frozenSize(__trieNode_children(n)[i]);
+  }
+  if (size > UINT32_MAX) return NULL;
+
+  __trieNode_sortChildren(n);
+  char *block = malloc(size);
+  size_t off = 0;
+  for (t_len i = 0; i < n->numChildren; i++) {
+    TrieNode *child = __trieNode_children(n)[i];
+    __trieNode_children(n)[i] = (TrieNode *)(block + off);
+    off += trieNode_freezeTo(child, block + off);
+    TrieNode_Free(child);
+  }
+  *blockSize = size;
+  return block;
+}
+
 // comparator for node sorting by child max score
 static int __trieNode_Cmp(const void *p1, const void *p2) {
   TrieNode *n1 = *(TrieNode **)p1;
@@ -395,7 +660,8 @@ static int __trieNode_Cmp(const void *p1, const void *p2) {
 
 /* Sort the children of a node by their maxChildScore */
 void __trieNode_sortChildren(TrieNode *n) {
-  if (!(n->flags & TRIENODE_SORTED) && n->numChildren > 1) {
+  // frozen nodes are sorted when they are frozen
+  if (!(n->flags & TRIENODE_SORTED) && n->numChildren > 1 && !__trieNode_isFrozen(n)) {
     qsort(__trieNode_children(n), n->numChildren, sizeof(TrieNode *), __trieNode_Cmp);
   }
   n->flags |= TRIENODE_SORTED;
@@ -407,6 +673,7 @@ inline void __ti_Push(TrieIterator *it, TrieNode *node, int skipped) {
     stackNode *sn = &it->stack[it->stackOffset++];
     sn->childOffset = 0;
     sn->stringOffset = 0;
+    sn->byteOffset = 0;
     sn->isSkipped = skipped;
     sn->n = node;
     sn->state = ITERSTATE_SELF;
@@ -446,9 +713,10 @@ inline int __ti_step(TrieIterator *it, void *matchCtx) {
 
     case ITERSTATE_SELF:
 
-      if (current->stringOffset < current->n->len) {
+      if (current->byteOffset < current->n->len) {
         // get the current rune to feed the filter
-        rune b = current->n->str[current->stringOffset];
+        int blen;
+        rune b = utf8_decode(current->n->str + current->byteOffset, &blen);
 
         if (it->filter) {
           // run the next character in the filter
@@ -470,11 +738,12 @@ inline int __ti_step(TrieIterator *it, void *matchCtx) {
         // advance the buffer offset and character offset
         it->buf[it->bufOffset++] = b;
         current->stringOffset++;
+        current->byteOffset += blen;
 
         // if we don't have a filter, a "match" is when we reach the end of the
         // node
         if (!it->filter) {
-          if (current->n->len > 0 && current->stringOffset == current->n->len &&
+          if (current->n->len > 0 && current->byteOffset == current->n->len &&
               __trieNode_isTerminal(current->n) && !__trieNode_isDeleted(current->n)) {
             matched = 1;
           }
@@ -488,12 +757,14 @@ inline int __ti_step(TrieIterator *it, void *matchCtx) {
 
     case ITERSTATE_CHILDREN:
     default:
-      if (!(current->n->flags & TRIENODE_SORTED)) {
+      // only filtered iterations care for the order of the children. Plain ones, like saving the
+      // trie, never change it, so they are safe while the trie is shared with readers
+      if (it->filter && !(current->n->flags & TRIENODE_SORTED)) {
         __trieNode_sortChildren(current->n);
       }
       // push the next child
       if (current->childOffset < current->n->numChildren) {
-        TrieNode *ch = __trieNode_children(current->n)[current->childOffset++];
+        TrieNode *ch = __trieNode_child(current->n, current->childOffset++);
         if (ch->maxChildScore >= it->minScore || ch->score >= it->minScore) {
           __ti_Push(it, ch, 0);
           it->nodesConsumed++;
@@ -522,26 +793,164 @@ TrieIterator *TrieNode_Iterate(TrieNode *n, StepFilter f, StackPopCallback pf, v
   return it;
 }
 
+/* A node in the frontier of a best-first traversal, with the string up to its end. The string of
+ * its parent is the first parentLen runes of it */
+typedef struct {
+  TrieNode *n;
+  float bound;
+  t_len parentLen;
+  t_len len;
+  rune path[];
+} frontierNode;
+
+// comparator for the frontier, keeping the node with the highest bound on top
+static int __frontierNode_Cmp(const void *p1, const void *p2, const void *udata) {
+  const frontierNode *n1 = p1, *n2 = p2;
+
+  if (n1->bound > n2->bound) {
+    return 1;
+  } else if (n1->bound < n2->bound) {
+    return -1;
+  }
+  return 0;
+}
+
+/* Add a node to the frontier, with the string of its parent. Nodes that cannot beat minScore are
+ * not added */
+static void __ti_pushFrontier(TrieIterator *it, TrieNode *n, const rune *parent, t_len parentLen) {
+  rune path[MAX_STRING_LEN + 1];
+  memcpy(path, parent, parentLen * sizeof(rune));
+  t_len len = parentLen;
+  for (t_len off = 0; off < n->len && len < MAX_STRING_LEN;) {
+    int blen;
+    path[len++] = utf8_decode(n->str + off, &blen);
+    off += blen;
+  }
+
+  float bound = MAX(n->score, n->maxChildScore);
+  if (it->boundCallback) {
+    bound = it->boundCallback(it->boundCtx, path, len, bound);
+  }
+  if (it->minScore > 0 && bound <= it->minScore) {
+    it->nodesSkipped++;
+    return;
+  }
+
+  frontierNode *fn = malloc(sizeof(frontierNode) + len * sizeof(rune));
+  fn->n = n;
+  fn->bound = bound;
+  fn->parentLen = parentLen;
+  fn->len = len;
+  memcpy(fn->path, path, len * sizeof(rune));
+  heap_offer(&it->frontier, fn);
+}
+
+/* Feed the filter with the next rune of the iterator's string. Returns 0 if the filter stops */
+static int __ti_feed(TrieIterator *it, rune r, int *matched, void *matchCtx) {
+  if (it->filter && it->filter(r, it->ctx, matched, matchCtx) == F_STOP) {
+    return 0;
+  }
+  it->buf[it->bufOffset++] = r;
+  return 1;
+}
+
+/* Visit the nodes of a best-first traversal until one matches, returning it, or NULL when we're
+ * done. To visit a node, the filter is rewound to the longest common prefix of the string it has
+ * been fed and the string of the node's parent, and is then fed the rest of the node's string */
+static TrieNode *__ti_nextBestFirst(TrieIterator *it, void *matchCtx) {
+  frontierNode *fn;
+  while ((fn = heap_peek(it->frontier)) && !(it->minScore > 0 && fn->bound <= it->minScore)) {
+    heap_poll(it->frontier);
+    it->nodesConsumed++;
+
+    t_len common = 0;
+    while (common < it->bufOffset && common < fn->parentLen &&
+           it->buf[common] == fn->path[common]) {
+      common++;
+    }
+    if (it->popCallback && it->bufOffset > common) {
+      it->popCallback(it->ctx, it->bufOffset - common);
+    }
+    it->bufOffset = common;
+
+    int matched = 0, stopped = 0;
+    for (t_len i = common; i < fn->len && !stopped; i++) {
+      matched = 0;
+      stopped = !__ti_feed(it, fn->path[i], &matched, matchCtx);
+    }
+
+    TrieNode *n = fn->n;
+    free(fn);
+    if (stopped) continue;
+
+    for (t_len i = 0; i < n->numChildren; i++) {
+      __ti_pushFrontier(it, __trieNode_child(n, i), it->buf, it->bufOffset);
+    }
+    if ((matched || !it->filter) && n->len > 0 && __trieNode_isTerminal(n) &&
+        !__trieNode_isDeleted(n)) {
+      return n;
+    }
+  }
+  return NULL;
+}
+
+TrieIterator *TrieNode_IterateBestFirst(TrieNode *n, StepFilter f, StackPopCallback pf, void *ctx,
+                                        TrieBoundCallback bf, void *boundCtx) {
+  TrieIterator *it = calloc(1, sizeof(TrieIterator));
+  it->filter = f;
+  it->popCallback = pf;
+  it->minScore = 0;
+  it->ctx = ctx;
+  it->boundCallback = bf;
+  it->boundCtx = boundCtx;
+  it->frontier = heap_new(__frontierNode_Cmp, NULL);
+  __ti_pushFrontier(it, n, NULL, 0);
+
+  return it;
+}
+
 void TrieIterator_Free(TrieIterator *it) {
+  if (it->frontier) {
+    frontierNode *fn;
+    while ((fn = heap_poll(it->frontier))) {
+      free(fn);
+    }
+    heap_free(it->frontier);
+  }
   free(it);
 }
 
 int TrieIterator_Next(TrieIterator *it, rune **ptr, t_len *len, RSPayload *payload, float *score,
                       void *matchCtx) {
   int rc;
+  if (it->frontier) {
+    TrieNode *n = __ti_nextBestFirst(it, matchCtx);
+    if (!n) return 0;
+    *ptr = it->buf;
+    *len = it->bufOffset;
+    *score = n->score;
+    if (payload != NULL) {
+      TriePayload *p = __trieNode_payload(n);
+      payload->data = p ? p->data : NULL;
+      payload->len = p ? p->len : 0;
+    }
+    return 1;
+  }
+
   while ((rc = __ti_step(it, matchCtx)) != __STEP_STOP) {
     if (rc == __STEP_MATCH) {
       stackNode *sn = __ti_current(it);
 
-      if (__trieNode_isTerminal(sn->n) && sn->n->len == sn->stringOffset &&
+      if (__trieNode_isTerminal(sn->n) && sn->n->len == sn->byteOffset &&
           !__trieNode_isDeleted(sn->n)) {
         *ptr = it->buf;
         *len = it->bufOffset;
         *score = sn->n->score;
         if (payload != NULL) {
-          if (sn->n->payload != NULL) {
-            payload->data = sn->n->payload->data;
-            payload->len = sn->n->payload->len;
+          TriePayload *p = __trieNode_payload(sn->n);
+          if (p != NULL) {
+            payload->data = p->data;
+            payload->len = p->len;
           } else {
             payload->data = NULL;
             payload->len = 0;
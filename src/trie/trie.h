@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include "rune_util.h"
 #include "redisearch.h"
+#include "../util/heap.h"
 
 typedef uint16_t t_len;
 
@@ -14,6 +15,10 @@ typedef uint16_t t_len;
 #define TRIENODE_SORTED 0x1
 #define TRIENODE_TERMINAL 0x2
 #define TRIENODE_DELETED 0x4
+// the node has a payload, stored after its children
+#define TRIENODE_PAYLOAD 0x8
+// the node is part of a frozen block, see TrieNode_Freeze
+#define TRIENODE_FROZEN 0x10
 
 #pragma pack(1)
 typedef struct {
@@ -26,15 +31,14 @@ typedef struct {
 size_t __triePayload_Sizeof(uint32_t len);
 
 #pragma pack(1)
-/* TrieNode represents a single node in a trie. The actual size of it is bigger,
- * as the children are
- * allocated after str[].
- * Non terminal nodes always have a score of 0, meaning you can't insert nodes
- * with score 0 to the
+/* TrieNode represents a single node in a trie. The actual size of it is bigger, as the node's
+ * string, its children and its payload are allocated after it, in a single allocation.
+ * The string of the node is kept utf-8 encoded, and is always split at character boundaries.
+ * Non terminal nodes always have a score of 0, meaning you can't insert nodes with score 0 to the
  * trie.
  */
 typedef struct {
-  // the string length of this node. can be 0
+  // the byte length of the node's string. can be 0
   t_len len;
   // the number of child nodes
   t_len numChildren;
@@ -48,12 +52,10 @@ typedef struct {
   // traversal
   float maxChildScore;
 
-  // the payload of terminal node. could be NULL if it's not terminal
-  TriePayload *payload;
-
-  // the string of the current node
-  rune str[];
-  // ... now come the children, to be accessed with __trieNode_children
+  // the utf-8 string of the current node
+  unsigned char str[];
+  // ... now come the children, to be accessed with __trieNode_child, and the payload of nodes
+  // flagged with TRIENODE_PAYLOAD, to be accessed with __trieNode_payload
 } TrieNode;
 #pragma pack()
 
@@ -61,8 +63,8 @@ typedef struct {
 
 void TrieNode_Print(TrieNode *n, int idx, int depth);
 
-/* The byte size of a node, based on its internal string length and number of
- * children */
+/* The byte size of a node, based on its string length and number of children, without its
+ * payload */
 size_t __trieNode_Sizeof(t_len numChildren, t_len slen);
 
 /* Create a new trie node. str is a string to be copied into the node, starting
@@ -71,20 +73,38 @@ size_t __trieNode_Sizeof(t_len numChildren, t_len slen);
 TrieNode *__newTrieNode(rune *str, t_len offset, t_len len, const char *payload, size_t plen, t_len numChildren, float score,
                         int terminal);
 
-/* Get a pointer to the children array of a node. This is not an actual member
- * of the node for
- * memory saving reasons */
-#define __trieNode_children(n) \
-  ((TrieNode **)((void *)n + sizeof(TrieNode) + (n->len + 1) * sizeof(rune)))
+/* Get a pointer to the children array of a node that is not frozen. This is not an actual member
+ * of the node for memory saving reasons */
+#define __trieNode_children(n) ((TrieNode **)((void *)(n)->str + (n)->len))
+
+/* Frozen nodes keep their children as 32 bit offsets from the node itself */
+#define __trieNode_frozenChildren(n) ((uint32_t *)((void *)(n)->str + (n)->len))
 
 #define __trieNode_isTerminal(n) (n->flags & TRIENODE_TERMINAL)
 
 #define __trieNode_isDeleted(n) (n->flags & TRIENODE_DELETED)
 
-/* Add a child node to the parent node n, with a string str starting at offset
-up until len, and a
-given score */
-TrieNode *__trie_AddChild(TrieNode *n, rune *str, t_len offset, t_len len, RSPayload *payload, float score);
+#define __trieNode_isFrozen(n) ((n)->flags & TRIENODE_FROZEN)
+
+/* Get the i-th child of a node, frozen or not */
+static inline TrieNode *__trieNode_child(TrieNode *n, t_len i) {
+  if (__trieNode_isFrozen(n)) {
+    return (TrieNode *)((char *)n + __trieNode_frozenChildren(n)[i]);
+  }
+  return __trieNode_children(n)[i];
+}
+
+/* Get the payload of a node, or NULL if it has none */
+static inline TriePayload *__trieNode_payload(TrieNode *n) {
+  if (!(n->flags & TRIENODE_PAYLOAD)) return NULL;
+  size_t childSize = __trieNode_isFrozen(n) ? sizeof(uint32_t) : sizeof(TrieNode *);
+  return (TriePayload *)((char *)n->str + n->len + n->numChildren * childSize);
+}
+
+/* Add a child node to the parent node n, with a utf-8 string str starting at offset up until
+ * len, and a given score */
+TrieNode *__trie_AddChild(TrieNode *n, const unsigned char *str, t_len offset, t_len len,
+                          RSPayload *payload, float score);
 
 /* Split node n at string offset n. This returns a new node which has a string
 * up until offset, and
@@ -113,14 +133,48 @@ float TrieNode_Find(TrieNode *n, rune *str, t_len len);
 * Returns 1 if the node was indeed deleted, 0 otherwise */
 int TrieNode_Delete(TrieNode *n, rune *str, t_len len);
 
-/* Free the trie's root and all its children recursively */
+/* Called with the nodes a change to a shared trie unlinked, to free them once no reader can see
+ * them */
+typedef void (*TrieRetireFunc)(TrieNode *n);
+
+/* Add or delete a string in a trie that readers may be reading concurrently from the same root.
+ * Rather than changing the nodes on the way to the string, the trie gets copies of them, and *n
+ * the copy of the root. The nodes the change unlinks are passed to retire, while the readers keep
+ * seeing the trie as it was */
+int TrieNode_AddShared(TrieNode **n, rune *str, t_len len, RSPayload *payload, float score,
+                       TrieAddOp op, TrieRetireFunc retire);
+int TrieNode_DeleteShared(TrieNode **n, rune *str, t_len len, TrieRetireFunc retire);
+
+/* Free the trie's root and all its children recursively. Frozen nodes are left to be freed with
+ * their block */
 void TrieNode_Free(TrieNode *n);
 
+/* Pack all the descendants of a node into a single block, in the order they are iterated. Frozen
+ * nodes take no allocation of their own, keep their children as 32 bit offsets, and are laid out
+ * for sequential access, so a frozen trie takes a fraction of the memory of a trie built by
+ * inserts and is iterated with far fewer cache misses.
+ *
+ * Scores and flags of frozen nodes are updated in place. Any other change to a frozen node - a new
+ * child, a split or a new payload - copies it, along with its frozen ancestors, out of the block,
+ * so new inserts form a small delta of regular nodes over the frozen block.
+ *
+ * The node itself is not frozen, and keeps pointing to its children in the new block. Returns the
+ * block, which the caller frees after freeing the trie, and any block frozen before, or NULL if
+ * the node has no children or the block would be too big for 32 bit offsets. blockSize is set to
+ * the size of the block */
+void *TrieNode_Freeze(TrieNode *n, size_t *blockSize);
+
+/* The memory used by the nodes of the trie, not counting frozen nodes */
+size_t TrieNode_MemUsage(TrieNode *n);
+
 /* trie iterator stack node. for internal use only */
 typedef struct {
   int state;
   TrieNode *n;
+  // the number of runes of the node consumed so far
   t_len stringOffset;
+  // the byte offset of the next rune in the node's string
+  t_len byteOffset;
   t_len childOffset;
   int isSkipped;
 } stackNode;
@@ -135,6 +189,11 @@ typedef FilterCode (*StepFilter)(rune b, void *ctx, int *match, void *matchCtx);
 
 typedef void (*StackPopCallback)(void *ctx, int num);
 
+/* A callback ranking the nodes of a best-first traversal. It returns an upper bound on the scores,
+ * as the caller ranks them, of the matches at a node and under it. path is the string up to the
+ * end of the node, and maxScore is the highest score in the node's subtree */
+typedef float (*TrieBoundCallback)(void *ctx, const rune *path, t_len len, float maxScore);
+
 #define ITERSTATE_SELF 0
 #define ITERSTATE_CHILDREN 1
 #define ITERSTATE_MATCH 2
@@ -153,6 +212,11 @@ typedef struct TrieIterator {
   int nodesSkipped;
   StackPopCallback popCallback;
   void *ctx;
+
+  // the nodes left to visit in a best-first traversal, by their bound
+  heap_t *frontier;
+  TrieBoundCallback boundCallback;
+  void *boundCtx;
 } TrieIterator;
 
 /* push a new trie iterator stack node  */
@@ -184,6 +248,16 @@ int __ti_step(TrieIterator *it, void *matchCtx);
  * continue iterating the entire trie. ctx is the filter's context */
 TrieIterator *TrieNode_Iterate(TrieNode *n, StepFilter f, StackPopCallback pf, void *ctx);
 
+/* Iterate the tree best-first: the subtrees are visited by the order of their bound, given by bf,
+ * or by their highest score if bf is NULL. The filter is used as in TrieNode_Iterate.
+ *
+ * Matches are not returned in order, but any match returned after another is from a subtree with a
+ * lower bound. The iteration stops when no node left can beat the iterator's minScore, so a caller
+ * collecting the top matches raises minScore as it goes, and stops visiting the trie once the
+ * bound of everything left is below the matches it has */
+TrieIterator *TrieNode_IterateBestFirst(TrieNode *n, StepFilter f, StackPopCallback pf, void *ctx,
+                                        TrieBoundCallback bf, void *boundCtx);
+
 /* Free a trie iterator */
 void TrieIterator_Free(TrieIterator *it);
 
@@ -17,6 +17,9 @@ Trie *NewTrie() {
   rune *rs = strToRunes("", 0);
   tree->root = __newTrieNode(rs, 0, 0, NULL, 0, 0, 0, 0);
   tree->size = 0;
+  tree->frozen = NULL;
+  tree->frozenSize = 0;
+  tree->snapshotEpoch = 0;
   free(rs);
   return tree;
 }
@@ -28,12 +31,28 @@ int Trie_Insert(Trie *t, RedisModuleString *s, double score, int incr, RSPayload
   return ret;
 }
 
+static void trie_retireNode(TrieNode *n) {
+  Epoch_Retire(n, free);
+}
+
+/* Is the trie shared with readers of a snapshot that may still be searching it? */
+static int trie_isShared(Trie *t) {
+  if (!Epoch_InUse(t->snapshotEpoch)) {
+    t->snapshotEpoch = 0;
+    return 0;
+  }
+  return 1;
+}
+
 int Trie_InsertStringBuffer(Trie *t, char *s, size_t len, double score, int incr,
                             RSPayload *payload) {
   rune *runes = strToRunes(s, &len);
   if (len && len < MAX_STRING_LEN) {
-    int rc =
-        TrieNode_Add(&t->root, runes, len, payload, (float)score, incr ? ADD_INCR : ADD_REPLACE);
+    TrieAddOp op = incr ? ADD_INCR : ADD_REPLACE;
+    int rc = trie_isShared(t)
+                 ? TrieNode_AddShared(&t->root, runes, len, payload, (float)score, op,
+                                      trie_retireNode)
+                 : TrieNode_Add(&t->root, runes, len, payload, (float)score, op);
     free(runes);
     t->size += rc;
     return rc;
@@ -46,12 +65,28 @@ int Trie_InsertStringBuffer(Trie *t, char *s, size_t len, double score, int incr
 int Trie_Delete(Trie *t, char *s, size_t len) {
 
   rune *runes = strToRunes(s, &len);
-  int rc = TrieNode_Delete(t->root, runes, len);
+  int rc = trie_isShared(t) ? TrieNode_DeleteShared(&t->root, runes, len, trie_retireNode)
+                            : TrieNode_Delete(t->root, runes, len);
   t->size -= rc;
   free(runes);
   return rc;
 }
 
+void Trie_Freeze(Trie *t) {
+  size_t size;
+  void *block = TrieNode_Freeze(t->root, &size);
+  if (!block) return;
+  // the nodes of the old block that are still in the trie were copied to the new one
+  free(t->frozen);
+  t->frozen = block;
+  t->frozenSize = size;
+}
+
+TrieNode *Trie_Snapshot(Trie *t) {
+  t->snapshotEpoch = Epoch_Current();
+  return t->root;
+}
+
 void TrieSearchResult_Free(TrieSearchResult *e) {
   if (e->str) {
     free(e->str);
@@ -84,8 +119,35 @@ TrieIterator *Trie_IteratePrefix(Trie *t, char *prefix, size_t len, int maxDist)
   return it;
 }
 
+/* The query of a search, used to bound the scores of the matches in a subtree */
+typedef struct {
+  rune *runes;
+  size_t rlen;
+  size_t len;
+  int prefixMode;
+} searchBoundCtx;
+
+/* A match never scores more than its trie score, and in prefix mode it is further divided by the
+ * length of its suffix, which is at least as long as the path to the node. The exact match of the
+ * query outranks everything, so the path to it comes first */
+static float searchBound(void *ctx, const rune *path, t_len len, float maxScore) {
+  searchBoundCtx *sc = ctx;
+  if (len <= sc->rlen && memcmp(path, sc->runes, len * sizeof(rune)) == 0) {
+    return INFINITY;
+  }
+  if (sc->prefixMode && len > sc->len) {
+    maxScore /= sqrt(1 + len - sc->len);
+  }
+  return maxScore;
+}
+
 Vector *Trie_Search(Trie *tree, char *s, size_t len, size_t num, int maxDist, int prefixMode,
                     int trim, int optimize) {
+  return Trie_SearchRoot(tree->root, s, len, num, maxDist, prefixMode, trim, optimize);
+}
+
+Vector *Trie_SearchRoot(TrieNode *root, char *s, size_t len, size_t num, int maxDist,
+                        int prefixMode, int trim, int optimize) {
   heap_t *pq = malloc(heap_sizeof(num));
   heap_init(pq, cmpEntries, NULL, num);
 
@@ -93,8 +155,10 @@ Vector *Trie_Search(Trie *tree, char *s, size_t len, size_t num, int maxDist, in
   rune *runes = strToFoldedRunes(s, &rlen);
   DFAFilter fc = NewDFAFilter(runes, rlen, maxDist, prefixMode);
 
-  TrieIterator *it = TrieNode_Iterate(tree->root, FilterFunc, StackPop, &fc);
-  // TrieIterator *it = TrieNode_Iterate(tree->root,NULL, NULL, NULL);
+  // visit the most promising subtrees first, so we stop once nothing left can make the top results
+  searchBoundCtx sc = {.runes = runes, .rlen = rlen, .len = len, .prefixMode = prefixMode};
+  TrieIterator *it =
+      TrieNode_IterateBestFirst(root, FilterFunc, StackPop, &fc, searchBound, &sc);
   rune *rstr;
   t_len slen;
   float score;
@@ -111,7 +175,8 @@ Vector *Trie_Search(Trie *tree, char *s, size_t len, size_t num, int maxDist, in
     }
     TrieSearchResult *ent = pooledEntry;
 
-    ent->score = slen > 0 && slen == rlen && memcmp(runes, rstr, slen) == 0 ? INT_MAX : score;
+    ent->score =
+        slen > 0 && slen == rlen && memcmp(runes, rstr, slen * sizeof(rune)) == 0 ? INT_MAX : score;
 
     if (maxDist > 0) {
       // factor the distance into the score
@@ -241,6 +306,7 @@ void *TrieType_GenericLoad(RedisModuleIO *rdb, int loadPayloads) {
     if (payload.data != NULL) RedisModule_Free(payload.data);
   }
   // TrieNode_Print(tree->root, 0, 0);
+  Trie_Freeze(tree);
   return tree;
 }
 
@@ -311,23 +377,35 @@ void TrieType_Digest(RedisModuleDigest *digest, void *value) {
   /* TODO: The DIGEST module interface is yet not implemented. */
 }
 
-void TrieType_Free(void *value) {
+static void trie_free(void *value) {
   Trie *tree = value;
   if (tree->root) {
 
     TrieNode_Free(tree->root);
   }
+  free(tree->frozen);
 
   RedisModule_Free(tree);
 }
 
+void TrieType_Free(void *value) {
+  // readers may still be searching a snapshot of the trie
+  Epoch_Retire(value, trie_free);
+}
+
+size_t TrieType_MemUsage(const void *value) {
+  const Trie *tree = value;
+  return sizeof(Trie) + (tree->root ? TrieNode_MemUsage(tree->root) : 0) + tree->frozenSize;
+}
+
 int TrieType_Register(RedisModuleCtx *ctx) {
 
   RedisModuleTypeMethods tm = {.version = REDISMODULE_TYPE_METHOD_VERSION,
                                .rdb_load = TrieType_RdbLoad,
                                .rdb_save = TrieType_RdbSave,
                                .aof_rewrite = TrieType_AofRewrite,
-                               .free = TrieType_Free};
+                               .free = TrieType_Free,
+                               .mem_usage = TrieType_MemUsage};
 
   TrieType = RedisModule_CreateDataType(ctx, "trietype0", TRIE_ENCVER_CURRENT, &tm);
   if (TrieType == NULL) {
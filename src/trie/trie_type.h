@@ -2,6 +2,7 @@
 #define __TRIE_TYPE_H__
 
 #include "../redismodule.h"
+#include "../epoch.h"
 
 #include "trie.h"
 #include "levenshtein.h"
@@ -14,6 +15,11 @@ extern RedisModuleType *TrieType;
 typedef struct {
   TrieNode *root;
   size_t size;
+  // the block of the frozen nodes, if the trie was frozen
+  void *frozen;
+  size_t frozenSize;
+  // the epoch of the last snapshot of the trie, see Trie_Snapshot
+  t_epoch snapshotEpoch;
 } Trie;
 
 typedef struct {
@@ -38,6 +44,20 @@ void TrieSearchResult_Free(TrieSearchResult *e);
 Vector *Trie_Search(Trie *tree, char *s, size_t len, size_t num, int maxDist, int prefixMode,
                     int trim, int optimize);
 
+/* Take a snapshot of the trie, to be searched without the global lock by a reader in a read epoch
+ * (see epoch.h). Until the reader exits the epoch, the returned root and the nodes under it stay as
+ * they are: writers copy the nodes they change instead, and retire the ones they unlink */
+TrieNode *Trie_Snapshot(Trie *t);
+
+/* Search a trie by its root, which may be a snapshot */
+Vector *Trie_SearchRoot(TrieNode *root, char *s, size_t len, size_t num, int maxDist,
+                        int prefixMode, int trim, int optimize);
+
+/* Freeze the nodes of the trie into a single compact block. Nodes inserted afterwards are
+ * allocated separately, and frozen nodes are copied out of the block when they change. This is
+ * done after bulk loading the trie */
+void Trie_Freeze(Trie *t);
+
 /* Iterate a prefix in the trie, using maxDist edit distance, returning a trie iterator that the
  * caller needs to free */
 TrieIterator *Trie_IteratePrefix(Trie *t, char *prefix, size_t len, int maxDist);
@@ -51,5 +71,6 @@ void TrieType_RdbSave(RedisModuleIO *rdb, void *value);
 void TrieType_AofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value);
 void TrieType_Digest(RedisModuleDigest *digest, void *value);
 void TrieType_Free(void *value);
+size_t TrieType_MemUsage(const void *value);
 
 #endif